@@ -0,0 +1,76 @@
+#!/usr/bin/env bash
+# Smoke test of s3:// output against a local MinIO server: compress a ROM
+# into a bucket, download the object and check that it extracts back to the
+# original bytes.
+#
+# Usage: scripts/s3_minio_smoke.sh <z3ds_compressor> <rom>
+#
+# MinIO runs in docker when docker is available, otherwise the `minio` binary
+# must be on PATH. The bucket is created and the object fetched with curl's
+# own SigV4 signing (curl 7.75 or later).
+set -euo pipefail
+
+if [ $# -ne 2 ]; then
+    echo "Usage: $0 <z3ds_compressor> <rom>" >&2
+    exit 2
+fi
+COMPRESSOR=$(realpath "$1")
+ROM=$(realpath "$2")
+
+PORT=${MINIO_PORT:-9000}
+ENDPOINT=http://127.0.0.1:$PORT
+BUCKET=z3ds-smoke
+KEY=smoke/$(basename "$ROM").z3ds
+export AWS_ACCESS_KEY_ID=minioadmin
+export AWS_SECRET_ACCESS_KEY=minioadmin
+export AWS_REGION=us-east-1
+unset AWS_SESSION_TOKEN
+
+WORK=$(mktemp -d)
+CONTAINER=""
+SERVER_PID=""
+cleanup() {
+    if [ -n "$CONTAINER" ]; then
+        docker rm -f "$CONTAINER" >/dev/null 2>&1 || true
+    fi
+    if [ -n "$SERVER_PID" ]; then
+        kill "$SERVER_PID" 2>/dev/null || true
+        wait "$SERVER_PID" 2>/dev/null || true
+    fi
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+if command -v docker >/dev/null 2>&1; then
+    CONTAINER=$(docker run -d --rm -p "$PORT:9000" \
+        -e MINIO_ROOT_USER="$AWS_ACCESS_KEY_ID" -e MINIO_ROOT_PASSWORD="$AWS_SECRET_ACCESS_KEY" \
+        quay.io/minio/minio server /data)
+elif command -v minio >/dev/null 2>&1; then
+    MINIO_ROOT_USER="$AWS_ACCESS_KEY_ID" MINIO_ROOT_PASSWORD="$AWS_SECRET_ACCESS_KEY" \
+        minio server --address "127.0.0.1:$PORT" "$WORK/data" >"$WORK/minio.log" 2>&1 &
+    SERVER_PID=$!
+else
+    echo "Error: neither docker nor minio is available" >&2
+    exit 1
+fi
+
+for _ in $(seq 1 60); do
+    if curl -sf "$ENDPOINT/minio/health/ready" >/dev/null; then
+        break
+    fi
+    sleep 0.5
+done
+curl -sf "$ENDPOINT/minio/health/ready" >/dev/null || { echo "Error: MinIO did not start" >&2; exit 1; }
+
+s3curl() {
+    curl -sSf --aws-sigv4 "aws:amz:$AWS_REGION:s3" --user "$AWS_ACCESS_KEY_ID:$AWS_SECRET_ACCESS_KEY" \
+        -H "x-amz-content-sha256: UNSIGNED-PAYLOAD" "$@"
+}
+
+s3curl -X PUT "$ENDPOINT/$BUCKET" >/dev/null
+# A small part size gives a multipart upload even for small test images
+"$COMPRESSOR" "$ROM" "s3://$BUCKET/$KEY" --s3-endpoint "$ENDPOINT" --s3-part-size 5242880
+s3curl -o "$WORK/object.z3ds" "$ENDPOINT/$BUCKET/$KEY"
+"$COMPRESSOR" extract "$WORK/object.z3ds" "$WORK/restored"
+cmp "$ROM" "$WORK/restored"
+echo "OK: s3://$BUCKET/$KEY round trip matches $ROM"
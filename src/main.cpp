@@ -1,22 +1,120 @@
 #include "z3ds_compression.h"
+#include "z3ds_bench.h"
+#include "z3ds_dedup.h"
+#include "z3ds_disk_cache.h"
+#include "z3ds_extract.h"
+#include "z3ds_frame_cache.h"
+#include "z3ds_import.h"
+#include "z3ds_layout.h"
+#include "z3ds_pack.h"
+#include "z3ds_precomp.h"
+#include "z3ds_rebalance.h"
+#include "z3ds_romfs.h"
+#include "z3ds_s3.h"
+#include "z3ds_stitch.h"
+#include "z3ds_update.h"
+#include "z3ds_access_stats.h"
 #include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <filesystem>
 #include <chrono>
 
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
 void showUsage(const char* program_name) {
     std::cout << "Z3DS ROM Compressor - CLI Version\n";
     std::cout << "Based on Azahar Emulator's compression format\n\n";
-    std::cout << "Usage: " << program_name << " <input_rom> [output_file] [options]\n\n";
+    std::cout << "Usage: " << program_name << " <input_rom> [output_file] [options]\n";
+    std::cout << "       " << program_name << " <command> [arguments]\n\n";
     std::cout << "Arguments:\n";
     std::cout << "  input_rom     Input ROM file (.cci, .cia, .cxi, .3dsx)\n";
-    std::cout << "  output_file   Output Z3DS file (optional, auto-generated if not specified)\n\n";
+    std::cout << "  output_file   Output Z3DS file (optional, auto-generated if not specified), or\n";
+    std::cout << "                s3://bucket/key to stream it into a multipart upload\n\n";
     std::cout << "Options:\n";
     std::cout << "  --frame-size SIZE   Set compression frame size in bytes (default: auto)\n";
+    std::cout << "  --profile NAME      Compression profile: default, decode-fast, archive, raw, or one\n";
+    std::cout << "                      from --profile-file\n";
+    std::cout << "  --profile-file FILE Load named profiles from an INI-style file\n";
+    std::cout << "  --zstd-param K=V    Override a zstd parameter (level, windowLog, hashLog, chainLog,\n";
+    std::cout << "                      searchLog, minMatch, targetLength, strategy, rawLiterals,\n";
+    std::cout << "                      mediaUnitMatcher)\n";
+    std::cout << "  --regions           Choose parameters per NCCH/ExeFS/RomFS region (code, exefs, romfs,\n";
+    std::cout << "                      audio, texture, header, encrypted, padding, other)\n";
+    std::cout << "  --region-profile TYPE=PROFILE\n";
+    std::cout << "                      Override the profile of one region type (implies --regions)\n";
+    std::cout << "  --deadline SECONDS  Finish within SECONDS: a fast pass over every frame, then the\n";
+    std::cout << "                      remaining time recompresses frames at higher levels on all cores\n";
+    std::cout << "  --part START:END    Compress only bytes START to END (frame-aligned, END may be empty\n";
+    std::cout << "                      for the end of the file) into a part for the stitch command\n";
+    std::cout << "  --precomp           Archive mode: store LZ10/LZ11 assets decoded where they re-encode\n";
+    std::cout << "                      exactly; the output must be restored before use\n";
+    std::cout << "  --s3-endpoint URL   S3-compatible endpoint for s3:// output (default: AWS_ENDPOINT_URL);\n";
+    std::cout << "                      credentials from AWS_ACCESS_KEY_ID, AWS_SECRET_ACCESS_KEY and\n";
+    std::cout << "                      AWS_SESSION_TOKEN\n";
+    std::cout << "  --s3-part-size SIZE Bytes per uploaded part (default: 16 MB, minimum 5 MB)\n";
+    std::cout << "  --front-index       Also store the seek table after the metadata, so readers open the\n";
+    std::cout << "                      file with one read from its start (high-latency storage)\n";
+    std::cout << "  --stats-json FILE   Append a JSON line with size, time and memory stats to FILE\n";
     std::cout << "  --help, -h          Show this help message\n\n";
+    std::cout << "Commands:\n";
+    std::cout << "  bench-io <file> [--storage DIR] [--cold] [--buffer-size SIZE] [--compress] [--json]\n";
+    std::cout << "                      Compare read/write backends on a file and storage path\n";
+    std::cout << "  bench-decode <file.z3ds> [--iterations N] [--json]\n";
+    std::cout << "                      Report decode MB/s and ratio per frame\n";
+    std::cout << "  list <file.z3ds> [--json]\n";
+    std::cout << "                      List ExeFS and RomFS files of a compressed decrypted title\n";
+    std::cout << "  cat <file.z3ds> <path> [-o FILE] [--stats]\n";
+    std::cout << "                      Write one file (e.g. exefs/icon, romfs/a/b.bin) to stdout or FILE;\n";
+    std::cout << "                      --stats reports frame and disk cache use on stderr\n";
+    std::cout << "  extract <file.z3ds> [output_file] [--known-fill-ff] [--verify]\n";
+    std::cout << "                      Write the uncompressed image, leaving all-zero frames as holes;\n";
+    std::cout << "                      --known-fill-ff writes all-0xFF frames from their checksum and\n";
+    std::cout << "                      --verify checks every decoded frame\n";
+    std::cout << "  import <file.zst> [output_file] [--verify]\n";
+    std::cout << "                      Wrap a seekable zstd file into Z3DS without recompressing;\n";
+    std::cout << "                      --verify decodes and checks every frame, not just the first\n";
+    std::cout << "  rebalance <dir|file>... [--stats-dir DIR] [--cpu-budget SECONDS] [--hot-score N]\n";
+    std::cout << "            [--cold-days N] [--hot-profile NAME] [--cold-profile NAME] [--dry-run]\n";
+    std::cout << "                      Recompress often-read titles for fast decoding and idle ones for\n";
+    std::cout << "                      size, using access stats recorded by readers when\n";
+    std::cout << "                      Z3DS_ACCESS_STATS_DIR is set\n";
+    std::cout << "  analyze-dedup <dir|file>... [--chunk-size N] [--cdc-size N] [--sample N] [--threads N]\n";
+    std::cout << "            [--json]\n";
+    std::cout << "                      Estimate how much of a ROM library repeats within files, across\n";
+    std::cout << "                      titles of one family (game, update, DLC) and across families\n";
+    std::cout << "  pack <dir|file>... -o FILE [--dict-size N] [--frame-size SIZE] [--profile NAME]\n";
+    std::cout << "                      Store many small titles (e.g. .3dsx) in one file with a shared\n";
+    std::cout << "                      dictionary; list and cat read single members\n";
+    std::cout << "  stitch <part>... -o FILE\n";
+    std::cout << "                      Join parts made with --part into one Z3DS file without\n";
+    std::cout << "                      recompressing\n";
+    std::cout << "  update <old.z3ds> (--source NEW_ROM | --patch FILE.ips|.bps) -o FILE [--profile NAME]\n";
+    std::cout << "            [--verify]\n";
+    std::cout << "                      Recompress only the frames a new revision or patch changes;\n";
+    std::cout << "                      --verify checks a BPS patch's source and target CRC32\n";
+    std::cout << "  restore <file.precomp.z3ds> [output_file]\n";
+    std::cout << "                      Rebuild the original image from a --precomp archive\n\n";
     std::cout << "Examples:\n";
     std::cout << "  " << program_name << " game.cia\n";
     std::cout << "  " << program_name << " game.cci game_compressed.zcci\n";
     std::cout << "  " << program_name << " game.cia --frame-size 33554432\n";
+    std::cout << "  " << program_name << " game.cci --profile decode-fast\n";
+    std::cout << "  " << program_name << " bench-io game.cci --storage /mnt/nas --cold\n";
+    std::cout << "  " << program_name << " cat game.zcci exefs/icon -o icon.bin\n";
+    std::cout << "  " << program_name << " game.cci --precomp --profile archive\n";
+    std::cout << "  " << program_name << " game.cci s3://roms/game.zcci --s3-endpoint http://localhost:9000\n";
+    std::cout << "  " << program_name << " game.cci p0 --part 0:2147483648 && " << program_name
+              << " game.cci p1 --part 2147483648: && " << program_name << " stitch p0 p1 -o game.zcci\n";
 }
 
 std::string generateOutputFilename(const std::string& input_file) {
@@ -41,6 +139,655 @@ std::string generateOutputFilename(const std::string& input_file) {
     return input_path.parent_path() / (base_name + z3ds_extension);
 }
 
+// Option values must be whole numbers: std::stoull throws on "abc" and
+// accepts "12abc" and "-1"
+bool parseUnsigned(const std::string& text, u64& value) {
+    if (text.empty() || !std::isdigit(static_cast<unsigned char>(text[0]))) {
+        return false;
+    }
+    errno = 0;
+    char* end = nullptr;
+    unsigned long long parsed = std::strtoull(text.c_str(), &end, 10);
+    if (errno == ERANGE || *end != '\0') {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+// A positive, finite number of seconds
+bool parseSeconds(const std::string& text, double& value) {
+    if (text.empty()) {
+        return false;
+    }
+    errno = 0;
+    char* end = nullptr;
+    double parsed = std::strtod(text.c_str(), &end);
+    if (errno == ERANGE || *end != '\0' || !std::isfinite(parsed) || parsed <= 0) {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+std::string escapeJSON(const std::string& str) {
+    std::string out;
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char esc[8];
+            std::snprintf(esc, sizeof(esc), "\\u%04x", c);
+            out += esc;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+// "energy" member, null when RAPL could not be read; bytes is the data size
+// the joules per GB refer to
+std::string energyJSON(const EnergyReading& energy, u64 bytes) {
+    if (!energy.available) {
+        return ",\"energy\":null";
+    }
+    std::ostringstream out;
+    out << ",\"energy\":{\"package_j\":" << energy.package_joules;
+    if (energy.has_dram) {
+        out << ",\"dram_j\":" << energy.dram_joules;
+    }
+    out << ",\"total_j\":" << energy.Joules() << ",\"j_per_gb\":" << energy.JoulesPerGB(bytes) << "}";
+    return out.str();
+}
+
+// One JSON object per line so that a batch (e.g. find -exec) accumulates into a
+// single file; the batch peak is the maximum peak_rss_bytes over its lines.
+bool appendStatsJSON(const std::string& stats_file, const std::string& input_file,
+                     u64 input_size, u64 output_size, long long duration_ms,
+                     const CompressionStats& stats, const EnergyReading& energy) {
+    std::ofstream out(stats_file, std::ios::app);
+    if (!out.is_open()) {
+        return false;
+    }
+    out << "{\"input\":\"" << escapeJSON(input_file) << "\""
+        << ",\"input_bytes\":" << input_size
+        << ",\"output_bytes\":" << output_size
+        << ",\"time_ms\":" << duration_ms
+        << ",\"frames\":" << stats.frame_count
+        << ",\"frame_buffer_bytes\":" << stats.frame_buffer_bytes
+        << ",\"context_bytes\":" << stats.context_bytes
+        << ",\"io_buffer_bytes\":" << stats.io_buffer_bytes
+        << ",\"frame_cache_bytes\":" << stats.frame_cache_bytes
+        << ",\"disk_cache_queued_bytes\":" << stats.disk_cache_queued_bytes
+        << ",\"disk_cache_bytes\":" << stats.disk_cache_bytes
+        << ",\"tracked_bytes\":" << stats.TrackedBytes()
+        << ",\"peak_rss_bytes\":" << stats.peak_rss_bytes
+        << energyJSON(energy, input_size);
+    if (!stats.frames_per_level.empty()) {
+        out << ",\"frames_per_level\":{";
+        bool first = true;
+        for (size_t level = 0; level < stats.frames_per_level.size(); ++level) {
+            if (stats.frames_per_level[level]) {
+                out << (first ? "" : ",") << "\"" << (level ? std::to_string(level) : "raw") << "\":"
+                    << stats.frames_per_level[level];
+                first = false;
+            }
+        }
+        out << "}";
+    }
+    if (!stats.regions.empty()) {
+        out << ",\"regions\":{";
+        bool first = true;
+        for (const auto& region : stats.regions) {
+            if (region.input_bytes == 0) {
+                continue;
+            }
+            out << (first ? "" : ",") << "\"" << region.name << "\":{\"input_bytes\":" << region.input_bytes
+                << ",\"output_bytes\":" << region.output_bytes << ",\"seconds\":" << region.seconds << "}";
+            first = false;
+        }
+        out << "}";
+    }
+    out << "}\n";
+    return out.good();
+}
+
+int runBenchIO(int argc, char* argv[]) {
+    IOBenchOptions options;
+    bool json = false;
+    
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        
+        if (arg == "--storage" && i + 1 < argc) {
+            options.storage_dir = argv[++i];
+        } else if (arg == "--buffer-size" && i + 1 < argc) {
+            options.buffer_size = std::stoull(argv[++i]);
+        } else if (arg == "--cold") {
+            options.cold_cache = true;
+        } else if (arg == "--compress") {
+            options.compress = true;
+        } else if (arg == "--json") {
+            json = true;
+        } else if (options.input_file.empty()) {
+            options.input_file = arg;
+        } else {
+            std::cerr << "Error: Unknown bench-io argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+    
+    if (options.input_file.empty() || !std::filesystem::exists(options.input_file)) {
+        std::cerr << "Error: bench-io requires an existing input file\n";
+        return 1;
+    }
+    if (options.buffer_size == 0 || options.buffer_size % 4096 != 0) {
+        std::cerr << "Error: --buffer-size must be a non-zero multiple of 4096\n";
+        return 1;
+    }
+    
+    auto results = RunIOBenchmark(options);
+    
+    if (json) {
+        std::cout << "[";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const auto& r = results[i];
+            std::cout << (i ? "," : "") << "{\"backend\":\"" << r.backend << "\""
+                      << ",\"mode\":\"" << r.mode << "\""
+                      << ",\"available\":" << (r.available ? "true" : "false");
+            if (r.available) {
+                std::cout << ",\"bytes\":" << r.bytes
+                          << ",\"wall_s\":" << r.wall_seconds
+                          << ",\"cpu_s\":" << r.cpu_seconds
+                          << ",\"mb_per_s\":" << r.MBps()
+                          << energyJSON(r.energy, r.bytes);
+            } else {
+                std::cout << ",\"error\":\"" << escapeJSON(r.error) << "\"";
+            }
+            std::cout << "}";
+        }
+        std::cout << "]" << std::endl;
+        return 0;
+    }
+    
+    std::cout << "I/O benchmark: " << options.input_file
+              << (options.cold_cache ? " (cold cache)" : " (warm cache)")
+              << (options.compress ? ", with zstd level 3" : "") << std::endl;
+    for (const auto& r : results) {
+        std::cout << "  " << std::left << std::setw(6) << r.mode << std::setw(10) << r.backend;
+        if (r.available) {
+            std::cout << std::fixed << std::setprecision(1) << std::right << std::setw(9) << r.MBps()
+                      << " MB/s  " << std::setprecision(3) << r.wall_seconds << " s wall  "
+                      << r.cpu_seconds << " s CPU";
+            if (r.energy.available) {
+                std::cout << "  " << r.energy.JoulesPerGB(r.bytes) << " J/GB";
+            }
+            std::cout << std::endl;
+        } else {
+            std::cout << "unavailable (" << r.error << ")" << std::endl;
+        }
+    }
+    return 0;
+}
+
+int runBenchDecode(int argc, char* argv[]) {
+    std::string input_file;
+    int iterations = 3;
+    bool json = false;
+    
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        
+        if (arg == "--iterations" && i + 1 < argc) {
+            iterations = std::stoi(argv[++i]);
+        } else if (arg == "--json") {
+            json = true;
+        } else if (input_file.empty()) {
+            input_file = arg;
+        } else {
+            std::cerr << "Error: Unknown bench-decode argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+    
+    if (input_file.empty()) {
+        std::cerr << "Error: bench-decode requires a Z3DS file\n";
+        return 1;
+    }
+    
+    DecodeBenchResult result;
+    if (!RunDecodeBenchmark(input_file, iterations, result)) {
+        return 1;
+    }
+    
+    if (json) {
+        std::cout << "{\"file\":\"" << escapeJSON(input_file) << "\""
+                  << ",\"profile\":\"" << escapeJSON(result.profile) << "\""
+                  << ",\"compressed_bytes\":" << result.compressed_bytes
+                  << ",\"decompressed_bytes\":" << result.decompressed_bytes
+                  << ",\"ratio\":" << result.Ratio()
+                  << ",\"mb_per_s\":" << result.MBps()
+                  << energyJSON(result.energy, result.decoded_bytes)
+                  << ",\"frames\":[";
+        for (size_t i = 0; i < result.frames.size(); ++i) {
+            const auto& f = result.frames[i];
+            std::cout << (i ? "," : "") << "{\"index\":" << f.index
+                      << ",\"compressed_bytes\":" << f.compressed_size
+                      << ",\"decompressed_bytes\":" << f.decompressed_size
+                      << ",\"ratio\":" << f.Ratio()
+                      << ",\"mb_per_s\":" << f.MBps() << "}";
+        }
+        std::cout << "]}" << std::endl;
+        return 0;
+    }
+    
+    std::cout << "Decode benchmark: " << input_file << " (profile " << result.profile << ")" << std::endl;
+    std::cout << "  frame   compressed  decompressed   ratio      MB/s" << std::endl;
+    for (const auto& f : result.frames) {
+        std::cout << std::right << "  " << std::setw(5) << f.index << std::setw(13) << f.compressed_size
+                  << std::setw(14) << f.decompressed_size << std::fixed << std::setprecision(1)
+                  << std::setw(7) << f.Ratio() * 100.0 << "%" << std::setw(10) << f.MBps() << std::endl;
+    }
+    std::cout << "Total: " << std::fixed << std::setprecision(1) << result.Ratio() * 100.0
+              << "% ratio, " << result.MBps() << " MB/s decode";
+    if (result.energy.available) {
+        std::cout << ", " << result.energy.JoulesPerGB(result.decoded_bytes) << " J/GB";
+    }
+    std::cout << std::endl;
+    return 0;
+}
+
+bool openRomFileSystem(const std::string& input_file, Z3DSReader& reader, RomFileSystem& filesystem) {
+    if (!reader.Open(input_file)) {
+        return false;
+    }
+    if (!filesystem.Open(reader)) {
+        std::cerr << "Error: Not a CCI, CIA, CXI image or pack: " << input_file << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int runList(int argc, char* argv[]) {
+    std::string input_file;
+    bool json = false;
+    
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        
+        if (arg == "--json") {
+            json = true;
+        } else if (input_file.empty()) {
+            input_file = arg;
+        } else {
+            std::cerr << "Error: Unknown list argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+    
+    if (input_file.empty()) {
+        std::cerr << "Error: list requires a Z3DS file\n";
+        return 1;
+    }
+    
+    Z3DSReader reader;
+    RomFileSystem filesystem;
+    if (!openRomFileSystem(input_file, reader, filesystem)) {
+        return 1;
+    }
+    for (const auto& ncch : filesystem.GetPartitions()) {
+        if (ncch.encrypted) {
+            std::cerr << "Warning: Partition " << ncch.index << " is encrypted, its files are not listed" << std::endl;
+        }
+    }
+    
+    if (json) {
+        std::cout << "[";
+        bool first = true;
+        for (const auto& file : filesystem.GetFiles()) {
+            std::cout << (first ? "" : ",") << "{\"path\":\"" << escapeJSON(file.path) << "\""
+                      << ",\"partition\":" << file.partition
+                      << ",\"offset\":" << file.offset
+                      << ",\"size\":" << file.size << "}";
+            first = false;
+        }
+        std::cout << "]" << std::endl;
+        return 0;
+    }
+    
+    for (const auto& file : filesystem.GetFiles()) {
+        std::cout << std::setw(12) << file.size << "  " << file.path << std::endl;
+    }
+    return 0;
+}
+
+// On stderr, so it does not mix with file data written to stdout
+void printCacheStats(const Z3DSReader& reader) {
+    FrameCache::Stats cache = FrameCache::Instance().GetStats();
+    FrameCache::FileStats file = FrameCache::Instance().GetFileStats(reader.GetFileId());
+    std::cerr << "Frame cache: " << (cache.used_bytes / 1024) << " of " << (cache.budget_bytes / 1024)
+              << " KB in " << cache.frames << " frames, " << cache.hits << " hits, " << cache.misses
+              << " misses, " << cache.evictions << " evictions" << std::endl;
+    std::cerr << "This file: " << file.hits << " hits, " << file.misses << " misses ("
+              << std::fixed << std::setprecision(1) << (file.HitRate() * 100.0) << "% hit rate), "
+              << (file.resident_bytes / 1024) << " KB resident" << std::endl;
+    DiskFrameCache::Stats disk = DiskFrameCache::Instance().GetStats();
+    if (disk.capacity_bytes) {
+        std::cerr << "Disk cache: " << (disk.used_bytes / 1024) << " of " << (disk.capacity_bytes / 1024)
+                  << " KB in " << disk.frames << " frames, " << disk.hits << " hits, " << disk.misses
+                  << " misses, " << disk.writes << " writes, " << disk.dropped_writes << " dropped" << std::endl;
+    }
+}
+
+int runCat(int argc, char* argv[]) {
+    std::string input_file;
+    std::string path;
+    std::string output_file;
+    bool print_stats = false;
+    
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        
+        if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
+            output_file = argv[++i];
+        } else if (arg == "--stats") {
+            print_stats = true;
+        } else if (input_file.empty()) {
+            input_file = arg;
+        } else if (path.empty()) {
+            path = arg;
+        } else {
+            std::cerr << "Error: Unknown cat argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+    
+    if (input_file.empty() || path.empty()) {
+        std::cerr << "Error: cat requires a Z3DS file and a path\n";
+        return 1;
+    }
+    
+    Z3DSReader reader;
+    RomFileSystem filesystem;
+    if (!openRomFileSystem(input_file, reader, filesystem)) {
+        return 1;
+    }
+    const RomFSFile* file = filesystem.Find(path);
+    if (!file) {
+        std::cerr << "Error: No such file in image: " << path << std::endl;
+        return 1;
+    }
+    
+    std::ofstream output;
+    if (!output_file.empty()) {
+        output.open(output_file, std::ios::binary);
+        if (!output.is_open()) {
+            std::cerr << "Error: Could not create output file: " << output_file << std::endl;
+            return 1;
+        }
+    } else {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    }
+    std::ostream& out = output_file.empty() ? std::cout : output;
+    
+    std::vector<char> buffer(1024 * 1024);
+    for (u64 offset = 0; offset < file->size;) {
+        size_t read = filesystem.Read(*file, offset, buffer.data(), buffer.size());
+        if (read == 0) {
+            std::cerr << "Error: Could not read " << path << " at offset " << offset << std::endl;
+            return 1;
+        }
+        out.write(buffer.data(), read);
+        offset += read;
+    }
+    out.flush();
+    if (!out.good()) {
+        std::cerr << "Error: Could not write " << path << std::endl;
+        return 1;
+    }
+    if (print_stats) {
+        printCacheStats(reader);
+    }
+    return 0;
+}
+
+int runRebalance(int argc, char* argv[]) {
+    RebalanceOptions options;
+    options.stats_dir = AccessStatsStore::DefaultDirectory();
+    
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        
+        if (arg == "--stats-dir" && i + 1 < argc) {
+            options.stats_dir = argv[++i];
+        } else if (arg == "--cpu-budget" && i + 1 < argc) {
+            options.cpu_budget_seconds = std::stod(argv[++i]);
+        } else if (arg == "--hot-score" && i + 1 < argc) {
+            options.hot_score = std::stod(argv[++i]);
+        } else if (arg == "--cold-days" && i + 1 < argc) {
+            options.cold_days = std::stod(argv[++i]);
+        } else if (arg == "--hot-profile" && i + 1 < argc) {
+            options.hot_profile = argv[++i];
+        } else if (arg == "--cold-profile" && i + 1 < argc) {
+            options.cold_profile = argv[++i];
+        } else if (arg == "--profile-file" && i + 1 < argc) {
+            if (!LoadCompressionProfiles(argv[++i])) {
+                return 1;
+            }
+        } else if (arg == "--dry-run") {
+            options.dry_run = true;
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "Error: Unknown rebalance argument: " << arg << std::endl;
+            return 1;
+        } else {
+            options.paths.push_back(arg);
+        }
+    }
+    
+    if (options.paths.empty()) {
+        std::cerr << "Error: rebalance requires at least one file or directory\n";
+        return 1;
+    }
+    
+    std::vector<RebalanceResult> results;
+    if (!RunRebalance(options, results)) {
+        return 1;
+    }
+    
+    bool failed = false;
+    for (const auto& r : results) {
+        std::cout << r.file << ": ";
+        if (!r.error.empty() && r.target_profile.empty()) {
+            std::cout << r.error << std::endl;
+            continue;
+        }
+        std::cout << std::fixed << std::setprecision(1) << "score " << r.score << ", idle "
+                  << r.idle_days << " days, " << r.current_profile;
+        if (r.target_profile.empty()) {
+            std::cout << ", kept" << std::endl;
+        } else if (r.deferred) {
+            std::cout << " -> " << r.target_profile << " deferred (needs ~" << r.estimated_cpu_seconds
+                      << " s CPU)" << std::endl;
+        } else if (options.dry_run) {
+            std::cout << " -> " << r.target_profile << " (~" << r.estimated_cpu_seconds << " s CPU)" << std::endl;
+        } else if (r.recompressed) {
+            std::cout << " -> " << r.target_profile << ", " << r.old_size << " -> " << r.new_size
+                      << " bytes in " << r.cpu_seconds << " s CPU" << std::endl;
+        } else {
+            std::cout << " -> " << r.target_profile << " failed: " << r.error << std::endl;
+            failed = true;
+        }
+    }
+    return failed ? 1 : 0;
+}
+
+int runImport(int argc, char* argv[]) {
+    std::string input_file;
+    std::string output_file;
+    bool verify = false;
+    
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        
+        if (arg == "--verify") {
+            verify = true;
+        } else if (input_file.empty()) {
+            input_file = arg;
+        } else if (output_file.empty()) {
+            output_file = arg;
+        } else {
+            std::cerr << "Error: Unknown import argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+    
+    if (input_file.empty()) {
+        std::cerr << "Error: import requires a seekable zstd file\n";
+        return 1;
+    }
+    if (output_file.empty()) {
+        // game.cci.zst -> game.zcci
+        std::filesystem::path input_path(input_file);
+        output_file = generateOutputFilename(input_path.extension() == ".zst"
+            ? (input_path.parent_path() / input_path.stem()).string() : input_file);
+    }
+    
+    // A failed import only cleans up a file it created
+    std::error_code ec;
+    bool output_existed = std::filesystem::exists(output_file, ec);
+    auto start_time = std::chrono::high_resolution_clock::now();
+    ImportResult result;
+    if (!ImportSeekableZstd(input_file, output_file, verify, result)) {
+        if (!output_existed) {
+            std::filesystem::remove(output_file, ec);
+        }
+        return 1;
+    }
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::high_resolution_clock::now() - start_time);
+    
+    std::cout << "Imported " << input_file << " -> " << output_file << std::endl;
+    std::cout << "Detected file magic: "
+              << static_cast<char>(result.underlying_magic[0]) << static_cast<char>(result.underlying_magic[1])
+              << static_cast<char>(result.underlying_magic[2]) << static_cast<char>(result.underlying_magic[3])
+              << std::endl;
+    std::cout << "Frames: " << result.frame_count << " (largest " << result.max_frame_size << " bytes, "
+              << (result.has_checksums ? "with" : "without") << " checksums, "
+              << result.verified_frames << " verified)" << std::endl;
+    std::cout << "Uncompressed size: " << result.uncompressed_size << " bytes" << std::endl;
+    std::cout << "Compressed size: " << result.compressed_size << " bytes, copied with "
+              << (result.used_copy_file_range ? "copy_file_range" : "read/write") << std::endl;
+    std::cout << "Time taken: " << duration.count() << " ms" << std::endl;
+    return 0;
+}
+
+int runAnalyzeDedup(int argc, char* argv[]) {
+    DedupOptions options;
+    bool json = false;
+    
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        
+        if (arg == "--chunk-size" && i + 1 < argc) {
+            options.fixed_chunk_size = std::stoull(argv[++i]);
+        } else if (arg == "--cdc-size" && i + 1 < argc) {
+            options.cdc_average_size = std::stoull(argv[++i]);
+        } else if (arg == "--sample" && i + 1 < argc) {
+            options.sample_rate = static_cast<u32>(std::stoul(argv[++i]));
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.threads = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--json") {
+            json = true;
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "Error: Unknown analyze-dedup argument: " << arg << std::endl;
+            return 1;
+        } else {
+            options.inputs.push_back(arg);
+        }
+    }
+    
+    if (options.inputs.empty()) {
+        std::cerr << "Error: analyze-dedup requires at least one file or directory\n";
+        return 1;
+    }
+    
+    DedupReport report;
+    if (!RunDedupAnalysis(options, report)) {
+        return 1;
+    }
+    
+    auto bytesJSON = [](const DedupBytes& b) {
+        std::ostringstream out;
+        out << "{\"total\":" << b.total << ",\"unique\":" << b.unique << ",\"fill\":" << b.fill
+            << ",\"within_file\":" << b.within_file << ",\"across_files\":" << b.across_files
+            << ",\"across_families\":" << b.across_families << ",\"chunks\":" << b.chunks << "}";
+        return out.str();
+    };
+    
+    if (json) {
+        std::cout << "{\"fixed_chunk_size\":" << options.fixed_chunk_size
+                  << ",\"cdc_average_size\":" << options.cdc_average_size
+                  << ",\"sample_rate\":" << report.sample_rate
+                  << ",\"tracked_chunks\":" << report.tracked_chunks
+                  << ",\"seconds\":" << report.seconds
+                  << ",\"fixed\":" << bytesJSON(report.fixed)
+                  << ",\"cdc\":" << bytesJSON(report.cdc) << ",\"files\":[";
+        for (size_t i = 0; i < report.files.size(); ++i) {
+            const auto& f = report.files[i];
+            std::cout << (i ? "," : "") << "{\"path\":\"" << escapeJSON(f.path) << "\",\"size\":" << f.size;
+            if (!f.error.empty()) {
+                std::cout << ",\"error\":\"" << escapeJSON(f.error) << "\"}";
+                continue;
+            }
+            if (f.family_known) {
+                std::cout << ",\"family\":\"" << std::hex << std::setw(5) << std::setfill('0') << f.family
+                          << std::dec << std::setfill(' ') << "\"";
+            }
+            std::cout << ",\"fixed\":" << bytesJSON(f.fixed) << ",\"cdc\":" << bytesJSON(f.cdc) << "}";
+        }
+        std::cout << "]}" << std::endl;
+        return 0;
+    }
+    
+    for (const auto& f : report.files) {
+        if (!f.error.empty()) {
+            std::cerr << "Warning: " << f.path << ": " << f.error << std::endl;
+        }
+    }
+    
+    auto percent = [](u64 part, u64 total) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1) << (total ? 100.0 * part / total : 0.0) << "%";
+        return out.str();
+    };
+    auto row = [&](const char* name, u64 fixed, u64 cdc) {
+        std::cout << "  " << std::left << std::setw(18) << name << std::right
+                  << std::setw(16) << fixed << std::setw(8) << percent(fixed, report.fixed.total)
+                  << std::setw(16) << cdc << std::setw(8) << percent(cdc, report.cdc.total) << std::endl;
+    };
+    
+    std::cout << "Files: " << report.files.size() << ", " << report.fixed.total << " bytes in "
+              << std::fixed << std::setprecision(1) << report.seconds << " s";
+    if (report.sample_rate > 1) {
+        std::cout << " (1/" << report.sample_rate << " of chunks sampled)";
+    }
+    std::cout << std::endl << std::endl;
+    std::cout << "  " << std::left << std::setw(18) << "" << std::right
+              << std::setw(24) << ("fixed " + std::to_string(options.fixed_chunk_size))
+              << std::setw(24) << ("cdc ~" + std::to_string(options.cdc_average_size)) << std::endl;
+    row("unique", report.fixed.unique, report.cdc.unique);
+    row("fill", report.fixed.fill, report.cdc.fill);
+    row("within file", report.fixed.within_file, report.cdc.within_file);
+    row("across files", report.fixed.across_files, report.cdc.across_files);
+    row("across families", report.fixed.across_families, report.cdc.across_families);
+    row("total duplicate", report.fixed.Duplicate() + report.fixed.fill, report.cdc.Duplicate() + report.cdc.fill);
+    return 0;
+}
+
 void progressCallback(std::size_t processed, std::size_t total) {
     double percentage = (double)processed / total * 100.0;
     int bar_width = 50;
@@ -61,15 +808,393 @@ void progressCallback(std::size_t processed, std::size_t total) {
     std::cout.flush();
 }
 
+int runRestore(int argc, char* argv[]) {
+    std::string input_file;
+    std::string output_file;
+    
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        
+        if (input_file.empty()) {
+            input_file = arg;
+        } else if (output_file.empty()) {
+            output_file = arg;
+        } else {
+            std::cerr << "Error: Unknown restore argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+    
+    if (input_file.empty()) {
+        std::cerr << "Error: restore requires a precompressed Z3DS file\n";
+        return 1;
+    }
+    if (output_file.empty()) {
+        std::string name = GetPrecompOriginalName(input_file);
+        if (name.empty()) {
+            std::cerr << "Error: Not a precompressed image: " << input_file << std::endl;
+            return 1;
+        }
+        output_file = (std::filesystem::path(input_file).parent_path() /
+                       std::filesystem::path(name).filename()).string();
+    }
+    if (std::filesystem::exists(output_file)) {
+        std::cerr << "Error: Output file already exists: " << output_file << std::endl;
+        return 1;
+    }
+    
+    auto start_time = std::chrono::high_resolution_clock::now();
+    bool success = RestorePrecompFile(input_file, output_file, progressCallback);
+    std::cout << std::endl;
+    if (!success) {
+        std::error_code ec;
+        std::filesystem::remove(output_file, ec);
+        std::cerr << "Restore failed!" << std::endl;
+        return 1;
+    }
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::high_resolution_clock::now() - start_time);
+    
+    std::cout << "Restored " << input_file << " -> " << output_file << std::endl;
+    std::cout << "Size: " << std::filesystem::file_size(output_file) << " bytes" << std::endl;
+    std::cout << "Time taken: " << duration.count() << " ms" << std::endl;
+    return 0;
+}
+
+int runExtract(int argc, char* argv[]) {
+    std::string input_file;
+    std::string output_file;
+    ExtractOptions options;
+    
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        
+        if (arg == "--known-fill-ff") {
+            options.known_fill_ff = true;
+        } else if (arg == "--verify") {
+            options.verify = true;
+        } else if (input_file.empty()) {
+            input_file = arg;
+        } else if (output_file.empty()) {
+            output_file = arg;
+        } else {
+            std::cerr << "Error: Unknown extract argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+    
+    if (input_file.empty()) {
+        std::cerr << "Error: extract requires a Z3DS file\n";
+        return 1;
+    }
+    if (output_file.empty()) {
+        // game.zcci -> game.cci
+        std::filesystem::path input_path(input_file);
+        std::string extension = input_path.extension().string();
+        if (extension.size() < 3 || extension.compare(0, 2, ".z") != 0 || extension == ".z3ds") {
+            std::cerr << "Error: Cannot derive an output name from " << input_file << ", give one\n";
+            return 1;
+        }
+        output_file = (input_path.parent_path() / (input_path.stem().string() + "." + extension.substr(2))).string();
+    }
+    if (std::filesystem::exists(output_file)) {
+        std::cerr << "Error: Output file already exists: " << output_file << std::endl;
+        return 1;
+    }
+    
+    auto start_time = std::chrono::high_resolution_clock::now();
+    ExtractResult result;
+    bool success = ExtractZ3DSFile(input_file, output_file, options, progressCallback, result);
+    std::cout << std::endl;
+    if (!success) {
+        std::error_code ec;
+        std::filesystem::remove(output_file, ec);
+        std::cerr << "Extraction failed!" << std::endl;
+        return 1;
+    }
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::high_resolution_clock::now() - start_time);
+    
+    std::cout << "Extracted " << input_file << " -> " << output_file << std::endl;
+    std::cout << "Size: " << result.size << " bytes, " << result.written_bytes << " written" << std::endl;
+    std::cout << "Frames: " << result.frames << " (" << result.zero_frames << " zero, left as holes";
+    if (options.known_fill_ff) {
+        std::cout << ", " << result.ff_frames << " 0xFF";
+    }
+    std::cout << ")" << std::endl;
+    if (result.allocated_bytes) {
+        std::cout << "Disk usage: " << result.allocated_bytes << " bytes" << std::endl;
+    }
+    std::cout << "Time taken: " << duration.count() << " ms" << std::endl;
+    return 0;
+}
+
+int runStitch(int argc, char* argv[]) {
+    std::vector<std::string> part_files;
+    std::string output_file;
+    
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        
+        if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
+            output_file = argv[++i];
+        } else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "Error: Unknown stitch argument: " << arg << std::endl;
+            return 1;
+        } else {
+            part_files.push_back(arg);
+        }
+    }
+    
+    if (part_files.empty() || output_file.empty()) {
+        std::cerr << "Error: stitch requires part files and -o FILE\n";
+        return 1;
+    }
+    
+    // A failed stitch only cleans up a file it created
+    std::error_code ec;
+    bool output_existed = std::filesystem::exists(output_file, ec);
+    auto start_time = std::chrono::high_resolution_clock::now();
+    StitchResult result;
+    if (!StitchZ3DSParts(part_files, output_file, result)) {
+        if (!output_existed) {
+            std::filesystem::remove(output_file, ec);
+        }
+        return 1;
+    }
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::high_resolution_clock::now() - start_time);
+    
+    std::cout << "Stitched " << result.parts << " parts -> " << output_file << std::endl;
+    std::cout << "Frames: " << result.frame_count << std::endl;
+    std::cout << "Uncompressed size: " << result.uncompressed_size << " bytes" << std::endl;
+    std::cout << "Compressed size: " << result.compressed_size << " bytes" << std::endl;
+    std::cout << "Time taken: " << duration.count() << " ms" << std::endl;
+    return 0;
+}
+
+int runUpdate(int argc, char* argv[]) {
+    std::string input_file;
+    std::string output_file;
+    std::string profile_name;
+    UpdateOptions options;
+    
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        
+        if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
+            output_file = argv[++i];
+        } else if (arg == "--source" && i + 1 < argc) {
+            options.source_file = argv[++i];
+        } else if (arg == "--patch" && i + 1 < argc) {
+            options.patch_file = argv[++i];
+        } else if (arg == "--profile" && i + 1 < argc) {
+            profile_name = argv[++i];
+        } else if (arg == "--verify") {
+            options.verify = true;
+        } else if (input_file.empty()) {
+            input_file = arg;
+        } else {
+            std::cerr << "Error: Unknown update argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+    
+    if (input_file.empty() || output_file.empty() ||
+        options.source_file.empty() == options.patch_file.empty()) {
+        std::cerr << "Error: update requires a Z3DS file, one of --source or --patch, and -o FILE\n";
+        return 1;
+    }
+    if (!profile_name.empty()) {
+        options.profile = FindCompressionProfile(profile_name);
+        if (!options.profile) {
+            std::cerr << "Error: Unknown profile: " << profile_name << std::endl;
+            return 1;
+        }
+    }
+    
+    auto start_time = std::chrono::high_resolution_clock::now();
+    UpdateResult result;
+    bool success = UpdateZ3DSFile(input_file, output_file, options, progressCallback, result);
+    std::cout << std::endl;
+    if (!success) {
+        std::cerr << "Update failed!" << std::endl;
+        return 1;
+    }
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::high_resolution_clock::now() - start_time);
+    
+    std::cout << "Updated " << input_file << " -> " << output_file << std::endl;
+    std::cout << "Size: " << result.old_size << " -> " << result.new_size << " bytes";
+    if (!options.patch_file.empty()) {
+        std::cout << " (" << result.patched_bytes << " bytes patched)";
+    }
+    std::cout << std::endl;
+    std::cout << "Frames: " << result.frames << " (" << result.copied_frames << " copied, "
+              << result.recompressed_frames << " recompressed)" << std::endl;
+    std::cout << "Compressed size: " << std::filesystem::file_size(output_file) << " bytes" << std::endl;
+    std::cout << "Time taken: " << duration.count() << " ms" << std::endl;
+    return 0;
+}
+
+int runPack(int argc, char* argv[]) {
+    PackOptions options;
+    std::string output_file;
+    std::string profile_name = "default";
+    bool frame_size_set = false;
+    
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        
+        if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
+            output_file = argv[++i];
+        } else if (arg == "--dict-size" && i + 1 < argc) {
+            options.dictionary_size = std::stoull(argv[++i]);
+        } else if (arg == "--frame-size" && i + 1 < argc) {
+            options.frame_size = std::stoull(argv[++i]);
+            frame_size_set = true;
+        } else if (arg == "--profile" && i + 1 < argc) {
+            profile_name = argv[++i];
+        } else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "Error: Unknown pack argument: " << arg << std::endl;
+            return 1;
+        } else {
+            options.paths.push_back(arg);
+        }
+    }
+    
+    if (options.paths.empty() || output_file.empty()) {
+        std::cerr << "Error: pack requires input files or directories and -o FILE\n";
+        return 1;
+    }
+    auto profile = FindCompressionProfile(profile_name);
+    if (!profile) {
+        std::cerr << "Error: Unknown profile: " << profile_name << std::endl;
+        return 1;
+    }
+    if (!frame_size_set && profile->frame_size) {
+        options.frame_size = profile->frame_size;
+    }
+    
+    auto start_time = std::chrono::high_resolution_clock::now();
+    PackResult result;
+    CompressionStats stats;
+    bool success = CreatePack(options, output_file, *profile, progressCallback, result, &stats);
+    std::cout << std::endl;
+    if (!success) {
+        std::cerr << "Packing failed!" << std::endl;
+        return 1;
+    }
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::high_resolution_clock::now() - start_time);
+    
+    auto output_size = std::filesystem::file_size(output_file);
+    std::cout << "Packed " << result.members << " files (" << result.input_bytes << " bytes) -> "
+              << output_file << std::endl;
+    std::cout << "Compressed size: " << output_size << " bytes (" << std::fixed << std::setprecision(1)
+              << (result.input_bytes ? (double)output_size / result.input_bytes * 100.0 : 0.0) << "%)" << std::endl;
+    std::cout << "Dictionary: ";
+    if (result.dictionary_size) {
+        std::cout << result.dictionary_size << " bytes" << std::endl;
+    } else {
+        std::cout << "none" << std::endl;
+    }
+    std::cout << "Time taken: " << duration.count() << " ms" << std::endl;
+    return 0;
+}
+
+// Compress into an S3 multipart upload instead of a local file
+bool compressToS3(const std::string& input_file, const std::string& url, const S3Options& options,
+                  const std::array<u8, 4>& magic, size_t frame_size, CompressionStats& stats,
+                  const CompressionProfile& profile, const RegionPolicy* region_policy,
+                  const DeadlineOptions* deadline, u64& output_size) {
+#ifdef Z3DS_HAVE_S3
+    std::ifstream input(input_file, std::ios::binary);
+    if (!input.is_open()) {
+        std::cerr << "Error: Could not open source file: " << input_file << std::endl;
+        return false;
+    }
+    S3UploadStream output;
+    if (!output.Open(url, options)) {
+        return false;
+    }
+    if (!CompressZ3DSStream(input, output, magic, frame_size, progressCallback, {}, &stats, profile,
+                            region_policy, deadline)) {
+        output.Abort();
+        return false;
+    }
+    if (!output.Finish()) {
+        return false;
+    }
+    output_size = output.GetSize();
+    std::cout << "Uploaded " << output.GetPartCount() << " parts to " << url << std::endl;
+    return true;
+#else
+    (void)input_file, (void)options, (void)magic, (void)frame_size, (void)stats, (void)profile;
+    (void)region_policy, (void)deadline, (void)output_size;
+    std::cerr << "Error: Cannot write " << url << ": built without S3 support (libcurl)" << std::endl;
+    return false;
+#endif
+}
+
 int main(int argc, char* argv[]) {
     if (argc < 2) {
         showUsage(argv[0]);
         return 1;
     }
     
+    std::string command = argv[1];
+    if (command == "bench-io") {
+        return runBenchIO(argc, argv);
+    }
+    if (command == "bench-decode") {
+        return runBenchDecode(argc, argv);
+    }
+    if (command == "list") {
+        return runList(argc, argv);
+    }
+    if (command == "cat") {
+        return runCat(argc, argv);
+    }
+    if (command == "import") {
+        return runImport(argc, argv);
+    }
+    if (command == "rebalance") {
+        return runRebalance(argc, argv);
+    }
+    if (command == "analyze-dedup") {
+        return runAnalyzeDedup(argc, argv);
+    }
+    if (command == "extract") {
+        return runExtract(argc, argv);
+    }
+    if (command == "stitch") {
+        return runStitch(argc, argv);
+    }
+    if (command == "update") {
+        return runUpdate(argc, argv);
+    }
+    if (command == "pack") {
+        return runPack(argc, argv);
+    }
+    if (command == "restore") {
+        return runRestore(argc, argv);
+    }
+    
     std::string input_file;
     std::string output_file;
+    std::string stats_file;
+    std::string profile_name = "default";
+    std::vector<std::string> profile_files;
+    std::vector<std::string> zstd_params;
+    std::vector<std::string> region_profiles;
+    bool use_regions = false;
+    bool precomp = false;
+    bool front_index = false;
+    std::optional<PartRange> part;
     size_t frame_size = 0; // 0 means auto-detect
+    std::optional<DeadlineOptions> deadline;
+    S3Options s3_options;
     
     // Parse arguments
     for (int i = 1; i < argc; ++i) {
@@ -85,6 +1210,82 @@ int main(int argc, char* argv[]) {
                 std::cerr << "Error: --frame-size requires a value\n";
                 return 1;
             }
+        } else if (arg == "--profile") {
+            if (i + 1 < argc) {
+                profile_name = argv[++i];
+            } else {
+                std::cerr << "Error: --profile requires a value\n";
+                return 1;
+            }
+        } else if (arg == "--profile-file") {
+            if (i + 1 < argc) {
+                profile_files.push_back(argv[++i]);
+            } else {
+                std::cerr << "Error: --profile-file requires a value\n";
+                return 1;
+            }
+        } else if (arg == "--zstd-param") {
+            if (i + 1 < argc) {
+                zstd_params.push_back(argv[++i]);
+            } else {
+                std::cerr << "Error: --zstd-param requires a value\n";
+                return 1;
+            }
+        } else if (arg == "--regions") {
+            use_regions = true;
+        } else if (arg == "--region-profile") {
+            if (i + 1 < argc) {
+                region_profiles.push_back(argv[++i]);
+                use_regions = true;
+            } else {
+                std::cerr << "Error: --region-profile requires a value\n";
+                return 1;
+            }
+        } else if (arg == "--deadline") {
+            double seconds = 0;
+            if (i + 1 >= argc || !parseSeconds(argv[++i], seconds)) {
+                std::cerr << "Error: --deadline requires a positive number of seconds\n";
+                showUsage(argv[0]);
+                return 1;
+            }
+            deadline.emplace();
+            deadline->seconds = seconds;
+        } else if (arg == "--precomp") {
+            precomp = true;
+        } else if (arg == "--front-index") {
+            front_index = true;
+        } else if (arg == "--part") {
+            std::string range = i + 1 < argc ? argv[++i] : "";
+            size_t colon = range.find(':');
+            part.emplace();
+            std::string end = colon == std::string::npos ? "" : range.substr(colon + 1);
+            if (colon == std::string::npos || !parseUnsigned(range.substr(0, colon), part->start) ||
+                (!end.empty() && !parseUnsigned(end, part->end))) {
+                std::cerr << "Error: --part requires START:END in bytes, e.g. 0:2147483648 or 2147483648:\n";
+                showUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--s3-endpoint") {
+            if (i + 1 < argc) {
+                s3_options.endpoint = argv[++i];
+            } else {
+                std::cerr << "Error: --s3-endpoint requires a value\n";
+                return 1;
+            }
+        } else if (arg == "--s3-part-size") {
+            if (i + 1 < argc) {
+                s3_options.part_size = std::stoull(argv[++i]);
+            } else {
+                std::cerr << "Error: --s3-part-size requires a value\n";
+                return 1;
+            }
+        } else if (arg == "--stats-json") {
+            if (i + 1 < argc) {
+                stats_file = argv[++i];
+            } else {
+                std::cerr << "Error: --stats-json requires a value\n";
+                return 1;
+            }
         } else if (input_file.empty()) {
             input_file = arg;
         } else if (output_file.empty()) {
@@ -108,9 +1309,77 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
+    // Resolve the compression profile, then apply parameter overrides
+    for (const auto& file : profile_files) {
+        if (!LoadCompressionProfiles(file)) {
+            return 1;
+        }
+    }
+    auto profile = FindCompressionProfile(profile_name);
+    if (!profile) {
+        std::cerr << "Error: Unknown profile: " << profile_name << std::endl;
+        return 1;
+    }
+    for (const auto& param : zstd_params) {
+        size_t equals = param.find('=');
+        std::string error;
+        if (equals == std::string::npos) {
+            error = "expected KEY=VALUE: " + param;
+        } else if (SetCompressionParameter(*profile, param.substr(0, equals), param.substr(equals + 1), error)) {
+            continue;
+        }
+        std::cerr << "Error: --zstd-param " << error << std::endl;
+        return 1;
+    }
+    if (front_index) {
+        profile->front_index = true;
+    }
+    std::string profile_error;
+    if (!ValidateCompressionProfile(*profile, profile_error)) {
+        std::cerr << "Error: " << profile_error << std::endl;
+        return 1;
+    }
+    
+    if (precomp && (use_regions || deadline || part)) {
+        std::cerr << "Error: --precomp cannot be combined with --regions, --deadline or --part\n";
+        return 1;
+    }
+    if (part && use_regions) {
+        std::cerr << "Error: --part cannot be combined with --regions\n";
+        return 1;
+    }
+    bool s3_output = IsS3Url(output_file);
+    if (s3_output && (precomp || part)) {
+        std::cerr << "Error: --precomp and --part write local files only\n";
+        return 1;
+    }
+    
+    std::optional<RegionPolicy> region_policy;
+    if (use_regions) {
+        region_policy = MakeDefaultRegionPolicy(*profile);
+        for (const auto& override_spec : region_profiles) {
+            size_t equals = override_spec.find('=');
+            auto type = ParseRegionTypeName(override_spec.substr(0, equals));
+            auto region_profile = equals == std::string::npos
+                ? std::nullopt : FindCompressionProfile(override_spec.substr(equals + 1));
+            if (!type || !region_profile) {
+                std::cerr << "Error: Invalid --region-profile: " << override_spec << std::endl;
+                return 1;
+            }
+            region_policy->profiles[static_cast<size_t>(*type)] = *region_profile;
+        }
+    }
+    
     // Generate output filename if not provided
     if (output_file.empty()) {
-        output_file = generateOutputFilename(input_file);
+        // game.cci -> game.precomp.z3ds, so archives are not mistaken for playable images
+        std::filesystem::path input_path(input_file);
+        output_file = precomp ? (input_path.parent_path() / input_path.stem()).string() + ".precomp.z3ds"
+                              : generateOutputFilename(input_file);
+        if (part) {
+            // game.zcci.part0, game.zcci.part2147483648, ...
+            output_file += ".part" + std::to_string(part->start);
+        }
     }
     
     // Detect file magic
@@ -121,37 +1390,100 @@ int main(int argc, char* argv[]) {
     
     // Use auto frame size if not specified
     if (frame_size == 0) {
-        frame_size = GetDefaultFrameSize(magic);
+        frame_size = profile->frame_size ? profile->frame_size : GetDefaultFrameSize(magic);
     }
     
     std::cout << "Using frame size: " << frame_size << " bytes (" 
               << (frame_size / 1024 / 1024) << " MB)" << std::endl;
     
+    std::cout << "Profile: " << profile->name << " (" << DescribeCompressionProfile(*profile) << ")" << std::endl;
     std::cout << "Compressing: " << input_file << std::endl;
     std::cout << "Output: " << output_file << std::endl;
     
+    EnergyMeter energy_meter;
+    energy_meter.Start();
     auto start_time = std::chrono::high_resolution_clock::now();
     
     // Perform compression
-    bool success = CompressZ3DSFile(input_file, output_file, magic, frame_size, progressCallback);
+    CompressionStats stats;
+    PrecompResult precomp_result;
+    u64 s3_size = 0;
+    bool success = s3_output
+        ? compressToS3(input_file, output_file, s3_options, magic, frame_size, stats, *profile,
+                       region_policy ? &*region_policy : nullptr, deadline ? &*deadline : nullptr, s3_size)
+        : precomp
+        ? PrecompressZ3DSFile(input_file, output_file, frame_size, *profile, progressCallback, precomp_result,
+                              &stats)
+        : part
+        ? CompressZ3DSPart(input_file, output_file, magic, frame_size, *part, progressCallback, &stats, *profile,
+                           deadline ? &*deadline : nullptr)
+        : CompressZ3DSFile(input_file, output_file, magic, frame_size, progressCallback,
+                           {}, &stats, *profile,
+                           region_policy ? &*region_policy : nullptr,
+                           deadline ? &*deadline : nullptr);
     
     auto end_time = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+    EnergyReading energy = energy_meter.Stop();
     
     std::cout << std::endl; // New line after progress bar
     
     if (success) {
         // Calculate compression ratio
         auto input_size = std::filesystem::file_size(input_file);
-        auto output_size = std::filesystem::file_size(output_file);
+        if (part) {
+            input_size = (part->end ? part->end : input_size) - part->start;
+        }
+        auto output_size = s3_output ? s3_size : std::filesystem::file_size(output_file);
         double ratio = (double)output_size / input_size * 100.0;
         
+        std::cout << "Created " << stats.frame_count << " seekable frames" << std::endl;
         std::cout << "Compression completed successfully!" << std::endl;
         std::cout << "Original size: " << input_size << " bytes" << std::endl;
         std::cout << "Compressed size: " << output_size << " bytes" << std::endl;
         std::cout << "Compression ratio: " << std::fixed << std::setprecision(1) 
                   << ratio << "%" << std::endl;
         std::cout << "Time taken: " << duration.count() << " ms" << std::endl;
+        if (energy.available) {
+            std::cout << "Energy: " << std::setprecision(1) << energy.Joules() << " J ("
+                      << energy.JoulesPerGB(input_size) << " J/GB)" << std::endl;
+        }
+        if (precomp) {
+            std::cout << "Precompressed: " << precomp_result.streams << " of " << precomp_result.candidates
+                      << " LZ streams (" << precomp_result.stream_bytes << " -> " << precomp_result.decoded_bytes
+                      << " bytes)" << std::endl;
+        }
+        std::cout << "Memory: " << (stats.TrackedBytes() / 1024) << " KB tracked ("
+                  << (stats.frame_buffer_bytes / 1024) << " KB frame buffers, "
+                  << (stats.context_bytes / 1024) << " KB zstd context, "
+                  << (stats.frame_cache_bytes / 1024) << " KB frame cache, "
+                  << (stats.disk_cache_queued_bytes / 1024) << " KB disk cache queue), peak RSS "
+                  << (stats.peak_rss_bytes / 1024) << " KB" << std::endl;
+        if (stats.disk_cache_bytes) {
+            std::cout << "Disk cache: " << (stats.disk_cache_bytes / 1024) << " KB on disk" << std::endl;
+        }
+        for (const auto& region : stats.regions) {
+            if (region.input_bytes == 0) {
+                continue;
+            }
+            std::cout << "  " << std::left << std::setw(10) << region.name << std::right
+                      << std::setw(12) << region.input_bytes << " -> " << std::setw(12) << region.output_bytes
+                      << " bytes, " << std::setprecision(3) << region.seconds << " s" << std::endl;
+        }
+        if (!stats.frames_per_level.empty()) {
+            std::cout << "Frames by level:";
+            for (size_t level = 0; level < stats.frames_per_level.size(); ++level) {
+                if (stats.frames_per_level[level]) {
+                    std::cout << " " << (level ? std::to_string(level) : "raw") << "=" << stats.frames_per_level[level];
+                }
+            }
+            std::cout << std::endl;
+        }
+        
+        if (!stats_file.empty() &&
+            !appendStatsJSON(stats_file, input_file, input_size, output_size, duration.count(), stats, energy)) {
+            std::cerr << "Warning: Could not write stats to " << stats_file << std::endl;
+        }
         return 0;
     } else {
         std::cerr << "Compression failed!" << std::endl;
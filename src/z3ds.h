@@ -0,0 +1,128 @@
+/*
+ * C interface to the Z3DS reader and compressor.
+ *
+ * Handles are opaque and every function returns a status (or a byte count,
+ * negative on error) instead of throwing, so the library can be loaded from
+ * any language with a C FFI. A reader handle may be shared between threads;
+ * calls on one handle are serialised. The message for the last failed call on
+ * the current thread is available from z3ds_last_error(). It includes the
+ * library's own error messages, which are collected instead of printed.
+ */
+#ifndef Z3DS_H
+#define Z3DS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32) && defined(Z3DS_SHARED)
+#ifdef Z3DS_BUILDING
+#define Z3DS_API __declspec(dllexport)
+#else
+#define Z3DS_API __declspec(dllimport)
+#endif
+#elif defined(__GNUC__)
+#define Z3DS_API __attribute__((visibility("default")))
+#else
+#define Z3DS_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define Z3DS_ABI_VERSION 1
+
+enum {
+    Z3DS_OK = 0,
+    Z3DS_ERROR_INVALID_ARGUMENT = -1,
+    Z3DS_ERROR_IO = -2,
+    Z3DS_ERROR_FORMAT = -3,
+    Z3DS_ERROR_OUT_OF_MEMORY = -4,
+    Z3DS_ERROR_INTERNAL = -5,
+};
+
+typedef struct z3ds_reader z3ds_reader;
+
+typedef struct z3ds_stat_info {
+    uint8_t underlying_magic[4];
+    uint64_t uncompressed_size;
+    uint64_t compressed_size;
+    uint64_t file_size;
+    uint32_t frame_count;
+    uint32_t max_frame_size;
+} z3ds_stat_info;
+
+/* One range for z3ds_readv */
+typedef struct z3ds_read_request {
+    uint64_t offset;
+    void* buffer;
+    size_t size;
+} z3ds_read_request;
+
+/* Counters of the process-wide decoded frame cache and, when configured
+ * with Z3DS_DISK_CACHE_DIR, the disk cache below it */
+typedef struct z3ds_cache_stats_info {
+    uint64_t budget_bytes;
+    uint64_t used_bytes;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t frames;
+    /* For the reader passed to z3ds_cache_stats, zero without one */
+    uint64_t file_hits;
+    uint64_t file_misses;
+    uint64_t file_resident_bytes;
+    uint64_t disk_capacity_bytes;  /* 0 when the disk cache is off */
+    uint64_t disk_used_bytes;
+    uint64_t disk_hits;
+    uint64_t disk_misses;
+    uint64_t disk_writes;
+    uint64_t disk_dropped_writes;  /* Write-back queue was full */
+    uint64_t disk_frames;
+} z3ds_cache_stats_info;
+
+typedef void (*z3ds_progress_fn)(uint64_t processed, uint64_t total, void* user_data);
+
+typedef struct z3ds_compress_options {
+    uint32_t struct_size;           /* Set by z3ds_compress_options_init */
+    uint64_t frame_size;            /* 0 picks the profile or format default */
+    const char* profile;            /* NULL for "default" */
+    const char* profile_file;       /* Optional INI file of named profiles, for this call only */
+    const char* const* zstd_params; /* Optional "name=value" overrides */
+    size_t zstd_param_count;
+    int use_regions;                /* Choose parameters per ROM region */
+    z3ds_progress_fn progress;
+    void* user_data;
+} z3ds_compress_options;
+
+Z3DS_API int z3ds_abi_version(void);
+Z3DS_API const char* z3ds_last_error(void);
+
+Z3DS_API int z3ds_open(const char* path, z3ds_reader** out);
+Z3DS_API void z3ds_close(z3ds_reader* reader);
+Z3DS_API int z3ds_stat(z3ds_reader* reader, z3ds_stat_info* info);
+
+/* Returns the number of bytes read (short only at end of data) or an error */
+Z3DS_API int64_t z3ds_read(z3ds_reader* reader, uint64_t offset, void* buffer, size_t size);
+
+/* Reads each range in order; returns the total bytes read or an error */
+Z3DS_API int64_t z3ds_readv(z3ds_reader* reader, const z3ds_read_request* requests, size_t count);
+
+/* Copies a metadata item into buffer and returns its full length, or an
+ * error if the item does not exist. Pass a NULL buffer to query the length. */
+Z3DS_API int64_t z3ds_get_metadata(z3ds_reader* reader, const char* name, void* buffer, size_t size);
+
+Z3DS_API void z3ds_compress_options_init(z3ds_compress_options* options);
+Z3DS_API int z3ds_compress(const char* src_path, const char* dst_path, const z3ds_compress_options* options);
+
+/* Memory budget of the process-wide decoded frame cache, 0 disables it */
+Z3DS_API void z3ds_set_cache_budget(uint64_t bytes);
+
+/* Cache counters, plus those of one file when reader is not NULL */
+Z3DS_API int z3ds_cache_stats(z3ds_reader* reader, z3ds_cache_stats_info* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* Z3DS_H */
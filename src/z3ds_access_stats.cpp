@@ -0,0 +1,252 @@
+#include "z3ds_access_stats.h"
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr double HALF_LIFE_SECONDS = 7 * 24 * 3600.0;
+constexpr size_t MAX_HOT_FRAMES = 64;
+constexpr double MIN_HOT_SCORE = 0.1;
+
+// Exclusive advisory lock on the store, held across a read-modify-write so
+// processes closing the same title at once do not lose each other's counts.
+// Records are replaced by rename, so the lock lives in a separate file.
+class StoreLock {
+public:
+    explicit StoreLock(const std::string& directory) {
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+        std::string path = (std::filesystem::path(directory) / "stats.lock").string();
+#ifdef _WIN32
+        fd = _open(path.c_str(), _O_WRONLY | _O_CREAT, 0644);
+        if (fd >= 0) {
+            OVERLAPPED overlapped{};
+            LockFileEx(reinterpret_cast<HANDLE>(_get_osfhandle(fd)), LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped);
+        }
+#else
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        while (fd >= 0 && flock(fd, LOCK_EX) != 0 && errno == EINTR) {
+        }
+#endif
+    }
+
+    ~StoreLock() {
+        if (fd < 0) {
+            return;
+        }
+#ifdef _WIN32
+        OVERLAPPED overlapped{};
+        UnlockFileEx(reinterpret_cast<HANDLE>(_get_osfhandle(fd)), 0, 1, 0, &overlapped);
+        _close(fd);
+#else
+        close(fd); // Releases the lock
+#endif
+    }
+
+    StoreLock(const StoreLock&) = delete;
+    StoreLock& operator=(const StoreLock&) = delete;
+
+private:
+    int fd = -1;
+};
+
+} // namespace
+
+double AccessRecord::ScoreAt(u64 now) const {
+    if (now <= last_access) {
+        return score;
+    }
+    return score * std::exp2(-static_cast<double>(now - last_access) / HALF_LIFE_SECONDS);
+}
+
+std::string AccessStatsStore::DefaultDirectory() {
+    const char* env = std::getenv("Z3DS_ACCESS_STATS_DIR");
+    return env ? env : "";
+}
+
+AccessStatsStore::AccessStatsStore(std::string dir) : directory(std::move(dir)) {}
+
+std::string AccessStatsStore::RecordPath(u64 fingerprint) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.stats", static_cast<unsigned long long>(fingerprint));
+    return (std::filesystem::path(directory) / name).string();
+}
+
+bool AccessStatsStore::Load(u64 fingerprint, AccessRecord& record) const {
+    record = {};
+    record.fingerprint = fingerprint;
+    if (!Enabled()) {
+        return false;
+    }
+    std::ifstream file(RecordPath(fingerprint));
+    if (!file.is_open()) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t equals = line.find('=');
+        if (equals == std::string::npos) {
+            continue;
+        }
+        std::string key = line.substr(0, equals);
+        std::string value = line.substr(equals + 1);
+        if (key == "path") {
+            record.path = value;
+        } else if (key == "opens") {
+            record.opens = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (key == "score") {
+            record.score = std::strtod(value.c_str(), nullptr);
+        } else if (key == "last_access") {
+            record.last_access = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (key == "bytes_read") {
+            record.bytes_read = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (key == "heat") {
+            std::stringstream heat(value);
+            std::string count;
+            while (std::getline(heat, count, ',')) {
+                record.frame_heat.push_back(static_cast<u32>(std::strtoul(count.c_str(), nullptr, 10)));
+            }
+        } else if (key == "hotset") {
+            std::stringstream hot(value);
+            std::string item;
+            while (std::getline(hot, item, ',')) {
+                char* end = nullptr;
+                u32 frame = static_cast<u32>(std::strtoul(item.c_str(), &end, 10));
+                if (*end == ':') {
+                    record.hot_set.push_back({frame, std::strtod(end + 1, nullptr)});
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool AccessStatsStore::Save(const AccessRecord& record) const {
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+
+    // Write a private temporary file, then replace the record in one step
+    std::string path = RecordPath(record.fingerprint);
+    std::ostringstream temp_name;
+    temp_name << path << ".tmp" << std::hex
+              << (std::chrono::steady_clock::now().time_since_epoch().count() ^
+                  std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    std::string temp_path = temp_name.str();
+    {
+        std::ofstream file(temp_path, std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        file << "path=" << record.path << "\n"
+             << "opens=" << record.opens << "\n"
+             << "score=" << record.score << "\n"
+             << "last_access=" << record.last_access << "\n"
+             << "bytes_read=" << record.bytes_read << "\n"
+             << "heat=";
+        for (size_t i = 0; i < record.frame_heat.size(); ++i) {
+            file << (i ? "," : "") << record.frame_heat[i];
+        }
+        file << "\n"
+             << "hotset=";
+        for (size_t i = 0; i < record.hot_set.size(); ++i) {
+            file << (i ? "," : "") << record.hot_set[i].frame << ":" << record.hot_set[i].score;
+        }
+        file << "\n";
+        if (!file.good()) {
+            file.close();
+            std::filesystem::remove(temp_path, ec);
+            return false;
+        }
+    }
+    std::filesystem::rename(temp_path, path, ec);
+    return !ec;
+}
+
+bool AccessStatsStore::Merge(const AccessRecord& session) {
+    if (!Enabled()) {
+        return false;
+    }
+    StoreLock lock(directory);
+    AccessRecord record;
+    Load(session.fingerprint, record);
+
+    u64 now = std::max(session.last_access, record.last_access);
+    double decay = record.score > 0.0 ? record.ScoreAt(now) / record.score : 1.0;
+    record.score = record.ScoreAt(now) + static_cast<double>(session.opens);
+    record.last_access = now;
+    record.opens += session.opens;
+    record.bytes_read += session.bytes_read;
+    if (!session.path.empty()) {
+        record.path = session.path;
+    }
+    if (record.frame_heat.size() != session.frame_heat.size()) {
+        record.frame_heat.assign(session.frame_heat.size(), 0);
+        record.hot_set.clear();
+    }
+    for (size_t i = 0; i < session.frame_heat.size(); ++i) {
+        record.frame_heat[i] += session.frame_heat[i];
+    }
+
+    // Every session adds 1 to each frame it read early, plus up to 1 more the
+    // earlier the frame came, so frames needed first are warmed first
+    std::unordered_map<u32, double> hot;
+    for (const auto& frame : record.hot_set) {
+        hot[frame.frame] = frame.score * decay;
+    }
+    for (size_t rank = 0; rank < session.hot_set.size(); ++rank) {
+        hot[session.hot_set[rank].frame] += 1.0 + 1.0 / (1.0 + rank);
+    }
+    record.hot_set.clear();
+    for (const auto& [frame, score] : hot) {
+        if (score >= MIN_HOT_SCORE) {
+            record.hot_set.push_back({frame, score});
+        }
+    }
+    std::sort(record.hot_set.begin(), record.hot_set.end(), [](const auto& a, const auto& b) {
+        return a.score != b.score ? a.score > b.score : a.frame < b.frame;
+    });
+    if (record.hot_set.size() > MAX_HOT_FRAMES) {
+        record.hot_set.resize(MAX_HOT_FRAMES);
+    }
+    return Save(record);
+}
+
+bool AccessStatsStore::Rekey(u64 old_fingerprint, u64 new_fingerprint, size_t new_frame_count,
+                             const std::string& path) {
+    StoreLock lock(directory);
+    AccessRecord record;
+    if (!Load(old_fingerprint, record)) {
+        return false;
+    }
+    record.fingerprint = new_fingerprint;
+    record.path = path;
+    if (record.frame_heat.size() != new_frame_count) {
+        record.frame_heat.assign(new_frame_count, 0);
+        record.hot_set.clear();
+    }
+    if (!Save(record)) {
+        return false;
+    }
+    std::error_code ec;
+    std::filesystem::remove(RecordPath(old_fingerprint), ec);
+    return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "z3ds_compression.h"
+
+// How often a Z3DS file is read, kept per file fingerprint (see
+// Z3DSReader::GetFingerprint) in a local directory so usage survives across
+// processes and drives `rebalance`.
+struct AccessRecord {
+    u64 fingerprint = 0;
+    std::string path;      // Last path the file was read through
+    u64 opens = 0;         // Reader sessions that read any data
+    double score = 0.0;    // Opens with a 7 day half-life, as of last_access
+    u64 last_access = 0;   // Unix time
+    u64 bytes_read = 0;
+    std::vector<u32> frame_heat; // Times each frame was switched to
+
+    // Frames first read within the start-up window of a session (see
+    // Z3DSReader), which a reader decodes ahead on open. In a session they
+    // are in first-read order; stored, they carry a score that decays like
+    // `score` and are in priority order.
+    struct HotFrame {
+        u32 frame;
+        double score;
+    };
+    std::vector<HotFrame> hot_set;
+
+    // Score decayed to the given time
+    double ScoreAt(u64 now) const;
+};
+
+// One small text file per fingerprint in the stats directory. Updates replace
+// the file atomically; concurrent updates of the same file may lose one
+// session's counts, which only blurs the statistics.
+class AccessStatsStore {
+public:
+    // Z3DS_ACCESS_STATS_DIR, empty when access recording is off
+    static std::string DefaultDirectory();
+
+    explicit AccessStatsStore(std::string directory);
+
+    bool Enabled() const { return !directory.empty(); }
+
+    bool Load(u64 fingerprint, AccessRecord& record) const;
+
+    // Add one session (opens, bytes, heat and hot set of `session`) to the
+    // stored record, under a lock on the store shared with other processes
+    bool Merge(const AccessRecord& session);
+
+    // Move a record to the fingerprint of a recompressed file. Frame heat and
+    // the hot set are dropped when the frame count changes.
+    bool Rekey(u64 old_fingerprint, u64 new_fingerprint, size_t new_frame_count, const std::string& path);
+
+private:
+    std::string RecordPath(u64 fingerprint) const;
+    bool Save(const AccessRecord& record) const;
+
+    std::string directory;
+};
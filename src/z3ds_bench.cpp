@@ -0,0 +1,468 @@
+#include "z3ds_bench.h"
+#include "z3ds_reader.h"
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <zstd.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#endif
+
+double GetProcessCPUSeconds() {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+        return 0.0;
+    }
+    auto to_seconds = [](const FILETIME& ft) {
+        u64 ticks = (static_cast<u64>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+        return ticks / 1e7; // 100ns units
+    };
+    return to_seconds(kernel) + to_seconds(user);
+#else
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0.0;
+    }
+    auto to_seconds = [](const timeval& tv) {
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    };
+    return to_seconds(usage.ru_utime) + to_seconds(usage.ru_stime);
+#endif
+}
+
+namespace {
+
+// Receives the bytes produced by a read backend. Without compression it only
+// touches one word per page so that mmap actually faults the data in.
+class BenchSink {
+public:
+    BenchSink(bool compress, size_t frame_size) : compress(compress), frame_size(frame_size) {
+        if (compress) {
+            cctx = ZSTD_createCCtx();
+            ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, 3);
+            frame_buffer.reserve(frame_size);
+            compressed_buffer.resize(ZSTD_compressBound(frame_size));
+        }
+    }
+
+    ~BenchSink() {
+        if (cctx) {
+            ZSTD_freeCCtx(cctx);
+        }
+    }
+
+    void Consume(const u8* data, size_t size) {
+        if (!compress) {
+            for (size_t i = 0; i < size; i += 4096) {
+                fold ^= data[i];
+            }
+            return;
+        }
+        while (size > 0) {
+            size_t to_copy = std::min(size, frame_size - frame_buffer.size());
+            frame_buffer.insert(frame_buffer.end(), data, data + to_copy);
+            data += to_copy;
+            size -= to_copy;
+            if (frame_buffer.size() == frame_size) {
+                Flush();
+            }
+        }
+    }
+
+    void Finish() {
+        if (compress && !frame_buffer.empty()) {
+            Flush();
+        }
+    }
+
+    u64 Fold() const {
+        return fold;
+    }
+
+private:
+    void Flush() {
+        size_t result = ZSTD_compress2(cctx, compressed_buffer.data(), compressed_buffer.size(),
+                                       frame_buffer.data(), frame_buffer.size());
+        if (!ZSTD_isError(result)) {
+            fold += result;
+        }
+        frame_buffer.clear();
+    }
+
+    bool compress;
+    size_t frame_size;
+    ZSTD_CCtx* cctx = nullptr;
+    std::vector<u8> frame_buffer;
+    std::vector<u8> compressed_buffer;
+    u64 fold = 0;
+};
+
+// Page-aligned buffer, required by O_DIRECT
+struct AlignedBuffer {
+    explicit AlignedBuffer(size_t size) : size(size) {
+#ifdef _WIN32
+        data = static_cast<u8*>(_aligned_malloc(size, 4096));
+#else
+        void* ptr = nullptr;
+        if (posix_memalign(&ptr, 4096, size) == 0) {
+            data = static_cast<u8*>(ptr);
+        }
+#endif
+    }
+
+    ~AlignedBuffer() {
+#ifdef _WIN32
+        _aligned_free(data);
+#else
+        free(data);
+#endif
+    }
+
+    u8* data = nullptr;
+    size_t size;
+};
+
+void DropPageCache(const std::string& path) {
+#if defined(_WIN32) || defined(__APPLE__)
+    (void)path; // No portable way to evict a single file
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+#endif
+}
+
+bool ReadIfstream(const IOBenchOptions& options, BenchSink& sink, u64& bytes, std::string& error) {
+    std::ifstream input(options.input_file, std::ios::binary);
+    if (!input.is_open()) {
+        error = "could not open input";
+        return false;
+    }
+    // Same 64KB buffer as CompressZ3DSFile
+    std::vector<u8> buffer(64 * 1024);
+    while (input.good()) {
+        input.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+        size_t read_size = input.gcount();
+        if (read_size == 0) break;
+        sink.Consume(buffer.data(), read_size);
+        bytes += read_size;
+    }
+    return true;
+}
+
+#ifndef _WIN32
+bool ReadPread(const IOBenchOptions& options, BenchSink& sink, u64& bytes, std::string& error) {
+    int fd = open(options.input_file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = std::strerror(errno);
+        return false;
+    }
+    std::vector<u8> buffer(options.buffer_size);
+    off_t offset = 0;
+    while (true) {
+        ssize_t result = pread(fd, buffer.data(), buffer.size(), offset);
+        if (result < 0) {
+            error = std::strerror(errno);
+            close(fd);
+            return false;
+        }
+        if (result == 0) break;
+        sink.Consume(buffer.data(), result);
+        offset += result;
+    }
+    bytes = offset;
+    close(fd);
+    return true;
+}
+
+bool ReadMmap(const IOBenchOptions& options, BenchSink& sink, u64& bytes, std::string& error) {
+    int fd = open(options.input_file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = std::strerror(errno);
+        return false;
+    }
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        error = "could not stat input";
+        close(fd);
+        return false;
+    }
+    void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        error = std::strerror(errno);
+        return false;
+    }
+    madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+    const u8* data = static_cast<const u8*>(mapping);
+    for (off_t offset = 0; offset < st.st_size; offset += options.buffer_size) {
+        size_t chunk = std::min<u64>(options.buffer_size, st.st_size - offset);
+        sink.Consume(data + offset, chunk);
+    }
+    bytes = st.st_size;
+    munmap(mapping, st.st_size);
+    return true;
+}
+#endif
+
+#ifdef __linux__
+bool ReadDirect(const IOBenchOptions& options, BenchSink& sink, u64& bytes, std::string& error) {
+    int fd = open(options.input_file.c_str(), O_RDONLY | O_DIRECT);
+    if (fd < 0) {
+        error = std::strerror(errno);
+        return false;
+    }
+    AlignedBuffer buffer(options.buffer_size);
+    off_t offset = 0;
+    while (true) {
+        // O_DIRECT returns a short read at end of file, which is how we stop
+        ssize_t result = pread(fd, buffer.data, buffer.size, offset);
+        if (result < 0) {
+            error = std::strerror(errno);
+            close(fd);
+            return false;
+        }
+        if (result == 0) break;
+        sink.Consume(buffer.data, result);
+        offset += result;
+        if (static_cast<size_t>(result) < buffer.size) break;
+    }
+    bytes = offset;
+    close(fd);
+    return true;
+}
+#endif
+
+// Write runs produce as many bytes as the input file holds, taken from its
+// first buffer, and include the final flush to storage in the timing.
+bool WriteOfstream(const std::string& path, const std::vector<u8>& pattern, u64 total,
+                   std::string& error) {
+    std::ofstream output(path, std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) {
+        error = "could not create scratch file";
+        return false;
+    }
+    constexpr size_t CHUNK = 64 * 1024;
+    for (u64 written = 0; written < total;) {
+        size_t chunk = std::min<u64>({CHUNK, total - written, pattern.size()});
+        output.write(reinterpret_cast<const char*>(pattern.data()), chunk);
+        written += chunk;
+    }
+    output.close();
+    if (output.fail()) {
+        error = "write failed";
+        return false;
+    }
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+#endif
+    return true;
+}
+
+#ifndef _WIN32
+bool WritePwrite(const std::string& path, const std::vector<u8>& pattern, u64 total, int extra_flags,
+                 std::string& error) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | extra_flags, 0644);
+    if (fd < 0) {
+        error = std::strerror(errno);
+        return false;
+    }
+    AlignedBuffer buffer(pattern.size());
+    std::memcpy(buffer.data, pattern.data(), pattern.size());
+    // O_DIRECT needs block-multiple sizes, so the direct run rounds the total down
+    u64 limit = extra_flags ? total / 4096 * 4096 : total;
+    off_t offset = 0;
+    while (static_cast<u64>(offset) < limit) {
+        size_t chunk = std::min<u64>(buffer.size, limit - offset);
+        ssize_t result = pwrite(fd, buffer.data, chunk, offset);
+        if (result <= 0) {
+            error = std::strerror(errno);
+            close(fd);
+            return false;
+        }
+        offset += result;
+    }
+    fsync(fd);
+    close(fd);
+    return true;
+}
+#endif
+
+template <typename Func>
+IOBenchResult TimeRun(const std::string& backend, const std::string& mode, Func&& run) {
+    IOBenchResult result;
+    result.backend = backend;
+    result.mode = mode;
+
+    EnergyMeter meter;
+    meter.Start();
+    double cpu_start = GetProcessCPUSeconds();
+    auto start = std::chrono::steady_clock::now();
+    result.available = run(result.bytes, result.error);
+    auto end = std::chrono::steady_clock::now();
+    result.energy = meter.Stop();
+
+    result.wall_seconds = std::chrono::duration<double>(end - start).count();
+    result.cpu_seconds = GetProcessCPUSeconds() - cpu_start;
+    return result;
+}
+
+} // namespace
+
+std::vector<IOBenchResult> RunIOBenchmark(const IOBenchOptions& options) {
+    std::vector<IOBenchResult> results;
+
+    using ReadFunc = bool (*)(const IOBenchOptions&, BenchSink&, u64&, std::string&);
+    std::vector<std::pair<std::string, ReadFunc>> readers = {
+        {"ifstream", ReadIfstream},
+#ifndef _WIN32
+        {"pread", ReadPread},
+        {"mmap", ReadMmap},
+#endif
+#ifdef __linux__
+        {"odirect", ReadDirect},
+#endif
+    };
+
+    // Warm runs start from a populated page cache
+    if (!options.cold_cache) {
+        BenchSink sink(false, options.frame_size);
+        u64 bytes = 0;
+        std::string error;
+        ReadIfstream(options, sink, bytes, error);
+    }
+
+    for (const auto& [name, func] : readers) {
+        if (options.cold_cache) {
+            DropPageCache(options.input_file);
+        }
+        BenchSink sink(options.compress, options.frame_size);
+        results.push_back(TimeRun(name, "read", [&](u64& bytes, std::string& error) {
+            bool ok = func(options, sink, bytes, error);
+            sink.Finish();
+            return ok;
+        }));
+    }
+
+    // io_uring needs liburing, which is not a dependency of this tool
+    IOBenchResult uring;
+    uring.backend = "io_uring";
+    uring.mode = "read";
+    uring.available = false;
+    uring.error = "not built";
+    results.push_back(uring);
+
+    if (options.storage_dir.empty()) {
+        return results;
+    }
+
+    std::error_code ec;
+    u64 total = std::filesystem::file_size(options.input_file, ec);
+    std::vector<u8> pattern(options.buffer_size);
+    {
+        std::ifstream input(options.input_file, std::ios::binary);
+        input.read(reinterpret_cast<char*>(pattern.data()), pattern.size());
+    }
+    std::string scratch = (std::filesystem::path(options.storage_dir) / ".z3ds_bench_io.tmp").string();
+
+    results.push_back(TimeRun("ofstream", "write", [&](u64& bytes, std::string& error) {
+        bytes = total;
+        return WriteOfstream(scratch, pattern, total, error);
+    }));
+#ifndef _WIN32
+    results.push_back(TimeRun("pwrite", "write", [&](u64& bytes, std::string& error) {
+        bytes = total;
+        return WritePwrite(scratch, pattern, total, 0, error);
+    }));
+#endif
+#ifdef __linux__
+    results.push_back(TimeRun("odirect", "write", [&](u64& bytes, std::string& error) {
+        bytes = total / 4096 * 4096;
+        return WritePwrite(scratch, pattern, total, O_DIRECT, error);
+    }));
+#endif
+    std::filesystem::remove(scratch, ec);
+
+    return results;
+}
+
+bool RunDecodeBenchmark(const std::string& z3ds_file, int iterations, DecodeBenchResult& result) {
+    Z3DSReader reader;
+    if (!reader.Open(z3ds_file)) {
+        return false;
+    }
+    result = {};
+    result.profile = reader.GetMetadataString("profile");
+    if (result.profile.empty()) {
+        result.profile = "default";
+    }
+
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    if (reader.GetDictionary()) {
+        ZSTD_DCtx_refDDict(dctx, reader.GetDictionary());
+    }
+    std::vector<u8> compressed;
+    std::vector<u8> decompressed;
+    bool ok = true;
+
+    EnergyMeter meter;
+    meter.Start();
+    for (size_t i = 0; i < reader.GetFrames().size() && ok; ++i) {
+        const auto& info = reader.GetFrames()[i];
+        if (!reader.ReadCompressedFrame(i, compressed)) {
+            ok = false;
+            break;
+        }
+        decompressed.resize(info.decompressed_size);
+
+        DecodeBenchFrame frame;
+        frame.index = i;
+        frame.compressed_size = info.compressed_size;
+        frame.decompressed_size = info.decompressed_size;
+        for (int iter = 0; iter < std::max(1, iterations); ++iter) {
+            auto start = std::chrono::steady_clock::now();
+            size_t size = ZSTD_decompressDCtx(dctx, decompressed.data(), decompressed.size(),
+                                              compressed.data(), compressed.size());
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (ZSTD_isError(size) || size != info.decompressed_size) {
+                std::cerr << "Error: Could not decompress frame " << i << std::endl;
+                ok = false;
+                break;
+            }
+            if (iter == 0 || seconds < frame.seconds) {
+                frame.seconds = seconds;
+            }
+            result.decoded_bytes += size;
+        }
+
+        result.compressed_bytes += frame.compressed_size;
+        result.decompressed_bytes += frame.decompressed_size;
+        result.seconds += frame.seconds;
+        result.frames.push_back(frame);
+    }
+
+    result.energy = meter.Stop();
+
+    ZSTD_freeDCtx(dctx);
+    return ok;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "z3ds_compression.h"
+#include "z3ds_energy.h"
+
+// I/O backend comparison benchmark
+struct IOBenchOptions {
+    std::string input_file;
+    std::string storage_dir;           // Where write runs put their scratch file, empty to skip writes
+    size_t buffer_size = 4 * 1024 * 1024; // Buffer used by the large-buffer backends
+    bool cold_cache = false;           // Drop the page cache for the file before each run
+    bool compress = false;             // Feed read data through zstd level 3 frames
+    size_t frame_size = 1024 * 1024;   // Frame size used when compress is set
+};
+
+struct IOBenchResult {
+    std::string backend;
+    std::string mode; // "read" or "write"
+    bool available = true;
+    std::string error;
+    u64 bytes = 0;
+    double wall_seconds = 0.0;
+    double cpu_seconds = 0.0;
+    EnergyReading energy;
+
+    double MBps() const {
+        return wall_seconds > 0.0 ? bytes / wall_seconds / (1024.0 * 1024.0) : 0.0;
+    }
+};
+
+std::vector<IOBenchResult> RunIOBenchmark(const IOBenchOptions& options);
+
+// Process CPU time (user + system) in seconds
+double GetProcessCPUSeconds();
+
+// Decode speed per frame of an existing Z3DS file
+struct DecodeBenchFrame {
+    size_t index = 0;
+    u32 compressed_size = 0;
+    u32 decompressed_size = 0;
+    double seconds = 0.0; // Best of all iterations
+
+    double MBps() const {
+        return seconds > 0.0 ? decompressed_size / seconds / (1024.0 * 1024.0) : 0.0;
+    }
+    double Ratio() const {
+        return decompressed_size ? static_cast<double>(compressed_size) / decompressed_size : 0.0;
+    }
+};
+
+struct DecodeBenchResult {
+    std::string profile; // From the file metadata
+    std::vector<DecodeBenchFrame> frames;
+    u64 compressed_bytes = 0;
+    u64 decompressed_bytes = 0;
+    double seconds = 0.0;
+    u64 decoded_bytes = 0;  // Over all iterations
+    EnergyReading energy;   // Over all iterations, including reading the frames
+
+    double MBps() const {
+        return seconds > 0.0 ? decompressed_bytes / seconds / (1024.0 * 1024.0) : 0.0;
+    }
+    double Ratio() const {
+        return decompressed_bytes ? static_cast<double>(compressed_bytes) / decompressed_bytes : 0.0;
+    }
+};
+
+// Compressed frames are read up front so only decompression is timed
+bool RunDecodeBenchmark(const std::string& z3ds_file, int iterations, DecodeBenchResult& result);
@@ -0,0 +1,299 @@
+#include "z3ds.h"
+#include "z3ds_disk_cache.h"
+#include "z3ds_frame_cache.h"
+#include "z3ds_layout.h"
+#include "z3ds_reader.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <new>
+#include <sstream>
+
+struct z3ds_reader {
+    Z3DSReader reader;
+    std::mutex mutex;
+    u64 file_size = 0;
+};
+
+namespace {
+
+thread_local std::string last_error;
+
+// Messages the library printed during the current Guard call
+thread_local const std::ostringstream* library_messages = nullptr;
+
+// Never throws, so it is safe outside Guard; an error message that cannot
+// be stored leaves z3ds_last_error empty. Inside Guard, what the library
+// reported is added as the detail, e.g. "Not a readable Z3DS file: a.z3ds
+// (Header sizes run past the end of a.z3ds)".
+int Fail(int status, const char* message) noexcept {
+    try {
+        last_error = message;
+        if (library_messages) {
+            std::istringstream lines(library_messages->str());
+            std::string detail;
+            for (std::string line; std::getline(lines, line);) {
+                if (line.rfind("Error: ", 0) == 0) {
+                    line.erase(0, 7);
+                }
+                if (!line.empty()) {
+                    detail += (detail.empty() ? "" : "; ") + line;
+                }
+            }
+            if (!detail.empty()) {
+                last_error += " (" + detail + ")";
+            }
+        }
+    } catch (...) {
+        last_error.clear();
+    }
+    return status;
+}
+
+int Fail(int status, const std::string& message) noexcept {
+    return Fail(status, message.c_str());
+}
+
+// Run fn, turning any escaping exception into a status code and collecting
+// the library's messages for Fail instead of printing them
+template <typename Func>
+auto Guard(Func&& fn) -> decltype(fn()) {
+    struct Capture {
+        std::ostringstream messages;
+        ScopedErrorLog log{messages};
+        Capture() { library_messages = &messages; }
+        ~Capture() { library_messages = nullptr; }
+    };
+    try {
+        Capture capture;
+        return fn();
+    } catch (const std::bad_alloc&) {
+        return Fail(Z3DS_ERROR_OUT_OF_MEMORY, "Out of memory");
+    } catch (const std::exception& e) {
+        return Fail(Z3DS_ERROR_INTERNAL, e.what());
+    } catch (...) {
+        return Fail(Z3DS_ERROR_INTERNAL, "Unknown error");
+    }
+}
+
+} // namespace
+
+extern "C" {
+
+int z3ds_abi_version(void) {
+    return Z3DS_ABI_VERSION;
+}
+
+const char* z3ds_last_error(void) {
+    return last_error.c_str();
+}
+
+int z3ds_open(const char* path, z3ds_reader** out) {
+    if (!path || !out) {
+        return Fail(Z3DS_ERROR_INVALID_ARGUMENT, "path and out must not be NULL");
+    }
+    *out = nullptr;
+    return Guard([&]() -> int {
+        std::error_code ec;
+        u64 file_size = std::filesystem::file_size(path, ec);
+        if (ec) {
+            return Fail(Z3DS_ERROR_IO, std::string("Could not open ") + path + ": " + ec.message());
+        }
+        auto handle = std::make_unique<z3ds_reader>();
+        if (!handle->reader.Open(path)) {
+            return Fail(Z3DS_ERROR_FORMAT, std::string("Not a readable Z3DS file: ") + path);
+        }
+        handle->file_size = file_size;
+        *out = handle.release();
+        return Z3DS_OK;
+    });
+}
+
+void z3ds_close(z3ds_reader* reader) {
+    delete reader;
+}
+
+int z3ds_stat(z3ds_reader* reader, z3ds_stat_info* info) {
+    if (!reader || !info) {
+        return Fail(Z3DS_ERROR_INVALID_ARGUMENT, "reader and info must not be NULL");
+    }
+    return Guard([&]() -> int {
+        std::lock_guard lock(reader->mutex);
+        const Z3DSFileHeader& header = reader->reader.GetHeader();
+        std::memcpy(info->underlying_magic, header.underlying_magic.data(), 4);
+        info->uncompressed_size = header.uncompressed_size;
+        info->compressed_size = header.compressed_size;
+        info->file_size = reader->file_size;
+        info->frame_count = static_cast<uint32_t>(reader->reader.GetFrames().size());
+        info->max_frame_size = 0;
+        for (const auto& frame : reader->reader.GetFrames()) {
+            info->max_frame_size = std::max(info->max_frame_size, frame.decompressed_size);
+        }
+        return Z3DS_OK;
+    });
+}
+
+int64_t z3ds_read(z3ds_reader* reader, uint64_t offset, void* buffer, size_t size) {
+    z3ds_read_request request{offset, buffer, size};
+    return z3ds_readv(reader, &request, 1);
+}
+
+int64_t z3ds_readv(z3ds_reader* reader, const z3ds_read_request* requests, size_t count) {
+    if (!reader || (!requests && count > 0)) {
+        return Fail(Z3DS_ERROR_INVALID_ARGUMENT, "reader and requests must not be NULL");
+    }
+    return Guard([&]() -> int64_t {
+        std::lock_guard lock(reader->mutex);
+        u64 size = reader->reader.GetSize();
+        int64_t total = 0;
+        for (size_t i = 0; i < count; ++i) {
+            const z3ds_read_request& request = requests[i];
+            if (!request.buffer && request.size > 0) {
+                return Fail(Z3DS_ERROR_INVALID_ARGUMENT, "NULL buffer in read request");
+            }
+            size_t expected = request.offset >= size
+                ? 0 : static_cast<size_t>(std::min<u64>(request.size, size - request.offset));
+            size_t read = reader->reader.Read(request.offset, request.buffer, request.size);
+            if (read != expected) {
+                return Fail(Z3DS_ERROR_IO, "Could not read at offset " + std::to_string(request.offset));
+            }
+            total += static_cast<int64_t>(read);
+        }
+        return total;
+    });
+}
+
+int64_t z3ds_get_metadata(z3ds_reader* reader, const char* name, void* buffer, size_t size) {
+    if (!reader || !name) {
+        return Fail(Z3DS_ERROR_INVALID_ARGUMENT, "reader and name must not be NULL");
+    }
+    return Guard([&]() -> int64_t {
+        std::lock_guard lock(reader->mutex);
+        const auto& metadata = reader->reader.GetMetadata();
+        auto it = metadata.find(name);
+        if (it == metadata.end()) {
+            return Fail(Z3DS_ERROR_INVALID_ARGUMENT, std::string("No metadata item: ") + name);
+        }
+        if (buffer) {
+            std::memcpy(buffer, it->second.data(), std::min(size, it->second.size()));
+        }
+        return static_cast<int64_t>(it->second.size());
+    });
+}
+
+void z3ds_compress_options_init(z3ds_compress_options* options) {
+    if (options) {
+        *options = {};
+        options->struct_size = sizeof(z3ds_compress_options);
+    }
+}
+
+int z3ds_compress(const char* src_path, const char* dst_path, const z3ds_compress_options* options) {
+    if (!src_path || !dst_path) {
+        return Fail(Z3DS_ERROR_INVALID_ARGUMENT, "src_path and dst_path must not be NULL");
+    }
+    z3ds_compress_options defaults;
+    z3ds_compress_options_init(&defaults);
+    if (!options) {
+        options = &defaults;
+    } else if (options->struct_size != sizeof(z3ds_compress_options)) {
+        return Fail(Z3DS_ERROR_INVALID_ARGUMENT, "options were not set up with z3ds_compress_options_init");
+    } else if (options->zstd_param_count > 0 && !options->zstd_params) {
+        return Fail(Z3DS_ERROR_INVALID_ARGUMENT, "zstd_params must not be NULL when zstd_param_count is set");
+    }
+
+    return Guard([&]() -> int {
+        if (!std::filesystem::exists(src_path)) {
+            return Fail(Z3DS_ERROR_IO, std::string("Input file does not exist: ") + src_path);
+        }
+        // Profiles from the file apply to this call only
+        std::vector<CompressionProfile> file_profiles;
+        if (options->profile_file && !ParseCompressionProfiles(options->profile_file, file_profiles)) {
+            return Fail(Z3DS_ERROR_INVALID_ARGUMENT, std::string("Could not load profiles from ") + options->profile_file);
+        }
+        std::string profile_name = options->profile ? options->profile : "default";
+        auto file_profile = std::find_if(file_profiles.begin(), file_profiles.end(),
+                                         [&](const CompressionProfile& p) { return p.name == profile_name; });
+        auto profile = file_profile != file_profiles.end() ? std::optional(*file_profile)
+                                                           : FindCompressionProfile(profile_name);
+        if (!profile) {
+            return Fail(Z3DS_ERROR_INVALID_ARGUMENT, "Unknown profile: " + profile_name);
+        }
+        for (size_t i = 0; i < options->zstd_param_count; ++i) {
+            std::string param = options->zstd_params[i] ? options->zstd_params[i] : "";
+            size_t equals = param.find('=');
+            std::string error = "expected KEY=VALUE: " + param;
+            if (equals == std::string::npos ||
+                !SetCompressionParameter(*profile, param.substr(0, equals), param.substr(equals + 1), error)) {
+                return Fail(Z3DS_ERROR_INVALID_ARGUMENT, "zstd parameter " + error);
+            }
+        }
+        std::string profile_error;
+        if (!ValidateCompressionProfile(*profile, profile_error)) {
+            return Fail(Z3DS_ERROR_INVALID_ARGUMENT, profile_error);
+        }
+
+        std::optional<RegionPolicy> region_policy;
+        if (options->use_regions) {
+            region_policy = MakeDefaultRegionPolicy(*profile);
+        }
+
+        auto magic = DetectFileMagic(src_path);
+        size_t frame_size = static_cast<size_t>(options->frame_size);
+        if (frame_size == 0) {
+            frame_size = profile->frame_size ? profile->frame_size : GetDefaultFrameSize(magic);
+        }
+
+        ProgressCallback progress;
+        if (options->progress) {
+            progress = [options](size_t processed, size_t total) {
+                options->progress(processed, total, options->user_data);
+            };
+        }
+        if (!CompressZ3DSFile(src_path, dst_path, magic, frame_size, progress, {}, nullptr, *profile,
+                              region_policy ? &*region_policy : nullptr)) {
+            return Fail(Z3DS_ERROR_IO, std::string("Compression failed: ") + src_path);
+        }
+        return Z3DS_OK;
+    });
+}
+
+void z3ds_set_cache_budget(uint64_t bytes) {
+    FrameCache::Instance().SetBudget(bytes);
+}
+
+int z3ds_cache_stats(z3ds_reader* reader, z3ds_cache_stats_info* stats) {
+    if (!stats) {
+        return Fail(Z3DS_ERROR_INVALID_ARGUMENT, "stats must not be NULL");
+    }
+    return Guard([&]() -> int {
+        FrameCache& cache = FrameCache::Instance();
+        FrameCache::Stats totals = cache.GetStats();
+        *stats = {};
+        stats->budget_bytes = totals.budget_bytes;
+        stats->used_bytes = totals.used_bytes;
+        stats->hits = totals.hits;
+        stats->misses = totals.misses;
+        stats->evictions = totals.evictions;
+        stats->frames = totals.frames;
+        DiskFrameCache::Stats disk = DiskFrameCache::Instance().GetStats();
+        stats->disk_capacity_bytes = disk.capacity_bytes;
+        stats->disk_used_bytes = disk.used_bytes;
+        stats->disk_hits = disk.hits;
+        stats->disk_misses = disk.misses;
+        stats->disk_writes = disk.writes;
+        stats->disk_dropped_writes = disk.dropped_writes;
+        stats->disk_frames = disk.frames;
+        if (reader) {
+            std::lock_guard lock(reader->mutex);
+            FrameCache::FileStats file = cache.GetFileStats(reader->reader.GetFileId());
+            stats->file_hits = file.hits;
+            stats->file_misses = file.misses;
+            stats->file_resident_bytes = file.resident_bytes;
+        }
+        return Z3DS_OK;
+    });
+}
+
+} // extern "C"
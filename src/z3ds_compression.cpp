@@ -1,15 +1,47 @@
 #include "z3ds_compression.h"
+#include "z3ds_disk_cache.h"
+#include "z3ds_frame_cache.h"
+#include "z3ds_layout.h"
+#include "z3ds_media_matcher.h"
 #include <fstream>
 #include <iostream>
 #include <chrono>
 #include <iomanip>
 #include <sstream>
 #include <algorithm>
+#include <limits>
 #include <cstring>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#define ZSTD_STATIC_LINKING_ONLY // ZSTD_c_literalCompressionMode, ZSTD_cParam_getBounds ranges
 #include <zstd.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
 // XXH64 implementation to match ZSTD seekable format specification
-static u64 XXH64(const void* data, size_t len, u64 seed = 0) {
+namespace {
+thread_local std::ostream* error_log = nullptr;
+}
+
+std::ostream& ErrorLog() {
+    return error_log ? *error_log : std::cerr;
+}
+
+ScopedErrorLog::ScopedErrorLog(std::ostream& stream) : previous(error_log) {
+    error_log = &stream;
+}
+
+ScopedErrorLog::~ScopedErrorLog() {
+    error_log = previous;
+}
+
+u64 XXH64(const void* data, size_t len, u64 seed) {
     const u8* p = static_cast<const u8*>(data);
     const u8* const end = p + len;
     u64 h64;
@@ -148,27 +180,64 @@ std::vector<u8> Z3DSMetadata::AsBinary() const {
     return std::vector<u8>(out_str.begin(), out_str.end());
 }
 
+bool Z3DSMetadata::Parse(const u8* data, size_t size,
+                         std::unordered_map<std::string, std::vector<u8>>& out) {
+    if (size == 0) {
+        return true; // No metadata
+    }
+    if (data[0] != METADATA_VERSION) {
+        return false;
+    }
+    
+    size_t pos = 1;
+    while (pos + sizeof(Item) <= size) {
+        Item item{
+            .type = static_cast<Item::Type>(data[pos]),
+            .name_len = data[pos + 1],
+            .data_len = static_cast<u16>(data[pos + 2] | (data[pos + 3] << 8)),
+        };
+        pos += sizeof(Item);
+        
+        if (item.type == Item::TYPE_END) {
+            return true;
+        }
+        if (pos + item.name_len + item.data_len > size) {
+            return false;
+        }
+        
+        std::string name(reinterpret_cast<const char*>(data + pos), item.name_len);
+        pos += item.name_len;
+        out[name] = std::vector<u8>(data + pos, data + pos + item.data_len);
+        pos += item.data_len;
+    }
+    
+    return false; // Missing end item
+}
+
 std::array<u8, 4> DetectFileMagic(const std::string& filename) {
     std::ifstream file(filename, std::ios::binary);
     if (!file.is_open()) {
         return {'U', 'N', 'K', 'N'}; // Unknown
     }
     
+    u8 start[0x104];
+    file.read(reinterpret_cast<char*>(start), sizeof(start));
+    return DetectDataMagic(start, static_cast<size_t>(file.gcount()), filename);
+}
+
+std::array<u8, 4> DetectDataMagic(const u8* data, size_t size, const std::string& filename) {
     // First check for 3DSX format (magic at start)
     std::array<u8, 4> magic{};
-    file.read(reinterpret_cast<char*>(magic.data()), 4);
-    
-    if (file.gcount() >= 4) {
+    if (size >= 4) {
+        std::memcpy(magic.data(), data, 4);
         if (magic == std::array<u8, 4>{'3', 'D', 'S', 'X'}) {
             return magic;
         }
     }
     
     // Check for NCCH format (CXI) - magic at offset 0x100
-    file.seekg(0x100, std::ios::beg);
-    file.read(reinterpret_cast<char*>(magic.data()), 4);
-    
-    if (file.gcount() >= 4) {
+    if (size >= 0x104) {
+        std::memcpy(magic.data(), data + 0x100, 4);
         if (magic == std::array<u8, 4>{'N', 'C', 'C', 'H'}) {
             return magic;
         }
@@ -179,14 +248,12 @@ std::array<u8, 4> DetectFileMagic(const std::string& filename) {
     
     // Check for CIA files - they don't have a standard magic, try to detect by structure
     // CIA files start with a certificate chain, we can check for ASN.1 structure
-    file.seekg(0x00, std::ios::beg);
-    file.read(reinterpret_cast<char*>(magic.data()), 4);
-    
-    if (file.gcount() >= 4) {
+    if (size >= 4) {
         // CIA files often start with 0x30 (ASN.1 SEQUENCE) for certificate
-        if (magic[0] == 0x30) {
+        if (data[0] == 0x30) {
             // Additional heuristic: check file extension
-            std::string ext = filename.substr(filename.find_last_of('.'));
+            size_t dot = filename.find_last_of('.');
+            std::string ext = dot == std::string::npos ? "" : filename.substr(dot);
             std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
             if (ext == ".cia") {
                 return {'N', 'C', 'S', 'D'}; // Treat CIA as NCSD for frame size purposes
@@ -215,6 +282,310 @@ std::string GetCurrentTimeISO() {
     return ss.str();
 }
 
+namespace {
+
+// zstd parameters that profiles can set, by their zstd names
+struct ProfileParameter {
+    const char* name;
+    ZSTD_cParameter param;
+    int CompressionProfile::*field;
+};
+
+const ProfileParameter PROFILE_PARAMETERS[] = {
+    {"level", ZSTD_c_compressionLevel, &CompressionProfile::level},
+    {"windowLog", ZSTD_c_windowLog, &CompressionProfile::window_log},
+    {"hashLog", ZSTD_c_hashLog, &CompressionProfile::hash_log},
+    {"chainLog", ZSTD_c_chainLog, &CompressionProfile::chain_log},
+    {"searchLog", ZSTD_c_searchLog, &CompressionProfile::search_log},
+    {"minMatch", ZSTD_c_minMatch, &CompressionProfile::min_match},
+    {"targetLength", ZSTD_c_targetLength, &CompressionProfile::target_length},
+    {"strategy", ZSTD_c_strategy, &CompressionProfile::strategy},
+};
+
+const char* STRATEGY_NAMES[] = {
+    nullptr, "fast", "dfast", "greedy", "lazy", "lazy2", "btlazy2", "btopt", "btultra", "btultra2",
+};
+
+std::vector<CompressionProfile>& LoadedProfiles() {
+    static std::vector<CompressionProfile> profiles;
+    return profiles;
+}
+
+std::mutex& LoadedProfilesMutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::string Trim(const std::string& str) {
+    size_t begin = str.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) {
+        return {};
+    }
+    size_t end = str.find_last_not_of(" \t\r");
+    return str.substr(begin, end - begin + 1);
+}
+
+} // namespace
+
+std::optional<CompressionProfile> FindCompressionProfile(const std::string& name) {
+    {
+        std::lock_guard lock(LoadedProfilesMutex());
+        for (const auto& profile : LoadedProfiles()) {
+            if (profile.name == name) {
+                return profile;
+            }
+        }
+    }
+    
+    static const std::vector<CompressionProfile> builtin_profiles = {
+        CompressionProfile{},
+        // Fewer, longer matches within a 1MB window and raw literals keep the
+        // decoder out of Huffman decoding; small frames bound seek latency.
+        CompressionProfile{
+            .name = "decode-fast",
+            .level = 3,
+            .strategy = ZSTD_dfast,
+            .window_log = 20,
+            .min_match = 6,
+            .raw_literals = true,
+            .frame_size = 1024 * 1024,
+        },
+        CompressionProfile{
+            .name = "raw",
+            .store_raw = true,
+        },
+        // Smallest output for rarely read titles, at a fraction of the
+        // compression speed
+        CompressionProfile{
+            .name = "archive",
+            .level = 19,
+            .frame_size = 32 * 1024 * 1024,
+        },
+    };
+    
+    for (const auto& profile : builtin_profiles) {
+        if (profile.name == name) {
+            return profile;
+        }
+    }
+    return std::nullopt;
+}
+
+bool SetCompressionParameter(CompressionProfile& profile, const std::string& name,
+                             const std::string& value, std::string& error) {
+    bool CompressionProfile::* flag = name == "rawLiterals" ? &CompressionProfile::raw_literals
+                                    : name == "mediaUnitMatcher" ? &CompressionProfile::media_unit_matcher
+                                    : name == "frontIndex" ? &CompressionProfile::front_index
+                                    : nullptr;
+    if (flag) {
+        if (value == "1" || value == "true") {
+            profile.*flag = true;
+        } else if (value == "0" || value == "false") {
+            profile.*flag = false;
+        } else {
+            error = "invalid value for " + name + ": " + value + " (expected 0, 1, true or false)";
+            return false;
+        }
+        return true;
+    }
+    
+    try {
+        if (name == "frameSize") {
+            profile.frame_size = std::stoull(value);
+            return true;
+        }
+        for (const auto& param : PROFILE_PARAMETERS) {
+            if (name != param.name) {
+                continue;
+            }
+            int parsed = 0;
+            bool named_strategy = false;
+            if (param.param == ZSTD_c_strategy) {
+                for (int i = 1; i < static_cast<int>(std::size(STRATEGY_NAMES)); ++i) {
+                    if (value == STRATEGY_NAMES[i]) {
+                        parsed = i;
+                        named_strategy = true;
+                    }
+                }
+            }
+            if (!named_strategy) {
+                parsed = std::stoi(value);
+            }
+            profile.*param.field = parsed;
+            return true;
+        }
+    } catch (const std::exception&) {
+        error = "invalid value for " + name + ": " + value;
+        return false;
+    }
+    
+    error = "unknown zstd parameter: " + name;
+    return false;
+}
+
+bool ValidateCompressionProfile(const CompressionProfile& profile, std::string& error) {
+    for (const auto& param : PROFILE_PARAMETERS) {
+        int value = profile.*param.field;
+        // Zero means "derive from level"; the level itself may be zero or negative
+        if (value == 0 && param.param != ZSTD_c_compressionLevel) {
+            continue;
+        }
+        ZSTD_bounds bounds = ZSTD_cParam_getBounds(param.param);
+        if (ZSTD_isError(bounds.error)) {
+            error = std::string("cannot query bounds of ") + param.name;
+            return false;
+        }
+        if (value < bounds.lowerBound || value > bounds.upperBound) {
+            error = std::string(param.name) + "=" + std::to_string(value) + " outside [" +
+                    std::to_string(bounds.lowerBound) + ", " + std::to_string(bounds.upperBound) + "]";
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string DescribeCompressionProfile(const CompressionProfile& profile) {
+    if (profile.store_raw) {
+        return "raw";
+    }
+    std::string description;
+    for (const auto& param : PROFILE_PARAMETERS) {
+        int value = profile.*param.field;
+        if (value == 0 && param.param != ZSTD_c_compressionLevel) {
+            continue;
+        }
+        if (!description.empty()) {
+            description += ",";
+        }
+        description += std::string(param.name) + "=" + std::to_string(value);
+    }
+    if (profile.raw_literals) {
+        description += ",rawLiterals=1";
+    }
+    if (profile.media_unit_matcher) {
+        description += ",mediaUnitMatcher=1";
+    }
+    if (!profile.dictionary.empty()) {
+        description += ",dictID=" + std::to_string(ZSTD_getDictID_fromDict(profile.dictionary.data(),
+                                                                           profile.dictionary.size()));
+    }
+    return description;
+}
+
+bool LoadCompressionProfiles(const std::string& filename) {
+    std::vector<CompressionProfile> profiles;
+    if (!ParseCompressionProfiles(filename, profiles)) {
+        return false;
+    }
+    std::lock_guard lock(LoadedProfilesMutex());
+    auto& loaded = LoadedProfiles();
+    loaded.insert(loaded.begin(), profiles.begin(), profiles.end());
+    return true;
+}
+
+bool ParseCompressionProfiles(const std::string& filename, std::vector<CompressionProfile>& profiles) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        ErrorLog() << "Error: Could not open profile file: " << filename << std::endl;
+        return false;
+    }
+    
+    profiles.clear();
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        ++line_number;
+        line = Trim(line.substr(0, line.find_first_of("#;")));
+        if (line.empty()) {
+            continue;
+        }
+        
+        if (line.front() == '[' && line.back() == ']') {
+            CompressionProfile profile;
+            profile.name = Trim(line.substr(1, line.size() - 2));
+            profiles.push_back(profile);
+            continue;
+        }
+        
+        size_t equals = line.find('=');
+        std::string error;
+        if (profiles.empty() || equals == std::string::npos) {
+            error = "expected [name] or key = value";
+        } else if (SetCompressionParameter(profiles.back(), Trim(line.substr(0, equals)),
+                                           Trim(line.substr(equals + 1)), error)) {
+            continue;
+        }
+        ErrorLog() << "Error: " << filename << ":" << line_number << ": " << error << std::endl;
+        return false;
+    }
+    
+    for (const auto& profile : profiles) {
+        std::string error;
+        if (!ValidateCompressionProfile(profile, error)) {
+            ErrorLog() << "Error: Profile " << profile.name << " in " << filename << ": " << error << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Apply profile parameters to a compression context
+static bool ApplyCompressionProfile(ZSTD_CCtx* cctx, const CompressionProfile& profile) {
+    std::string error;
+    if (!ValidateCompressionProfile(profile, error)) {
+        ErrorLog() << "Error: Invalid zstd parameters: " << error << std::endl;
+        return false;
+    }
+    
+    for (const auto& param : PROFILE_PARAMETERS) {
+        int value = profile.*param.field;
+        if (value == 0 && param.param != ZSTD_c_compressionLevel) {
+            continue;
+        }
+        size_t result = ZSTD_CCtx_setParameter(cctx, param.param, value);
+        if (ZSTD_isError(result)) {
+            ErrorLog() << "Error: Could not set " << param.name << "=" << value << ": "
+                      << ZSTD_getErrorName(result) << std::endl;
+            return false;
+        }
+    }
+    if (profile.raw_literals) {
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_literalCompressionMode, ZSTD_ps_disable);
+    }
+    if (profile.media_unit_matcher && !EnableMediaUnitMatcher(cctx, error)) {
+        ErrorLog() << "Error: " << error << std::endl;
+        return false;
+    }
+    if (!profile.dictionary.empty()) {
+        size_t result = ZSTD_CCtx_loadDictionary(cctx, profile.dictionary.data(), profile.dictionary.size());
+        if (ZSTD_isError(result)) {
+            ErrorLog() << "Error: Could not load dictionary: " << ZSTD_getErrorName(result) << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+u64 GetPeakRSS() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (!K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<u64>(usage.ru_maxrss); // Already in bytes
+#else
+    return static_cast<u64>(usage.ru_maxrss) * 1024; // Kilobytes on Linux
+#endif
+#endif
+}
+
 // Proper seekable ZSTD compression implementation
 class SeekableZSTDCompressor {
 private:
@@ -224,17 +595,21 @@ private:
         u32 checksum; // XXH64 lower 32 bits
     };
     
-    std::ofstream& output;
+    std::ostream& output;
     size_t frame_size;
     ZSTD_CCtx* cctx;
     std::vector<u8> frame_buffer;
+    std::vector<u8> compressed_buffer;
     size_t current_frame_pos;
     u64 total_compressed;
     std::vector<SeekEntry> seek_entries;
+    std::vector<u8> seek_table;
     bool use_checksums;
+    bool store_raw = false;
+    size_t peak_context_size = 0;
     
 public:
-    SeekableZSTDCompressor(std::ofstream& out, size_t frame_sz, bool checksums = true) 
+    SeekableZSTDCompressor(std::ostream& out, size_t frame_sz, bool checksums = true) 
         : output(out), frame_size(frame_sz), current_frame_pos(0), total_compressed(0), use_checksums(checksums) {
         cctx = ZSTD_createCCtx();
         frame_buffer.reserve(frame_size);
@@ -242,6 +617,18 @@ public:
         ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, 3);
     }
     
+    // Only valid between frames
+    bool SetProfile(const CompressionProfile& profile) {
+        store_raw = profile.store_raw;
+        ZSTD_CCtx_reset(cctx, ZSTD_reset_session_and_parameters);
+        return ApplyCompressionProfile(cctx, profile);
+    }
+    
+    // End the current frame early, e.g. at a region boundary
+    bool EndFrame() {
+        return FlushFrame();
+    }
+    
     ~SeekableZSTDCompressor() {
         if (cctx) {
             ZSTD_freeCCtx(cctx);
@@ -288,10 +675,61 @@ public:
         return total_compressed;
     }
     
+    // Skippable frame written by Finish
+    const std::vector<u8>& GetSeekTable() const {
+        return seek_table;
+    }
+    
     size_t GetFrameCount() const {
         return seek_entries.size();
     }
     
+    size_t GetBufferMemory() const {
+        return frame_buffer.capacity() + compressed_buffer.capacity();
+    }
+    
+    size_t GetContextMemory() const {
+        return std::max(peak_context_size, ZSTD_sizeof_CCtx(cctx));
+    }
+    
+    // Append a frame compressed elsewhere; only valid between frames
+    bool WriteFrame(const u8* compressed, size_t compressed_size, u32 decompressed_size, u32 checksum) {
+        output.write(reinterpret_cast<const char*>(compressed), compressed_size);
+        if (!output.good()) {
+            return false;
+        }
+        seek_entries.push_back({static_cast<u32>(compressed_size), decompressed_size,
+                                use_checksums ? checksum : 0});
+        total_compressed += compressed_size;
+        return true;
+    }
+    
+    // A zstd frame made of raw blocks: single-segment header with a 4-byte
+    // content size, then blocks of at most 128KB. The output never exceeds
+    // ZSTD_compressBound for the same input.
+    static size_t WriteRawFrame(u8* dst, const u8* src, size_t size) {
+        u8* out = dst;
+        auto put_le = [&](u64 value, int bytes) {
+            for (int i = 0; i < bytes; ++i) {
+                *out++ = static_cast<u8>(value >> (8 * i));
+            }
+        };
+        put_le(ZSTD_MAGICNUMBER, 4);
+        *out++ = 0xA0; // Frame_Content_Size_flag = 2 (4 bytes), Single_Segment_flag
+        put_le(size, 4);
+        
+        size_t pos = 0;
+        do {
+            size_t block = std::min<size_t>(size - pos, ZSTD_BLOCKSIZE_MAX);
+            bool last = pos + block == size;
+            put_le((block << 3) | last, 3); // Block_Type 0 = Raw_Block
+            std::memcpy(out, src + pos, block);
+            out += block;
+            pos += block;
+        } while (pos < size);
+        return out - dst;
+    }
+    
 private:
     bool FlushFrame() {
         if (frame_buffer.empty()) {
@@ -305,36 +743,30 @@ private:
             checksum = static_cast<u32>(hash & 0xFFFFFFFF);
         }
         
-        // Compress the frame
+        // Compress the frame, reusing the output buffer between frames
         size_t const compressed_bound = ZSTD_compressBound(frame_buffer.size());
-        std::vector<u8> compressed_buffer(compressed_bound);
+        if (compressed_buffer.size() < compressed_bound) {
+            compressed_buffer.resize(compressed_bound);
+        }
         
-        size_t compressed_size = ZSTD_compressCCtx(cctx, 
-            compressed_buffer.data(), compressed_buffer.size(),
-            frame_buffer.data(), frame_buffer.size(),
-            3); // Compression level 3
+        // Uses the parameters set on the context (level 3 unless a profile is set)
+        size_t compressed_size = store_raw
+            ? WriteRawFrame(compressed_buffer.data(), frame_buffer.data(), frame_buffer.size())
+            : ZSTD_compress2(cctx,
+                  compressed_buffer.data(), compressed_buffer.size(),
+                  frame_buffer.data(), frame_buffer.size());
             
         if (ZSTD_isError(compressed_size)) {
-            std::cerr << "Compression error: " << ZSTD_getErrorName(compressed_size) << std::endl;
+            ErrorLog() << "Compression error: " << ZSTD_getErrorName(compressed_size) << std::endl;
             return false;
         }
+        peak_context_size = std::max(peak_context_size, ZSTD_sizeof_CCtx(cctx));
         
-        // Write compressed frame
-        output.write(reinterpret_cast<const char*>(compressed_buffer.data()), compressed_size);
-        if (!output.good()) {
+        // Write compressed frame and record its seek entry
+        if (!WriteFrame(compressed_buffer.data(), compressed_size, static_cast<u32>(frame_buffer.size()), checksum)) {
             return false;
         }
         
-        // Record seek entry
-        SeekEntry entry{
-            .compressed_size = static_cast<u32>(compressed_size),
-            .decompressed_size = static_cast<u32>(frame_buffer.size()),
-            .checksum = checksum
-        };
-        seek_entries.push_back(entry);
-        
-        total_compressed += compressed_size;
-        
         // Reset frame buffer
         frame_buffer.clear();
         current_frame_pos = 0;
@@ -351,15 +783,14 @@ private:
         size_t entry_size = use_checksums ? 12 : 8; // 4+4+4 or 4+4 bytes per entry
         size_t table_size = seek_entries.size() * entry_size + 9; // +9 for footer
         
-        // Helper function to write little-endian values
+        // Helper function to append little-endian values
+        seek_table.clear();
+        seek_table.reserve(8 + table_size);
         auto write_le32 = [&](u32 value) {
-            u8 bytes[4] = {
-                static_cast<u8>(value & 0xFF),
-                static_cast<u8>((value >> 8) & 0xFF),
-                static_cast<u8>((value >> 16) & 0xFF),
-                static_cast<u8>((value >> 24) & 0xFF)
-            };
-            output.write(reinterpret_cast<const char*>(bytes), 4);
+            seek_table.push_back(static_cast<u8>(value & 0xFF));
+            seek_table.push_back(static_cast<u8>((value >> 8) & 0xFF));
+            seek_table.push_back(static_cast<u8>((value >> 16) & 0xFF));
+            seek_table.push_back(static_cast<u8>((value >> 24) & 0xFF));
         };
         
         // Write skippable frame header (little-endian)
@@ -384,11 +815,12 @@ private:
         u32 seekable_magic = 0x8F92EAB1; // Seekable ZSTD magic
         
         write_le32(num_frames);
-        output.write(reinterpret_cast<const char*>(&descriptor), 1);
+        seek_table.push_back(descriptor);
         write_le32(seekable_magic);
         
+        output.write(reinterpret_cast<const char*>(seek_table.data()), seek_table.size());
         if (!output.good()) {
-            std::cerr << "Error writing seek table" << std::endl;
+            ErrorLog() << "Error writing seek table" << std::endl;
             return false;
         }
         
@@ -397,29 +829,459 @@ private:
     }
 };
 
+namespace {
+
+// One output frame in anytime compression and the best result found for it
+struct AnytimeFrame {
+    u64 offset;
+    u32 size;
+    const CompressionProfile* profile;
+    size_t segment;
+    u32 checksum = 0;
+    std::vector<u8> best;     // Released once the frame is written
+    int level = -1;           // Level of `best`, 0 for a raw frame, -1 before the fast pass
+    size_t attempted = 0;     // Ladder step of the last attempt
+    double gain_factor = 1.0; // This frame's last saving relative to the average
+    double seconds = 0.0;     // All attempts
+    bool busy = false;
+    bool done = false;        // Nothing more to try
+};
+
+// Receives each frame once its result is final, in frame order
+using AnytimeSink = std::function<bool(const AnytimeFrame& frame)>;
+
+// Rough single-thread speeds until measurements replace them
+double PriorMBps(int level) {
+    if (level <= 1) return 400.0;
+    if (level <= 3) return 250.0;
+    if (level <= 6) return 100.0;
+    if (level <= 9) return 60.0;
+    if (level <= 12) return 30.0;
+    if (level <= 15) return 12.0;
+    if (level <= 17) return 6.0;
+    if (level <= 19) return 3.0;
+    return 1.5;
+}
+
+// Compress one frame, fed in pieces so that an attempt past `stop` can be
+// abandoned part way; `stopped` tells that apart from an error
+bool CompressFrameUntil(ZSTD_CCtx* cctx, const CompressionProfile& profile, const u8* src, size_t size,
+                        std::vector<u8>& out, std::chrono::steady_clock::time_point stop, bool& stopped) {
+    constexpr size_t PIECE = 256 * 1024;
+    stopped = false;
+    ZSTD_CCtx_reset(cctx, ZSTD_reset_session_and_parameters);
+    if (!ApplyCompressionProfile(cctx, profile)) {
+        return false;
+    }
+    ZSTD_CCtx_setPledgedSrcSize(cctx, size);
+    out.resize(ZSTD_compressBound(size));
+    ZSTD_outBuffer output{out.data(), out.size(), 0};
+    size_t pos = 0;
+    do {
+        size_t piece = std::min(PIECE, size - pos);
+        bool last = pos + piece == size;
+        ZSTD_inBuffer input{src + pos, piece, 0};
+        size_t remaining;
+        do {
+            remaining = ZSTD_compressStream2(cctx, &output, &input, last ? ZSTD_e_end : ZSTD_e_continue);
+            if (ZSTD_isError(remaining)) {
+                ErrorLog() << "Compression error: " << ZSTD_getErrorName(remaining) << std::endl;
+                return false;
+            }
+        } while (last ? remaining != 0 : input.pos < input.size);
+        pos += piece;
+        if (!last && std::chrono::steady_clock::now() >= stop) {
+            stopped = true;
+            return false;
+        }
+    } while (pos < size);
+    out.resize(output.pos);
+    return true;
+}
+
+struct AnytimeMemory {
+    u64 buffer_bytes = 0;
+    u64 context_bytes = 0;
+};
+
+bool CompressFramesAnytime(std::istream& input, std::vector<AnytimeFrame>& frames, const DeadlineOptions& options,
+                           std::chrono::steady_clock::time_point start, ProgressCallback update_callback,
+                           u64 total_size, const AnytimeSink& sink, AnytimeMemory& memory) {
+    using Clock = std::chrono::steady_clock;
+    constexpr double MiB = 1024.0 * 1024.0;
+    if (options.seconds <= 0.0 || options.fast_level < 1 || options.max_level < options.fast_level ||
+        options.max_level > ZSTD_maxCLevel()) {
+        ErrorLog() << "Error: Invalid deadline options (levels must be 1 to " << ZSTD_maxCLevel() << ")" << std::endl;
+        return false;
+    }
+    const Clock::time_point hard_stop = start + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options.seconds));
+
+    // Levels tried after the fast pass, in order
+    std::vector<int> ladder = {options.fast_level};
+    for (int level : {3, 6, 9, 12, 15, 17, 19, 22}) {
+        if (level > ladder.back() && level <= options.max_level) {
+            ladder.push_back(level);
+        }
+    }
+    if (ladder.back() < options.max_level) {
+        ladder.push_back(options.max_level);
+    }
+    std::vector<double> mbps;
+    std::vector<double> gain(ladder.size(), 0.03); // Expected relative saving of each step
+    for (int level : ladder) {
+        mbps.push_back(PriorMBps(level));
+    }
+
+    std::mutex mutex;
+    std::mutex input_mutex;
+    std::mutex write_mutex;
+    std::atomic<u64> held{0}; // Results not written yet; read without the lock by soft_stop
+    u64 held_peak = 0;
+    u64 context_peak = 0;
+    u64 processed = 0;
+    size_t completed = 0;
+    size_t next_write = 0;
+    bool failed = false;
+
+    // Leave time to write what has been produced
+    auto soft_stop = [&] {
+        return hard_stop - std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(held / (256.0 * MiB)));
+    };
+    auto read_frame = [&](const AnytimeFrame& frame, std::vector<u8>& data) {
+        std::lock_guard lock(input_mutex);
+        data.resize(frame.size);
+        input.clear();
+        input.seekg(frame.offset);
+        input.read(reinterpret_cast<char*>(data.data()), frame.size);
+        return input.gcount() == static_cast<std::streamsize>(frame.size);
+    };
+    // Hand the finished frames at the front to the sink. Over the memory
+    // limit, or with `all`, frames that could still improve are committed
+    // too. Called and returns with `lock` held; the writes happen without it,
+    // in order because write_mutex is taken before it is released
+    auto flush = [&](std::unique_lock<std::mutex>& lock, bool all) {
+        if (failed) {
+            return;
+        }
+        std::vector<AnytimeFrame*> ready;
+        u64 pending = held;
+        while (next_write < frames.size()) {
+            AnytimeFrame& frame = frames[next_write];
+            if (frame.level < 0 || frame.busy ||
+                (!frame.done && !all && pending <= options.memory_limit)) {
+                break;
+            }
+            frame.done = true;
+            pending -= frame.best.size();
+            ready.push_back(&frame);
+            ++next_write;
+        }
+        if (ready.empty()) {
+            return;
+        }
+        std::unique_lock write_lock(write_mutex);
+        lock.unlock();
+        bool ok = true;
+        for (AnytimeFrame* frame : ready) {
+            ok = ok && sink(*frame);
+            held -= frame->best.size();
+            std::vector<u8>().swap(frame->best);
+        }
+        write_lock.unlock();
+        lock.lock();
+        failed = failed || !ok;
+    };
+
+    unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::min<size_t>(threads, frames.size()));
+    std::atomic<size_t> next{0};
+
+    auto worker = [&] {
+        ZSTD_CCtx* cctx = ZSTD_createCCtx();
+        std::vector<u8> data;
+        std::vector<u8> compressed;
+        bool stopped = false;
+
+        // Fast pass: every frame gets a result, raw once the deadline has passed
+        for (size_t i = next++; i < frames.size(); i = next++) {
+            AnytimeFrame& frame = frames[i];
+            if (!read_frame(frame, data)) {
+                std::lock_guard lock(mutex);
+                failed = true;
+                break;
+            }
+            frame.checksum = static_cast<u32>(XXH64(data.data(), data.size()));
+            auto begin = Clock::now();
+            bool raw = frame.profile->store_raw || begin >= soft_stop();
+            if (!raw) {
+                CompressionProfile profile = *frame.profile;
+                profile.level = ladder[0];
+                if (!CompressFrameUntil(cctx, profile, data.data(), data.size(), compressed, soft_stop(), stopped)) {
+                    if (!stopped) {
+                        std::lock_guard lock(mutex);
+                        failed = true;
+                        break;
+                    }
+                    // Out of time part way: store this one as it is
+                    raw = true;
+                }
+            }
+            if (raw) {
+                compressed.resize(ZSTD_compressBound(data.size()));
+                compressed.resize(SeekableZSTDCompressor::WriteRawFrame(compressed.data(), data.data(), data.size()));
+            }
+            double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+
+            std::unique_lock lock(mutex);
+            frame.best.swap(compressed);
+            frame.level = raw ? 0 : ladder[0];
+            frame.seconds = seconds;
+            // Nearly incompressible frames rarely improve at higher levels
+            frame.done = raw || ladder.size() == 1;
+            frame.gain_factor = frame.best.size() >= frame.size * 0.98 ? 0.05 : 1.0;
+            if (!raw && seconds > 0.0) {
+                mbps[0] = 0.7 * mbps[0] + 0.3 * (frame.size / MiB / seconds);
+            }
+            held += frame.best.size();
+            held_peak = std::max<u64>(held_peak, held);
+            processed += frame.size;
+            ++completed;
+            if (update_callback) {
+                update_callback(processed, total_size);
+            }
+            flush(lock, false);
+        }
+
+        // Recompression: the attempt with the largest expected saving per
+        // second that still fits before the deadline
+        std::unique_lock lock(mutex);
+        context_peak = std::max<u64>(context_peak, ZSTD_sizeof_CCtx(cctx));
+        while (!failed) {
+            // Other workers may still be in the fast pass
+            if (completed < frames.size()) {
+                lock.unlock();
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                lock.lock();
+                continue;
+            }
+            Clock::time_point stop = soft_stop();
+            Clock::time_point now = Clock::now();
+            AnytimeFrame* chosen = nullptr;
+            double chosen_rate = 0.0;
+            for (auto& frame : frames) {
+                if (frame.busy || frame.done) {
+                    continue;
+                }
+                size_t step = frame.attempted + 1;
+                double seconds = frame.size / MiB / mbps[step];
+                if (now + std::chrono::duration_cast<Clock::duration>(
+                        std::chrono::duration<double>(seconds * 1.2)) > stop) {
+                    continue;
+                }
+                double rate = frame.best.size() * gain[step] * frame.gain_factor / seconds;
+                if (!chosen || rate > chosen_rate) {
+                    chosen = &frame;
+                    chosen_rate = rate;
+                }
+            }
+            if (!chosen) {
+                break;
+            }
+            AnytimeFrame& frame = *chosen;
+            frame.busy = true;
+            size_t step = frame.attempted + 1;
+            CompressionProfile profile = *frame.profile;
+            profile.level = ladder[step];
+            lock.unlock();
+
+            bool read = read_frame(frame, data);
+            auto begin = Clock::now();
+            bool ok = read && CompressFrameUntil(cctx, profile, data.data(), data.size(), compressed, stop, stopped);
+            double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+
+            lock.lock();
+            context_peak = std::max<u64>(context_peak, ZSTD_sizeof_CCtx(cctx));
+            frame.busy = false;
+            frame.seconds += seconds;
+            if (!ok) {
+                if (!read || !stopped) {
+                    failed = true;
+                    break;
+                }
+                // Out of time for this one; nothing later will fit either
+                frame.done = true;
+                flush(lock, false);
+                continue;
+            }
+            frame.attempted = step;
+            mbps[step] = 0.7 * mbps[step] + 0.3 * (frame.size / MiB / std::max(seconds, 1e-6));
+            double saving = frame.best.size() > compressed.size()
+                ? static_cast<double>(frame.best.size() - compressed.size()) / frame.best.size() : 0.0;
+            frame.gain_factor = std::clamp(saving / gain[step], 0.0, 4.0);
+            gain[step] = 0.7 * gain[step] + 0.3 * saving;
+            if (compressed.size() < frame.best.size()) {
+                held -= frame.best.size() - compressed.size();
+                frame.best.swap(compressed);
+                frame.level = ladder[step];
+            }
+            frame.done = step + 1 >= ladder.size() || saving < 0.001;
+            flush(lock, false);
+        }
+        lock.unlock();
+        ZSTD_freeCCtx(cctx);
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back(worker);
+    }
+    for (auto& thread : workers) {
+        thread.join();
+    }
+
+    // Out of time: commit whatever each remaining frame has
+    std::unique_lock lock(mutex);
+    if (!failed) {
+        flush(lock, true);
+    }
+    memory.buffer_bytes = static_cast<u64>(threads) * 2 * (frames.empty() ? 0 : frames[0].size) + held_peak;
+    memory.context_bytes = context_peak * threads;
+    if (failed) {
+        ErrorLog() << "Error during compression" << std::endl;
+    }
+    return !failed;
+}
+
+} // namespace
+
+bool CompressZ3DSFrame(const CompressionProfile& profile, const u8* src, size_t size, std::vector<u8>& out) {
+    out.resize(ZSTD_compressBound(size));
+    if (profile.store_raw) {
+        out.resize(SeekableZSTDCompressor::WriteRawFrame(out.data(), src, size));
+        return true;
+    }
+    ZSTD_CCtx* cctx = ZSTD_createCCtx();
+    bool ok = ApplyCompressionProfile(cctx, profile);
+    size_t result = ok ? ZSTD_compress2(cctx, out.data(), out.size(), src, size) : 0;
+    ZSTD_freeCCtx(cctx);
+    if (ok && ZSTD_isError(result)) {
+        ErrorLog() << "Compression error: " << ZSTD_getErrorName(result) << std::endl;
+        ok = false;
+    }
+    if (ok) {
+        out.resize(result);
+    }
+    return ok;
+}
+
 bool CompressZ3DSFile(const std::string& src_file, const std::string& dst_file,
                       const std::array<u8, 4>& underlying_magic, size_t frame_size,
                       ProgressCallback update_callback,
-                      const std::unordered_map<std::string, std::vector<u8>>& metadata) {
+                      const std::unordered_map<std::string, std::vector<u8>>& metadata,
+                      CompressionStats* stats,
+                      const CompressionProfile& profile,
+                      const RegionPolicy* region_policy,
+                      const DeadlineOptions* deadline,
+                      const std::vector<u64>* frame_breaks) {
     
     // Open source file
     std::ifstream input(src_file, std::ios::binary);
     if (!input.is_open()) {
-        std::cerr << "Error: Could not open source file: " << src_file << std::endl;
+        ErrorLog() << "Error: Could not open source file: " << src_file << std::endl;
+        return false;
+    }
+    
+    return CompressZ3DSStream(input, dst_file, underlying_magic, frame_size, update_callback,
+                              metadata, stats, profile, region_policy, deadline, frame_breaks);
+}
+
+bool CompressZ3DSStream(std::istream& input, const std::string& dst_file,
+                        const std::array<u8, 4>& underlying_magic, size_t frame_size,
+                        ProgressCallback update_callback,
+                        const std::unordered_map<std::string, std::vector<u8>>& metadata,
+                        CompressionStats* stats,
+                        const CompressionProfile& profile,
+                        const RegionPolicy* region_policy,
+                        const DeadlineOptions* deadline,
+                        const std::vector<u64>* frame_breaks) {
+    // Open output file
+    std::ofstream output(dst_file, std::ios::binary);
+    if (!output.is_open()) {
+        ErrorLog() << "Error: Could not create output file: " << dst_file << std::endl;
         return false;
     }
     
+    return CompressZ3DSStream(input, output, underlying_magic, frame_size, update_callback,
+                              metadata, stats, profile, region_policy, deadline, frame_breaks);
+}
+
+bool CompressZ3DSStream(std::istream& input, std::ostream& output,
+                        const std::array<u8, 4>& underlying_magic, size_t frame_size,
+                        ProgressCallback update_callback,
+                        const std::unordered_map<std::string, std::vector<u8>>& metadata,
+                        CompressionStats* stats,
+                        const CompressionProfile& profile,
+                        const RegionPolicy* region_policy,
+                        const DeadlineOptions* deadline,
+                        const std::vector<u64>* frame_breaks) {
+    auto start_time = std::chrono::steady_clock::now();
+    
     // Get file size
     input.seekg(0, std::ios::end);
     u64 uncompressed_size = input.tellg();
     input.seekg(0, std::ios::beg);
     
-    // Open output file
-    std::ofstream output(dst_file, std::ios::binary);
-    if (!output.is_open()) {
-        std::cerr << "Error: Could not create output file: " << dst_file << std::endl;
-        return false;
+    // Frames never span a change of compression parameters. Without a region
+    // policy the whole file is one segment using the base profile.
+    struct Segment {
+        u64 end;
+        const CompressionProfile* profile;
+        std::vector<RomRegion> regions;
+    };
+    std::vector<Segment> segments;
+    if (region_policy) {
+        std::vector<NCCHPartition> partitions;
+        auto read = [&](u64 offset, void* data, size_t size) {
+            input.clear();
+            input.seekg(offset);
+            input.read(static_cast<char*>(data), size);
+            return input.gcount() == static_cast<std::streamsize>(size);
+        };
+        ParseRomLayout(read, uncompressed_size, partitions);
+        input.clear();
+        input.seekg(0, std::ios::beg);
+        
+        for (const auto& region : BuildRomRegions(partitions, uncompressed_size)) {
+            const CompressionProfile& region_profile = region_policy->For(region.type);
+            if (segments.empty() ||
+                DescribeCompressionProfile(*segments.back().profile) != DescribeCompressionProfile(region_profile)) {
+                segments.push_back({region.offset, &region_profile, {}});
+            }
+            segments.back().end = region.offset + region.size;
+            segments.back().regions.push_back(region);
+        }
+        
+        if (stats) {
+            stats->regions.clear();
+            for (u8 i = 0; i < static_cast<u8>(RegionType::Count); ++i) {
+                stats->regions.push_back({GetRegionTypeName(static_cast<RegionType>(i))});
+            }
+        }
     }
+    if (segments.empty()) {
+        segments.push_back({uncompressed_size, &profile, {}});
+    }
+    
+    // Bytes from offset to the next forced frame end
+    auto until_break = [&](u64 offset) {
+        if (!frame_breaks) {
+            return std::numeric_limits<u64>::max();
+        }
+        auto next = std::upper_bound(frame_breaks->begin(), frame_breaks->end(), offset);
+        return next == frame_breaks->end() ? std::numeric_limits<u64>::max() : *next - offset;
+    };
     
     // Create Z3DS header
     Z3DSFileHeader header;
@@ -431,14 +1293,44 @@ bool CompressZ3DSFile(const std::string& src_file, const std::string& dst_file,
     meta.Add("compressor", "Z3DS CLI Tool v1.0");
     meta.Add("date", GetCurrentTimeISO());
     meta.Add("maxframesize", std::to_string(frame_size));
+    if (profile.name != "default") {
+        meta.Add("profile", profile.name);
+    }
+    meta.Add("zstdparams", DescribeCompressionProfile(profile));
+    if (region_policy) {
+        meta.Add("regionpolicy", DescribeRegionPolicy(*region_policy));
+    }
+    if (!profile.dictionary.empty()) {
+        meta.Add("zdict", profile.dictionary);
+    }
+    if (deadline) {
+        std::ostringstream description;
+        description << "seconds=" << deadline->seconds << ",levels=" << deadline->fast_level << "-"
+                    << deadline->max_level;
+        meta.Add("deadline", description.str());
+    }
     
     // Add user metadata
     for (const auto& [key, value] : metadata) {
         meta.Add(key, value);
     }
     
+    // Reserve room for a copy of the seek table at the end of the metadata
+    // block. Every segment and forced break can end a frame early.
+    u64 front_index_size = 0;
+    if (profile.front_index) {
+        u64 max_frames = frame_breaks ? frame_breaks->size() : 0;
+        u64 segment_start = 0;
+        for (const auto& segment : segments) {
+            max_frames += (segment.end - segment_start + frame_size - 1) / frame_size;
+            segment_start = segment.end;
+        }
+        front_index_size = (8 + max_frames * 12 + 9 + 15) / 16 * 16;
+        meta.Add("seekindex", "size=" + std::to_string(front_index_size));
+    }
+    
     auto metadata_binary = meta.AsBinary();
-    header.metadata_size = ((metadata_binary.size() + 15) / 16) * 16; // Align to 16 bytes
+    header.metadata_size = ((metadata_binary.size() + 15) / 16) * 16 + front_index_size; // Align to 16 bytes
     
     // Write header (will be updated later with compressed size)
     size_t header_pos = output.tellp();
@@ -447,7 +1339,7 @@ bool CompressZ3DSFile(const std::string& src_file, const std::string& dst_file,
     // Write metadata
     output.write(reinterpret_cast<const char*>(metadata_binary.data()), metadata_binary.size());
     
-    // Pad metadata to 16-byte boundary
+    // Pad metadata to 16-byte boundary, followed by the zeroed index area
     size_t padding = header.metadata_size - metadata_binary.size();
     std::vector<u8> pad(padding, 0);
     output.write(reinterpret_cast<const char*>(pad.data()), padding);
@@ -455,36 +1347,124 @@ bool CompressZ3DSFile(const std::string& src_file, const std::string& dst_file,
     // Start compression with proper seekable ZSTD format
     SeekableZSTDCompressor compressor(output, frame_size, true);
     
+    // Split a segment's time and output between its regions by input bytes
+    auto add_region_stats = [&](const Segment& segment, double input_bytes, double output_bytes, double seconds) {
+        if (!stats || stats->regions.empty() || input_bytes <= 0) {
+            return;
+        }
+        for (const auto& region : segment.regions) {
+            auto& region_stats = stats->regions[static_cast<size_t>(region.type)];
+            double share = region.size / input_bytes;
+            region_stats.input_bytes += region.size;
+            region_stats.output_bytes += static_cast<u64>(output_bytes * share + 0.5);
+            region_stats.seconds += seconds * share;
+        }
+    };
+    
     // Compress file in chunks
     constexpr size_t BUFFER_SIZE = 64 * 1024; // 64KB buffer
     std::vector<u8> buffer(BUFFER_SIZE);
     size_t processed = 0;
+    AnytimeMemory anytime_memory;
     
-    while (input.good() && processed < uncompressed_size) {
-        size_t to_read = std::min(BUFFER_SIZE, static_cast<size_t>(uncompressed_size - processed));
-        input.read(reinterpret_cast<char*>(buffer.data()), to_read);
-        size_t read_size = input.gcount();
-        
-        if (read_size == 0) break;
+    if (deadline) {
+        std::vector<AnytimeFrame> frames;
+        u64 offset = 0;
+        for (size_t i = 0; i < segments.size(); ++i) {
+            while (offset < segments[i].end) {
+                AnytimeFrame& frame = frames.emplace_back();
+                frame.offset = offset;
+                frame.size = static_cast<u32>(std::min<u64>({frame_size, segments[i].end - offset,
+                                                             until_break(offset)}));
+                offset += frame.size;
+                frame.profile = segments[i].profile;
+                frame.segment = i;
+            }
+        }
         
-        if (!compressor.WriteData(buffer.data(), read_size)) {
-            std::cerr << "Error during compression" << std::endl;
+        std::vector<double> segment_output(segments.size());
+        std::vector<double> segment_seconds(segments.size());
+        if (stats) {
+            stats->frames_per_level.assign(23, 0);
+        }
+        auto write_frame = [&](const AnytimeFrame& frame) {
+            if (!compressor.WriteFrame(frame.best.data(), frame.best.size(), frame.size, frame.checksum)) {
+                return false;
+            }
+            segment_output[frame.segment] += frame.best.size();
+            segment_seconds[frame.segment] += frame.seconds;
+            if (stats) {
+                stats->frames_per_level[frame.level]++;
+            }
+            return true;
+        };
+        if (!CompressFramesAnytime(input, frames, *deadline, start_time, update_callback, uncompressed_size,
+                                   write_frame, anytime_memory)) {
+            return false;
+        }
+        u64 segment_start = 0;
+        for (size_t i = 0; i < segments.size(); ++i) {
+            add_region_stats(segments[i], segments[i].end - segment_start, segment_output[i], segment_seconds[i]);
+            segment_start = segments[i].end;
+        }
+        segments.clear();
+    }
+    
+    for (const auto& segment : segments) {
+        if (!compressor.SetProfile(*segment.profile)) {
             return false;
         }
+        u64 compressed_before = compressor.GetTotalCompressed();
+        u64 segment_start = processed;
+        double seconds = 0.0;
         
-        processed += read_size;
+        while (input.good() && processed < segment.end) {
+            size_t to_read = static_cast<size_t>(std::min<u64>({BUFFER_SIZE, segment.end - processed,
+                                                                until_break(processed)}));
+            input.read(reinterpret_cast<char*>(buffer.data()), to_read);
+            size_t read_size = input.gcount();
+            
+            if (read_size == 0) break;
+            
+            auto start = std::chrono::steady_clock::now();
+            if (!compressor.WriteData(buffer.data(), read_size) ||
+                (read_size == until_break(processed) && !compressor.EndFrame())) {
+                ErrorLog() << "Error during compression" << std::endl;
+                return false;
+            }
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            
+            processed += read_size;
+            
+            if (update_callback) {
+                update_callback(processed, uncompressed_size);
+            }
+        }
         
-        if (update_callback) {
-            update_callback(processed, uncompressed_size);
+        auto start = std::chrono::steady_clock::now();
+        if (!compressor.EndFrame()) {
+            ErrorLog() << "Error during compression" << std::endl;
+            return false;
         }
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        
+        add_region_stats(segment, static_cast<double>(processed - segment_start),
+                         static_cast<double>(compressor.GetTotalCompressed() - compressed_before), seconds);
     }
     
     // Finish compression
     if (!compressor.Finish()) {
-        std::cerr << "Error finishing compression" << std::endl;
+        ErrorLog() << "Error finishing compression" << std::endl;
         return false;
     }
     
+    // Fill the index area reserved after the metadata
+    const auto& seek_table = compressor.GetSeekTable();
+    if (front_index_size > 0 && seek_table.size() <= front_index_size) {
+        output.seekp(header_pos + header.header_size + header.metadata_size - front_index_size);
+        output.write(reinterpret_cast<const char*>(seek_table.data()), seek_table.size());
+    }
+    
     // Update header with compressed size (ensure little-endian)
     header.compressed_size = compressor.GetTotalCompressed();
     output.seekp(header_pos);
@@ -534,11 +1514,22 @@ bool CompressZ3DSFile(const std::string& src_file, const std::string& dst_file,
     write_le64(header.uncompressed_size);
     
     if (!output.good()) {
-        std::cerr << "Error writing final header" << std::endl;
+        ErrorLog() << "Error writing final header" << std::endl;
         return false;
     }
     
-    std::cout << "\nCreated " << compressor.GetFrameCount() << " seekable frames" << std::endl;
+    if (stats) {
+        stats->frame_buffer_bytes = compressor.GetBufferMemory() + anytime_memory.buffer_bytes;
+        stats->context_bytes = compressor.GetContextMemory() + anytime_memory.context_bytes;
+        stats->io_buffer_bytes = buffer.capacity();
+        stats->peak_rss_bytes = GetPeakRSS();
+        stats->frame_count = compressor.GetFrameCount();
+        // Z3DS inputs (dedup, precomp, rebalance) are read through the shared caches
+        stats->frame_cache_bytes = FrameCache::Instance().GetStats().used_bytes;
+        DiskFrameCache::Stats disk_stats = DiskFrameCache::Instance().GetStats();
+        stats->disk_cache_queued_bytes = disk_stats.queued_bytes;
+        stats->disk_cache_bytes = disk_stats.used_bytes;
+    }
     
     return true;
 }
\ No newline at end of file
@@ -6,6 +6,9 @@
 #include <functional>
 #include <unordered_map>
 #include <cstdint>
+#include <istream>
+#include <ostream>
+#include <optional>
 #include <span>
 
 using u8 = uint8_t;
@@ -39,6 +42,10 @@ public:
     void Add(const std::string& name, const std::vector<u8>& data);
     std::vector<u8> AsBinary() const;
     
+    // Parse a metadata block as written by AsBinary
+    static bool Parse(const u8* data, size_t size,
+                      std::unordered_map<std::string, std::vector<u8>>& out);
+    
 private:
     struct Item {
         enum Type : u8 {
@@ -55,16 +62,171 @@ private:
     std::unordered_map<std::string, std::vector<u8>> items;
 };
 
+// zstd parameters applied to every frame. Zero leaves a parameter at the
+// value implied by the compression level.
+struct CompressionProfile {
+    std::string name = "default";
+    int level = 3;
+    int strategy = 0;
+    int window_log = 0;
+    int hash_log = 0;
+    int chain_log = 0;
+    int search_log = 0;
+    int min_match = 0;
+    int target_length = 0;
+    bool raw_literals = false; // Skip Huffman coding of literals, faster to decode
+    bool store_raw = false;    // Write raw zstd blocks without compressing
+    bool media_unit_matcher = false; // Aligned match finder ahead of zstd's (z3ds_media_matcher.h)
+    size_t frame_size = 0;     // Preferred frame size, 0 for the per-format default
+    bool front_index = false;  // Also store the seek table after the metadata (see CompressZ3DSFile)
+    std::vector<u8> dictionary = {}; // zstd dictionary for every frame, stored as "zdict" metadata
+};
+
+// Looks up profiles loaded with LoadCompressionProfiles, then the built-in
+// "default", "decode-fast", "raw" and "archive" profiles
+std::optional<CompressionProfile> FindCompressionProfile(const std::string& name);
+
+// Load named profiles from an INI-style file:
+//   [archive]
+//   level = 19
+//   strategy = btultra2
+//   windowLog = 27
+bool LoadCompressionProfiles(const std::string& filename);
+
+// Parse such a file into profiles without registering them
+bool ParseCompressionProfiles(const std::string& filename, std::vector<CompressionProfile>& profiles);
+
+// Set a parameter by its zstd name (level, windowLog, hashLog, chainLog,
+// searchLog, minMatch, targetLength, strategy, rawLiterals, frameSize),
+// mediaUnitMatcher or frontIndex
+bool SetCompressionParameter(CompressionProfile& profile, const std::string& name,
+                             const std::string& value, std::string& error);
+
+// Check every set parameter against ZSTD_cParam_getBounds
+bool ValidateCompressionProfile(const CompressionProfile& profile, std::string& error);
+
+// "level=3,windowLog=20,..." listing only the parameters that are set
+std::string DescribeCompressionProfile(const CompressionProfile& profile);
+
 // Progress callback type
 using ProgressCallback = std::function<void(std::size_t, std::size_t)>;
 
-// Main compression function
+// Time and bytes spent on one region type (see z3ds_layout.h). Where
+// neighbouring types share parameters they share frames, and the frames'
+// time and output are split between them by input bytes.
+struct RegionStats {
+    std::string name;
+    u64 input_bytes = 0;
+    u64 output_bytes = 0;
+    double seconds = 0.0;
+};
+
+// Memory usage collected while compressing a file
+struct CompressionStats {
+    u64 frame_buffer_bytes = 0; // Uncompressed and compressed frame buffers
+    u64 context_bytes = 0;      // ZSTD_sizeof_CCtx, sampled at its largest
+    u64 io_buffer_bytes = 0;    // Input read buffer
+    u64 frame_cache_bytes = 0;  // Decoded frames held by FrameCache
+    u64 disk_cache_queued_bytes = 0; // Frames waiting for DiskFrameCache write-back
+    u64 disk_cache_bytes = 0;   // DiskFrameCache usage on disk, not counted as memory
+    u64 peak_rss_bytes = 0;     // Process peak resident set size after compression
+    size_t frame_count = 0;
+    std::vector<RegionStats> regions; // Only with a region policy
+    std::vector<size_t> frames_per_level; // Only with a deadline, by zstd level (0 for raw frames)
+
+    u64 TrackedBytes() const {
+        return frame_buffer_bytes + context_bytes + io_buffer_bytes + frame_cache_bytes + disk_cache_queued_bytes;
+    }
+};
+
+struct RegionPolicy;
+
+// Anytime compression: every frame first gets a result at fast_level (raw if
+// the deadline has already passed), then the remaining time is spent
+// recompressing frames at higher levels, the largest expected saving per
+// second first, on all threads. Each frame keeps its smallest result and
+// attempts that would run past the deadline are abandoned.
+struct DeadlineOptions {
+    double seconds = 0.0;  // From the start of compression, including writing the output
+    int fast_level = 1;
+    int max_level = 19;
+    unsigned threads = 0;  // 0 for one per hardware thread
+    // Results are written in frame order as they become final; past this
+    // many bytes held, the oldest are committed before they are
+    u64 memory_limit = 256 * 1024 * 1024;
+};
+
+// Main compression function. With a region policy, the NCSD/NCCH/CIA layout
+// of the source is parsed and each region is compressed with the policy's
+// parameters for its type; frames end where the parameters change. Frames
+// also end at every offset in frame_breaks (sorted), e.g. the members of a
+// pack.
+//
+// With profile.front_index the metadata block ends with a zeroed area that
+// is filled with a byte-for-byte copy of the seek table once the frames are
+// written, and a "seekindex" item ("size=N") gives its size. Readers then get
+// the header, metadata and frame map in one read from the start of the file;
+// readers that do not know the item skip the area as metadata padding.
 bool CompressZ3DSFile(const std::string& src_file, const std::string& dst_file,
                       const std::array<u8, 4>& underlying_magic, size_t frame_size,
                       ProgressCallback update_callback = nullptr,
-                      const std::unordered_map<std::string, std::vector<u8>>& metadata = {});
+                      const std::unordered_map<std::string, std::vector<u8>>& metadata = {},
+                      CompressionStats* stats = nullptr,
+                      const CompressionProfile& profile = {},
+                      const RegionPolicy* region_policy = nullptr,
+                      const DeadlineOptions* deadline = nullptr,
+                      const std::vector<u64>* frame_breaks = nullptr);
+
+// Same as CompressZ3DSFile, reading the image from a seekable stream
+bool CompressZ3DSStream(std::istream& input, const std::string& dst_file,
+                        const std::array<u8, 4>& underlying_magic, size_t frame_size,
+                        ProgressCallback update_callback = nullptr,
+                        const std::unordered_map<std::string, std::vector<u8>>& metadata = {},
+                        CompressionStats* stats = nullptr,
+                        const CompressionProfile& profile = {},
+                        const RegionPolicy* region_policy = nullptr,
+                        const DeadlineOptions* deadline = nullptr,
+                        const std::vector<u64>* frame_breaks = nullptr);
+
+// Same, writing to any output stream. The stream must support seeking back
+// to where it started to patch the header once the frames are written.
+bool CompressZ3DSStream(std::istream& input, std::ostream& output,
+                        const std::array<u8, 4>& underlying_magic, size_t frame_size,
+                        ProgressCallback update_callback = nullptr,
+                        const std::unordered_map<std::string, std::vector<u8>>& metadata = {},
+                        CompressionStats* stats = nullptr,
+                        const CompressionProfile& profile = {},
+                        const RegionPolicy* region_policy = nullptr,
+                        const DeadlineOptions* deadline = nullptr,
+                        const std::vector<u64>* frame_breaks = nullptr);
+
+// Compress one standalone frame as CompressZ3DSFile would write it with
+// this profile (raw blocks for store_raw)
+bool CompressZ3DSFrame(const CompressionProfile& profile, const u8* src, size_t size, std::vector<u8>& out);
+
+// Error and warning messages of the library go to ErrorLog(): std::cerr,
+// unless the calling thread has redirected them with a ScopedErrorLog (the C
+// API collects them for z3ds_last_error). Worker threads always use std::cerr.
+std::ostream& ErrorLog();
+
+class ScopedErrorLog {
+public:
+    explicit ScopedErrorLog(std::ostream& stream);
+    ~ScopedErrorLog();
+
+    ScopedErrorLog(const ScopedErrorLog&) = delete;
+    ScopedErrorLog& operator=(const ScopedErrorLog&) = delete;
+
+private:
+    std::ostream* previous;
+};
 
 // Utility functions
+u64 XXH64(const void* data, size_t len, u64 seed = 0);
 std::array<u8, 4> DetectFileMagic(const std::string& filename);
+// Same detection on the first bytes of an image; filename only supplies the
+// extension used to recognise CIAs
+std::array<u8, 4> DetectDataMagic(const u8* data, size_t size, const std::string& filename);
 size_t GetDefaultFrameSize(const std::array<u8, 4>& magic);
-std::string GetCurrentTimeISO();
\ No newline at end of file
+std::string GetCurrentTimeISO();
+u64 GetPeakRSS(); // Bytes, 0 if unavailable
\ No newline at end of file
@@ -0,0 +1,386 @@
+#include "z3ds_dedup.h"
+#include "z3ds_layout.h"
+#include "z3ds_reader.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+struct ChunkRecord {
+    u64 hash;
+    u32 size;
+};
+
+struct FileChunks {
+    std::vector<ChunkRecord> fixed;
+    std::vector<ChunkRecord> cdc;
+    u64 fixed_fill = 0;
+    u64 cdc_fill = 0;
+    u64 fixed_chunks = 0;
+    u64 cdc_chunks = 0;
+};
+
+// Sequential and random access to a plain image or the inside of a Z3DS file
+class ImageSource {
+public:
+    bool Open(const std::string& path, std::string& error) {
+        file.open(path, std::ios::binary);
+        if (!file.is_open()) {
+            error = "could not open";
+            return false;
+        }
+        char magic[4] = {};
+        file.read(magic, 4);
+        if (file.gcount() == 4 && std::memcmp(magic, "Z3DS", 4) == 0) {
+            file.close();
+            reader.SetRecordAccess(false);
+            if (!reader.Open(path)) {
+                error = "unreadable Z3DS file";
+                return false;
+            }
+            is_z3ds = true;
+            size = reader.GetSize();
+        } else {
+            file.clear();
+            file.seekg(0, std::ios::end);
+            size = file.tellg();
+        }
+        return true;
+    }
+
+    bool Read(u64 offset, void* buffer, size_t length) {
+        if (offset + length > size) {
+            return false;
+        }
+        if (is_z3ds) {
+            return reader.Read(offset, buffer, length) == length;
+        }
+        file.clear();
+        file.seekg(offset);
+        file.read(static_cast<char*>(buffer), length);
+        return file.gcount() == static_cast<std::streamsize>(length);
+    }
+
+    u64 Size() const { return size; }
+
+private:
+    std::ifstream file;
+    Z3DSReader reader;
+    bool is_z3ds = false;
+    u64 size = 0;
+};
+
+bool IsFill(const u8* data, size_t size) {
+    return size > 0 && (size == 1 || std::memcmp(data, data + 1, size - 1) == 0);
+}
+
+class Chunker {
+public:
+    Chunker(const DedupOptions& options, FileChunks& out) : options(options), out(out) {
+        u64 state = 0x9E3779B97F4A7C15ULL;
+        for (auto& value : gear) {
+            // splitmix64, so the table (and chunk boundaries) never change
+            u64 z = (state += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            value = z ^ (z >> 31);
+        }
+        int bits = 0;
+        while ((size_t{1} << (bits + 1)) <= options.cdc_average_size) {
+            ++bits;
+        }
+        min_size = options.cdc_average_size / 4;
+        max_size = options.cdc_average_size * 8;
+        // Normalised chunking: harder to cut before the average, easier after
+        mask_small = ((1ULL << (bits + 1)) - 1) << (63 - bits);
+        mask_large = ((1ULL << (bits - 1)) - 1) << (65 - bits);
+    }
+
+    void Feed(const u8* data, size_t size) {
+        fixed_carry.insert(fixed_carry.end(), data, data + size);
+        size_t pos = 0;
+        while (fixed_carry.size() - pos >= options.fixed_chunk_size) {
+            Emit(fixed_carry.data() + pos, options.fixed_chunk_size, false);
+            pos += options.fixed_chunk_size;
+        }
+        fixed_carry.erase(fixed_carry.begin(), fixed_carry.begin() + pos);
+
+        cdc_carry.insert(cdc_carry.end(), data, data + size);
+        pos = 0;
+        while (cdc_carry.size() - pos >= max_size) {
+            size_t cut = Cut(cdc_carry.data() + pos, cdc_carry.size() - pos);
+            Emit(cdc_carry.data() + pos, cut, true);
+            pos += cut;
+        }
+        cdc_carry.erase(cdc_carry.begin(), cdc_carry.begin() + pos);
+    }
+
+    void Finish() {
+        if (!fixed_carry.empty()) {
+            Emit(fixed_carry.data(), fixed_carry.size(), false);
+        }
+        size_t pos = 0;
+        while (pos < cdc_carry.size()) {
+            size_t cut = Cut(cdc_carry.data() + pos, cdc_carry.size() - pos);
+            Emit(cdc_carry.data() + pos, cut, true);
+            pos += cut;
+        }
+    }
+
+private:
+    size_t Cut(const u8* data, size_t size) const {
+        if (size <= min_size) {
+            return size;
+        }
+        size_t normal = std::min(size, options.cdc_average_size);
+        size_t end = std::min(size, max_size);
+        u64 hash = 0;
+        size_t i = min_size;
+        for (; i < normal; ++i) {
+            hash = (hash << 1) + gear[data[i]];
+            if (!(hash & mask_small)) {
+                return i + 1;
+            }
+        }
+        for (; i < end; ++i) {
+            hash = (hash << 1) + gear[data[i]];
+            if (!(hash & mask_large)) {
+                return i + 1;
+            }
+        }
+        return end;
+    }
+
+    void Emit(const u8* data, size_t size, bool cdc) {
+        (cdc ? out.cdc_chunks : out.fixed_chunks)++;
+        if (IsFill(data, size)) {
+            (cdc ? out.cdc_fill : out.fixed_fill) += size;
+            return;
+        }
+        u64 hash = XXH64(data, size);
+        if (hash % options.sample_rate == 0) {
+            (cdc ? out.cdc : out.fixed).push_back({hash, static_cast<u32>(size)});
+        }
+    }
+
+    const DedupOptions& options;
+    FileChunks& out;
+    u64 gear[256];
+    size_t min_size;
+    size_t max_size;
+    u64 mask_small;
+    u64 mask_large;
+    std::vector<u8> fixed_carry;
+    std::vector<u8> cdc_carry;
+};
+
+bool ChunkFile(const DedupOptions& options, DedupFileResult& result, FileChunks& chunks) {
+    ImageSource source;
+    if (!source.Open(result.path, result.error)) {
+        return false;
+    }
+    result.size = source.Size();
+
+    // Title family from the first NCCH's program ID (bits 8-27, the unique ID)
+    std::vector<NCCHPartition> partitions;
+    auto read = [&](u64 offset, void* buffer, size_t size) { return source.Read(offset, buffer, size); };
+    if (ParseRomLayout(read, source.Size(), partitions) && !partitions.empty() && partitions[0].program_id) {
+        result.family = (partitions[0].program_id >> 8) & 0xFFFFF;
+        result.family_known = true;
+    }
+
+    Chunker chunker(options, chunks);
+    constexpr size_t BLOCK = 4 * 1024 * 1024;
+    std::vector<u8> buffer(BLOCK);
+    for (u64 offset = 0; offset < source.Size(); offset += BLOCK) {
+        size_t size = static_cast<size_t>(std::min<u64>(BLOCK, source.Size() - offset));
+        if (!source.Read(offset, buffer.data(), size)) {
+            result.error = "read failed at offset " + std::to_string(offset);
+            return false;
+        }
+        chunker.Feed(buffer.data(), size);
+    }
+    chunker.Finish();
+    return true;
+}
+
+struct ChunkSeen {
+    u32 first_file;
+    u32 last_file;
+    u64 first_family;
+    u64 last_family;
+};
+
+void MergeChunks(const std::vector<ChunkRecord>& records, u32 file, u64 family, u32 sample_rate,
+                 std::unordered_map<u64, ChunkSeen>& seen, DedupBytes& bytes) {
+    for (const auto& record : records) {
+        u64 scaled = static_cast<u64>(record.size) * sample_rate;
+        auto [it, inserted] = seen.try_emplace(record.hash, ChunkSeen{file, file, family, family});
+        if (inserted) {
+            continue;
+        }
+        ChunkSeen& entry = it->second;
+        if (entry.last_file == file) {
+            bytes.within_file += scaled;
+        } else if (entry.first_family == family || entry.last_family == family) {
+            bytes.across_files += scaled;
+        } else {
+            bytes.across_families += scaled;
+        }
+        entry.last_file = file;
+        entry.last_family = family;
+    }
+}
+
+void FinishBytes(DedupBytes& bytes, u64 total, u64 fill, u64 chunks) {
+    bytes.total = total;
+    bytes.fill = fill;
+    bytes.chunks = chunks;
+    // Sampled counts are estimates; keep the rows summing to the total
+    u64 duplicate = std::min(bytes.Duplicate(), total - std::min(total, fill));
+    if (duplicate < bytes.Duplicate()) {
+        double scale = static_cast<double>(duplicate) / bytes.Duplicate();
+        bytes.within_file = static_cast<u64>(bytes.within_file * scale);
+        bytes.across_files = static_cast<u64>(bytes.across_files * scale);
+        bytes.across_families = static_cast<u64>(bytes.across_families * scale);
+    }
+    bytes.unique = total - fill - bytes.Duplicate();
+}
+
+void AddBytes(DedupBytes& sum, const DedupBytes& bytes) {
+    sum.total += bytes.total;
+    sum.unique += bytes.unique;
+    sum.fill += bytes.fill;
+    sum.within_file += bytes.within_file;
+    sum.across_files += bytes.across_files;
+    sum.across_families += bytes.across_families;
+    sum.chunks += bytes.chunks;
+}
+
+bool IsRomFile(const std::filesystem::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+    for (const char* known : {".cci", ".3ds", ".cia", ".cxi", ".3dsx", ".app",
+                              ".zcci", ".zcia", ".zcxi", ".z3dsx", ".z3ds"}) {
+        if (ext == known) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+bool RunDedupAnalysis(const DedupOptions& options, DedupReport& report) {
+    report = {};
+    if (options.fixed_chunk_size == 0 || options.cdc_average_size < 256 ||
+        (options.cdc_average_size & (options.cdc_average_size - 1)) || options.sample_rate == 0) {
+        std::cerr << "Error: Chunk sizes must be non-zero, the CDC average a power of two >= 256" << std::endl;
+        return false;
+    }
+    report.sample_rate = options.sample_rate;
+
+    for (const auto& input : options.inputs) {
+        std::error_code ec;
+        if (std::filesystem::is_directory(input, ec)) {
+            std::vector<std::string> found;
+            for (const auto& entry : std::filesystem::recursive_directory_iterator(input, ec)) {
+                if (entry.is_regular_file() && IsRomFile(entry.path())) {
+                    found.push_back(entry.path().string());
+                }
+            }
+            std::sort(found.begin(), found.end());
+            for (auto& path : found) {
+                report.files.emplace_back().path = std::move(path);
+            }
+        } else if (std::filesystem::is_regular_file(input, ec)) {
+            report.files.emplace_back().path = input;
+        } else {
+            std::cerr << "Warning: Skipping missing input: " << input << std::endl;
+        }
+    }
+    if (report.files.empty()) {
+        std::cerr << "Error: No input files" << std::endl;
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Workers chunk and hash files in any order; this thread merges them in
+    // input order so the attribution of repeats does not depend on timing.
+    // A worker may only start a file within a window of the merge cursor, so
+    // one slow file does not leave the chunk lists of all later ones waiting
+    // in memory
+    size_t count = report.files.size();
+    std::vector<FileChunks> chunks(count);
+    std::vector<bool> ready(count, false);
+    std::mutex mutex;
+    std::condition_variable file_done;
+    std::condition_variable file_merged;
+    std::atomic<size_t> next{0};
+    size_t next_merge = 0;
+
+    unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::min<size_t>(threads, count));
+    size_t window = size_t{threads} * 2;
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&] {
+            for (size_t i = next++; i < count; i = next++) {
+                {
+                    std::unique_lock lock(mutex);
+                    file_merged.wait(lock, [&] { return i < next_merge + window; });
+                }
+                FileChunks file_chunks;
+                ChunkFile(options, report.files[i], file_chunks);
+                std::lock_guard lock(mutex);
+                chunks[i] = std::move(file_chunks);
+                ready[i] = true;
+                file_done.notify_all();
+            }
+        });
+    }
+
+    std::unordered_map<u64, ChunkSeen> fixed_seen;
+    std::unordered_map<u64, ChunkSeen> cdc_seen;
+    for (size_t i = 0; i < count; ++i) {
+        FileChunks file_chunks;
+        {
+            std::unique_lock lock(mutex);
+            file_done.wait(lock, [&] { return ready[i]; });
+            file_chunks = std::move(chunks[i]);
+            next_merge = i + 1;
+        }
+        file_merged.notify_all();
+        DedupFileResult& file = report.files[i];
+        if (!file.error.empty()) {
+            continue;
+        }
+        if (!file.family_known) {
+            // Unknown titles are a family of their own
+            file.family = (1ULL << 63) | i;
+        }
+        u32 index = static_cast<u32>(i);
+        MergeChunks(file_chunks.fixed, index, file.family, options.sample_rate, fixed_seen, file.fixed);
+        MergeChunks(file_chunks.cdc, index, file.family, options.sample_rate, cdc_seen, file.cdc);
+        FinishBytes(file.fixed, file.size, file_chunks.fixed_fill, file_chunks.fixed_chunks);
+        FinishBytes(file.cdc, file.size, file_chunks.cdc_fill, file_chunks.cdc_chunks);
+        AddBytes(report.fixed, file.fixed);
+        AddBytes(report.cdc, file.cdc);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    report.tracked_chunks = fixed_seen.size() + cdc_seen.size();
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
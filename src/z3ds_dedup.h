@@ -0,0 +1,55 @@
+#pragma once
+
+#include "z3ds_compression.h"
+
+// Duplicate-content analysis over many ROM images (plain or Z3DS). Each file
+// is cut into fixed-size chunks and into content-defined chunks (FastCDC style
+// gear hash, so inserted bytes do not shift every later boundary), chunks are
+// hashed with XXH64 and every repeat of an earlier chunk is attributed to the
+// closest place it was seen first: the same file, another file of the same
+// title family (NCCH program ID unique ID, shared by a game, its update and
+// DLC), or another family. Chunks of one repeated byte are counted as fill.
+//
+// With sample_rate N only chunks whose hash is 0 modulo N are tracked and the
+// byte counts are scaled by N, which keeps the hash table 1/N the size for
+// very large libraries at the cost of some precision.
+struct DedupOptions {
+    std::vector<std::string> inputs; // Files or directories searched recursively
+    size_t fixed_chunk_size = 4096;
+    size_t cdc_average_size = 8192;  // Power of two; min is 1/4, max 8x
+    u32 sample_rate = 1;
+    unsigned threads = 0;            // 0 for one per hardware thread
+};
+
+struct DedupBytes {
+    u64 total = 0;
+    u64 unique = 0;
+    u64 fill = 0;
+    u64 within_file = 0;
+    u64 across_files = 0;    // Same title family
+    u64 across_families = 0;
+    u64 chunks = 0;
+
+    u64 Duplicate() const { return within_file + across_files + across_families; }
+};
+
+struct DedupFileResult {
+    std::string path;
+    u64 family = 0;          // Unique ID from the program ID, or a per-file key
+    bool family_known = false;
+    u64 size = 0;
+    DedupBytes fixed;
+    DedupBytes cdc;
+    std::string error;
+};
+
+struct DedupReport {
+    u32 sample_rate = 1;
+    size_t tracked_chunks = 0; // Entries in the hash tables
+    double seconds = 0.0;
+    DedupBytes fixed;
+    DedupBytes cdc;
+    std::vector<DedupFileResult> files;
+};
+
+bool RunDedupAnalysis(const DedupOptions& options, DedupReport& report);
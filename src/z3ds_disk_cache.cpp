@@ -0,0 +1,396 @@
+#include "z3ds_disk_cache.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#define open _open
+#define close _close
+#define write _write
+#define fsync _commit
+#else
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr u32 INDEX_MAGIC = 0x43443358; // "X3DC"
+constexpr u8 RECORD_ADD = 1;
+constexpr u8 RECORD_REMOVE = 2;
+constexpr u64 MAX_QUEUED_BYTES = 512ULL * 1024 * 1024;
+
+// Index log record, little-endian on disk
+struct IndexRecord {
+    u32 magic;
+    u8 type;
+    u8 reserved[3];
+    u64 fingerprint;
+    u32 frame;
+    u32 size;
+    u64 data_hash;
+    u64 record_hash; // XXH64 of the fields above
+};
+static_assert(sizeof(IndexRecord) == 40);
+
+u64 RecordHash(const IndexRecord& record) {
+    return XXH64(&record, offsetof(IndexRecord, record_hash));
+}
+
+bool WriteAll(int fd, const void* data, size_t size) {
+    const u8* ptr = static_cast<const u8*>(data);
+    while (size > 0) {
+        auto result = write(fd, ptr, static_cast<unsigned>(std::min<size_t>(size, 1 << 30)));
+        if (result <= 0) {
+            return false;
+        }
+        ptr += result;
+        size -= result;
+    }
+    return true;
+}
+
+} // namespace
+
+DiskFrameCache& DiskFrameCache::Instance() {
+    static DiskFrameCache cache;
+    return cache;
+}
+
+DiskFrameCache::DiskFrameCache() {
+    const char* dir = std::getenv("Z3DS_DISK_CACHE_DIR");
+    if (dir && *dir) {
+        u64 megabytes = 4096;
+        if (const char* env = std::getenv("Z3DS_DISK_CACHE_MB")) {
+            megabytes = std::strtoull(env, nullptr, 10);
+        }
+        Configure(dir, megabytes * 1024 * 1024);
+    }
+}
+
+DiskFrameCache::~DiskFrameCache() {
+    Shutdown();
+}
+
+void DiskFrameCache::Shutdown() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    queue_changed.notify_all();
+    if (writer.joinable()) {
+        writer.join();
+    }
+    std::lock_guard lock(mutex);
+    if (index_fd >= 0) {
+        fsync(index_fd);
+        close(index_fd);
+        index_fd = -1;
+    }
+    if (lock_fd >= 0) {
+        close(lock_fd); // Releases the directory lock
+        lock_fd = -1;
+    }
+    stopping = false;
+}
+
+bool DiskFrameCache::Configure(const std::string& dir, u64 capacity_bytes) {
+    Shutdown();
+
+    std::lock_guard lock(mutex);
+    entries.clear();
+    lru.clear();
+    used = 0;
+    directory.clear();
+    capacity = 0;
+    if (dir.empty() || capacity_bytes == 0) {
+        return true;
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    directory = dir;
+    capacity = capacity_bytes;
+    if (!LockDirectoryLocked()) {
+        ErrorLog() << "Warning: Disk frame cache disabled, " << dir << " is in use by another process" << std::endl;
+        directory.clear();
+        capacity = 0;
+        return false;
+    }
+    if (!LoadIndexLocked()) {
+        ErrorLog() << "Warning: Disk frame cache disabled, cannot use " << dir << std::endl;
+        directory.clear();
+        capacity = 0;
+        return false;
+    }
+    EvictLocked();
+
+    writer = std::thread(&DiskFrameCache::WriterThread, this);
+    return true;
+}
+
+bool DiskFrameCache::Enabled() const {
+    std::lock_guard lock(mutex);
+    return capacity > 0;
+}
+
+std::string DiskFrameCache::FramePath(const Key& key) const {
+    char name[48];
+    std::snprintf(name, sizeof(name), "%016llx-%u.frm",
+                  static_cast<unsigned long long>(key.fingerprint), key.frame);
+    return (std::filesystem::path(directory) / name).string();
+}
+
+bool DiskFrameCache::LockDirectoryLocked() {
+    std::string lock_path = (std::filesystem::path(directory) / "lock").string();
+    lock_fd = open(lock_path.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (lock_fd < 0) {
+        return false;
+    }
+#ifndef _WIN32
+    // LoadIndexLocked replaces index.log, which would strand another
+    // process appending to the old file
+    if (flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+        close(lock_fd);
+        lock_fd = -1;
+        return false;
+    }
+#endif
+    return true;
+}
+
+bool DiskFrameCache::LoadIndexLocked() {
+    std::string index_path = (std::filesystem::path(directory) / "index.log").string();
+
+    // Replay the log up to the first torn or corrupt record
+    {
+        std::ifstream log(index_path, std::ios::binary);
+        IndexRecord record;
+        while (log.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+            if (record.magic != INDEX_MAGIC || record.record_hash != RecordHash(record)) {
+                break;
+            }
+            Key key{record.fingerprint, record.frame};
+            auto it = entries.find(key);
+            if (it != entries.end()) {
+                used -= it->second.size;
+                lru.erase(it->second.lru_position);
+                entries.erase(it);
+            }
+            if (record.type == RECORD_ADD) {
+                lru.push_front(key);
+                entries[key] = {record.size, record.data_hash, lru.begin()};
+                used += record.size;
+            }
+        }
+    }
+
+    // Drop entries whose frame file went missing
+    for (auto it = entries.begin(); it != entries.end();) {
+        std::error_code ec;
+        if (std::filesystem::file_size(FramePath(it->first), ec) != it->second.size || ec) {
+            used -= it->second.size;
+            lru.erase(it->second.lru_position);
+            it = entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // Frame files without an index record, e.g. written before a crash that
+    // lost the record, are never looked up again
+    std::error_code list_ec;
+    for (const auto& file : std::filesystem::directory_iterator(directory, list_ec)) {
+        std::string name = file.path().filename().string();
+        unsigned long long fingerprint = 0;
+        unsigned frame = 0;
+        char extension[8] = {};
+        if (std::sscanf(name.c_str(), "%16llx-%u.%7s", &fingerprint, &frame, extension) != 3) {
+            continue;
+        }
+        bool temporary = std::strcmp(extension, "frm.tmp") == 0;
+        bool orphan = std::strcmp(extension, "frm") == 0 && !entries.count(Key{fingerprint, frame});
+        if (temporary || orphan) {
+            std::error_code ec;
+            std::filesystem::remove(file.path(), ec);
+        }
+    }
+
+    // Rewrite the log with only live entries, replacing it atomically
+    std::string temp_path = index_path + ".tmp";
+    int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = true;
+    for (auto it = lru.rbegin(); it != lru.rend() && ok; ++it) {
+        const Entry& entry = entries.at(*it);
+        IndexRecord record{INDEX_MAGIC, RECORD_ADD, {}, it->fingerprint, it->frame, entry.size, entry.data_hash, 0};
+        record.record_hash = RecordHash(record);
+        ok = WriteAll(fd, &record, sizeof(record));
+    }
+    ok = ok && fsync(fd) == 0;
+    close(fd);
+    std::error_code ec;
+    std::filesystem::rename(temp_path, index_path, ec);
+    if (!ok || ec) {
+        return false;
+    }
+
+    index_fd = open(index_path.c_str(), O_WRONLY | O_APPEND);
+    return index_fd >= 0;
+}
+
+// The record is synced later by the writer thread, outside the lock. Losing
+// an unsynced record in a crash only loses a cache entry: additions are only
+// logged once their frame file is durable, and the frame file of a lost
+// removal is either missing (dropped on load) or still valid.
+bool DiskFrameCache::AppendRecordLocked(u8 type, const Key& key, u32 size, u64 data_hash) {
+    IndexRecord record{INDEX_MAGIC, type, {}, key.fingerprint, key.frame, size, data_hash, 0};
+    record.record_hash = RecordHash(record);
+    return WriteAll(index_fd, &record, sizeof(record));
+}
+
+void DiskFrameCache::RemoveLocked(const Key& key) {
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+        return;
+    }
+    // Log the removal first so a crash never leaves a record for a deleted file
+    AppendRecordLocked(RECORD_REMOVE, key, 0, 0);
+    std::error_code ec;
+    std::filesystem::remove(FramePath(key), ec);
+    used -= it->second.size;
+    lru.erase(it->second.lru_position);
+    entries.erase(it);
+}
+
+void DiskFrameCache::EvictLocked() {
+    while (used > capacity && !lru.empty()) {
+        RemoveLocked(lru.back());
+    }
+}
+
+DiskFrameCache::FrameData DiskFrameCache::Lookup(u64 fingerprint, u32 frame, size_t size) {
+    Key key{fingerprint, frame};
+    u64 data_hash;
+    std::string path;
+    {
+        std::lock_guard lock(mutex);
+        auto it = entries.find(key);
+        if (capacity == 0 || it == entries.end() || it->second.size != size) {
+            ++misses;
+            return nullptr;
+        }
+        data_hash = it->second.data_hash;
+        lru.splice(lru.begin(), lru, it->second.lru_position);
+        path = FramePath(key);
+    }
+
+    std::shared_ptr<u8[]> data(new u8[size]);
+    std::ifstream file(path, std::ios::binary);
+    file.read(reinterpret_cast<char*>(data.get()), size);
+    bool valid = file.gcount() == static_cast<std::streamsize>(size) && XXH64(data.get(), size) == data_hash;
+
+    std::lock_guard lock(mutex);
+    if (!valid) {
+        ++misses;
+        // The writer may have evicted and rewritten the frame meanwhile
+        auto it = entries.find(key);
+        if (it != entries.end() && it->second.data_hash == data_hash) {
+            RemoveLocked(key);
+        }
+        return nullptr;
+    }
+    ++hits;
+    return data;
+}
+
+void DiskFrameCache::Insert(u64 fingerprint, u32 frame, FrameData data, size_t size) {
+    {
+        std::lock_guard lock(mutex);
+        Key key{fingerprint, frame};
+        if (capacity == 0 || size > capacity || entries.count(key)) {
+            return;
+        }
+        if (queued_bytes + size > MAX_QUEUED_BYTES) {
+            ++dropped_writes;
+            return;
+        }
+        queue.push_back({key, std::move(data), size});
+        queued_bytes += size;
+    }
+    queue_changed.notify_all();
+}
+
+void DiskFrameCache::Flush() {
+    std::unique_lock lock(mutex);
+    queue_changed.wait(lock, [&] { return (queue.empty() && !writing) || !writer.joinable(); });
+}
+
+void DiskFrameCache::WriterThread() {
+    std::unique_lock lock(mutex);
+    while (true) {
+        queue_changed.wait(lock, [&] { return stopping || !queue.empty(); });
+        if (queue.empty()) {
+            break; // Stopping with nothing left to write
+        }
+        PendingWrite pending = std::move(queue.front());
+        queue.pop_front();
+        queued_bytes -= pending.size;
+        if (entries.count(pending.key)) {
+            continue;
+        }
+        std::string path = FramePath(pending.key);
+        writing = true;
+        lock.unlock();
+
+        // Write to a temporary name and rename once the data is durable
+        u64 data_hash = XXH64(pending.data.get(), pending.size);
+        std::string temp_path = path + ".tmp";
+        bool ok = false;
+        int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+            ok = WriteAll(fd, pending.data.get(), pending.size) && fsync(fd) == 0;
+            close(fd);
+        }
+        std::error_code ec;
+        if (ok) {
+            std::filesystem::rename(temp_path, path, ec);
+            ok = !ec;
+        }
+        if (!ok) {
+            std::filesystem::remove(temp_path, ec);
+        }
+        pending.data.reset();
+
+        lock.lock();
+        writing = false;
+        if (ok && AppendRecordLocked(RECORD_ADD, pending.key, static_cast<u32>(pending.size), data_hash)) {
+            lru.push_front(pending.key);
+            entries[pending.key] = {static_cast<u32>(pending.size), data_hash, lru.begin()};
+            used += pending.size;
+            ++writes;
+            EvictLocked();
+        }
+        int log_fd = index_fd;
+        lock.unlock();
+        if (log_fd >= 0) {
+            fsync(log_fd); // Also covers removals logged by readers since the last sync
+        }
+        lock.lock();
+        queue_changed.notify_all();
+    }
+    queue_changed.notify_all();
+}
+
+DiskFrameCache::Stats DiskFrameCache::GetStats() const {
+    std::lock_guard lock(mutex);
+    return {capacity, used, hits, misses, writes, dropped_writes, entries.size(), queued_bytes};
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "z3ds_compression.h"
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Second cache tier for decoded frames on local storage (e.g. an SSD in
+// front of a NAS), below the in-memory FrameCache.
+//
+// Frames are keyed by a content fingerprint of the Z3DS file (header and seek
+// table), so the same title keeps its entries when it is reached through a
+// different path or mount. Each frame is one file in the cache directory and
+// an append-only index log records additions and removals. Frame files are
+// written and synced before their index record is appended, and every record
+// and frame carries a hash, so a crash at any point leaves at worst a frame
+// that is ignored on the next start. Writes happen on a background thread,
+// which also syncs the index log outside the lock readers take.
+//
+// A cache directory belongs to one process at a time: Configure takes a lock
+// file in it and leaves the cache disabled if another process holds it.
+class DiskFrameCache {
+public:
+    using FrameData = std::shared_ptr<const u8[]>;
+
+    struct Stats {
+        u64 capacity_bytes = 0;
+        u64 used_bytes = 0;
+        u64 hits = 0;
+        u64 misses = 0;
+        u64 writes = 0;
+        u64 dropped_writes = 0; // Write-back queue was full
+        size_t frames = 0;
+        u64 queued_bytes = 0;   // Frames in memory waiting for write-back
+    };
+
+    // Configured from Z3DS_DISK_CACHE_DIR and Z3DS_DISK_CACHE_MB (default
+    // 4096) on first use; disabled when no directory is set
+    static DiskFrameCache& Instance();
+
+    bool Configure(const std::string& directory, u64 capacity_bytes);
+    bool Enabled() const;
+
+    FrameData Lookup(u64 fingerprint, u32 frame, size_t size);
+
+    // Queue a frame for asynchronous write-back
+    void Insert(u64 fingerprint, u32 frame, FrameData data, size_t size);
+
+    // Wait until all queued frames are written
+    void Flush();
+
+    Stats GetStats() const;
+
+    ~DiskFrameCache();
+
+private:
+    DiskFrameCache();
+
+    struct Key {
+        u64 fingerprint;
+        u32 frame;
+
+        bool operator==(const Key& other) const {
+            return fingerprint == other.fingerprint && frame == other.frame;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            return static_cast<size_t>(key.fingerprint * 0x9E3779B97F4A7C15ULL ^ key.frame);
+        }
+    };
+
+    struct Entry {
+        u32 size;
+        u64 data_hash;
+        std::list<Key>::iterator lru_position;
+    };
+
+    struct PendingWrite {
+        Key key;
+        FrameData data;
+        size_t size;
+    };
+
+    void Shutdown();
+    bool LockDirectoryLocked();
+    bool LoadIndexLocked();
+    bool AppendRecordLocked(u8 type, const Key& key, u32 size, u64 data_hash);
+    void EvictLocked();
+    void RemoveLocked(const Key& key);
+    std::string FramePath(const Key& key) const;
+    void WriterThread();
+
+    mutable std::mutex mutex;
+    std::condition_variable queue_changed;
+    std::string directory;
+    u64 capacity = 0;
+    u64 used = 0;
+    u64 hits = 0;
+    u64 misses = 0;
+    u64 writes = 0;
+    u64 dropped_writes = 0;
+
+    std::unordered_map<Key, Entry, KeyHash> entries;
+    std::list<Key> lru; // Most recently used at the front
+    int index_fd = -1;
+    int lock_fd = -1;
+
+    std::deque<PendingWrite> queue;
+    u64 queued_bytes = 0;
+    bool writing = false;
+    bool stopping = false;
+    std::thread writer;
+};
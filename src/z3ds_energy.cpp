@@ -0,0 +1,130 @@
+#include "z3ds_energy.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+
+constexpr auto SAMPLE_INTERVAL = std::chrono::seconds(10);
+
+bool ReadCounter(const std::string& file, u64& value) {
+    std::ifstream input(file);
+    return static_cast<bool>(input >> value);
+}
+
+std::string ReadName(const std::filesystem::path& zone) {
+    std::ifstream input(zone / "name");
+    std::string name;
+    std::getline(input, name);
+    return name;
+}
+
+} // namespace
+
+EnergyMeter::EnergyMeter() {
+#ifdef __linux__
+    const std::filesystem::path root = "/sys/class/powercap";
+    std::error_code ec;
+    if (!std::filesystem::is_directory(root, ec)) {
+        unavailable = "no /sys/class/powercap";
+        return;
+    }
+
+    // Package zones are intel-rapl:N (also used by AMD), DRAM their
+    // intel-rapl:N:M subzone named "dram"
+    std::vector<std::filesystem::path> zones;
+    for (const auto& entry : std::filesystem::directory_iterator(root, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.rfind("intel-rapl:", 0) == 0) {
+            zones.push_back(entry.path());
+        }
+    }
+    std::sort(zones.begin(), zones.end());
+
+    bool unreadable = false;
+    for (const auto& zone : zones) {
+        std::string name = ReadName(zone);
+        bool dram = name == "dram";
+        if (!dram && name.rfind("package-", 0) != 0) {
+            continue;
+        }
+        Domain domain;
+        domain.energy_file = (zone / "energy_uj").string();
+        domain.dram = dram;
+        if (!ReadCounter((zone / "max_energy_range_uj").string(), domain.max_range) ||
+            !ReadCounter(domain.energy_file, domain.last)) {
+            unreadable = true;
+            continue;
+        }
+        domains.push_back(domain);
+    }
+    if (domains.empty()) {
+        unavailable = unreadable ? "RAPL energy_uj not readable (needs root)" : "no RAPL package domain";
+    }
+#else
+    unavailable = "RAPL is only read on Linux";
+#endif
+}
+
+EnergyMeter::~EnergyMeter() {
+    if (sampler.joinable()) {
+        Stop();
+    }
+}
+
+void EnergyMeter::Sample() {
+    for (auto& domain : domains) {
+        u64 now;
+        if (!ReadCounter(domain.energy_file, now)) {
+            continue;
+        }
+        domain.total += now >= domain.last ? now - domain.last : domain.max_range - domain.last + now;
+        domain.last = now;
+    }
+}
+
+void EnergyMeter::Start() {
+    if (!Available()) {
+        return;
+    }
+    if (sampler.joinable()) {
+        Stop();
+    }
+    for (auto& domain : domains) {
+        domain.total = 0;
+        ReadCounter(domain.energy_file, domain.last);
+    }
+    running = true;
+    sampler = std::thread([this] {
+        std::unique_lock lock(mutex);
+        while (!wake.wait_for(lock, SAMPLE_INTERVAL, [this] { return !running; })) {
+            Sample();
+        }
+    });
+}
+
+EnergyReading EnergyMeter::Stop() {
+    EnergyReading reading;
+    if (!sampler.joinable()) {
+        return reading;
+    }
+    {
+        std::lock_guard lock(mutex);
+        running = false;
+    }
+    wake.notify_all();
+    sampler.join();
+    Sample();
+
+    reading.available = true;
+    for (const auto& domain : domains) {
+        if (domain.dram) {
+            reading.has_dram = true;
+            reading.dram_joules += domain.total / 1e6;
+        } else {
+            reading.package_joules += domain.total / 1e6;
+        }
+    }
+    return reading;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "z3ds_compression.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Energy used between Start and Stop, from the RAPL counters in
+// /sys/class/powercap (Linux). The counters cover the whole package and its
+// DRAM, so other load on the host is included in the figures.
+struct EnergyReading {
+    bool available = false;
+    bool has_dram = false;
+    double package_joules = 0.0;
+    double dram_joules = 0.0;
+
+    double Joules() const { return package_joules + dram_joules; }
+    double JoulesPerGB(u64 bytes) const {
+        return bytes ? Joules() / (bytes / (1024.0 * 1024.0 * 1024.0)) : 0.0;
+    }
+};
+
+class EnergyMeter {
+public:
+    EnergyMeter();
+    ~EnergyMeter();
+
+    EnergyMeter(const EnergyMeter&) = delete;
+    EnergyMeter& operator=(const EnergyMeter&) = delete;
+
+    // False without RAPL or without read access to energy_uj (root only on
+    // most kernels); Unavailable() says why
+    bool Available() const { return !domains.empty(); }
+    const std::string& Unavailable() const { return unavailable; }
+
+    void Start();
+    EnergyReading Stop();
+
+private:
+    struct Domain {
+        std::string energy_file;
+        u64 max_range = 0; // Counter wraps to 0 after this many uJ
+        bool dram = false;
+        u64 last = 0;
+        u64 total = 0;
+    };
+
+    void Sample();
+
+    std::vector<Domain> domains;
+    std::string unavailable;
+
+    // Counters can wrap within minutes under load, so long runs are sampled
+    // in the background rather than only at both ends
+    std::thread sampler;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool running = false;
+};
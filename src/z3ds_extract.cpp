@@ -0,0 +1,148 @@
+#include "z3ds_extract.h"
+#include "z3ds_reader.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+// A fill frame compresses at least this well (a few bytes per zstd block).
+// A checksum match alone could be a collision, so only frames this small are
+// taken as fill without decoding; others are decoded and their bytes checked
+constexpr u64 FILL_RATIO_HINT = 256;
+
+bool IsFill(const u8* data, size_t size, u8 value) {
+    return size == 0 || (data[0] == value && std::memcmp(data, data + 1, size - 1) == 0);
+}
+
+// Seek table checksum of a frame of `size` bytes of `value`
+class FillFingerprints {
+public:
+    explicit FillFingerprints(u8 value) : value(value) {}
+
+    u32 For(u32 size) {
+        auto it = checksums.find(size);
+        if (it != checksums.end()) {
+            return it->second;
+        }
+        if (fill.size() < size) {
+            fill.assign(size, value);
+        }
+        u32 checksum = static_cast<u32>(XXH64(fill.data(), size) & 0xFFFFFFFF);
+        checksums.emplace(size, checksum);
+        return checksum;
+    }
+
+private:
+    u8 value;
+    std::vector<u8> fill;
+    std::unordered_map<u32, u32> checksums;
+};
+
+} // namespace
+
+bool ExtractZ3DSFile(const std::string& src_file, const std::string& dst_file, const ExtractOptions& options,
+                     ProgressCallback update_callback, ExtractResult& result) {
+    result = {};
+    Z3DSReader reader;
+    reader.SetRecordAccess(false);
+    if (!reader.Open(src_file)) {
+        return false;
+    }
+    std::ofstream output(dst_file, std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) {
+        std::cerr << "Error: Could not create output file: " << dst_file << std::endl;
+        return false;
+    }
+
+    const auto& frames = reader.GetFrames();
+    result.size = reader.GetSize();
+    result.frames = frames.size();
+    FillFingerprints zero_fingerprints(0x00);
+    FillFingerprints ff_fingerprints(0xFF);
+    std::vector<u8> buffer;
+    std::vector<u8> ff_fill;
+    bool seek_pending = false;
+
+    for (size_t i = 0; i < frames.size(); ++i) {
+        const auto& frame = frames[i];
+        enum class Fill { None, Zero, FF } fill = Fill::None;
+        bool small = frame.compressed_size * FILL_RATIO_HINT < frame.decompressed_size;
+        bool check_zero = false;
+        if (reader.HasChecksums()) {
+            if (frame.checksum == zero_fingerprints.For(frame.decompressed_size)) {
+                fill = small ? Fill::Zero : Fill::None;
+                check_zero = !small;
+            } else if (options.known_fill_ff && small &&
+                       frame.checksum == ff_fingerprints.For(frame.decompressed_size)) {
+                fill = Fill::FF;
+            }
+        } else {
+            check_zero = small;
+        }
+
+        const u8* data = nullptr;
+        if (fill == Fill::FF) {
+            if (ff_fill.size() < frame.decompressed_size) {
+                ff_fill.assign(frame.decompressed_size, 0xFF);
+            }
+            data = ff_fill.data();
+            result.ff_frames++;
+        } else if (fill == Fill::None) {
+            if (!reader.DecompressFrame(i, buffer, options.verify)) {
+                return false;
+            }
+            data = buffer.data();
+            if (check_zero && IsFill(data, frame.decompressed_size, 0x00)) {
+                fill = Fill::Zero;
+            }
+        }
+
+        if (fill == Fill::Zero) {
+            // Skipping the bytes leaves a hole; a hole at the end needs the
+            // final size set explicitly below
+            result.zero_frames++;
+            seek_pending = true;
+        } else {
+            if (seek_pending) {
+                output.seekp(static_cast<std::streamoff>(frame.decompressed_offset));
+                seek_pending = false;
+            }
+            output.write(reinterpret_cast<const char*>(data), frame.decompressed_size);
+            result.written_bytes += frame.decompressed_size;
+            if (!output.good()) {
+                std::cerr << "Error: Could not write " << dst_file << std::endl;
+                return false;
+            }
+        }
+
+        if (update_callback) {
+            update_callback(frame.decompressed_offset + frame.decompressed_size, result.size);
+        }
+    }
+    output.close();
+    if (output.fail()) {
+        std::cerr << "Error: Could not write " << dst_file << std::endl;
+        return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::resize_file(dst_file, result.size, ec);
+    if (ec) {
+        std::cerr << "Error: Could not set the size of " << dst_file << ": " << ec.message() << std::endl;
+        return false;
+    }
+#ifndef _WIN32
+    struct stat info{};
+    if (stat(dst_file.c_str(), &info) == 0) {
+        result.allocated_bytes = static_cast<u64>(info.st_blocks) * 512;
+    }
+#endif
+    return true;
+}
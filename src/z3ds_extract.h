@@ -0,0 +1,27 @@
+#pragma once
+
+#include "z3ds_compression.h"
+
+// Write the uncompressed image of a Z3DS file. Frames that decode to all
+// zeros (untrimmed CCI padding) are recognised from the XXH64 checksum the
+// seek table already records together with a compressed size of almost
+// nothing, are not decoded and are left as holes in the output, so padding
+// costs neither write time nor disk space on file systems with sparse files.
+// Other frames whose checksum matches, and files without checksums, fall
+// back to decoding the frame and checking its bytes.
+struct ExtractOptions {
+    bool known_fill_ff = false; // Also write small all-0xFF frames from their checksum without decoding
+    bool verify = false;        // Check every decoded frame against its checksum
+};
+
+struct ExtractResult {
+    u64 size = 0;
+    size_t frames = 0;
+    size_t zero_frames = 0;  // Left as holes
+    size_t ff_frames = 0;    // Written without decoding
+    u64 written_bytes = 0;
+    u64 allocated_bytes = 0; // Disk space of the output, 0 if unknown
+};
+
+bool ExtractZ3DSFile(const std::string& src_file, const std::string& dst_file, const ExtractOptions& options,
+                     ProgressCallback update_callback, ExtractResult& result);
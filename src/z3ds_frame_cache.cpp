@@ -0,0 +1,215 @@
+#include "z3ds_frame_cache.h"
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+u64 GetFileIdentity(const std::string& filename) {
+#ifndef _WIN32
+    struct stat st{};
+    if (stat(filename.c_str(), &st) == 0) {
+        u64 fields[] = {
+            static_cast<u64>(st.st_dev),
+            static_cast<u64>(st.st_ino),
+            static_cast<u64>(st.st_size),
+            static_cast<u64>(st.st_mtime),
+        };
+        return XXH64(fields, sizeof(fields));
+    }
+#endif
+    // No inode numbers: fall back to the absolute path, size and time
+    std::error_code ec;
+    std::string absolute = std::filesystem::absolute(filename, ec).string();
+    u64 fields[] = {
+        static_cast<u64>(std::filesystem::file_size(filename, ec)),
+        static_cast<u64>(std::filesystem::last_write_time(filename, ec).time_since_epoch().count()),
+    };
+    return XXH64(fields, sizeof(fields), XXH64(absolute.data(), absolute.size()));
+}
+
+FrameCache& FrameCache::Instance() {
+    static FrameCache cache;
+    return cache;
+}
+
+FrameCache::FrameCache() {
+    budget = 256ULL * 1024 * 1024;
+    if (const char* env = std::getenv("Z3DS_FRAME_CACHE_MB")) {
+        budget = std::strtoull(env, nullptr, 10) * 1024 * 1024;
+    }
+}
+
+void FrameCache::SetBudget(u64 bytes) {
+    std::lock_guard lock(mutex);
+    budget = bytes;
+    EvictLocked();
+}
+
+bool FrameCache::Enabled() const {
+    std::lock_guard lock(mutex);
+    return budget > 0;
+}
+
+FrameCache::FrameData FrameCache::Lookup(u64 file_id, u32 frame) {
+    std::lock_guard lock(mutex);
+    auto it = nodes.find({file_id, frame});
+    if (it == nodes.end()) {
+        ++misses;
+        ++FileStatsLocked(file_id).misses;
+        return nullptr;
+    }
+    ++hits;
+    ++FileStatsLocked(file_id).hits;
+    it->second.freq = std::min<u8>(it->second.freq + 1, 3);
+    return it->second.data;
+}
+
+void FrameCache::Insert(u64 file_id, u32 frame, FrameData data, size_t size) {
+    std::lock_guard lock(mutex);
+    Key key{file_id, frame};
+    // A frame taking most of the budget would flush everything else
+    if (!data || size > budget / 10 * 9 || nodes.count(key)) {
+        return;
+    }
+
+    Node node;
+    node.data = std::move(data);
+    node.size = size;
+    if (ghost_keys.erase(key)) {
+        ghost_queue.remove(key);
+        node.in_main = true;
+        main_queue.push_front(key);
+        node.position = main_queue.begin();
+        main_bytes += size;
+    } else {
+        small_queue.push_front(key);
+        node.position = small_queue.begin();
+        small_bytes += size;
+    }
+    nodes.emplace(key, std::move(node));
+    FileStatsLocked(file_id).resident_bytes += size;
+    FileEntry& entry = file_stats.at(file_id);
+    if (entry.idle) {
+        idle_files.erase(entry.idle_position);
+        entry.idle = false;
+    }
+
+    EvictLocked();
+}
+
+void FrameCache::EvictLocked() {
+    while (small_bytes + main_bytes > budget && !nodes.empty()) {
+        if (!small_queue.empty() && (small_bytes > budget / 10 || main_queue.empty())) {
+            EvictSmallLocked();
+        } else {
+            EvictMainLocked();
+        }
+    }
+}
+
+void FrameCache::EvictSmallLocked() {
+    Key key = small_queue.back();
+    Node& node = nodes.at(key);
+    if (node.freq == 0) {
+        RemoveLocked(key, true);
+        return;
+    }
+    // Read again while in the small queue: promote
+    small_queue.pop_back();
+    small_bytes -= node.size;
+    node.freq = 0;
+    node.in_main = true;
+    main_queue.push_front(key);
+    node.position = main_queue.begin();
+    main_bytes += node.size;
+}
+
+void FrameCache::EvictMainLocked() {
+    Key key = main_queue.back();
+    Node& node = nodes.at(key);
+    if (node.freq == 0) {
+        RemoveLocked(key, false);
+        return;
+    }
+    // Second chance: reinsert with one access credit spent
+    --node.freq;
+    main_queue.splice(main_queue.begin(), main_queue, node.position);
+}
+
+void FrameCache::RemoveLocked(const Key& key, bool to_ghost) {
+    auto it = nodes.find(key);
+    Node& node = it->second;
+    if (node.in_main) {
+        main_queue.erase(node.position);
+        main_bytes -= node.size;
+    } else {
+        small_queue.erase(node.position);
+        small_bytes -= node.size;
+    }
+    FileEntry& entry = file_stats.at(key.file_id);
+    entry.stats.resident_bytes -= node.size;
+    if (entry.stats.resident_bytes == 0) {
+        MarkIdleLocked(key.file_id, entry);
+    }
+    nodes.erase(it);
+    ++evictions;
+
+    if (to_ghost) {
+        ghost_queue.push_front(key);
+        ghost_keys.insert(key);
+        // Remember about as many evicted keys as the main queue holds frames
+        while (ghost_queue.size() > std::max<size_t>(64, main_queue.size())) {
+            ghost_keys.erase(ghost_queue.back());
+            ghost_queue.pop_back();
+        }
+    }
+}
+
+FrameCache::FileStats& FrameCache::FileStatsLocked(u64 file_id) {
+    auto [it, inserted] = file_stats.try_emplace(file_id);
+    if (inserted || it->second.idle) {
+        MarkIdleLocked(file_id, it->second);
+    }
+    return it->second.stats;
+}
+
+void FrameCache::MarkIdleLocked(u64 file_id, FileEntry& entry) {
+    if (entry.idle) {
+        idle_files.erase(entry.idle_position);
+    }
+    idle_files.push_front(file_id);
+    entry.idle = true;
+    entry.idle_position = idle_files.begin();
+    // The entry just moved to the front, so only other files are dropped
+    while (idle_files.size() > MAX_IDLE_FILES) {
+        file_stats.erase(idle_files.back());
+        idle_files.pop_back();
+    }
+}
+
+FrameCache::FileStats FrameCache::GetFileStats(u64 file_id) const {
+    std::lock_guard lock(mutex);
+    auto it = file_stats.find(file_id);
+    return it == file_stats.end() ? FileStats{} : it->second.stats;
+}
+
+FrameCache::Stats FrameCache::GetStats() const {
+    std::lock_guard lock(mutex);
+    return {budget, small_bytes + main_bytes, hits, misses, evictions, nodes.size()};
+}
+
+void FrameCache::Clear() {
+    std::lock_guard lock(mutex);
+    nodes.clear();
+    small_queue.clear();
+    main_queue.clear();
+    ghost_queue.clear();
+    ghost_keys.clear();
+    small_bytes = 0;
+    main_bytes = 0;
+    file_stats.clear();
+    idle_files.clear();
+}
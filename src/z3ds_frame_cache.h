@@ -0,0 +1,118 @@
+#pragma once
+
+#include "z3ds_compression.h"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+
+// Identity of a file on disk (device, inode, size and modification time), so
+// the same file opened through different paths shares cache entries
+u64 GetFileIdentity(const std::string& filename);
+
+// Process-wide cache of decoded frames shared by all Z3DSReader instances,
+// keyed by (file identity, frame index) under one memory budget.
+//
+// Eviction is S3-FIFO: new frames enter a small FIFO holding ~10% of the
+// budget and only move to the main FIFO if they are read again before they
+// leave it, so a one-pass scan cannot flush frames that are in real use. Keys
+// evicted from the small queue are remembered in a ghost queue; a frame that
+// comes back while its key is still there goes straight to the main queue.
+class FrameCache {
+public:
+    using FrameData = std::shared_ptr<const u8[]>;
+
+    struct FileStats {
+        u64 hits = 0;
+        u64 misses = 0;
+        u64 resident_bytes = 0;
+
+        double HitRate() const {
+            return hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0;
+        }
+    };
+
+    struct Stats {
+        u64 budget_bytes = 0;
+        u64 used_bytes = 0;
+        u64 hits = 0;
+        u64 misses = 0;
+        u64 evictions = 0;
+        size_t frames = 0;
+    };
+
+    // Budget defaults to Z3DS_FRAME_CACHE_MB from the environment, else 256MB
+    static FrameCache& Instance();
+
+    // 0 disables caching and drops all frames
+    void SetBudget(u64 bytes);
+    bool Enabled() const;
+
+    FrameData Lookup(u64 file_id, u32 frame);
+    void Insert(u64 file_id, u32 frame, FrameData data, size_t size);
+
+    // Per-file counters are kept for files with frames in the cache and the
+    // MAX_IDLE_FILES most recently seen others, so a long-running process that
+    // opens many files does not grow without bound
+    FileStats GetFileStats(u64 file_id) const;
+    Stats GetStats() const;
+    // Drop all frames and per-file counters
+    void Clear();
+
+private:
+    FrameCache();
+
+    struct Key {
+        u64 file_id;
+        u32 frame;
+
+        bool operator==(const Key& other) const {
+            return file_id == other.file_id && frame == other.frame;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            return static_cast<size_t>(key.file_id * 0x9E3779B97F4A7C15ULL ^ key.frame);
+        }
+    };
+
+    struct Node {
+        FrameData data;
+        size_t size = 0;
+        u8 freq = 0;
+        bool in_main = false;
+        std::list<Key>::iterator position;
+    };
+
+    struct FileEntry {
+        FileStats stats;
+        bool idle = false;
+        std::list<u64>::iterator idle_position;
+    };
+
+    void EvictLocked();
+    void EvictSmallLocked();
+    void EvictMainLocked();
+    void RemoveLocked(const Key& key, bool to_ghost);
+    FileStats& FileStatsLocked(u64 file_id);
+    void MarkIdleLocked(u64 file_id, FileEntry& entry);
+
+    static constexpr size_t MAX_IDLE_FILES = 1024;
+
+    mutable std::mutex mutex;
+    u64 budget = 0;
+    u64 small_bytes = 0;
+    u64 main_bytes = 0;
+    u64 hits = 0;
+    u64 misses = 0;
+    u64 evictions = 0;
+
+    std::unordered_map<Key, Node, KeyHash> nodes;
+    std::list<Key> small_queue; // Newest at the front
+    std::list<Key> main_queue;
+    std::list<Key> ghost_queue;
+    std::unordered_set<Key, KeyHash> ghost_keys;
+    std::unordered_map<u64, FileEntry> file_stats;
+    std::list<u64> idle_files; // No resident frames, most recently seen at the front
+};
@@ -0,0 +1,268 @@
+#include "z3ds_import.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <zstd.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr u32 SKIPPABLE_MAGIC = 0x184D2A5E;
+constexpr u32 SEEKABLE_MAGIC = 0x8F92EAB1;
+constexpr size_t SEEK_FOOTER_SIZE = 9;
+
+u32 ReadLE32(const u8* data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<u32>(data[3]) << 24);
+}
+
+void WriteLE(std::vector<u8>& out, u64 value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out.push_back(static_cast<u8>(value >> (8 * i)));
+    }
+}
+
+struct SeekEntry {
+    u64 offset;
+    u32 compressed_size;
+    u32 decompressed_size;
+    u32 checksum;
+};
+
+bool CheckFrame(std::ifstream& input, const SeekEntry& entry, bool has_checksum, ZSTD_DCtx* dctx,
+                std::vector<u8>& compressed, std::vector<u8>& decompressed, size_t index) {
+    compressed.resize(entry.compressed_size);
+    decompressed.resize(entry.decompressed_size);
+    input.clear();
+    input.seekg(entry.offset);
+    input.read(reinterpret_cast<char*>(compressed.data()), compressed.size());
+    if (input.gcount() != static_cast<std::streamsize>(compressed.size())) {
+        ErrorLog() << "Error: Truncated frame " << index << std::endl;
+        return false;
+    }
+    size_t result = ZSTD_decompressDCtx(dctx, decompressed.data(), decompressed.size(),
+                                        compressed.data(), compressed.size());
+    if (ZSTD_isError(result) || result != entry.decompressed_size) {
+        ErrorLog() << "Error: Frame " << index << " does not decode to its table size";
+        if (ZSTD_isError(result)) {
+            ErrorLog() << ": " << ZSTD_getErrorName(result);
+        }
+        ErrorLog() << std::endl;
+        return false;
+    }
+    if (has_checksum &&
+        static_cast<u32>(XXH64(decompressed.data(), decompressed.size())) != entry.checksum) {
+        ErrorLog() << "Error: Checksum mismatch in frame " << index << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Append src[0, size) to dst at dst_offset, in the kernel where possible
+bool CopyPayload(const std::string& src_file, const std::string& dst_file, u64 dst_offset, u64 size,
+                 bool& used_copy_file_range) {
+    used_copy_file_range = false;
+#ifdef __linux__
+    int src_fd = open(src_file.c_str(), O_RDONLY | O_CLOEXEC);
+    int dst_fd = open(dst_file.c_str(), O_WRONLY | O_CLOEXEC);
+    if (src_fd >= 0 && dst_fd >= 0) {
+        loff_t in_offset = 0;
+        loff_t out_offset = static_cast<loff_t>(dst_offset);
+        u64 remaining = size;
+        while (remaining > 0) {
+            ssize_t copied = copy_file_range(src_fd, &in_offset, dst_fd, &out_offset,
+                                             std::min<u64>(remaining, 1ULL << 30), 0);
+            if (copied <= 0) {
+                break;
+            }
+            remaining -= copied;
+        }
+        close(src_fd);
+        close(dst_fd);
+        if (remaining == 0) {
+            used_copy_file_range = true;
+            return true;
+        }
+        // Unsupported across these filesystems (EXDEV, ENOSYS, ...): copy in
+        // user space from the start instead
+    } else {
+        if (src_fd >= 0) {
+            close(src_fd);
+        }
+        if (dst_fd >= 0) {
+            close(dst_fd);
+        }
+    }
+#endif
+
+    std::ifstream input(src_file, std::ios::binary);
+    std::fstream output(dst_file, std::ios::binary | std::ios::in | std::ios::out);
+    if (!input.is_open() || !output.is_open()) {
+        return false;
+    }
+    output.seekp(dst_offset);
+    std::vector<char> buffer(4 * 1024 * 1024);
+    u64 remaining = size;
+    while (remaining > 0) {
+        size_t chunk = static_cast<size_t>(std::min<u64>(buffer.size(), remaining));
+        input.read(buffer.data(), chunk);
+        if (input.gcount() != static_cast<std::streamsize>(chunk)) {
+            return false;
+        }
+        output.write(buffer.data(), chunk);
+        remaining -= chunk;
+    }
+    return output.good();
+}
+
+} // namespace
+
+bool ImportSeekableZstd(const std::string& src_file, const std::string& dst_file, bool verify_all,
+                        ImportResult& result) {
+    result = {};
+    std::error_code ec;
+    if (std::filesystem::equivalent(src_file, dst_file, ec)) {
+        ErrorLog() << "Error: Output is the same file as the input: " << dst_file << std::endl;
+        return false;
+    }
+    std::ifstream input(src_file, std::ios::binary);
+    if (!input.is_open()) {
+        ErrorLog() << "Error: Could not open source file: " << src_file << std::endl;
+        return false;
+    }
+    input.seekg(0, std::ios::end);
+    u64 file_size = input.tellg();
+
+    // Footer: frame count, descriptor, magic
+    u8 footer[SEEK_FOOTER_SIZE];
+    if (file_size < SEEK_FOOTER_SIZE + 8) {
+        ErrorLog() << "Error: Too small for a seekable zstd file: " << src_file << std::endl;
+        return false;
+    }
+    input.seekg(file_size - SEEK_FOOTER_SIZE);
+    input.read(reinterpret_cast<char*>(footer), sizeof(footer));
+    if (ReadLE32(footer + 5) != SEEKABLE_MAGIC) {
+        ErrorLog() << "Error: No seekable zstd footer (magic 0x8F92EAB1) in " << src_file << std::endl;
+        return false;
+    }
+    u32 num_frames = ReadLE32(footer);
+    u8 descriptor = footer[4];
+    if (descriptor & 0x7C) {
+        ErrorLog() << "Error: Reserved seek table descriptor bits set in " << src_file << std::endl;
+        return false;
+    }
+    result.has_checksums = (descriptor & 0x80) != 0;
+
+    // Seek table in a skippable frame that ends the file
+    size_t entry_size = result.has_checksums ? 12 : 8;
+    u64 table_size = static_cast<u64>(num_frames) * entry_size + SEEK_FOOTER_SIZE;
+    if (num_frames == 0 || table_size + 8 > file_size) {
+        ErrorLog() << "Error: Invalid seek table size in " << src_file << std::endl;
+        return false;
+    }
+    std::vector<u8> table(table_size + 8);
+    input.seekg(file_size - table.size());
+    input.read(reinterpret_cast<char*>(table.data()), table.size());
+    if (input.gcount() != static_cast<std::streamsize>(table.size()) ||
+        ReadLE32(table.data()) != SKIPPABLE_MAGIC || ReadLE32(table.data() + 4) != table_size) {
+        ErrorLog() << "Error: Seek table frame is malformed in " << src_file << std::endl;
+        return false;
+    }
+
+    std::vector<SeekEntry> entries;
+    entries.reserve(num_frames);
+    u64 offset = 0;
+    for (u32 i = 0; i < num_frames; ++i) {
+        const u8* entry = table.data() + 8 + static_cast<size_t>(i) * entry_size;
+        SeekEntry frame{offset, ReadLE32(entry), ReadLE32(entry + 4),
+                        result.has_checksums ? ReadLE32(entry + 8) : 0};
+        if (frame.compressed_size == 0) {
+            ErrorLog() << "Error: Empty frame " << i << " in seek table of " << src_file << std::endl;
+            return false;
+        }
+        entries.push_back(frame);
+        offset += frame.compressed_size;
+        result.uncompressed_size += frame.decompressed_size;
+        result.max_frame_size = std::max(result.max_frame_size, frame.decompressed_size);
+    }
+    if (offset + table.size() != file_size) {
+        ErrorLog() << "Error: Frames in the seek table do not fill " << src_file << std::endl;
+        return false;
+    }
+    result.frame_count = num_frames;
+    result.compressed_size = file_size;
+
+    // Decode the first frame (or all of them) to check the table against the data
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    std::vector<u8> compressed;
+    std::vector<u8> decompressed;
+    std::vector<u8> first_bytes;
+    size_t to_check = verify_all ? entries.size() : 1;
+    for (size_t i = 0; i < to_check; ++i) {
+        if (!CheckFrame(input, entries[i], result.has_checksums, dctx, compressed, decompressed, i)) {
+            ZSTD_freeDCtx(dctx);
+            return false;
+        }
+        if (i == 0) {
+            first_bytes.assign(decompressed.begin(),
+                               decompressed.begin() + std::min<size_t>(decompressed.size(), 0x104));
+        }
+        ++result.verified_frames;
+    }
+    ZSTD_freeDCtx(dctx);
+    input.close();
+
+    // "game.cia.zst" names a CIA
+    std::filesystem::path src_path(src_file);
+    std::string name_hint = src_path.extension() == ".zst" ? src_path.stem().string() : src_path.filename().string();
+    result.underlying_magic = DetectDataMagic(first_bytes.data(), first_bytes.size(), name_hint);
+
+    Z3DSMetadata meta;
+    meta.Add("compressor", "Z3DS CLI Tool v1.0");
+    meta.Add("date", GetCurrentTimeISO());
+    meta.Add("maxframesize", std::to_string(result.max_frame_size));
+    meta.Add("imported", src_path.filename().string());
+    auto metadata_binary = meta.AsBinary();
+    metadata_binary.resize((metadata_binary.size() + 15) / 16 * 16, 0);
+
+    Z3DSFileHeader header;
+    header.underlying_magic = result.underlying_magic;
+    header.metadata_size = static_cast<u32>(metadata_binary.size());
+    header.compressed_size = result.compressed_size;
+    header.uncompressed_size = result.uncompressed_size;
+
+    std::vector<u8> prefix;
+    prefix.insert(prefix.end(), header.magic.begin(), header.magic.end());
+    prefix.insert(prefix.end(), header.underlying_magic.begin(), header.underlying_magic.end());
+    prefix.push_back(header.version);
+    prefix.push_back(header.reserved);
+    WriteLE(prefix, header.header_size, 2);
+    WriteLE(prefix, header.metadata_size, 4);
+    WriteLE(prefix, header.compressed_size, 8);
+    WriteLE(prefix, header.uncompressed_size, 8);
+    prefix.insert(prefix.end(), metadata_binary.begin(), metadata_binary.end());
+
+    {
+        std::ofstream output(dst_file, std::ios::binary | std::ios::trunc);
+        if (!output.is_open()) {
+            ErrorLog() << "Error: Could not create output file: " << dst_file << std::endl;
+            return false;
+        }
+        output.write(reinterpret_cast<const char*>(prefix.data()), prefix.size());
+        if (!output.good()) {
+            ErrorLog() << "Error: Could not write " << dst_file << std::endl;
+            return false;
+        }
+    }
+
+    if (!CopyPayload(src_file, dst_file, prefix.size(), file_size, result.used_copy_file_range)) {
+        ErrorLog() << "Error: Could not copy frames into " << dst_file << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "z3ds_compression.h"
+
+struct ImportResult {
+    std::array<u8, 4> underlying_magic{};
+    size_t frame_count = 0;
+    u32 max_frame_size = 0;
+    u64 compressed_size = 0;   // Frames and seek table, copied unchanged
+    u64 uncompressed_size = 0;
+    bool has_checksums = false;
+    size_t verified_frames = 0;
+    bool used_copy_file_range = false;
+};
+
+// Wrap a seekable zstd file (frames followed by a seek table, as written by
+// SeekableZSTDCompressor or the zstd contrib seekable format) into a Z3DS
+// file without recompressing. The footer and frame table are validated and
+// the first frame is decoded to check its checksum and find the underlying
+// magic; with verify_all every frame is decoded and checked. Fails without
+// touching either file if dst_file is src_file under another name.
+bool ImportSeekableZstd(const std::string& src_file, const std::string& dst_file, bool verify_all,
+                        ImportResult& result);
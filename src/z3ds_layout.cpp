@@ -0,0 +1,465 @@
+#include "z3ds_layout.h"
+#include <algorithm>
+#include <map>
+#include <cstring>
+
+namespace {
+
+constexpr u64 MEDIA_UNIT = 0x200;
+
+u32 LE32(const u8* p) {
+    return static_cast<u32>(p[0]) | (static_cast<u32>(p[1]) << 8) |
+           (static_cast<u32>(p[2]) << 16) | (static_cast<u32>(p[3]) << 24);
+}
+
+u64 LE64(const u8* p) {
+    return static_cast<u64>(LE32(p)) | (static_cast<u64>(LE32(p + 4)) << 32);
+}
+
+u16 BE16(const u8* p) {
+    return static_cast<u16>((p[0] << 8) | p[1]);
+}
+
+u32 BE32(const u8* p) {
+    return (static_cast<u32>(p[0]) << 24) | (static_cast<u32>(p[1]) << 16) |
+           (static_cast<u32>(p[2]) << 8) | static_cast<u32>(p[3]);
+}
+
+u64 BE64(const u8* p) {
+    return (static_cast<u64>(BE32(p)) << 32) | BE32(p + 4);
+}
+
+u64 AlignUp(u64 value, u64 alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+std::string UTF16ToUTF8(const u8* data, size_t bytes) {
+    std::string out;
+    for (size_t i = 0; i + 1 < bytes; i += 2) {
+        u32 c = data[i] | (data[i + 1] << 8);
+        if (c >= 0xD800 && c < 0xDC00 && i + 3 < bytes) {
+            u32 low = data[i + 2] | (data[i + 3] << 8);
+            c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+            i += 2;
+        }
+        if (c < 0x80) {
+            out += static_cast<char>(c);
+        } else if (c < 0x800) {
+            out += static_cast<char>(0xC0 | (c >> 6));
+            out += static_cast<char>(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            out += static_cast<char>(0xE0 | (c >> 12));
+            out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (c & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (c >> 18));
+            out += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (c & 0x3F));
+        }
+    }
+    return out;
+}
+
+bool ParseExeFS(const LayoutReadFunc& read, NCCHPartition& ncch) {
+    u8 header[0x200];
+    if (ncch.exefs_size < sizeof(header) || !read(ncch.exefs_offset, header, sizeof(header))) {
+        return false;
+    }
+    for (int i = 0; i < 10; ++i) {
+        const u8* entry = header + i * 16;
+        if (entry[0] == 0) {
+            continue;
+        }
+        std::string name(reinterpret_cast<const char*>(entry), strnlen(reinterpret_cast<const char*>(entry), 8));
+        u64 offset = ncch.exefs_offset + sizeof(header) + LE32(entry + 8);
+        u64 size = LE32(entry + 12);
+        if (offset + size > ncch.exefs_offset + ncch.exefs_size) {
+            return false;
+        }
+        ncch.exefs_files.push_back({name, offset, size});
+    }
+    return true;
+}
+
+// RomFS level 3 directory and file metadata tables
+class RomFSWalker {
+public:
+    RomFSWalker(const std::vector<u8>& dirs, const std::vector<u8>& files, u64 data_offset,
+                std::vector<RomFileEntry>& out)
+        : dirs(dirs), files(files), data_offset(data_offset), out(out) {}
+
+    // Offsets and lengths come from the image, so bounds are checked in 64 bits
+    bool Walk(u32 dir_offset, const std::string& prefix, int depth) {
+        if (depth > 64 || u64{dir_offset} + 0x18 > dirs.size()) {
+            return false;
+        }
+        const u8* dir = dirs.data() + dir_offset;
+
+        for (u32 file = LE32(dir + 0xC); file != 0xFFFFFFFF;) {
+            if (u64{file} + 0x20 > files.size() || ++visited > MAX_ENTRIES) {
+                return false;
+            }
+            const u8* entry = files.data() + file;
+            u32 name_len = LE32(entry + 0x1C);
+            if (u64{file} + 0x20 + name_len > files.size()) {
+                return false;
+            }
+            out.push_back({prefix + "/" + UTF16ToUTF8(entry + 0x20, name_len),
+                           data_offset + LE64(entry + 0x8), LE64(entry + 0x10)});
+            file = LE32(entry + 0x4);
+        }
+
+        for (u32 child = LE32(dir + 0x8); child != 0xFFFFFFFF;) {
+            if (u64{child} + 0x18 > dirs.size() || ++visited > MAX_ENTRIES) {
+                return false;
+            }
+            const u8* entry = dirs.data() + child;
+            u32 name_len = LE32(entry + 0x14);
+            if (u64{child} + 0x18 + name_len > dirs.size() ||
+                !Walk(child, prefix + "/" + UTF16ToUTF8(entry + 0x18, name_len), depth + 1)) {
+                return false;
+            }
+            child = LE32(entry + 0x4);
+        }
+        return true;
+    }
+
+private:
+    static constexpr size_t MAX_ENTRIES = 1 << 22;
+
+    const std::vector<u8>& dirs;
+    const std::vector<u8>& files;
+    u64 data_offset;
+    std::vector<RomFileEntry>& out;
+    size_t visited = 0;
+};
+
+bool ParseRomFS(const LayoutReadFunc& read, NCCHPartition& ncch) {
+    u8 ivfc[0x5C];
+    if (ncch.romfs_size < sizeof(ivfc) || !read(ncch.romfs_offset, ivfc, sizeof(ivfc)) ||
+        std::memcmp(ivfc, "IVFC", 4) != 0 || LE32(ivfc + 4) != 0x10000) {
+        return false;
+    }
+    u32 master_hash_size = LE32(ivfc + 0x8);
+    u32 level3_block_log2 = LE32(ivfc + 0x4C);
+    if (level3_block_log2 > 30) {
+        return false;
+    }
+    u64 level3 = ncch.romfs_offset + AlignUp(0x60 + master_hash_size, u64(1) << level3_block_log2);
+
+    u8 header[0x28];
+    if (!read(level3, header, sizeof(header)) || LE32(header) != sizeof(header)) {
+        return false;
+    }
+    u32 dir_meta_offset = LE32(header + 0xC);
+    u32 dir_meta_size = LE32(header + 0x10);
+    u32 file_meta_offset = LE32(header + 0x1C);
+    u32 file_meta_size = LE32(header + 0x20);
+    u64 file_data_offset = level3 + LE32(header + 0x24);
+    u64 romfs_end = ncch.romfs_offset + ncch.romfs_size;
+    if (level3 + dir_meta_offset + dir_meta_size > romfs_end ||
+        level3 + file_meta_offset + file_meta_size > romfs_end) {
+        return false;
+    }
+
+    std::vector<u8> dirs(dir_meta_size);
+    std::vector<u8> files(file_meta_size);
+    if (!read(level3 + dir_meta_offset, dirs.data(), dirs.size()) ||
+        !read(level3 + file_meta_offset, files.data(), files.size())) {
+        return false;
+    }
+
+    RomFSWalker walker(dirs, files, file_data_offset, ncch.romfs_files);
+    if (!walker.Walk(0, "", 0)) {
+        ncch.romfs_files.clear();
+        return false;
+    }
+    for (const auto& file : ncch.romfs_files) {
+        if (file.offset + file.size > romfs_end) {
+            ncch.romfs_files.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ParseNCCH(const LayoutReadFunc& read, u64 offset, u64 size, NCCHPartition& ncch) {
+    u8 header[0x200];
+    if (size < sizeof(header) || !read(offset, header, sizeof(header)) ||
+        std::memcmp(header + 0x100, "NCCH", 4) != 0) {
+        return false;
+    }
+    ncch.offset = offset;
+    ncch.size = std::min<u64>(size, LE32(header + 0x104) * MEDIA_UNIT);
+    ncch.program_id = LE64(header + 0x118);
+    ncch.encrypted = (header[0x188 + 7] & 0x4) == 0; // NoCrypto flag
+    ncch.exefs_offset = offset + LE32(header + 0x1A0) * MEDIA_UNIT;
+    ncch.exefs_size = LE32(header + 0x1A4) * MEDIA_UNIT;
+    ncch.romfs_offset = offset + LE32(header + 0x1B0) * MEDIA_UNIT;
+    ncch.romfs_size = LE32(header + 0x1B4) * MEDIA_UNIT;
+
+    if (!ncch.encrypted) {
+        if (ncch.exefs_size && !ParseExeFS(read, ncch)) {
+            ncch.exefs_files.clear();
+        }
+        if (ncch.romfs_size && !ParseRomFS(read, ncch)) {
+            ncch.romfs_files.clear();
+        }
+    }
+    return true;
+}
+
+bool ParseNCSD(const LayoutReadFunc& read, u64 image_size, std::vector<NCCHPartition>& partitions) {
+    u8 table[0x40];
+    if (!read(0x120, table, sizeof(table))) {
+        return false;
+    }
+    for (u32 i = 0; i < 8; ++i) {
+        u64 offset = LE32(table + i * 8) * MEDIA_UNIT;
+        u64 size = LE32(table + i * 8 + 4) * MEDIA_UNIT;
+        if (size == 0 || offset + size > image_size) {
+            continue;
+        }
+        NCCHPartition ncch;
+        if (!ParseNCCH(read, offset, size, ncch)) {
+            ncch.offset = offset;
+            ncch.size = size;
+        }
+        ncch.index = i;
+        partitions.push_back(std::move(ncch));
+    }
+    return true;
+}
+
+bool ParseCIA(const LayoutReadFunc& read, u64 image_size, std::vector<NCCHPartition>& partitions) {
+    u8 header[0x2020];
+    if (image_size < sizeof(header) || !read(0, header, sizeof(header)) || LE32(header) != sizeof(header)) {
+        return false;
+    }
+    u64 cert_offset = AlignUp(sizeof(header), 64);
+    u64 ticket_offset = AlignUp(cert_offset + LE32(header + 0x8), 64);
+    u64 tmd_offset = AlignUp(ticket_offset + LE32(header + 0xC), 64);
+    u64 tmd_size = LE32(header + 0x10);
+    u64 content_offset = AlignUp(tmd_offset + tmd_size, 64);
+
+    std::vector<u8> tmd(tmd_size);
+    if (tmd_size < 4 || !read(tmd_offset, tmd.data(), tmd.size())) {
+        return false;
+    }
+    u64 signature_size;
+    switch (BE32(tmd.data())) {
+    case 0x010000: case 0x010003: signature_size = 0x200 + 0x3C; break;
+    case 0x010001: case 0x010004: signature_size = 0x100 + 0x3C; break;
+    case 0x010002: case 0x010005: signature_size = 0x3C + 0x40; break;
+    default: return false;
+    }
+    u64 tmd_header = 4 + signature_size;
+    u64 records = tmd_header + 0xC4 + 64 * 0x24;
+    if (tmd_header + 0xC4 > tmd.size()) {
+        return false;
+    }
+    u16 content_count = BE16(tmd.data() + tmd_header + 0x9E);
+
+    const u8* index_bitmap = header + 0x20;
+    u64 offset = content_offset;
+    for (u16 i = 0; i < content_count && records + (i + 1) * 0x30 <= tmd.size(); ++i) {
+        const u8* record = tmd.data() + records + i * 0x30;
+        u16 index = BE16(record + 4);
+        u16 type = BE16(record + 6);
+        u64 size = BE64(record + 8);
+        if (!(index_bitmap[index / 8] & (0x80 >> (index % 8)))) {
+            continue; // Content not included in this CIA
+        }
+        if (offset + size > image_size) {
+            break;
+        }
+        NCCHPartition ncch;
+        // Title-key encrypted contents (type bit 0) have no readable NCCH header
+        if ((type & 1) || !ParseNCCH(read, offset, size, ncch)) {
+            ncch.offset = offset;
+            ncch.size = size;
+            ncch.encrypted = true;
+        }
+        ncch.index = index;
+        partitions.push_back(std::move(ncch));
+        offset += size;
+    }
+    return true;
+}
+
+bool HasExtension(const std::string& path, std::initializer_list<const char*> extensions) {
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos) {
+        return false;
+    }
+    std::string ext = path.substr(dot);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    for (const char* candidate : extensions) {
+        if (ext == candidate) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Interval map: each key starts a run of its type up to the next key
+class RegionPainter {
+public:
+    RegionPainter(u64 size, RegionType base) : size(size) {
+        runs[0] = base;
+    }
+
+    void Paint(u64 start, u64 length, RegionType type) {
+        u64 end = std::min(size, start + length);
+        if (start >= end) {
+            return;
+        }
+        RegionType after = std::prev(runs.upper_bound(end))->second;
+        runs.erase(runs.lower_bound(start), runs.upper_bound(end));
+        runs[start] = type;
+        runs[end] = after;
+    }
+
+    std::vector<RomRegion> Regions() const {
+        std::vector<RomRegion> regions;
+        for (auto it = runs.begin(); it != runs.end() && it->first < size; ++it) {
+            u64 end = std::next(it) == runs.end() ? size : std::min(size, std::next(it)->first);
+            if (end <= it->first) {
+                continue;
+            }
+            if (!regions.empty() && regions.back().type == it->second) {
+                regions.back().size = end - regions.back().offset;
+            } else {
+                regions.push_back({it->first, end - it->first, it->second});
+            }
+        }
+        return regions;
+    }
+
+private:
+    u64 size;
+    std::map<u64, RegionType> runs;
+};
+
+} // namespace
+
+bool ParseRomLayout(const LayoutReadFunc& read, u64 image_size, std::vector<NCCHPartition>& partitions) {
+    partitions.clear();
+    u8 magic[4];
+    if (image_size < 0x200 || !read(0x100, magic, sizeof(magic))) {
+        return false;
+    }
+    if (std::memcmp(magic, "NCSD", 4) == 0) {
+        return ParseNCSD(read, image_size, partitions);
+    }
+    if (std::memcmp(magic, "NCCH", 4) == 0) {
+        NCCHPartition ncch;
+        if (!ParseNCCH(read, 0, image_size, ncch)) {
+            return false;
+        }
+        partitions.push_back(std::move(ncch));
+        return true;
+    }
+    return ParseCIA(read, image_size, partitions);
+}
+
+const char* GetRegionTypeName(RegionType type) {
+    switch (type) {
+    case RegionType::Other: return "other";
+    case RegionType::Header: return "header";
+    case RegionType::ExeFSCode: return "code";
+    case RegionType::ExeFS: return "exefs";
+    case RegionType::RomFS: return "romfs";
+    case RegionType::Audio: return "audio";
+    case RegionType::Texture: return "texture";
+    case RegionType::Encrypted: return "encrypted";
+    case RegionType::Padding: return "padding";
+    default: return "unknown";
+    }
+}
+
+std::optional<RegionType> ParseRegionTypeName(const std::string& name) {
+    for (u8 i = 0; i < static_cast<u8>(RegionType::Count); ++i) {
+        if (name == GetRegionTypeName(static_cast<RegionType>(i))) {
+            return static_cast<RegionType>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+std::vector<RomRegion> BuildRomRegions(const std::vector<NCCHPartition>& partitions, u64 image_size,
+                                       u64 min_file_region) {
+    // Space outside all partitions is container headers before the first one
+    // and padding after the last one
+    RegionPainter painter(image_size, RegionType::Padding);
+    if (partitions.empty()) {
+        painter.Paint(0, image_size, RegionType::Other);
+        return painter.Regions();
+    }
+    u64 first = image_size;
+    for (const auto& ncch : partitions) {
+        first = std::min(first, ncch.offset);
+    }
+    painter.Paint(0, first, RegionType::Header);
+
+    for (const auto& ncch : partitions) {
+        if (ncch.encrypted) {
+            painter.Paint(ncch.offset, ncch.size, RegionType::Encrypted);
+            continue;
+        }
+        painter.Paint(ncch.offset, ncch.size, RegionType::Other);
+        painter.Paint(ncch.offset, 0x200, RegionType::Header);
+        painter.Paint(ncch.exefs_offset, ncch.exefs_size, RegionType::ExeFS);
+        for (const auto& file : ncch.exefs_files) {
+            if (file.path == ".code") {
+                painter.Paint(file.offset, file.size, RegionType::ExeFSCode);
+            }
+        }
+        painter.Paint(ncch.romfs_offset, ncch.romfs_size, RegionType::RomFS);
+        for (const auto& file : ncch.romfs_files) {
+            if (file.size < min_file_region) {
+                continue;
+            }
+            if (HasExtension(file.path, {".bcstm", ".bfstm", ".bcwav", ".bfwav", ".bcsar", ".bfsar"})) {
+                painter.Paint(file.offset, file.size, RegionType::Audio);
+            } else if (HasExtension(file.path, {".bclim", ".bflim", ".ctpk"})) {
+                painter.Paint(file.offset, file.size, RegionType::Texture);
+            }
+        }
+    }
+    return painter.Regions();
+}
+
+RegionPolicy MakeDefaultRegionPolicy(const CompressionProfile& base) {
+    RegionPolicy policy;
+    policy.profiles.fill(base);
+    
+    CompressionProfile code;
+    code.name = "code";
+    code.level = 19;
+    CompressionProfile fast;
+    fast.name = "fast";
+    fast.level = 1;
+    
+    // ExeFS code is small and read on every boot: spend CPU there. Audio banks
+    // are large and barely compressible, padding compresses at any level, and
+    // encrypted data cannot be compressed at all.
+    policy.profiles[static_cast<size_t>(RegionType::ExeFSCode)] = code;
+    policy.profiles[static_cast<size_t>(RegionType::Audio)] = fast;
+    policy.profiles[static_cast<size_t>(RegionType::Padding)] = fast;
+    policy.profiles[static_cast<size_t>(RegionType::Encrypted)] = *FindCompressionProfile("raw");
+    return policy;
+}
+
+std::string DescribeRegionPolicy(const RegionPolicy& policy) {
+    std::string description;
+    for (u8 i = 0; i < static_cast<u8>(RegionType::Count); ++i) {
+        if (!description.empty()) {
+            description += ";";
+        }
+        description += std::string(GetRegionTypeName(static_cast<RegionType>(i))) + ":" +
+                       DescribeCompressionProfile(policy.profiles[i]);
+    }
+    return description;
+}
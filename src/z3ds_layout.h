@@ -0,0 +1,75 @@
+#pragma once
+
+#include "z3ds_compression.h"
+
+// Reads `size` bytes at `offset` of the (uncompressed) ROM image
+using LayoutReadFunc = std::function<bool(u64 offset, void* buffer, size_t size)>;
+
+struct RomFileEntry {
+    std::string path; // "/dir/file.ext" for RomFS, ".code" etc. for ExeFS
+    u64 offset;       // Absolute offset in the ROM image
+    u64 size;
+};
+
+// One NCCH inside a CCI (NCSD partition), CIA (content) or a bare CXI
+struct NCCHPartition {
+    u32 index = 0;
+    u64 offset = 0;
+    u64 size = 0;
+    bool encrypted = true; // Only NoCrypto NCCHs have readable ExeFS/RomFS
+    u64 program_id = 0;
+    u64 exefs_offset = 0;
+    u64 exefs_size = 0;
+    u64 romfs_offset = 0;
+    u64 romfs_size = 0;
+    std::vector<RomFileEntry> exefs_files;
+    std::vector<RomFileEntry> romfs_files;
+};
+
+// Parse the NCCH partitions of a CCI, CIA or CXI image. Returns false if the
+// image is none of these; partitions that fail to parse are marked encrypted.
+bool ParseRomLayout(const LayoutReadFunc& read, u64 image_size, std::vector<NCCHPartition>& partitions);
+
+// Content classes that compression policy can treat differently
+enum class RegionType : u8 {
+    Other,
+    Header,
+    ExeFSCode,
+    ExeFS,
+    RomFS,
+    Audio,
+    Texture,
+    Encrypted,
+    Padding,
+    Count,
+};
+
+struct RomRegion {
+    u64 offset;
+    u64 size;
+    RegionType type;
+};
+
+const char* GetRegionTypeName(RegionType type);
+std::optional<RegionType> ParseRegionTypeName(const std::string& name);
+
+// Cover [0, image_size) with non-overlapping regions, merging neighbours of the
+// same type and folding RomFS files below min_file_region into the RomFS region
+std::vector<RomRegion> BuildRomRegions(const std::vector<NCCHPartition>& partitions, u64 image_size,
+                                       u64 min_file_region = 256 * 1024);
+
+// Compression parameters per region type
+struct RegionPolicy {
+    std::array<CompressionProfile, static_cast<size_t>(RegionType::Count)> profiles;
+
+    const CompressionProfile& For(RegionType type) const {
+        return profiles[static_cast<size_t>(type)];
+    }
+};
+
+// High level for ExeFS code, fast level for audio and padding, raw for
+// encrypted content and `base` for everything else
+RegionPolicy MakeDefaultRegionPolicy(const CompressionProfile& base);
+
+// "type:params;..." for the metadata
+std::string DescribeRegionPolicy(const RegionPolicy& policy);
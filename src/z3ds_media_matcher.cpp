@@ -0,0 +1,106 @@
+#include "z3ds_media_matcher.h"
+#include "z3ds_compression.h"
+#include <cstring>
+#define ZSTD_STATIC_LINKING_ONLY // Sequence producer API
+#include <zstd.h>
+
+#if ZSTD_VERSION_NUMBER >= 10504
+
+namespace {
+
+constexpr size_t ALIGNMENT = 16;
+constexpr size_t MIN_MATCH = 32;
+constexpr int HASH_BITS = 13; // One entry per aligned position of a 128KB block
+constexpr size_t MIN_COVERAGE_PERCENT = 90;
+
+u32 HashAt(const u8* data) {
+    u64 a;
+    u64 b;
+    std::memcpy(&a, data, 8);
+    std::memcpy(&b, data + 8, 8);
+    return static_cast<u32>(((a * 0x9E3779B185EBCA87ULL) ^ (b * 0xC2B2AE3D27D4EB4FULL)) >> (64 - HASH_BITS));
+}
+
+size_t AlignUp(size_t value) {
+    return (value + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+size_t ProduceSequences(void*, ZSTD_Sequence* out, size_t, const void* source, size_t size,
+                        const void*, size_t, int, size_t window_size) {
+    const u8* src = static_cast<const u8*>(source);
+    if (size < MIN_MATCH * 4) {
+        return ZSTD_SEQUENCE_PRODUCER_ERROR;
+    }
+
+    // Called on the compressing thread (no zstd workers with a producer),
+    // so the table can be per thread. Entries are position + 1, 0 is empty.
+    thread_local u32 table[1 << HASH_BITS];
+    std::memset(table, 0, sizeof(table));
+
+    size_t count = 0;
+    size_t literals_start = 0;
+    size_t matched = 0;
+    size_t pos = 0;
+    while (pos + MIN_MATCH <= size) {
+        u32 hash = HashAt(src + pos);
+        u32 entry = table[hash];
+        table[hash] = static_cast<u32>(pos + 1);
+        size_t candidate = entry - 1;
+        if (!entry || pos - candidate > window_size || std::memcmp(src + candidate, src + pos, MIN_MATCH) != 0) {
+            pos += ALIGNMENT;
+            continue;
+        }
+
+        size_t length = MIN_MATCH;
+        while (pos + length < size && src[candidate + length] == src[pos + length]) {
+            ++length;
+        }
+        size_t back = 0;
+        while (pos - back > literals_start && candidate > back && src[candidate - back - 1] == src[pos - back - 1]) {
+            ++back;
+        }
+        size_t start = pos - back;
+        length += back;
+        out[count++] = {static_cast<unsigned>(pos - candidate), static_cast<unsigned>(start - literals_start),
+                        static_cast<unsigned>(length), 0};
+        matched += length;
+
+        // Sparse entries inside the match so later data can refer back to it
+        for (size_t q = AlignUp(start) + ALIGNMENT; q + MIN_MATCH <= start + length; q += 0x200) {
+            table[HashAt(src + q)] = static_cast<u32>(q + 1);
+        }
+        literals_start = start + length;
+        pos = AlignUp(literals_start);
+    }
+
+    if (matched * 100 < size * MIN_COVERAGE_PERCENT) {
+        return ZSTD_SEQUENCE_PRODUCER_ERROR; // zstd's own match finder takes the block
+    }
+    out[count++] = {0, static_cast<unsigned>(size - literals_start), 0, 0};
+    return count;
+}
+
+} // namespace
+
+bool EnableMediaUnitMatcher(ZSTD_CCtx_s* cctx, std::string& error) {
+    // Long distance matching cannot be combined with a sequence producer
+    size_t result = ZSTD_CCtx_setParameter(cctx, ZSTD_c_enableLongDistanceMatching, ZSTD_ps_disable);
+    if (!ZSTD_isError(result)) {
+        result = ZSTD_CCtx_setParameter(cctx, ZSTD_c_enableSeqProducerFallback, 1);
+    }
+    if (ZSTD_isError(result)) {
+        error = ZSTD_getErrorName(result);
+        return false;
+    }
+    ZSTD_registerSequenceProducer(cctx, nullptr, ProduceSequences);
+    return true;
+}
+
+#else
+
+bool EnableMediaUnitMatcher(ZSTD_CCtx_s*, std::string& error) {
+    error = "the media unit matcher needs zstd 1.5.4 or later";
+    return false;
+}
+
+#endif
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+struct ZSTD_CCtx_s;
+
+// Match finder for 3DS images, run by zstd in place of its own (block-level
+// sequence producer API, zstd 1.5.4 or later). 3DS content is laid out in
+// 0x200-byte media units, so padding runs, repeated headers and hash tree
+// levels tend to repeat at 16-byte aligned positions. The finder only looks
+// there and only for matches of 32 bytes or more, which is cheap, and hands
+// a block back to zstd's own match finder when such matches cover less than
+// 90% of it.
+//
+// zstd gives external producers no history before the current 128KB block,
+// so blocks the finder does parse lose matches into earlier blocks; the
+// coverage threshold keeps that to blocks that are mostly repeats anyway.
+//
+// Registers the finder on a context after its parameters are set; they are
+// cleared again by a parameter reset.
+bool EnableMediaUnitMatcher(ZSTD_CCtx_s* cctx, std::string& error);
@@ -0,0 +1,290 @@
+#include "z3ds_pack.h"
+#include "z3ds_reader.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_set>
+#include <zdict.h>
+
+namespace {
+
+constexpr size_t MAX_SAMPLE_SIZE = 128 * 1024;
+constexpr size_t SAMPLE_BUDGET_FACTOR = 100; // Training input per dictionary byte
+
+struct PackInput {
+    std::string path;
+    PackMember member;
+};
+
+void WriteLE(std::vector<u8>& out, u64 value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out.push_back(static_cast<u8>(value >> (8 * i)));
+    }
+}
+
+u64 ReadLE(const u8* p, size_t bytes) {
+    u64 value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        value |= static_cast<u64>(p[i]) << (8 * i);
+    }
+    return value;
+}
+
+// The uncompressed view of a pack, read from the member files as needed so
+// the collection is streamed once instead of being copied to a temporary file
+class PackStreamBuf : public std::streambuf {
+public:
+    PackStreamBuf(const std::vector<PackInput>& inputs, const std::vector<u8>& index, u64 index_offset)
+        : inputs(inputs), index(index), index_offset(index_offset), buffer(1024 * 1024) {}
+
+    bool Failed() const { return failed; }
+
+protected:
+    int_type underflow() override {
+        if (gptr() < egptr()) {
+            return traits_type::to_int_type(*gptr());
+        }
+        position += egptr() - eback();
+        size_t size = Fill(position);
+        setg(buffer.data(), buffer.data(), buffer.data() + size);
+        return size ? traits_type::to_int_type(*gptr()) : traits_type::eof();
+    }
+
+    pos_type seekoff(off_type offset, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+        u64 current = position + (gptr() - eback());
+        u64 base = dir == std::ios_base::beg ? 0 : dir == std::ios_base::cur ? current : index_offset + index.size();
+        return seekpos(static_cast<pos_type>(base + offset), which);
+    }
+
+    pos_type seekpos(pos_type target, std::ios_base::openmode) override {
+        if (target < 0 || static_cast<u64>(target) > index_offset + index.size()) {
+            return pos_type(off_type(-1));
+        }
+        position = static_cast<u64>(target);
+        setg(buffer.data(), buffer.data(), buffer.data());
+        return target;
+    }
+
+private:
+    size_t Fill(u64 offset) {
+        if (offset >= index_offset) {
+            size_t size = static_cast<size_t>(std::min<u64>(buffer.size(), index_offset + index.size() - offset));
+            std::memcpy(buffer.data(), index.data() + (offset - index_offset), size);
+            return size;
+        }
+        auto next = std::upper_bound(inputs.begin(), inputs.end(), offset,
+                                     [](u64 value, const PackInput& input) { return value < input.member.offset; });
+        const PackInput& input = *(next - 1);
+        size_t index_in_inputs = (next - 1) - inputs.begin();
+        if (index_in_inputs != open_input) {
+            file.close();
+            file.clear();
+            file.open(input.path, std::ios::binary);
+            open_input = index_in_inputs;
+        }
+        u64 within = offset - input.member.offset;
+        size_t size = static_cast<size_t>(std::min<u64>(buffer.size(), input.member.size - within));
+        file.clear();
+        file.seekg(within);
+        file.read(buffer.data(), size);
+        if (file.gcount() != static_cast<std::streamsize>(size)) {
+            ErrorLog() << "Error: Could not read " << input.path << " (changed while packing?)" << std::endl;
+            failed = true;
+            return 0;
+        }
+        return size;
+    }
+
+    const std::vector<PackInput>& inputs;
+    const std::vector<u8>& index;
+    u64 index_offset;
+    std::vector<char> buffer;
+    u64 position = 0; // Offset of eback()
+    std::ifstream file;
+    size_t open_input = SIZE_MAX;
+    bool failed = false;
+};
+
+bool CollectInputs(const std::vector<std::string>& paths, std::vector<PackInput>& inputs) {
+    std::unordered_set<std::string> names;
+    for (const auto& path : paths) {
+        std::error_code ec;
+        std::vector<PackInput> found;
+        if (std::filesystem::is_directory(path, ec)) {
+            for (const auto& entry : std::filesystem::recursive_directory_iterator(path, ec)) {
+                if (entry.is_regular_file(ec)) {
+                    PackInput& input = found.emplace_back();
+                    input.path = entry.path().string();
+                    input.member.name = std::filesystem::relative(entry.path(), path, ec).generic_string();
+                }
+            }
+        } else if (std::filesystem::is_regular_file(path, ec)) {
+            PackInput& input = found.emplace_back();
+            input.path = path;
+            input.member.name = std::filesystem::path(path).filename().generic_string();
+        } else {
+            ErrorLog() << "Error: No such file or directory: " << path << std::endl;
+            return false;
+        }
+        // Directory order differs between file systems
+        std::sort(found.begin(), found.end(),
+                  [](const PackInput& a, const PackInput& b) { return a.member.name < b.member.name; });
+        for (auto& input : found) {
+            input.member.size = std::filesystem::file_size(input.path, ec);
+            if (ec || input.member.name.size() > 0xFFFF) {
+                ErrorLog() << "Error: Cannot pack " << input.path << std::endl;
+                return false;
+            }
+            if (!names.insert(input.member.name).second) {
+                ErrorLog() << "Error: Duplicate member name: " << input.member.name << std::endl;
+                return false;
+            }
+            inputs.push_back(std::move(input));
+        }
+    }
+    return true;
+}
+
+// Train on the start of every member, where homebrew shares the most
+// (3DSX headers, libctru and newlib code)
+std::vector<u8> TrainDictionary(const std::vector<PackInput>& inputs, size_t dictionary_size) {
+    if (dictionary_size == 0 || inputs.empty()) {
+        return {};
+    }
+    size_t per_file = std::clamp<size_t>(dictionary_size * SAMPLE_BUDGET_FACTOR / inputs.size(), 1024,
+                                         MAX_SAMPLE_SIZE);
+    std::vector<u8> samples;
+    std::vector<size_t> sample_sizes;
+    for (const auto& input : inputs) {
+        size_t size = static_cast<size_t>(std::min<u64>(per_file, input.member.size));
+        std::ifstream file(input.path, std::ios::binary);
+        size_t start = samples.size();
+        samples.resize(start + size);
+        file.read(reinterpret_cast<char*>(samples.data() + start), size);
+        samples.resize(start + file.gcount());
+        if (samples.size() > start) {
+            sample_sizes.push_back(samples.size() - start);
+        }
+    }
+
+    std::vector<u8> dictionary(dictionary_size);
+    size_t size = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), samples.data(),
+                                        sample_sizes.data(), static_cast<unsigned>(sample_sizes.size()));
+    if (ZDICT_isError(size)) {
+        return {};
+    }
+    dictionary.resize(size);
+    return dictionary;
+}
+
+} // namespace
+
+bool CreatePack(const PackOptions& options, const std::string& dst_file, const CompressionProfile& profile,
+                ProgressCallback update_callback, PackResult& result, CompressionStats* stats) {
+    result = {};
+    if (options.dictionary_size > 0xFFFF) {
+        ErrorLog() << "Error: Dictionary size is limited to 65535 bytes" << std::endl;
+        return false;
+    }
+    std::vector<PackInput> inputs;
+    if (!CollectInputs(options.paths, inputs)) {
+        return false;
+    }
+    if (inputs.empty()) {
+        ErrorLog() << "Error: No files to pack" << std::endl;
+        return false;
+    }
+
+    // Index entries: u64 offset, u64 size, u16 name length, name
+    u64 offset = 0;
+    std::vector<u64> frame_breaks;
+    std::vector<u8> index;
+    for (auto& input : inputs) {
+        input.member.offset = offset;
+        frame_breaks.push_back(offset);
+        offset += input.member.size;
+        WriteLE(index, input.member.offset, 8);
+        WriteLE(index, input.member.size, 8);
+        WriteLE(index, input.member.name.size(), 2);
+        index.insert(index.end(), input.member.name.begin(), input.member.name.end());
+    }
+    frame_breaks.push_back(offset);
+    result.members = inputs.size();
+    result.input_bytes = offset;
+
+    CompressionProfile pack_profile = profile;
+    pack_profile.dictionary = TrainDictionary(inputs, options.dictionary_size);
+    result.dictionary_size = pack_profile.dictionary.size();
+
+    std::ostringstream description;
+    description << "version=1,members=" << inputs.size() << ",index=" << offset << ",indexsize=" << index.size();
+    std::string pack = description.str();
+    std::unordered_map<std::string, std::vector<u8>> metadata = {{"pack", std::vector<u8>(pack.begin(), pack.end())}};
+
+    PackStreamBuf buffer(inputs, index, offset);
+    std::istream input(&buffer);
+    size_t frame_size = options.frame_size ? options.frame_size : profile.frame_size ? profile.frame_size : 256 * 1024;
+    bool success = CompressZ3DSStream(input, dst_file, PACK_MAGIC, frame_size, update_callback, metadata, stats,
+                                      pack_profile, nullptr, nullptr, &frame_breaks);
+    if (!success || buffer.Failed()) {
+        std::error_code ec;
+        std::filesystem::remove(dst_file, ec);
+        return false;
+    }
+    return true;
+}
+
+bool ReadPackIndex(Z3DSReader& reader, std::vector<PackMember>& members) {
+    members.clear();
+    if (reader.GetHeader().underlying_magic != PACK_MAGIC) {
+        return false;
+    }
+    std::unordered_map<std::string, std::string> fields;
+    std::stringstream stream(reader.GetMetadataString("pack"));
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        size_t equals = item.find('=');
+        if (equals != std::string::npos) {
+            fields[item.substr(0, equals)] = item.substr(equals + 1);
+        }
+    }
+    if (fields["version"] != "1") {
+        ErrorLog() << "Error: Unsupported pack version" << std::endl;
+        return false;
+    }
+    u64 index_offset = std::strtoull(fields["index"].c_str(), nullptr, 10);
+    u64 index_size = std::strtoull(fields["indexsize"].c_str(), nullptr, 10);
+    if (index_offset + index_size != reader.GetSize()) {
+        ErrorLog() << "Error: Pack index does not fit the file" << std::endl;
+        return false;
+    }
+    std::vector<u8> index(index_size);
+    if (reader.Read(index_offset, index.data(), index.size()) != index.size()) {
+        return false;
+    }
+
+    for (size_t pos = 0; pos < index.size();) {
+        if (index.size() - pos < 18) {
+            members.clear();
+            return false;
+        }
+        PackMember member;
+        member.offset = ReadLE(index.data() + pos, 8);
+        member.size = ReadLE(index.data() + pos + 8, 8);
+        size_t name_size = static_cast<size_t>(ReadLE(index.data() + pos + 16, 2));
+        pos += 18;
+        if (index.size() - pos < name_size || member.offset > index_offset ||
+            member.size > index_offset - member.offset) {
+            ErrorLog() << "Error: Invalid pack index" << std::endl;
+            members.clear();
+            return false;
+        }
+        member.name.assign(reinterpret_cast<const char*>(index.data() + pos), name_size);
+        pos += name_size;
+        members.push_back(std::move(member));
+    }
+    return true;
+}
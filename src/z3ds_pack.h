@@ -0,0 +1,37 @@
+#pragma once
+
+#include "z3ds_compression.h"
+
+class Z3DSReader;
+
+// Many small titles (e.g. .3dsx homebrew) in one Z3DS file. The uncompressed
+// view is the members back to back, each starting a new frame, followed by
+// the member index; all frames share a dictionary trained on the members,
+// stored as "zdict" metadata, so a member decodes on its own without paying
+// for a header, metadata and seek table per file. RomFileSystem lists the
+// members of a pack, so list and cat work on them like on RomFS files.
+inline constexpr std::array<u8, 4> PACK_MAGIC = {'P', 'A', 'C', 'K'};
+
+struct PackMember {
+    std::string name; // Path relative to the packed directory, '/'-separated
+    u64 offset;       // In the uncompressed view
+    u64 size;
+};
+
+struct PackOptions {
+    std::vector<std::string> paths; // Files, or directories searched recursively
+    size_t frame_size = 256 * 1024;
+    size_t dictionary_size = 0xFFFF; // 0 for none; a metadata item holds at most 0xFFFF bytes
+};
+
+struct PackResult {
+    size_t members = 0;
+    u64 input_bytes = 0;
+    size_t dictionary_size = 0; // 0 if training failed, e.g. on too few samples
+};
+
+bool CreatePack(const PackOptions& options, const std::string& dst_file, const CompressionProfile& profile,
+                ProgressCallback update_callback, PackResult& result, CompressionStats* stats = nullptr);
+
+// Member index of an open pack; false if the file is not a pack
+bool ReadPackIndex(Z3DSReader& reader, std::vector<PackMember>& members);
@@ -0,0 +1,493 @@
+#include "z3ds_precomp.h"
+#include "z3ds_layout.h"
+#include "z3ds_reader.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+constexpr u32 MAX_DECODED_SIZE = 256 * 1024 * 1024;
+constexpr u64 MAX_CANDIDATE_SIZE = 64 * 1024 * 1024;
+constexpr u64 ENCODE_WORK_BUDGET = 1ULL << 30; // Byte comparisons per encoder attempt
+constexpr size_t TABLE_ENTRY_SIZE = 28;
+
+struct PrecompEntry {
+    u64 offset;         // In the original image
+    u32 length;         // LZ stream bytes in the original image
+    u32 decoded_length; // Bytes in the transformed image
+    LZVariant variant;
+    u64 hash;           // XXH64 of the original stream bytes
+};
+
+u32 ReadLE32(const u8* p) {
+    return static_cast<u32>(p[0]) | (static_cast<u32>(p[1]) << 8) |
+           (static_cast<u32>(p[2]) << 16) | (static_cast<u32>(p[3]) << 24);
+}
+
+u64 ReadLE64(const u8* p) {
+    return static_cast<u64>(ReadLE32(p)) | (static_cast<u64>(ReadLE32(p + 4)) << 32);
+}
+
+void WriteLE(std::vector<u8>& out, u64 value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out.push_back(static_cast<u8>(value >> (8 * i)));
+    }
+}
+
+} // namespace
+
+bool DecodeLZ(const u8* data, size_t size, std::vector<u8>& out, size_t& length, bool& ext_header) {
+    if (size < 4 || (data[0] != 0x10 && data[0] != 0x11)) {
+        return false;
+    }
+    u8 type = data[0];
+    u32 decoded_size = ReadLE32(data) >> 8;
+    size_t pos = 4;
+    ext_header = false;
+    if (decoded_size == 0) {
+        if (type != 0x11 || size < 8) {
+            return false;
+        }
+        decoded_size = ReadLE32(data + 4);
+        pos = 8;
+        ext_header = true;
+    }
+    if (decoded_size == 0 || decoded_size > MAX_DECODED_SIZE) {
+        return false;
+    }
+
+    out.clear();
+    out.reserve(decoded_size);
+    while (out.size() < decoded_size) {
+        if (pos >= size) {
+            return false;
+        }
+        u8 flags = data[pos++];
+        for (int bit = 7; bit >= 0 && out.size() < decoded_size; --bit) {
+            if (!(flags & (1 << bit))) {
+                if (pos >= size) {
+                    return false;
+                }
+                out.push_back(data[pos++]);
+                continue;
+            }
+            size_t match_length;
+            size_t disp;
+            if (pos + 2 > size) {
+                return false;
+            }
+            u8 b0 = data[pos];
+            u8 b1 = data[pos + 1];
+            if (type == 0x10) {
+                match_length = (b0 >> 4) + 3;
+                disp = (((b0 & 0xF) << 8) | b1) + 1;
+                pos += 2;
+            } else if ((b0 >> 4) == 0) {
+                if (pos + 3 > size) {
+                    return false;
+                }
+                u8 b2 = data[pos + 2];
+                match_length = (((b0 & 0xF) << 4) | (b1 >> 4)) + 0x11;
+                disp = (((b1 & 0xF) << 8) | b2) + 1;
+                pos += 3;
+            } else if ((b0 >> 4) == 1) {
+                if (pos + 4 > size) {
+                    return false;
+                }
+                u8 b2 = data[pos + 2];
+                u8 b3 = data[pos + 3];
+                match_length = (((b0 & 0xF) << 12) | (b1 << 4) | (b2 >> 4)) + 0x111;
+                disp = (((b2 & 0xF) << 8) | b3) + 1;
+                pos += 4;
+            } else {
+                match_length = (b0 >> 4) + 1;
+                disp = (((b0 & 0xF) << 8) | b1) + 1;
+                pos += 2;
+            }
+            if (disp > out.size() || out.size() + match_length > decoded_size) {
+                return false;
+            }
+            for (size_t i = 0; i < match_length; ++i) {
+                out.push_back(out[out.size() - disp]);
+            }
+        }
+    }
+    length = pos;
+    return true;
+}
+
+bool EncodeLZ(const u8* src, size_t size, const LZVariant& variant, std::vector<u8>& out,
+              const u8* expect, size_t expect_size) {
+    out.clear();
+    out.push_back(variant.type);
+    if (variant.ext_header) {
+        WriteLE(out, 0, 3);
+        WriteLE(out, size, 4);
+    } else {
+        WriteLE(out, size, 3);
+    }
+    if (expect && (expect_size < out.size() || std::memcmp(out.data(), expect, out.size()) != 0)) {
+        return false;
+    }
+
+    const size_t max_length = variant.type == 0x10 ? 18 : variant.short_max ? 0x110 : 0x10110;
+    const size_t min_disp = variant.min_disp2 ? 2 : 1;
+    constexpr size_t WINDOW = 0x1000;
+    constexpr int HASH_BITS = 16;
+    std::vector<int64_t> head(1 << HASH_BITS, -1);
+    std::vector<int64_t> prev(size, -1);
+    auto hash = [&](size_t pos) {
+        u32 value = src[pos] | (src[pos + 1] << 8) | (src[pos + 2] << 16);
+        return (value * 2654435761u) >> (32 - HASH_BITS);
+    };
+    auto insert = [&](size_t pos) {
+        if (pos + 3 <= size) {
+            u32 h = hash(pos);
+            prev[pos] = head[h];
+            head[h] = static_cast<int64_t>(pos);
+        }
+    };
+
+    u64 work = 0;
+    size_t pos = 0;
+    while (pos < size) {
+        size_t group_start = out.size();
+        out.push_back(0);
+        for (int bit = 7; bit >= 0 && pos < size; --bit) {
+            size_t best_length = 0;
+            size_t best_disp = 0;
+            size_t limit = std::min(max_length, size - pos);
+            if (limit >= 3) {
+                for (int64_t candidate = head[hash(pos)]; candidate >= 0; candidate = prev[candidate]) {
+                    size_t disp = pos - static_cast<size_t>(candidate);
+                    if (disp > WINDOW) {
+                        break;
+                    }
+                    if (disp < min_disp) {
+                        continue;
+                    }
+                    size_t length = 0;
+                    while (length < limit && src[candidate + length] == src[pos + length]) {
+                        ++length;
+                    }
+                    work += length + 1;
+                    if (length > best_length || (variant.prefer_far && length == best_length && length >= 3)) {
+                        best_length = length;
+                        best_disp = disp;
+                    }
+                    if (!variant.prefer_far && best_length == limit) {
+                        break;
+                    }
+                }
+            }
+
+            if (best_length < 3) {
+                out.push_back(src[pos]);
+                insert(pos++);
+                continue;
+            }
+            out[group_start] |= 1 << bit;
+            size_t d = best_disp - 1;
+            if (variant.type == 0x10) {
+                out.push_back(static_cast<u8>(((best_length - 3) << 4) | (d >> 8)));
+                out.push_back(static_cast<u8>(d));
+            } else if (best_length <= 0x10) {
+                out.push_back(static_cast<u8>(((best_length - 1) << 4) | (d >> 8)));
+                out.push_back(static_cast<u8>(d));
+            } else if (best_length <= 0x110) {
+                size_t l = best_length - 0x11;
+                out.push_back(static_cast<u8>(l >> 4));
+                out.push_back(static_cast<u8>(((l & 0xF) << 4) | (d >> 8)));
+                out.push_back(static_cast<u8>(d));
+            } else {
+                size_t l = best_length - 0x111;
+                out.push_back(static_cast<u8>(0x10 | (l >> 12)));
+                out.push_back(static_cast<u8>(l >> 4));
+                out.push_back(static_cast<u8>(((l & 0xF) << 4) | (d >> 8)));
+                out.push_back(static_cast<u8>(d));
+            }
+            for (size_t i = 0; i < best_length; ++i) {
+                insert(pos + i);
+            }
+            pos += best_length;
+        }
+
+        if (expect && (out.size() > expect_size ||
+                       std::memcmp(out.data() + group_start, expect + group_start, out.size() - group_start) != 0)) {
+            return false;
+        }
+        if (work > ENCODE_WORK_BUDGET) {
+            return false;
+        }
+    }
+    return !expect || out.size() == expect_size;
+}
+
+namespace {
+
+// Find the encoder variant that reproduces `stream` from `decoded`
+bool FindVariant(const u8* stream, size_t length, const std::vector<u8>& decoded, bool ext_header,
+                 LZVariant& found) {
+    std::vector<u8> scratch;
+    for (u8 flags = 0; flags < 16; ++flags) {
+        LZVariant variant = LZVariant::FromFlags(stream[0], flags);
+        if (variant.ext_header != ext_header || (variant.type == 0x10 && variant.short_max)) {
+            continue;
+        }
+        if (EncodeLZ(decoded.data(), decoded.size(), variant, scratch, stream, length)) {
+            found = variant;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ReadAt(std::istream& input, u64 offset, void* buffer, size_t size) {
+    input.clear();
+    input.seekg(offset);
+    input.read(static_cast<char*>(buffer), size);
+    return input.gcount() == static_cast<std::streamsize>(size);
+}
+
+// Copy [offset, offset + size) of input to output
+bool CopyRange(std::istream& input, u64 offset, u64 size, std::ostream& output, std::vector<u8>& buffer) {
+    input.clear();
+    input.seekg(offset);
+    while (size > 0) {
+        size_t chunk = static_cast<size_t>(std::min<u64>(buffer.size(), size));
+        input.read(reinterpret_cast<char*>(buffer.data()), chunk);
+        if (input.gcount() != static_cast<std::streamsize>(chunk)) {
+            return false;
+        }
+        output.write(reinterpret_cast<const char*>(buffer.data()), chunk);
+        size -= chunk;
+    }
+    return output.good();
+}
+
+std::unordered_map<std::string, std::string> ParseDescription(const std::string& description) {
+    std::unordered_map<std::string, std::string> fields;
+    std::stringstream stream(description);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        size_t equals = item.find('=');
+        if (equals != std::string::npos) {
+            fields[item.substr(0, equals)] = item.substr(equals + 1);
+        }
+    }
+    return fields;
+}
+
+} // namespace
+
+bool PrecompressZ3DSFile(const std::string& src_file, const std::string& dst_file, size_t frame_size,
+                         const CompressionProfile& profile, ProgressCallback update_callback,
+                         PrecompResult& result, CompressionStats* stats) {
+    result = {};
+    std::ifstream input(src_file, std::ios::binary);
+    if (!input.is_open()) {
+        std::cerr << "Error: Could not open source file: " << src_file << std::endl;
+        return false;
+    }
+    input.seekg(0, std::ios::end);
+    u64 image_size = input.tellg();
+    std::array<u8, 4> magic = DetectFileMagic(src_file);
+
+    std::vector<NCCHPartition> partitions;
+    auto read = [&](u64 offset, void* buffer, size_t size) { return ReadAt(input, offset, buffer, size); };
+    if (!ParseRomLayout(read, image_size, partitions)) {
+        std::cerr << "Error: Not a CCI, CIA or CXI image: " << src_file << std::endl;
+        return false;
+    }
+    std::vector<RomFileEntry> files;
+    for (const auto& partition : partitions) {
+        if (!partition.encrypted) {
+            files.insert(files.end(), partition.exefs_files.begin(), partition.exefs_files.end());
+            files.insert(files.end(), partition.romfs_files.begin(), partition.romfs_files.end());
+        }
+    }
+    std::sort(files.begin(), files.end(), [](const auto& a, const auto& b) { return a.offset < b.offset; });
+
+    // Keep the streams that an encoder variant reproduces byte for byte
+    std::vector<PrecompEntry> entries;
+    std::vector<u8> data;
+    std::vector<u8> decoded;
+    u64 covered = 0;
+    for (const auto& file : files) {
+        u8 head[4];
+        if (file.size < 16 || file.size > MAX_CANDIDATE_SIZE || file.offset < covered ||
+            !ReadAt(input, file.offset, head, sizeof(head)) || (head[0] != 0x10 && head[0] != 0x11)) {
+            continue;
+        }
+        ++result.candidates;
+        data.resize(file.size);
+        size_t length;
+        bool ext_header;
+        LZVariant variant;
+        if (!ReadAt(input, file.offset, data.data(), data.size()) ||
+            !DecodeLZ(data.data(), data.size(), decoded, length, ext_header) || decoded.size() <= length ||
+            !FindVariant(data.data(), length, decoded, ext_header, variant)) {
+            continue;
+        }
+        entries.push_back({file.offset, static_cast<u32>(length), static_cast<u32>(decoded.size()), variant,
+                           XXH64(data.data(), length)});
+        covered = file.offset + length;
+        result.stream_bytes += length;
+        result.decoded_bytes += decoded.size();
+    }
+    result.streams = entries.size();
+
+    // Transformed image: the original with kept streams decoded, then the table
+    std::string temp_file = dst_file + ".precomp.tmp";
+    u64 table_offset = 0;
+    {
+        std::ofstream temp(temp_file, std::ios::binary | std::ios::trunc);
+        if (!temp.is_open()) {
+            std::cerr << "Error: Could not create temporary file: " << temp_file << std::endl;
+            return false;
+        }
+        std::vector<u8> buffer(4 * 1024 * 1024);
+        std::vector<u8> table;
+        u64 position = 0;
+        bool ok = true;
+        for (const auto& entry : entries) {
+            data.resize(entry.length);
+            ok = ok && CopyRange(input, position, entry.offset - position, temp, buffer) &&
+                 ReadAt(input, entry.offset, data.data(), data.size());
+            size_t length;
+            bool ext_header;
+            ok = ok && DecodeLZ(data.data(), data.size(), decoded, length, ext_header);
+            if (!ok) {
+                break;
+            }
+            temp.write(reinterpret_cast<const char*>(decoded.data()), decoded.size());
+            position = entry.offset + entry.length;
+
+            WriteLE(table, entry.offset, 8);
+            WriteLE(table, entry.length, 4);
+            WriteLE(table, entry.decoded_length, 4);
+            table.push_back(entry.variant.type);
+            table.push_back(entry.variant.Flags());
+            WriteLE(table, 0, 2);
+            WriteLE(table, entry.hash, 8);
+        }
+        ok = ok && CopyRange(input, position, image_size - position, temp, buffer);
+        table_offset = static_cast<u64>(temp.tellp());
+        temp.write(reinterpret_cast<const char*>(table.data()), table.size());
+        result.transformed_size = static_cast<u64>(temp.tellp());
+        if (!ok || !temp.good()) {
+            temp.close();
+            std::error_code ec;
+            std::filesystem::remove(temp_file, ec);
+            std::cerr << "Error: Could not write temporary file: " << temp_file << std::endl;
+            return false;
+        }
+    }
+
+    std::ostringstream description;
+    description << "version=1,magic=" << std::string(magic.begin(), magic.end()) << ",size=" << image_size
+                << ",table=" << table_offset << ",entries=" << entries.size();
+    std::string precomp = description.str();
+    std::string name = std::filesystem::path(src_file).filename().string();
+    std::unordered_map<std::string, std::vector<u8>> metadata = {
+        {"precomp", std::vector<u8>(precomp.begin(), precomp.end())},
+        {"precompname", std::vector<u8>(name.begin(), name.end())},
+    };
+    if (frame_size == 0) {
+        frame_size = profile.frame_size ? profile.frame_size : GetDefaultFrameSize(magic);
+    }
+    bool success = CompressZ3DSFile(temp_file, dst_file, PRECOMP_MAGIC, frame_size, update_callback, metadata,
+                                    stats, profile);
+    std::error_code ec;
+    std::filesystem::remove(temp_file, ec);
+    return success;
+}
+
+std::string GetPrecompOriginalName(const std::string& z3ds_file) {
+    Z3DSReader reader;
+    reader.SetRecordAccess(false);
+    if (!reader.Open(z3ds_file) || reader.GetHeader().underlying_magic != PRECOMP_MAGIC) {
+        return {};
+    }
+    return reader.GetMetadataString("precompname");
+}
+
+bool RestorePrecompFile(const std::string& src_file, const std::string& dst_file, ProgressCallback update_callback) {
+    Z3DSReader reader;
+    reader.SetRecordAccess(false);
+    if (!reader.Open(src_file)) {
+        return false;
+    }
+    auto fields = ParseDescription(reader.GetMetadataString("precomp"));
+    if (reader.GetHeader().underlying_magic != PRECOMP_MAGIC || fields["version"] != "1") {
+        std::cerr << "Error: Not a precompressed image: " << src_file << std::endl;
+        return false;
+    }
+    u64 image_size = std::strtoull(fields["size"].c_str(), nullptr, 10);
+    u64 table_offset = std::strtoull(fields["table"].c_str(), nullptr, 10);
+    u64 count = std::strtoull(fields["entries"].c_str(), nullptr, 10);
+    if (table_offset + count * TABLE_ENTRY_SIZE != reader.GetSize()) {
+        std::cerr << "Error: Reconstruction table does not fit " << src_file << std::endl;
+        return false;
+    }
+    std::vector<u8> table(count * TABLE_ENTRY_SIZE);
+    if (reader.Read(table_offset, table.data(), table.size()) != table.size()) {
+        return false;
+    }
+
+    std::ofstream output(dst_file, std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) {
+        std::cerr << "Error: Could not create output file: " << dst_file << std::endl;
+        return false;
+    }
+    Z3DSReaderStreamBuf buffer(reader);
+    std::istream transformed(&buffer);
+    std::vector<u8> copy_buffer(4 * 1024 * 1024);
+    std::vector<u8> decoded;
+    std::vector<u8> encoded;
+    u64 position = 0;     // In the original image
+    u64 source = 0;       // In the transformed image
+    for (u64 i = 0; i < count; ++i) {
+        const u8* raw = table.data() + i * TABLE_ENTRY_SIZE;
+        PrecompEntry entry{ReadLE64(raw), ReadLE32(raw + 8), ReadLE32(raw + 12),
+                           LZVariant::FromFlags(raw[16], raw[17]), ReadLE64(raw + 20)};
+        if (entry.offset < position || entry.offset + entry.length > image_size ||
+            (entry.variant.type != 0x10 && entry.variant.type != 0x11)) {
+            std::cerr << "Error: Invalid reconstruction entry " << i << " in " << src_file << std::endl;
+            return false;
+        }
+        u64 passthrough = entry.offset - position;
+        if (!CopyRange(transformed, source, passthrough, output, copy_buffer)) {
+            std::cerr << "Error: Could not copy image data" << std::endl;
+            return false;
+        }
+        source += passthrough;
+        decoded.resize(entry.decoded_length);
+        if (reader.Read(source, decoded.data(), decoded.size()) != decoded.size() ||
+            !EncodeLZ(decoded.data(), decoded.size(), entry.variant, encoded) || encoded.size() != entry.length ||
+            XXH64(encoded.data(), encoded.size()) != entry.hash) {
+            std::cerr << "Error: Stream at offset " << entry.offset << " does not re-encode to its original bytes"
+                      << std::endl;
+            return false;
+        }
+        output.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+        source += entry.decoded_length;
+        position = entry.offset + entry.length;
+        if (update_callback) {
+            update_callback(position, image_size);
+        }
+    }
+    if (source + (image_size - position) != table_offset ||
+        !CopyRange(transformed, source, image_size - position, output, copy_buffer)) {
+        std::cerr << "Error: Could not copy image data" << std::endl;
+        return false;
+    }
+    if (update_callback) {
+        update_callback(image_size, image_size);
+    }
+    return output.good();
+}
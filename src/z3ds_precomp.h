@@ -0,0 +1,62 @@
+#pragma once
+
+#include "z3ds_compression.h"
+
+// Archival precompression of LZ10/LZ11 assets. Files in decrypted RomFS and
+// ExeFS partitions that hold a Nintendo LZ10 (0x10) or LZ11 (0x11) stream are
+// decoded, and the stream is kept decoded only if one of the known encoder
+// variants turns the decoded data back into exactly the original bytes.
+// zstd then sees the raw asset data instead of LZ output it cannot shrink.
+//
+// The result is a Z3DS file whose underlying magic is PRECOMP_MAGIC, so
+// emulators do not take it for a playable image: the uncompressed view is
+// the image with every kept stream replaced by its decoded data, followed by
+// a reconstruction table. RestorePrecompFile rebuilds the original image.
+// BLZ-compressed code and LZ13 streams are left as they are.
+inline constexpr std::array<u8, 4> PRECOMP_MAGIC = {'P', 'R', 'C', 'P'};
+
+struct PrecompResult {
+    size_t candidates = 0;    // Files that start like an LZ10/LZ11 stream
+    size_t streams = 0;       // Streams stored decoded
+    u64 stream_bytes = 0;     // Their size in the original image
+    u64 decoded_bytes = 0;
+    u64 transformed_size = 0; // Uncompressed size of the Z3DS file
+};
+
+bool PrecompressZ3DSFile(const std::string& src_file, const std::string& dst_file, size_t frame_size,
+                         const CompressionProfile& profile, ProgressCallback update_callback,
+                         PrecompResult& result, CompressionStats* stats = nullptr);
+
+// Rebuild the original image from a precompressed Z3DS file, checking every
+// re-encoded stream against its recorded hash
+bool RestorePrecompFile(const std::string& src_file, const std::string& dst_file,
+                        ProgressCallback update_callback = nullptr);
+
+// How an encoder made a stream; restore runs the same encoder again
+struct LZVariant {
+    u8 type = 0x11;
+    bool ext_header = false; // LZ11 8-byte header even for small sizes
+    bool min_disp2 = false;  // Never uses a displacement of 1 (VRAM-safe encoders)
+    bool prefer_far = false; // Takes the farthest of equally long matches
+    bool short_max = false;  // LZ11 matches capped at 0x110 bytes
+
+    u8 Flags() const {
+        return (ext_header ? 1 : 0) | (min_disp2 ? 2 : 0) | (prefer_far ? 4 : 0) | (short_max ? 8 : 0);
+    }
+    static LZVariant FromFlags(u8 type, u8 flags) {
+        return {type, (flags & 1) != 0, (flags & 2) != 0, (flags & 4) != 0, (flags & 8) != 0};
+    }
+};
+
+// Decode an LZ10/LZ11 stream at the start of data; `length` is set to the
+// stream bytes consumed. Fails on anything a conforming encoder would not write.
+bool DecodeLZ(const u8* data, size_t size, std::vector<u8>& out, size_t& length, bool& ext_header);
+
+// Greedy LZ10/LZ11 encoder searching the whole 4KB window. With `expect`,
+// gives up as soon as the output differs from it.
+bool EncodeLZ(const u8* src, size_t size, const LZVariant& variant, std::vector<u8>& out,
+              const u8* expect = nullptr, size_t expect_size = 0);
+
+// Original file name recorded by PrecompressZ3DSFile, empty if the file is
+// not a precompressed image
+std::string GetPrecompOriginalName(const std::string& z3ds_file);
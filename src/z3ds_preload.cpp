@@ -0,0 +1,760 @@
+// LD_PRELOAD library that lets unmodified tools read Z3DS files as if they
+// were the uncompressed ROM:
+//
+//   LD_PRELOAD=libz3ds_preload.so sha256sum game.zcci
+//   LD_PRELOAD=libz3ds_preload.so rom-inspector game.cci   (game.zcci on disk)
+//
+// Opening a .zcci/.zcia/.zcxi/.z3dsx/.z3ds file, or a .cci/.cia/.cxi/.3dsx
+// name that does not exist next to its compressed counterpart, returns a
+// real descriptor of the compressed file whose reads, seeks and stats are
+// answered from a Z3DSReader (and the shared frame cache). With
+// Z3DS_PRELOAD=virtual only the second form is redirected, so tools can still
+// see the compressed files themselves.
+//
+// Covered: open/open64/openat/openat64, read, readv, pread/pread64,
+// preadv/preadv64, lseek/lseek64, fstat/fstat64, stat/stat64/lstat/lstat64/
+// statx (and the __xstat forms used by older glibc), the _FORTIFY_SOURCE
+// forms (__open_2, __openat_2, __read_chk, __pread_chk and their 64-bit
+// variants), fopen/fopen64, dup/dup2/dup3/fcntl(F_DUPFD) and close.
+// Opens for writing or creating are passed to libc untouched, so they see
+// the real files. mmap of a mapped descriptor, or a child process inheriting
+// it, sees the compressed bytes. An exception inside the shim becomes an
+// error return with errno set (ENOMEM, or EIO for anything else).
+#include "z3ds_reader.h"
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// glibc's _FORTIFY_SOURCE failure handler, which aborts
+extern "C" [[noreturn]] void __chk_fail(void);
+
+namespace {
+
+struct OpenImage {
+    std::mutex mutex;
+    Z3DSReader reader;
+    off64_t position = 0;
+};
+
+// Calls made by the reader itself (ifstream, cache files) go straight to libc
+thread_local bool in_shim = false;
+
+class ShimScope {
+public:
+    ShimScope() : previous(in_shim) { in_shim = true; }
+    ~ShimScope() { in_shim = previous; }
+
+private:
+    bool previous;
+};
+
+template <typename Func>
+Func Real(const char* name) {
+    return reinterpret_cast<Func>(dlsym(RTLD_NEXT, name));
+}
+
+#define REAL(name, type) static auto real_##name = Real<type>(#name)
+
+// Run the shim's part of a hook; nothing may throw into the C caller
+template <typename Result, typename Func>
+Result Guarded(Result failure, Func&& fn) noexcept {
+    try {
+        return fn();
+    } catch (const std::bad_alloc&) {
+        errno = ENOMEM;
+    } catch (...) {
+        errno = EIO;
+    }
+    return failure;
+}
+
+std::mutex& ImagesMutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::unordered_map<int, std::shared_ptr<OpenImage>>& Images() {
+    static auto* images = new std::unordered_map<int, std::shared_ptr<OpenImage>>();
+    return *images;
+}
+
+// Lets read/lseek/fstat skip the lock entirely while nothing is mapped
+std::atomic<size_t> image_count{0};
+
+std::shared_ptr<OpenImage> FindImage(int fd) {
+    if (in_shim || fd < 0 || image_count.load(std::memory_order_relaxed) == 0) {
+        return nullptr;
+    }
+    std::lock_guard lock(ImagesMutex());
+    auto it = Images().find(fd);
+    return it == Images().end() ? nullptr : it->second;
+}
+
+std::string Lowercase(std::string str) {
+    for (char& c : str) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return str;
+}
+
+// Compressed file to serve for a path, or empty to leave the call alone
+std::string ResolveImage(const char* path) {
+    if (in_shim || !path) {
+        return {};
+    }
+    std::string name = path;
+    size_t dot = name.rfind('.');
+    if (dot == std::string::npos || name.find('/', dot) != std::string::npos) {
+        return {};
+    }
+    std::string extension = Lowercase(name.substr(dot));
+
+    static const bool virtual_only = [] {
+        const char* mode = std::getenv("Z3DS_PRELOAD");
+        return mode && std::strcmp(mode, "virtual") == 0;
+    }();
+    if (extension == ".zcci" || extension == ".zcia" || extension == ".zcxi" ||
+        extension == ".z3dsx" || extension == ".z3ds") {
+        return virtual_only ? std::string() : name;
+    }
+
+    if (extension == ".cci" || extension == ".cia" || extension == ".cxi" || extension == ".3dsx") {
+        ShimScope scope;
+        std::string compressed = name.substr(0, dot + 1) + "z" + name.substr(dot + 1);
+        if (access(path, F_OK) != 0 && access(compressed.c_str(), R_OK) == 0) {
+            return compressed;
+        }
+    }
+    return {};
+}
+
+// Open a Z3DS file and register its descriptor. Returns -1 with errno set on
+// failure, or -2 if the call should fall through to libc unchanged: the file
+// is not a readable Z3DS file, or it is opened for writing or creating.
+int OpenMapped(const std::string& image, int flags) {
+    REAL(open, int (*)(const char*, int, ...));
+    if (flags & (O_WRONLY | O_RDWR | O_CREAT | O_TRUNC | O_APPEND)) {
+        return -2;
+    }
+
+    ShimScope scope;
+    int fd = real_open(image.c_str(), O_RDONLY | (flags & O_CLOEXEC));
+    if (fd < 0) {
+        return -1;
+    }
+    auto state = std::make_shared<OpenImage>();
+    if (!state->reader.Open(image)) {
+        REAL(close, int (*)(int));
+        real_close(fd);
+        return -2;
+    }
+    std::lock_guard lock(ImagesMutex());
+    Images()[fd] = std::move(state);
+    image_count = Images().size();
+    return fd;
+}
+
+ssize_t ReadMapped(OpenImage& image, void* buffer, size_t size, off64_t offset) {
+    if (offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    ShimScope scope;
+    u64 total = image.reader.GetSize();
+    size_t read = image.reader.Read(static_cast<u64>(offset), buffer, size);
+    if (read == 0 && size > 0 && static_cast<u64>(offset) < total) {
+        errno = EIO;
+        return -1;
+    }
+    return static_cast<ssize_t>(read);
+}
+
+ssize_t ReadMappedVector(OpenImage& image, const struct iovec* iov, int count, off64_t offset) {
+    if (count < 0 || count > IOV_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    ssize_t total = 0;
+    for (int i = 0; i < count; ++i) {
+        ssize_t result = ReadMapped(image, iov[i].iov_base, iov[i].iov_len, offset + total);
+        if (result < 0) {
+            return total > 0 ? total : -1;
+        }
+        total += result;
+        if (static_cast<size_t>(result) < iov[i].iov_len) {
+            break;
+        }
+    }
+    return total;
+}
+
+off64_t SeekMapped(OpenImage& image, off64_t offset, int whence) {
+    off64_t size = static_cast<off64_t>(image.reader.GetSize());
+    off64_t base;
+    switch (whence) {
+    case SEEK_SET:
+        base = 0;
+        break;
+    case SEEK_CUR:
+        base = image.position;
+        break;
+    case SEEK_END:
+        base = size;
+        break;
+#ifdef SEEK_DATA
+    case SEEK_DATA:
+    case SEEK_HOLE:
+        // No holes: data everywhere up to the end
+        if (offset >= size) {
+            errno = ENXIO;
+            return -1;
+        }
+        image.position = whence == SEEK_DATA ? offset : size;
+        return image.position;
+#endif
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+    if (base + offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    image.position = base + offset;
+    return image.position;
+}
+
+// The stat family moved between libc_nonshared and libc across glibc
+// versions, so any of these may be missing at runtime
+#define REAL_OR_ENOSYS(name, type)   \
+    REAL(name, type);                \
+    if (!real_##name) {              \
+        errno = ENOSYS;              \
+        return -1;                   \
+    }
+
+template <typename Stat>
+void PatchStat(Stat* st, u64 size) {
+    st->st_size = static_cast<decltype(st->st_size)>(size);
+    st->st_blocks = static_cast<decltype(st->st_blocks)>((size + 511) / 512);
+}
+
+// Apply the uncompressed size to a descriptor stat if it maps to an image
+template <typename Stat>
+int FstatMapped(int fd, Stat* st) {
+    if (auto image = FindImage(fd)) {
+        PatchStat(st, image->reader.GetSize());
+    }
+    return 0;
+}
+
+// Apply the uncompressed size to a path stat if the path maps to an image
+template <typename Stat>
+int StatMapped(const char* path, Stat* st, int result) {
+    std::string image = ResolveImage(path);
+    if (image.empty() || !st) {
+        return result;
+    }
+    ShimScope scope;
+    Z3DSReader reader;
+    reader.SetRecordAccess(false);
+    if (!reader.Open(image)) {
+        return result;
+    }
+    if (image != path) {
+        // Virtual name: stat the compressed file instead of reporting ENOENT
+        REAL(stat64, int (*)(const char*, struct stat64*));
+        struct stat64 real{};
+        if (!real_stat64 || real_stat64(image.c_str(), &real) != 0) {
+            return result;
+        }
+        std::memset(st, 0, sizeof(*st));
+        st->st_dev = real.st_dev;
+        st->st_ino = real.st_ino;
+        st->st_mode = real.st_mode;
+        st->st_nlink = real.st_nlink;
+        st->st_uid = real.st_uid;
+        st->st_gid = real.st_gid;
+        st->st_blksize = real.st_blksize;
+        st->st_atim = real.st_atim;
+        st->st_mtim = real.st_mtim;
+        st->st_ctim = real.st_ctim;
+        errno = 0;
+    } else if (result != 0) {
+        return result;
+    }
+    PatchStat(st, reader.GetSize());
+    return 0;
+}
+
+// fopen() streams are backed by the same descriptors through fopencookie,
+// since glibc's stdio calls its internal read/seek rather than the hooks
+ssize_t CookieRead(void* cookie, char* buffer, size_t size) {
+    return read(static_cast<int>(reinterpret_cast<intptr_t>(cookie)), buffer, size);
+}
+
+int CookieSeek(void* cookie, off64_t* offset, int whence) {
+    off64_t result = lseek64(static_cast<int>(reinterpret_cast<intptr_t>(cookie)), *offset, whence);
+    if (result < 0) {
+        return -1;
+    }
+    *offset = result;
+    return 0;
+}
+
+int CookieClose(void* cookie) {
+    return close(static_cast<int>(reinterpret_cast<intptr_t>(cookie)));
+}
+
+FILE* OpenMappedStream(const char* path, const char* mode) {
+    std::string image = ResolveImage(path);
+    if (image.empty() || !mode || std::strchr(mode, 'w') || std::strchr(mode, 'a') || std::strchr(mode, '+')) {
+        return nullptr;
+    }
+    int fd = OpenMapped(image, std::strchr(mode, 'e') ? O_CLOEXEC : 0);
+    if (fd < 0) {
+        return nullptr;
+    }
+    cookie_io_functions_t functions{CookieRead, nullptr, CookieSeek, CookieClose};
+    FILE* stream = fopencookie(reinterpret_cast<void*>(static_cast<intptr_t>(fd)), "r", functions);
+    if (!stream) {
+        close(fd);
+    }
+    return stream;
+}
+
+// Make new_fd another name for whatever old_fd maps to, sharing its position
+// like a real duplicated descriptor
+void DuplicateMapping(int old_fd, int new_fd) {
+    if (in_shim || new_fd < 0 || image_count.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+    std::shared_ptr<OpenImage> released;
+    std::lock_guard lock(ImagesMutex());
+    auto it = Images().find(new_fd);
+    if (it != Images().end()) {
+        released = std::move(it->second);
+        Images().erase(it);
+    }
+    it = Images().find(old_fd);
+    if (it != Images().end()) {
+        Images()[new_fd] = it->second;
+    }
+    image_count = Images().size();
+    ShimScope scope;
+    released.reset();
+}
+
+// Result of a dup call, or -1 if the duplicate could not be mapped too
+int DuplicateResult(int old_fd, int new_fd) {
+    REAL(close, int (*)(int));
+    int result = Guarded(-1, [&] {
+        DuplicateMapping(old_fd, new_fd);
+        return new_fd;
+    });
+    if (result < 0 && new_fd >= 0) {
+        int error = errno;
+        real_close(new_fd);
+        errno = error;
+    }
+    return result;
+}
+
+template <typename Func>
+int OpenHook(const char* path, int flags, Func&& fallback) {
+    int fd = Guarded(-1, [&] {
+        std::string image = ResolveImage(path);
+        return image.empty() ? -2 : OpenMapped(image, flags);
+    });
+    return fd != -2 ? fd : fallback();
+}
+
+// Shared body of the read and seek hooks: libc for other descriptors, else
+// fn(image) under the image's lock
+template <typename Fallback, typename Func>
+auto ReadHook(int fd, Fallback&& fallback, Func&& fn) -> decltype(fallback()) {
+    using Result = decltype(fallback());
+    std::shared_ptr<OpenImage> image;
+    if (Guarded(-1, [&] {
+            image = FindImage(fd);
+            return 0;
+        }) < 0) {
+        return -1;
+    }
+    if (!image) {
+        return fallback();
+    }
+    return Guarded<Result>(-1, [&] {
+        std::lock_guard lock(image->mutex);
+        return static_cast<Result>(fn(*image));
+    });
+}
+
+} // namespace
+
+extern "C" {
+
+int open(const char* path, int flags, ...) {
+    REAL(open, int (*)(const char*, int, ...));
+    mode_t mode = 0;
+    if (flags & (O_CREAT | O_TMPFILE)) {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+    return OpenHook(path, flags, [&] { return real_open(path, flags, mode); });
+}
+
+int open64(const char* path, int flags, ...) {
+    REAL(open64, int (*)(const char*, int, ...));
+    mode_t mode = 0;
+    if (flags & (O_CREAT | O_TMPFILE)) {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+    return OpenHook(path, flags, [&] { return real_open64(path, flags, mode); });
+}
+
+int openat(int dirfd, const char* path, int flags, ...) {
+    REAL(openat, int (*)(int, const char*, int, ...));
+    mode_t mode = 0;
+    if (flags & (O_CREAT | O_TMPFILE)) {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+    // Relative paths would need dirfd resolution; only absolute paths and
+    // AT_FDCWD are redirected
+    if (path && (path[0] == '/' || dirfd == AT_FDCWD)) {
+        return OpenHook(path, flags, [&] { return real_openat(dirfd, path, flags, mode); });
+    }
+    return real_openat(dirfd, path, flags, mode);
+}
+
+int openat64(int dirfd, const char* path, int flags, ...) {
+    REAL(openat64, int (*)(int, const char*, int, ...));
+    mode_t mode = 0;
+    if (flags & (O_CREAT | O_TMPFILE)) {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+    if (path && (path[0] == '/' || dirfd == AT_FDCWD)) {
+        return OpenHook(path, flags, [&] { return real_openat64(dirfd, path, flags, mode); });
+    }
+    return real_openat64(dirfd, path, flags, mode);
+}
+
+// _FORTIFY_SOURCE builds call these for opens without a mode argument
+int __open_2(const char* path, int flags) {
+    REAL_OR_ENOSYS(__open_2, int (*)(const char*, int));
+    return OpenHook(path, flags, [&] { return real___open_2(path, flags); });
+}
+
+int __open64_2(const char* path, int flags) {
+    REAL_OR_ENOSYS(__open64_2, int (*)(const char*, int));
+    return OpenHook(path, flags, [&] { return real___open64_2(path, flags); });
+}
+
+int __openat_2(int dirfd, const char* path, int flags) {
+    REAL_OR_ENOSYS(__openat_2, int (*)(int, const char*, int));
+    if (path && (path[0] == '/' || dirfd == AT_FDCWD)) {
+        return OpenHook(path, flags, [&] { return real___openat_2(dirfd, path, flags); });
+    }
+    return real___openat_2(dirfd, path, flags);
+}
+
+int __openat64_2(int dirfd, const char* path, int flags) {
+    REAL_OR_ENOSYS(__openat64_2, int (*)(int, const char*, int));
+    if (path && (path[0] == '/' || dirfd == AT_FDCWD)) {
+        return OpenHook(path, flags, [&] { return real___openat64_2(dirfd, path, flags); });
+    }
+    return real___openat64_2(dirfd, path, flags);
+}
+
+FILE* fopen(const char* path, const char* mode) {
+    REAL(fopen, FILE* (*)(const char*, const char*));
+    if (FILE* stream = Guarded<FILE*>(nullptr, [&] { return OpenMappedStream(path, mode); })) {
+        return stream;
+    }
+    return real_fopen(path, mode);
+}
+
+FILE* fopen64(const char* path, const char* mode) {
+    REAL(fopen64, FILE* (*)(const char*, const char*));
+    if (FILE* stream = Guarded<FILE*>(nullptr, [&] { return OpenMappedStream(path, mode); })) {
+        return stream;
+    }
+    return real_fopen64(path, mode);
+}
+
+ssize_t read(int fd, void* buffer, size_t size) {
+    REAL(read, ssize_t (*)(int, void*, size_t));
+    return ReadHook(fd, [&] { return real_read(fd, buffer, size); }, [&](OpenImage& image) {
+        ssize_t result = ReadMapped(image, buffer, size, image.position);
+        if (result > 0) {
+            image.position += result;
+        }
+        return result;
+    });
+}
+
+ssize_t readv(int fd, const struct iovec* iov, int count) {
+    REAL(readv, ssize_t (*)(int, const struct iovec*, int));
+    return ReadHook(fd, [&] { return real_readv(fd, iov, count); }, [&](OpenImage& image) {
+        ssize_t result = ReadMappedVector(image, iov, count, image.position);
+        if (result > 0) {
+            image.position += result;
+        }
+        return result;
+    });
+}
+
+ssize_t pread(int fd, void* buffer, size_t size, off_t offset) {
+    REAL(pread, ssize_t (*)(int, void*, size_t, off_t));
+    return ReadHook(fd, [&] { return real_pread(fd, buffer, size, offset); },
+                    [&](OpenImage& image) { return ReadMapped(image, buffer, size, offset); });
+}
+
+ssize_t pread64(int fd, void* buffer, size_t size, off64_t offset) {
+    REAL(pread64, ssize_t (*)(int, void*, size_t, off64_t));
+    return ReadHook(fd, [&] { return real_pread64(fd, buffer, size, offset); },
+                    [&](OpenImage& image) { return ReadMapped(image, buffer, size, offset); });
+}
+
+ssize_t preadv(int fd, const struct iovec* iov, int count, off_t offset) {
+    REAL(preadv, ssize_t (*)(int, const struct iovec*, int, off_t));
+    return ReadHook(fd, [&] { return real_preadv(fd, iov, count, offset); },
+                    [&](OpenImage& image) { return ReadMappedVector(image, iov, count, offset); });
+}
+
+ssize_t preadv64(int fd, const struct iovec* iov, int count, off64_t offset) {
+    REAL_OR_ENOSYS(preadv64, ssize_t (*)(int, const struct iovec*, int, off64_t));
+    return ReadHook(fd, [&] { return real_preadv64(fd, iov, count, offset); },
+                    [&](OpenImage& image) { return ReadMappedVector(image, iov, count, offset); });
+}
+
+// _FORTIFY_SOURCE forms, given the size of the destination buffer
+ssize_t __read_chk(int fd, void* buffer, size_t size, size_t buffer_size) {
+    if (size > buffer_size) {
+        __chk_fail();
+    }
+    return read(fd, buffer, size);
+}
+
+ssize_t __pread_chk(int fd, void* buffer, size_t size, off_t offset, size_t buffer_size) {
+    if (size > buffer_size) {
+        __chk_fail();
+    }
+    return pread(fd, buffer, size, offset);
+}
+
+ssize_t __pread64_chk(int fd, void* buffer, size_t size, off64_t offset, size_t buffer_size) {
+    if (size > buffer_size) {
+        __chk_fail();
+    }
+    return pread64(fd, buffer, size, offset);
+}
+
+off_t lseek(int fd, off_t offset, int whence) {
+    REAL(lseek, off_t (*)(int, off_t, int));
+    return ReadHook(fd, [&] { return real_lseek(fd, offset, whence); },
+                    [&](OpenImage& image) { return SeekMapped(image, offset, whence); });
+}
+
+off64_t lseek64(int fd, off64_t offset, int whence) {
+    REAL(lseek64, off64_t (*)(int, off64_t, int));
+    return ReadHook(fd, [&] { return real_lseek64(fd, offset, whence); },
+                    [&](OpenImage& image) { return SeekMapped(image, offset, whence); });
+}
+
+int fstat(int fd, struct stat* st) {
+    REAL_OR_ENOSYS(fstat, int (*)(int, struct stat*));
+    int result = real_fstat(fd, st);
+    return result != 0 ? result : Guarded(-1, [&] { return FstatMapped(fd, st); });
+}
+
+int fstat64(int fd, struct stat64* st) {
+    REAL_OR_ENOSYS(fstat64, int (*)(int, struct stat64*));
+    int result = real_fstat64(fd, st);
+    return result != 0 ? result : Guarded(-1, [&] { return FstatMapped(fd, st); });
+}
+
+int stat(const char* path, struct stat* st) {
+    REAL_OR_ENOSYS(stat, int (*)(const char*, struct stat*));
+    int result = real_stat(path, st);
+    return Guarded(-1, [&] { return StatMapped(path, st, result); });
+}
+
+int stat64(const char* path, struct stat64* st) {
+    REAL_OR_ENOSYS(stat64, int (*)(const char*, struct stat64*));
+    int result = real_stat64(path, st);
+    return Guarded(-1, [&] { return StatMapped(path, st, result); });
+}
+
+int lstat(const char* path, struct stat* st) {
+    REAL_OR_ENOSYS(lstat, int (*)(const char*, struct stat*));
+    int result = real_lstat(path, st);
+    return Guarded(-1, [&] { return StatMapped(path, st, result); });
+}
+
+int lstat64(const char* path, struct stat64* st) {
+    REAL_OR_ENOSYS(lstat64, int (*)(const char*, struct stat64*));
+    int result = real_lstat64(path, st);
+    return Guarded(-1, [&] { return StatMapped(path, st, result); });
+}
+
+// Binaries built against glibc < 2.33 call these instead of fstat/stat
+int __fxstat(int version, int fd, struct stat* st) {
+    REAL_OR_ENOSYS(__fxstat, int (*)(int, int, struct stat*));
+    int result = real___fxstat(version, fd, st);
+    return result != 0 ? result : Guarded(-1, [&] { return FstatMapped(fd, st); });
+}
+
+int __fxstat64(int version, int fd, struct stat64* st) {
+    REAL_OR_ENOSYS(__fxstat64, int (*)(int, int, struct stat64*));
+    int result = real___fxstat64(version, fd, st);
+    return result != 0 ? result : Guarded(-1, [&] { return FstatMapped(fd, st); });
+}
+
+int __xstat(int version, const char* path, struct stat* st) {
+    REAL_OR_ENOSYS(__xstat, int (*)(int, const char*, struct stat*));
+    int result = real___xstat(version, path, st);
+    return Guarded(-1, [&] { return StatMapped(path, st, result); });
+}
+
+int __xstat64(int version, const char* path, struct stat64* st) {
+    REAL_OR_ENOSYS(__xstat64, int (*)(int, const char*, struct stat64*));
+    int result = real___xstat64(version, path, st);
+    return Guarded(-1, [&] { return StatMapped(path, st, result); });
+}
+
+int dup(int fd) {
+    REAL(dup, int (*)(int));
+    return DuplicateResult(fd, real_dup(fd));
+}
+
+int dup2(int fd, int new_fd) {
+    REAL(dup2, int (*)(int, int));
+    int result = real_dup2(fd, new_fd);
+    if (result >= 0 && fd != new_fd) {
+        return DuplicateResult(fd, result);
+    }
+    return result;
+}
+
+int dup3(int fd, int new_fd, int flags) {
+    REAL(dup3, int (*)(int, int, int));
+    return DuplicateResult(fd, real_dup3(fd, new_fd, flags));
+}
+
+int fcntl(int fd, int command, ...) {
+    REAL(fcntl, int (*)(int, int, ...));
+    // Every fcntl argument is an int, a pointer or absent; passing it on as
+    // a pointer-sized value works for all of them
+    va_list args;
+    va_start(args, command);
+    void* arg = va_arg(args, void*);
+    va_end(args);
+    int result = real_fcntl(fd, command, arg);
+    if (command == F_DUPFD || command == F_DUPFD_CLOEXEC) {
+        return DuplicateResult(fd, result);
+    }
+    return result;
+}
+
+int fcntl64(int fd, int command, ...) {
+    REAL_OR_ENOSYS(fcntl64, int (*)(int, int, ...));
+    va_list args;
+    va_start(args, command);
+    void* arg = va_arg(args, void*);
+    va_end(args);
+    int result = real_fcntl64(fd, command, arg);
+    if (command == F_DUPFD || command == F_DUPFD_CLOEXEC) {
+        return DuplicateResult(fd, result);
+    }
+    return result;
+}
+
+#ifdef STATX_SIZE
+int statx(int dirfd, const char* path, int flags, unsigned int mask, struct statx* st) {
+    REAL_OR_ENOSYS(statx, int (*)(int, const char*, int, unsigned int, struct statx*));
+    int result = real_statx(dirfd, path, flags, mask, st);
+    return Guarded(-1, [&] {
+        if ((flags & AT_EMPTY_PATH) && path[0] == '\0') {
+            if (auto image = FindImage(dirfd); image && result == 0) {
+                st->stx_size = image->reader.GetSize();
+                st->stx_blocks = (st->stx_size + 511) / 512;
+            }
+            return result;
+        }
+        if (path[0] != '/' && dirfd != AT_FDCWD) {
+            return result;
+        }
+        std::string image = ResolveImage(path);
+        if (image.empty()) {
+            return result;
+        }
+        ShimScope scope;
+        Z3DSReader reader;
+        reader.SetRecordAccess(false);
+        if (!reader.Open(image)) {
+            return result;
+        }
+        if (image != path && real_statx(dirfd, image.c_str(), flags, mask, st) != 0) {
+            return result;
+        }
+        if (image == path && result != 0) {
+            return result;
+        }
+        st->stx_size = reader.GetSize();
+        st->stx_blocks = (st->stx_size + 511) / 512;
+        st->stx_mask |= STATX_SIZE | STATX_BLOCKS;
+        errno = 0;
+        return 0;
+    });
+}
+#endif
+
+int close(int fd) {
+    REAL(close, int (*)(int));
+    // The descriptor is closed even if releasing the image fails
+    Guarded(0, [&] {
+        std::shared_ptr<OpenImage> image;
+        if (!in_shim && fd >= 0 && image_count.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard lock(ImagesMutex());
+            auto it = Images().find(fd);
+            if (it != Images().end()) {
+                image = std::move(it->second);
+                Images().erase(it);
+                image_count = Images().size();
+            }
+        }
+        if (image) {
+            // The reader closes its own file when released
+            ShimScope scope;
+            image.reset();
+        }
+        return 0;
+    });
+    return real_close(fd);
+}
+
+} // extern "C"
@@ -0,0 +1,653 @@
+#include "z3ds_reader.h"
+#include "z3ds_access_stats.h"
+#include "z3ds_disk_cache.h"
+#include "z3ds_frame_cache.h"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <zstd.h>
+
+namespace {
+
+u16 ReadLE16(const u8* p) {
+    return static_cast<u16>(p[0] | (p[1] << 8));
+}
+
+u32 ReadLE32(const u8* p) {
+    return static_cast<u32>(p[0]) | (static_cast<u32>(p[1]) << 8) |
+           (static_cast<u32>(p[2]) << 16) | (static_cast<u32>(p[3]) << 24);
+}
+
+u64 ReadLE64(const u8* p) {
+    return static_cast<u64>(ReadLE32(p)) | (static_cast<u64>(ReadLE32(p + 4)) << 32);
+}
+
+constexpr u32 SKIPPABLE_MAGIC = 0x184D2A5E;
+constexpr u32 SEEKABLE_MAGIC = 0x8F92EAB1;
+constexpr size_t SEEK_FOOTER_SIZE = 9;
+
+// First read of Open; covers the header, metadata and a front seek index of
+// a few thousand frames
+constexpr size_t OPEN_READ_SIZE = 64 * 1024;
+
+double HotSetSeconds() {
+    static const double seconds = [] {
+        const char* env = std::getenv("Z3DS_HOTSET_SECONDS");
+        return env ? std::strtod(env, nullptr) : 10.0;
+    }();
+    return seconds;
+}
+
+} // namespace
+
+// Decodes a reader's stored hot set into the FrameCache on its own file
+// handles, in priority order
+class FrameWarmup {
+public:
+    FrameWarmup(const std::string& path, u64 file_id, u64 fingerprint,
+                const std::vector<Z3DSReader::FrameInfo>& frames, std::vector<u32> order,
+                std::shared_ptr<ZSTD_DDict> ddict)
+        : path(path), file_id(file_id), fingerprint(fingerprint), frames(frames), order(std::move(order)),
+          ddict(std::move(ddict)) {
+        for (u32 frame : this->order) {
+            state[frame] = State::Pending;
+        }
+        unsigned threads = std::min<size_t>({this->order.size(), 4,
+                                             std::max(1u, std::thread::hardware_concurrency())});
+        // Files are opened here, on the caller's thread, so an interposer
+        // that treats the caller specially (z3ds_preload) sees them too
+        files.resize(threads);
+        for (unsigned i = 0; i < threads; ++i) {
+            files[i].open(path, std::ios::binary);
+            workers.emplace_back(&FrameWarmup::Worker, this, std::ref(files[i]));
+        }
+    }
+
+    ~FrameWarmup() {
+        {
+            std::lock_guard lock(mutex);
+            stop = true;
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    // Called before the reader decodes a frame itself so a frame not started
+    // yet is not decoded twice. One in progress is not waited for: the
+    // reader may only need a small part of it, which decodes sooner.
+    void Claim(u32 frame) {
+        std::lock_guard lock(mutex);
+        auto it = state.find(frame);
+        if (it != state.end() && it->second == State::Pending) {
+            it->second = State::Done;
+        }
+    }
+
+private:
+    enum class State : u8 { Pending, Running, Done };
+
+    void Worker(std::ifstream& file) {
+        ZSTD_DCtx* dctx = ZSTD_createDCtx();
+        if (ddict) {
+            ZSTD_DCtx_refDDict(dctx, ddict.get());
+        }
+        std::vector<u8> compressed;
+        FrameCache& cache = FrameCache::Instance();
+        DiskFrameCache& disk_cache = DiskFrameCache::Instance();
+
+        std::unique_lock lock(mutex);
+        while (!stop && file.is_open()) {
+            while (next < order.size() && state[order[next]] != State::Pending) {
+                ++next;
+            }
+            if (next == order.size()) {
+                break;
+            }
+            u32 index = order[next++];
+            state[index] = State::Running;
+            lock.unlock();
+
+            const Z3DSReader::FrameInfo& frame = frames[index];
+            std::shared_ptr<const u8[]> data;
+            if (disk_cache.Enabled()) {
+                data = disk_cache.Lookup(fingerprint, index, frame.decompressed_size);
+            }
+            if (!data) {
+                compressed.resize(frame.compressed_size);
+                file.clear();
+                file.seekg(frame.compressed_offset);
+                file.read(reinterpret_cast<char*>(compressed.data()), compressed.size());
+                std::shared_ptr<u8[]> decoded(new u8[frame.decompressed_size]);
+                if (file.gcount() == static_cast<std::streamsize>(compressed.size()) &&
+                    ZSTD_decompressDCtx(dctx, decoded.get(), frame.decompressed_size,
+                                        compressed.data(), compressed.size()) == frame.decompressed_size) {
+                    disk_cache.Insert(fingerprint, index, decoded, frame.decompressed_size);
+                    data = std::move(decoded);
+                }
+            }
+            if (data) {
+                cache.Insert(file_id, index, std::move(data), frame.decompressed_size);
+            }
+
+            lock.lock();
+            state[index] = State::Done;
+        }
+        lock.unlock();
+        ZSTD_freeDCtx(dctx);
+    }
+
+    std::string path;
+    u64 file_id;
+    u64 fingerprint;
+    std::vector<Z3DSReader::FrameInfo> frames;
+    std::vector<u32> order;
+    std::shared_ptr<ZSTD_DDict> ddict;
+
+    std::mutex mutex;
+    std::unordered_map<u32, State> state;
+    size_t next = 0;
+    bool stop = false;
+    std::vector<std::ifstream> files;
+    std::vector<std::thread> workers;
+};
+
+Z3DSReader::Z3DSReader() {
+    dctx = ZSTD_createDCtx();
+}
+
+Z3DSReader::~Z3DSReader() {
+    Close();
+    if (dctx) {
+        ZSTD_freeDCtx(dctx);
+    }
+}
+
+bool Z3DSReader::Open(const std::string& filename) {
+    Close();
+
+    file.open(filename, std::ios::binary);
+    if (!file.is_open()) {
+        ErrorLog() << "Error: Could not open Z3DS file: " << filename << std::endl;
+        return false;
+    }
+    path = filename;
+    file_id = GetFileIdentity(filename);
+    file.seekg(0, std::ios::end);
+    u64 file_size = static_cast<u64>(std::max<std::streamoff>(file.tellg(), 0));
+    file.seekg(0);
+
+    // Header fields are little-endian
+    std::vector<u8> prefix(OPEN_READ_SIZE);
+    file.read(reinterpret_cast<char*>(prefix.data()), prefix.size());
+    prefix.resize(file.gcount());
+    file.clear();
+    if (prefix.size() < sizeof(Z3DSFileHeader)) {
+        ErrorLog() << "Error: File too small for a Z3DS header: " << filename << std::endl;
+        Close();
+        return false;
+    }
+    const u8* raw = prefix.data();
+    std::memcpy(header.magic.data(), raw, 4);
+    std::memcpy(header.underlying_magic.data(), raw + 4, 4);
+    header.version = raw[8];
+    header.reserved = raw[9];
+    header.header_size = ReadLE16(raw + 10);
+    header.metadata_size = ReadLE32(raw + 12);
+    header.compressed_size = ReadLE64(raw + 16);
+    header.uncompressed_size = ReadLE64(raw + 24);
+    fingerprint = XXH64(raw, sizeof(Z3DSFileHeader));
+
+    if (header.magic != Z3DSFileHeader::EXPECTED_MAGIC ||
+        header.version != Z3DSFileHeader::EXPECTED_VERSION ||
+        header.header_size < sizeof(Z3DSFileHeader)) {
+        ErrorLog() << "Error: Not a supported Z3DS file: " << filename << std::endl;
+        Close();
+        return false;
+    }
+
+    // Sizes from the header are untrusted: check them against the file
+    // before allocating anything for them
+    u64 data_start = static_cast<u64>(header.header_size) + header.metadata_size;
+    if (data_start > file_size || header.compressed_size > file_size - data_start) {
+        ErrorLog() << "Error: Header sizes run past the end of " << filename << std::endl;
+        Close();
+        return false;
+    }
+
+    if (header.metadata_size > 0) {
+        u64 metadata_end = data_start;
+        if (prefix.size() < metadata_end) {
+            size_t read = prefix.size();
+            prefix.resize(metadata_end);
+            file.seekg(read);
+            file.read(reinterpret_cast<char*>(prefix.data() + read), metadata_end - read);
+            prefix.resize(read + file.gcount());
+        }
+        if (prefix.size() < metadata_end ||
+            !Z3DSMetadata::Parse(prefix.data() + header.header_size, header.metadata_size, metadata)) {
+            ErrorLog() << "Warning: Ignoring unreadable metadata in " << filename << std::endl;
+            metadata.clear();
+            file.clear();
+        }
+    }
+    
+    auto dictionary = metadata.find("zdict");
+    if (dictionary != metadata.end()) {
+        ddict.reset(ZSTD_createDDict(dictionary->second.data(), dictionary->second.size()), ZSTD_freeDDict);
+        if (!ddict || ZSTD_isError(ZSTD_DCtx_refDDict(dctx, ddict.get()))) {
+            ErrorLog() << "Error: Invalid dictionary in " << filename << std::endl;
+            Close();
+            return false;
+        }
+    }
+
+    if (!ReadFrontIndex(prefix) && !ReadSeekTable(data_start + header.compressed_size)) {
+        ErrorLog() << "Error: Missing or invalid seek table in " << filename << std::endl;
+        Close();
+        return false;
+    }
+
+    open_time = std::chrono::steady_clock::now();
+    if (record_access) {
+        StartWarmup();
+    }
+    return true;
+}
+
+void Z3DSReader::StartWarmup() {
+    if (HotSetSeconds() <= 0.0 || !FrameCache::Instance().Enabled()) {
+        return;
+    }
+    AccessStatsStore store(AccessStatsStore::DefaultDirectory());
+    AccessRecord record;
+    if (!store.Load(fingerprint, record) || record.frame_heat.size() != frames.size()) {
+        return;
+    }
+    std::vector<u32> order;
+    for (const auto& hot : record.hot_set) {
+        if (hot.frame < frames.size()) {
+            order.push_back(hot.frame);
+        }
+    }
+    if (!order.empty()) {
+        warmup = std::make_unique<FrameWarmup>(path, file_id, fingerprint, frames, std::move(order), ddict);
+    }
+}
+
+void Z3DSReader::Close() {
+    warmup.reset();
+    if (record_access && session_bytes > 0) {
+        AccessStatsStore store(AccessStatsStore::DefaultDirectory());
+        if (store.Enabled()) {
+            AccessRecord session;
+            session.fingerprint = fingerprint;
+            std::error_code ec;
+            session.path = std::filesystem::absolute(path, ec).string();
+            session.opens = 1;
+            session.last_access = static_cast<u64>(std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count());
+            session.bytes_read = session_bytes;
+            session.frame_heat = std::move(frame_heat);
+            for (u32 frame : hot_frames) {
+                session.hot_set.push_back({frame, 0.0});
+            }
+            store.Merge(session);
+        }
+    }
+    session_bytes = 0;
+    frame_heat.clear();
+    hot_frames.clear();
+    if (file.is_open()) {
+        file.close();
+    }
+    file.clear();
+    path.clear();
+    header = {};
+    fingerprint = 0;
+    metadata.clear();
+    if (ddict) {
+        ZSTD_DCtx_reset(dctx, ZSTD_reset_session_and_parameters);
+        ddict.reset();
+    }
+    frames.clear();
+    has_checksums = false;
+    current_frame = SIZE_MAX;
+    frame_data.reset();
+    frame_decoded = 0;
+}
+
+std::string Z3DSReader::GetMetadataString(const std::string& name) const {
+    auto it = metadata.find(name);
+    if (it == metadata.end()) {
+        return {};
+    }
+    return std::string(it->second.begin(), it->second.end());
+}
+
+bool Z3DSReader::ReadSeekTable(u64 table_end) {
+    u64 data_start = static_cast<u64>(header.header_size) + header.metadata_size;
+    if (table_end < data_start + SEEK_FOOTER_SIZE + 8) {
+        return false;
+    }
+
+    u8 footer[SEEK_FOOTER_SIZE];
+    file.seekg(table_end - SEEK_FOOTER_SIZE);
+    file.read(reinterpret_cast<char*>(footer), sizeof(footer));
+    if (file.gcount() != sizeof(footer) || ReadLE32(footer + 5) != SEEKABLE_MAGIC) {
+        return false;
+    }
+
+    u32 num_frames = ReadLE32(footer);
+    size_t entry_size = (footer[4] & 0x80) != 0 ? 12 : 8;
+    u64 table_size = static_cast<u64>(num_frames) * entry_size + SEEK_FOOTER_SIZE;
+    if (table_size + 8 > table_end - data_start) {
+        return false;
+    }
+
+    std::vector<u8> table(table_size + 8);
+    file.seekg(table_end - table.size());
+    file.read(reinterpret_cast<char*>(table.data()), table.size());
+    return file.gcount() == static_cast<std::streamsize>(table.size()) && ParseSeekTable(table, table_end);
+}
+
+bool Z3DSReader::ReadFrontIndex(const std::vector<u8>& prefix) {
+    // "size=N": the last N bytes of the metadata block hold a copy of the
+    // seek table, or zeros if the writer did not get to fill them
+    std::string description = GetMetadataString("seekindex");
+    if (description.rfind("size=", 0) != 0) {
+        return false;
+    }
+    u64 size = std::strtoull(description.c_str() + 5, nullptr, 10);
+    u64 metadata_end = static_cast<u64>(header.header_size) + header.metadata_size;
+    if (size < 8 || size > header.metadata_size || metadata_end > prefix.size()) {
+        return false;
+    }
+    const u8* area = prefix.data() + metadata_end - size;
+    u64 table_size = static_cast<u64>(ReadLE32(area + 4)) + 8;
+    if (ReadLE32(area) != SKIPPABLE_MAGIC || table_size > size) {
+        return false;
+    }
+    std::vector<u8> table(area, area + table_size);
+    return ParseSeekTable(table, metadata_end + header.compressed_size);
+}
+
+bool Z3DSReader::ParseSeekTable(const std::vector<u8>& table, u64 table_end) {
+    if (table.size() < 8 + SEEK_FOOTER_SIZE) {
+        return false;
+    }
+    const u8* footer = table.data() + table.size() - SEEK_FOOTER_SIZE;
+    u32 num_frames = ReadLE32(footer);
+    bool checksums = (footer[4] & 0x80) != 0;
+    size_t entry_size = checksums ? 12 : 8;
+    if (ReadLE32(table.data()) != SKIPPABLE_MAGIC || ReadLE32(table.data() + 4) != table.size() - 8 ||
+        ReadLE32(footer + 5) != SEEKABLE_MAGIC ||
+        static_cast<u64>(num_frames) * entry_size + SEEK_FOOTER_SIZE != table.size() - 8) {
+        return false;
+    }
+
+    std::vector<FrameInfo> parsed;
+    parsed.reserve(num_frames);
+    u64 compressed_offset = static_cast<u64>(header.header_size) + header.metadata_size;
+    u64 decompressed_offset = 0;
+    const u8* entry = table.data() + 8;
+    for (u32 i = 0; i < num_frames; ++i, entry += entry_size) {
+        FrameInfo frame{
+            .compressed_offset = compressed_offset,
+            .compressed_size = ReadLE32(entry),
+            .decompressed_offset = decompressed_offset,
+            .decompressed_size = ReadLE32(entry + 4),
+            .checksum = checksums ? ReadLE32(entry + 8) : 0,
+        };
+        compressed_offset += frame.compressed_size;
+        decompressed_offset += frame.decompressed_size;
+        parsed.push_back(frame);
+    }
+
+    // Frames must exactly fill the space before the seek table
+    if (compressed_offset + table.size() != table_end || decompressed_offset != header.uncompressed_size) {
+        return false;
+    }
+    has_checksums = checksums;
+    frames = std::move(parsed);
+    frame_heat.assign(frames.size(), 0);
+    fingerprint = XXH64(table.data(), table.size(), fingerprint);
+    return true;
+}
+
+size_t Z3DSReader::FrameIndexForOffset(u64 offset) const {
+    auto it = std::upper_bound(frames.begin(), frames.end(), offset,
+        [](u64 value, const FrameInfo& frame) { return value < frame.decompressed_offset; });
+    return it == frames.begin() ? 0 : static_cast<size_t>(it - frames.begin() - 1);
+}
+
+bool Z3DSReader::ReadCompressedFrame(size_t index, std::vector<u8>& out) {
+    if (index >= frames.size()) {
+        return false;
+    }
+    const FrameInfo& frame = frames[index];
+    out.resize(frame.compressed_size);
+    file.clear();
+    file.seekg(frame.compressed_offset);
+    file.read(reinterpret_cast<char*>(out.data()), frame.compressed_size);
+    if (file.gcount() != static_cast<std::streamsize>(frame.compressed_size)) {
+        ErrorLog() << "Error: Truncated frame " << index << " in " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Z3DSReader::DecompressFrame(size_t index, std::vector<u8>& out, bool verify_checksum) {
+    if (index >= frames.size()) {
+        return false;
+    }
+    out.resize(frames[index].decompressed_size);
+    return DecompressFrameInto(index, out.data(), verify_checksum);
+}
+
+bool Z3DSReader::DecompressFrameInto(size_t index, u8* out, bool verify_checksum) {
+    // One-shot decoding resets dctx, dropping a partially streamed frame
+    if (current_frame != SIZE_MAX && frame_decoded < frames[current_frame].decompressed_size) {
+        current_frame = SIZE_MAX;
+    }
+    if (!ReadCompressedFrame(index, compressed_buffer)) {
+        return false;
+    }
+    const FrameInfo& frame = frames[index];
+    size_t result = ZSTD_decompressDCtx(dctx, out, frame.decompressed_size,
+                                        compressed_buffer.data(), compressed_buffer.size());
+    if (ZSTD_isError(result) || result != frame.decompressed_size) {
+        ErrorLog() << "Error: Could not decompress frame " << index << " in " << path;
+        if (ZSTD_isError(result)) {
+            ErrorLog() << ": " << ZSTD_getErrorName(result);
+        }
+        ErrorLog() << std::endl;
+        return false;
+    }
+    if (verify_checksum && has_checksums &&
+        static_cast<u32>(XXH64(out, frame.decompressed_size) & 0xFFFFFFFF) != frame.checksum) {
+        ErrorLog() << "Error: Checksum mismatch in frame " << index << " of " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Z3DSReader::DecodeFrameTo(size_t index, size_t end) {
+    const FrameInfo& frame = frames[index];
+    end = std::min<size_t>(end, frame.decompressed_size);
+    FrameCache& cache = FrameCache::Instance();
+
+    if (index != current_frame) {
+        if (frame_heat[index]++ == 0 &&
+            std::chrono::steady_clock::now() - open_time <= std::chrono::duration<double>(HotSetSeconds())) {
+            hot_frames.push_back(static_cast<u32>(index));
+        }
+        current_frame = SIZE_MAX;
+        frame_decoded = 0;
+        frame_data.reset();
+        
+        bool use_cache = cache.Enabled();
+        if (warmup) {
+            warmup->Claim(static_cast<u32>(index));
+        }
+        if (use_cache) {
+            if (auto cached = cache.Lookup(file_id, static_cast<u32>(index))) {
+                frame_data = std::move(cached);
+                frame_decoded = frame.decompressed_size;
+                frame_cached = true;
+                current_frame = index;
+                return true;
+            }
+        }
+
+        // Second tier: a decoded copy on local storage
+        DiskFrameCache& disk_cache = DiskFrameCache::Instance();
+        if (disk_cache.Enabled()) {
+            if (auto stored = disk_cache.Lookup(fingerprint, static_cast<u32>(index), frame.decompressed_size)) {
+                if (use_cache) {
+                    cache.Insert(file_id, static_cast<u32>(index), stored, frame.decompressed_size);
+                }
+                frame_data = std::move(stored);
+                frame_decoded = frame.decompressed_size;
+                frame_cached = true;
+                current_frame = index;
+                return true;
+            }
+        }
+        
+        if (frame_capacity < frame.decompressed_size || frame_buffer.use_count() > 1) {
+            frame_buffer.reset(new u8[frame.decompressed_size]);
+            frame_capacity = frame.decompressed_size;
+        }
+        frame_data = frame_buffer;
+        frame_cached = !use_cache && !disk_cache.Enabled();
+        
+        // Reads that need most of the frame are cheapest as a single call
+        if (end * 2 > frame.decompressed_size) {
+            if (!DecompressFrameInto(index, frame_buffer.get(), false)) {
+                return false;
+            }
+            current_frame = index;
+            frame_decoded = frame.decompressed_size;
+        } else {
+            ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+            stream_input.clear();
+            stream_input_pos = 0;
+            stream_compressed_read = 0;
+            current_frame = index;
+        }
+    }
+
+    while (frame_decoded < end) {
+        if (stream_input_pos == stream_input.size()) {
+            size_t chunk = static_cast<size_t>(std::min<u64>(ZSTD_DStreamInSize(),
+                                                             frame.compressed_size - stream_compressed_read));
+            stream_input.resize(chunk);
+            file.clear();
+            file.seekg(frame.compressed_offset + stream_compressed_read);
+            file.read(reinterpret_cast<char*>(stream_input.data()), chunk);
+            if (chunk == 0 || file.gcount() != static_cast<std::streamsize>(chunk)) {
+                ErrorLog() << "Error: Truncated frame " << index << " in " << path << std::endl;
+                current_frame = SIZE_MAX;
+                return false;
+            }
+            stream_compressed_read += chunk;
+            stream_input_pos = 0;
+        }
+        
+        // Bounding the output at `end` makes zstd stop after the block that
+        // reaches it, keeping the rest of the frame undecoded
+        ZSTD_inBuffer in{stream_input.data(), stream_input.size(), stream_input_pos};
+        ZSTD_outBuffer out{frame_buffer.get(), end, frame_decoded};
+        size_t result = ZSTD_decompressStream(dctx, &out, &in);
+        if (ZSTD_isError(result) || (result == 0 && out.pos < end)) {
+            ErrorLog() << "Error: Could not decompress frame " << index << " in " << path;
+            if (ZSTD_isError(result)) {
+                ErrorLog() << ": " << ZSTD_getErrorName(result);
+            }
+            ErrorLog() << std::endl;
+            current_frame = SIZE_MAX;
+            return false;
+        }
+        stream_input_pos = in.pos;
+        frame_decoded = out.pos;
+    }
+    
+    if (!frame_cached && frame_decoded == frame.decompressed_size) {
+        cache.Insert(file_id, static_cast<u32>(index), frame_buffer, frame.decompressed_size);
+        DiskFrameCache::Instance().Insert(fingerprint, static_cast<u32>(index), frame_buffer,
+                                          frame.decompressed_size);
+        frame_cached = true;
+    }
+    return true;
+}
+
+size_t Z3DSReader::Read(u64 offset, void* buffer, size_t size) {
+    if (offset >= GetSize() || frames.empty()) {
+        return 0;
+    }
+    size = static_cast<size_t>(std::min<u64>(size, GetSize() - offset));
+
+    u8* dst = static_cast<u8*>(buffer);
+    size_t done = 0;
+    while (done < size) {
+        size_t index = FrameIndexForOffset(offset + done);
+        const FrameInfo& frame = frames[index];
+        size_t in_frame = static_cast<size_t>(offset + done - frame.decompressed_offset);
+        size_t chunk = std::min<size_t>(size - done, frame.decompressed_size - in_frame);
+        if (!DecodeFrameTo(index, in_frame + chunk)) {
+            break;
+        }
+        std::memcpy(dst + done, frame_data.get() + in_frame, chunk);
+        done += chunk;
+    }
+    session_bytes += done;
+    return done;
+}
+
+Z3DSReaderStreamBuf::Z3DSReaderStreamBuf(Z3DSReader& z3ds, size_t buffer_size)
+    : reader(z3ds), buffer(buffer_size) {
+    setg(buffer.data(), buffer.data(), buffer.data());
+}
+
+Z3DSReaderStreamBuf::int_type Z3DSReaderStreamBuf::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    buffer_offset += egptr() - eback();
+    size_t read = reader.Read(buffer_offset, buffer.data(), buffer.size());
+    setg(buffer.data(), buffer.data(), buffer.data() + read);
+    return read ? traits_type::to_int_type(*gptr()) : traits_type::eof();
+}
+
+Z3DSReaderStreamBuf::pos_type Z3DSReaderStreamBuf::seekoff(off_type offset, std::ios_base::seekdir dir,
+                                                           std::ios_base::openmode which) {
+    off_type base = 0;
+    if (dir == std::ios_base::cur) {
+        base = static_cast<off_type>(buffer_offset + (gptr() - eback()));
+    } else if (dir == std::ios_base::end) {
+        base = static_cast<off_type>(reader.GetSize());
+    }
+    return seekpos(base + offset, which);
+}
+
+Z3DSReaderStreamBuf::pos_type Z3DSReaderStreamBuf::seekpos(pos_type position, std::ios_base::openmode which) {
+    off_type target = position;
+    if (!(which & std::ios_base::in) || target < 0 || static_cast<u64>(target) > reader.GetSize()) {
+        return pos_type(off_type(-1));
+    }
+    // Stay in the buffer when possible
+    u64 buffered = egptr() - eback();
+    if (static_cast<u64>(target) >= buffer_offset && static_cast<u64>(target) <= buffer_offset + buffered) {
+        setg(eback(), eback() + (target - buffer_offset), egptr());
+    } else {
+        buffer_offset = target;
+        setg(buffer.data(), buffer.data(), buffer.data());
+    }
+    return position;
+}
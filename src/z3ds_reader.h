@@ -0,0 +1,123 @@
+#pragma once
+
+#include "z3ds_compression.h"
+#include <chrono>
+#include <fstream>
+#include <memory>
+
+struct ZSTD_DCtx_s;
+struct ZSTD_DDict_s;
+class FrameWarmup;
+
+// Random-access reader for Z3DS files, driven by the seekable ZSTD seek table
+class Z3DSReader {
+public:
+    struct FrameInfo {
+        u64 compressed_offset;   // Absolute offset in the Z3DS file
+        u32 compressed_size;
+        u64 decompressed_offset; // Offset in the underlying ROM
+        u32 decompressed_size;
+        u32 checksum;            // XXH64 lower 32 bits, valid if HasChecksums()
+    };
+
+    Z3DSReader();
+    ~Z3DSReader();
+
+    Z3DSReader(const Z3DSReader&) = delete;
+    Z3DSReader& operator=(const Z3DSReader&) = delete;
+
+    bool Open(const std::string& filename);
+    void Close();
+    bool IsOpen() const { return file.is_open(); }
+
+    const Z3DSFileHeader& GetHeader() const { return header; }
+    const std::unordered_map<std::string, std::vector<u8>>& GetMetadata() const { return metadata; }
+    std::string GetMetadataString(const std::string& name) const;
+    const std::vector<FrameInfo>& GetFrames() const { return frames; }
+    bool HasChecksums() const { return has_checksums; }
+    u64 GetFileId() const { return file_id; } // Key in the shared FrameCache
+    u64 GetFingerprint() const { return fingerprint; } // Key in the DiskFrameCache
+    u64 GetSize() const { return header.uncompressed_size; }
+    // Dictionary from the "zdict" metadata item, null if frames need none
+    ZSTD_DDict_s* GetDictionary() const { return ddict.get(); }
+
+    // Index of the frame holding the given uncompressed offset
+    size_t FrameIndexForOffset(u64 offset) const;
+
+    bool ReadCompressedFrame(size_t index, std::vector<u8>& out);
+    bool DecompressFrame(size_t index, std::vector<u8>& out, bool verify_checksum = false);
+
+    // Read uncompressed bytes, returns the number of bytes read. Only the part
+    // of a frame up to the end of the request is decoded; fully decoded frames
+    // go to the process-wide FrameCache and, when configured, the
+    // DiskFrameCache.
+    size_t Read(u64 offset, void* buffer, size_t size);
+
+    // Sessions that read data are added to the AccessStatsStore on Close when
+    // Z3DS_ACCESS_STATS_DIR is set; tools that scan files turn this off.
+    // Frames first read within Z3DS_HOTSET_SECONDS (default 10, 0 to turn
+    // off) of Open form the session's hot set; on later opens the stored hot
+    // set is decoded into the FrameCache on background threads.
+    void SetRecordAccess(bool enabled) { record_access = enabled; }
+
+private:
+    bool ReadSeekTable(u64 table_end);
+    bool ReadFrontIndex(const std::vector<u8>& prefix);
+    bool ParseSeekTable(const std::vector<u8>& table, u64 table_end);
+    bool DecompressFrameInto(size_t index, u8* out, bool verify_checksum);
+    bool DecodeFrameTo(size_t index, size_t end);
+    void StartWarmup();
+
+    std::ifstream file;
+    std::string path;
+    u64 file_id = 0;
+    u64 fingerprint = 0; // Hash of the header and seek table
+    Z3DSFileHeader header{};
+    std::unordered_map<std::string, std::vector<u8>> metadata;
+    std::vector<FrameInfo> frames;
+    bool has_checksums = false;
+
+    ZSTD_DCtx_s* dctx = nullptr;
+    std::shared_ptr<ZSTD_DDict_s> ddict; // Shared with the warmup threads
+    std::vector<u8> compressed_buffer;
+
+    // Decoded prefix of the current frame. When a read stops mid-frame, dctx
+    // keeps the stream state so the next read in the frame continues from
+    // frame_decoded instead of starting over.
+    // The buffer is left uninitialised so a small read does not fault in a
+    // whole frame's worth of pages. It is replaced rather than reused once
+    // the frame cache holds a reference to it.
+    size_t current_frame = SIZE_MAX;
+    std::shared_ptr<u8[]> frame_buffer;
+    std::shared_ptr<const u8[]> frame_data; // frame_buffer or a cached frame
+    size_t frame_capacity = 0;
+    size_t frame_decoded = 0;
+    bool frame_cached = false;
+    std::vector<u8> stream_input;
+    size_t stream_input_pos = 0;
+    u64 stream_compressed_read = 0;
+
+    bool record_access = true;
+    u64 session_bytes = 0;
+    std::vector<u32> frame_heat;
+    std::chrono::steady_clock::time_point open_time;
+    std::vector<u32> hot_frames; // First read within the hot set window, in order
+    std::unique_ptr<FrameWarmup> warmup;
+};
+
+// Seekable std::streambuf over the uncompressed image, so code that takes an
+// std::istream (e.g. CompressZ3DSStream) can read a Z3DS file directly
+class Z3DSReaderStreamBuf : public std::streambuf {
+public:
+    explicit Z3DSReaderStreamBuf(Z3DSReader& reader, size_t buffer_size = 1024 * 1024);
+
+protected:
+    int_type underflow() override;
+    pos_type seekoff(off_type offset, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+    pos_type seekpos(pos_type position, std::ios_base::openmode which) override;
+
+private:
+    Z3DSReader& reader;
+    std::vector<char> buffer;
+    u64 buffer_offset = 0; // Image offset of eback()
+};
@@ -0,0 +1,241 @@
+#include "z3ds_rebalance.h"
+#include "z3ds_access_stats.h"
+#include "z3ds_bench.h"
+#include "z3ds_pack.h"
+#include "z3ds_precomp.h"
+#include "z3ds_reader.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <map>
+
+namespace {
+
+bool IsZ3DSFile(const std::filesystem::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+    return ext == ".zcci" || ext == ".zcia" || ext == ".zcxi" || ext == ".z3dsx" || ext == ".z3ds";
+}
+
+// Rough single-thread compression speed by level, replaced by measurements as
+// files are done
+double InitialMBps(const CompressionProfile& profile) {
+    if (profile.store_raw) {
+        return 1000.0;
+    }
+    if (profile.level <= 3) {
+        return 200.0;
+    }
+    if (profile.level <= 9) {
+        return 50.0;
+    }
+    if (profile.level <= 15) {
+        return 15.0;
+    }
+    return 4.0;
+}
+
+u64 UnixNow() {
+    return static_cast<u64>(std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+u64 FileTimeUnix(const std::filesystem::path& path) {
+    std::error_code ec;
+    auto file_time = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+        return 0;
+    }
+    auto system_time = std::chrono::time_point_cast<std::chrono::system_clock::duration>(
+        file_time - std::filesystem::file_time_type::clock::now() + std::chrono::system_clock::now());
+    return static_cast<u64>(std::chrono::duration_cast<std::chrono::seconds>(
+        system_time.time_since_epoch()).count());
+}
+
+// Both readers must return the same bytes over the whole image
+bool SameContent(Z3DSReader& a, Z3DSReader& b) {
+    if (a.GetSize() != b.GetSize()) {
+        return false;
+    }
+    constexpr size_t CHUNK = 4 * 1024 * 1024;
+    std::vector<u8> buffer_a(CHUNK);
+    std::vector<u8> buffer_b(CHUNK);
+    for (u64 offset = 0; offset < a.GetSize(); offset += CHUNK) {
+        size_t size = static_cast<size_t>(std::min<u64>(CHUNK, a.GetSize() - offset));
+        if (a.Read(offset, buffer_a.data(), size) != size || b.Read(offset, buffer_b.data(), size) != size ||
+            std::memcmp(buffer_a.data(), buffer_b.data(), size) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Recompress(const std::string& file, const CompressionProfile& profile, const std::string& tier,
+                AccessStatsStore& store, RebalanceResult& result) {
+    Z3DSReader reader;
+    reader.SetRecordAccess(false);
+    if (!reader.Open(file)) {
+        result.error = "could not open";
+        return false;
+    }
+
+    std::string temp_file = file + ".rebalance.tmp";
+    size_t frame_size = profile.frame_size ? profile.frame_size
+                                           : GetDefaultFrameSize(reader.GetHeader().underlying_magic);
+    Z3DSReaderStreamBuf buffer(reader);
+    std::istream input(&buffer);
+    if (!CompressZ3DSStream(input, temp_file, reader.GetHeader().underlying_magic, frame_size, nullptr,
+                            {{"tier", std::vector<u8>(tier.begin(), tier.end())}}, nullptr, profile)) {
+        std::error_code ec;
+        std::filesystem::remove(temp_file, ec);
+        result.error = "compression failed";
+        return false;
+    }
+
+    Z3DSReader check;
+    check.SetRecordAccess(false);
+    if (!check.Open(temp_file) || !SameContent(reader, check)) {
+        check.Close();
+        std::error_code ec;
+        std::filesystem::remove(temp_file, ec);
+        result.error = "verification failed";
+        return false;
+    }
+    u64 old_fingerprint = reader.GetFingerprint();
+    u64 new_fingerprint = check.GetFingerprint();
+    size_t new_frames = check.GetFrames().size();
+    reader.Close();
+    check.Close();
+
+    std::error_code ec;
+    std::filesystem::rename(temp_file, file, ec);
+    if (ec) {
+        std::filesystem::remove(temp_file, ec);
+        result.error = "could not replace file";
+        return false;
+    }
+    result.new_size = std::filesystem::file_size(file, ec);
+    store.Rekey(old_fingerprint, new_fingerprint, new_frames, std::filesystem::absolute(file, ec).string());
+    return true;
+}
+
+} // namespace
+
+bool RunRebalance(const RebalanceOptions& options, std::vector<RebalanceResult>& results) {
+    results.clear();
+    AccessStatsStore store(options.stats_dir);
+    if (!store.Enabled()) {
+        std::cerr << "Error: rebalance needs a stats directory (--stats-dir or Z3DS_ACCESS_STATS_DIR)" << std::endl;
+        return false;
+    }
+    auto hot_profile = FindCompressionProfile(options.hot_profile);
+    auto cold_profile = FindCompressionProfile(options.cold_profile);
+    if (!hot_profile || !cold_profile) {
+        std::cerr << "Error: Unknown profile: "
+                  << (hot_profile ? options.cold_profile : options.hot_profile) << std::endl;
+        return false;
+    }
+
+    std::vector<std::string> files;
+    for (const auto& path : options.paths) {
+        std::error_code ec;
+        if (std::filesystem::is_directory(path, ec)) {
+            for (const auto& entry : std::filesystem::recursive_directory_iterator(path, ec)) {
+                if (entry.is_regular_file() && IsZ3DSFile(entry.path())) {
+                    files.push_back(entry.path().string());
+                }
+            }
+        } else if (std::filesystem::is_regular_file(path, ec)) {
+            files.push_back(path);
+        } else {
+            std::cerr << "Warning: Skipping missing path: " << path << std::endl;
+        }
+    }
+
+    // Classify every file from its stored access record
+    u64 now = UnixNow();
+    struct Candidate {
+        size_t result;
+        bool hot;
+        u64 size;
+    };
+    std::vector<Candidate> candidates;
+    for (const auto& file : files) {
+        RebalanceResult result;
+        result.file = file;
+        Z3DSReader reader;
+        reader.SetRecordAccess(false);
+        if (!reader.Open(file)) {
+            result.error = "not a Z3DS file";
+            results.push_back(result);
+            continue;
+        }
+        // Recompressing would drop their frame layout and index metadata
+        const auto& magic = reader.GetHeader().underlying_magic;
+        if (magic == PACK_MAGIC || magic == PRECOMP_MAGIC) {
+            result.error = "pack or precomp archive";
+            results.push_back(result);
+            continue;
+        }
+        std::string profile = reader.GetMetadataString("profile");
+        result.current_profile = profile.empty() ? "default" : profile;
+        std::error_code ec;
+        result.old_size = std::filesystem::file_size(file, ec);
+
+        AccessRecord record;
+        store.Load(reader.GetFingerprint(), record);
+        u64 last_access = record.last_access ? record.last_access : FileTimeUnix(file);
+        result.score = record.ScoreAt(now);
+        result.idle_days = now > last_access ? (now - last_access) / 86400.0 : 0.0;
+
+        bool hot = result.score >= options.hot_score;
+        bool cold = !hot && result.idle_days >= options.cold_days;
+        if (hot && result.current_profile != hot_profile->name) {
+            result.target_profile = hot_profile->name;
+        } else if (cold && result.current_profile != cold_profile->name) {
+            result.target_profile = cold_profile->name;
+        }
+        if (!result.target_profile.empty()) {
+            candidates.push_back({results.size(), hot, reader.GetSize()});
+        }
+        results.push_back(result);
+    }
+
+    std::stable_sort(candidates.begin(), candidates.end(), [&](const Candidate& a, const Candidate& b) {
+        if (a.hot != b.hot) {
+            return a.hot;
+        }
+        return a.hot ? results[a.result].score > results[b.result].score
+                     : results[a.result].idle_days > results[b.result].idle_days;
+    });
+
+    std::map<std::string, double> mbps = {
+        {hot_profile->name, InitialMBps(*hot_profile)},
+        {cold_profile->name, InitialMBps(*cold_profile)},
+    };
+    double remaining = options.cpu_budget_seconds;
+    for (const auto& candidate : candidates) {
+        RebalanceResult& result = results[candidate.result];
+        const CompressionProfile& profile = candidate.hot ? *hot_profile : *cold_profile;
+        result.estimated_cpu_seconds = candidate.size / (mbps[profile.name] * 1024 * 1024);
+        if (result.estimated_cpu_seconds > remaining) {
+            result.deferred = true;
+            continue;
+        }
+        if (options.dry_run) {
+            remaining -= result.estimated_cpu_seconds;
+            continue;
+        }
+
+        double cpu_start = GetProcessCPUSeconds();
+        result.recompressed = Recompress(result.file, profile, candidate.hot ? "hot" : "cold", store, result);
+        result.cpu_seconds = GetProcessCPUSeconds() - cpu_start;
+        remaining -= result.cpu_seconds;
+        if (result.recompressed && result.cpu_seconds > 0.01) {
+            mbps[profile.name] = candidate.size / (1024.0 * 1024.0) / result.cpu_seconds;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "z3ds_compression.h"
+
+// Recompress Z3DS files according to how often they are read (see
+// z3ds_access_stats.h): titles with a high decayed open score get a profile
+// that is fast to decode with small frames, titles idle for a long time get
+// the smallest output. Work is done hottest first, then longest idle first,
+// and stops taking new files once the CPU budget would be exceeded.
+struct RebalanceOptions {
+    std::vector<std::string> paths; // Files or directories searched recursively
+    std::string stats_dir;
+    double cpu_budget_seconds = 3600.0;
+    double hot_score = 2.0;         // Decayed opens (7 day half-life)
+    double cold_days = 30.0;        // Idle time before a title counts as cold
+    std::string hot_profile = "decode-fast";
+    std::string cold_profile = "archive";
+    bool dry_run = false;
+};
+
+struct RebalanceResult {
+    std::string file;
+    std::string current_profile;
+    std::string target_profile; // Empty when the file stays as it is
+    double score = 0.0;
+    double idle_days = 0.0;
+    bool recompressed = false;
+    bool deferred = false;      // Did not fit in the remaining CPU budget
+    std::string error;
+    u64 old_size = 0;
+    u64 new_size = 0;
+    double estimated_cpu_seconds = 0.0;
+    double cpu_seconds = 0.0;
+};
+
+bool RunRebalance(const RebalanceOptions& options, std::vector<RebalanceResult>& results);
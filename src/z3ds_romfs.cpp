@@ -0,0 +1,62 @@
+#include "z3ds_romfs.h"
+#include "z3ds_pack.h"
+#include <algorithm>
+
+bool RomFileSystem::Open(Z3DSReader& z3ds) {
+    reader = &z3ds;
+    partitions.clear();
+    files.clear();
+
+    if (z3ds.GetHeader().underlying_magic == PACK_MAGIC) {
+        std::vector<PackMember> members;
+        if (!ReadPackIndex(z3ds, members)) {
+            return false;
+        }
+        for (const auto& member : members) {
+            files.push_back({member.name, 0, member.offset, member.size});
+        }
+        return true;
+    }
+
+    u64 image_size = z3ds.GetSize();
+    auto read = [&](u64 offset, void* buffer, size_t size) {
+        return offset + size <= image_size && z3ds.Read(offset, buffer, size) == size;
+    };
+    if (!ParseRomLayout(read, image_size, partitions)) {
+        return false;
+    }
+
+    // The first partition is the one tools care about; give it short paths
+    std::sort(partitions.begin(), partitions.end(),
+              [](const NCCHPartition& a, const NCCHPartition& b) { return a.index < b.index; });
+    for (size_t i = 0; i < partitions.size(); ++i) {
+        const NCCHPartition& ncch = partitions[i];
+        std::string prefix = i == 0 ? "" : "p" + std::to_string(ncch.index) + "/";
+        for (const auto& file : ncch.exefs_files) {
+            files.push_back({prefix + "exefs/" + file.path, ncch.index, file.offset, file.size});
+        }
+        for (const auto& file : ncch.romfs_files) {
+            // RomFS paths start with '/'
+            files.push_back({prefix + "romfs" + file.path, ncch.index, file.offset, file.size});
+        }
+    }
+    return true;
+}
+
+const RomFSFile* RomFileSystem::Find(const std::string& path) const {
+    std::string wanted = !path.empty() && path[0] == '/' ? path.substr(1) : path;
+    for (const auto& file : files) {
+        if (file.path == wanted) {
+            return &file;
+        }
+    }
+    return nullptr;
+}
+
+size_t RomFileSystem::Read(const RomFSFile& file, u64 offset, void* buffer, size_t size) {
+    if (!reader || offset >= file.size) {
+        return 0;
+    }
+    size = static_cast<size_t>(std::min<u64>(size, file.size - offset));
+    return reader->Read(file.offset + offset, buffer, size);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "z3ds_layout.h"
+#include "z3ds_reader.h"
+
+// File-level view of the ExeFS and RomFS of a compressed image. Paths are
+// "exefs/<name>" and "romfs/<dir>/<file>" for the first NCCH and are prefixed
+// with "p<index>/" for the others (e.g. "p1/romfs/..." for a CCI manual).
+// For a pack (z3ds_pack.h) the files are its members under their own names.
+// Only the frames holding the requested bytes are decoded.
+struct RomFSFile {
+    std::string path;
+    u32 partition;
+    u64 offset; // Absolute offset in the uncompressed image
+    u64 size;
+};
+
+class RomFileSystem {
+public:
+    // Parse the layout of an open reader; fails for images that are not
+    // CCI/CIA/CXI or a pack. Encrypted partitions contribute no files.
+    bool Open(Z3DSReader& reader);
+
+    const std::vector<RomFSFile>& GetFiles() const { return files; }
+    const std::vector<NCCHPartition>& GetPartitions() const { return partitions; }
+    const RomFSFile* Find(const std::string& path) const;
+
+    // Read from a file, returns the number of bytes read
+    size_t Read(const RomFSFile& file, u64 offset, void* buffer, size_t size);
+
+private:
+    Z3DSReader* reader = nullptr;
+    std::vector<NCCHPartition> partitions;
+    std::vector<RomFSFile> files;
+};
@@ -0,0 +1,472 @@
+#include "z3ds_s3.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <curl/curl.h>
+
+namespace {
+
+constexpr size_t MIN_PART_SIZE = 5 * 1024 * 1024;
+constexpr int MAX_PARTS = 10000;
+constexpr int MAX_ATTEMPTS = 3;
+
+// Percent-encoding of the path and query as Signature Version 4 expects it;
+// libcurl signs the URL as given
+std::string UriEncode(const std::string& value, bool keep_slash) {
+    static const char digits[] = "0123456789ABCDEF";
+    std::string encoded;
+    for (unsigned char c : value) {
+        if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~' || (keep_slash && c == '/')) {
+            encoded += static_cast<char>(c);
+        } else {
+            encoded += '%';
+            encoded += digits[c >> 4];
+            encoded += digits[c & 0xF];
+        }
+    }
+    return encoded;
+}
+
+std::string GetEnv(const char* name) {
+    const char* value = std::getenv(name);
+    return value ? value : "";
+}
+
+size_t AppendResponse(char* data, size_t size, size_t count, void* user) {
+    static_cast<std::string*>(user)->append(data, size * count);
+    return size * count;
+}
+
+size_t FindETag(char* data, size_t size, size_t count, void* user) {
+    std::string line(data, size * count);
+    std::string name = line.substr(0, 5);
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+    if (name == "etag:") {
+        size_t start = line.find_first_not_of(" \t", 5);
+        size_t end = line.find_last_not_of(" \t\r\n");
+        if (start != std::string::npos && end != std::string::npos && end >= start) {
+            *static_cast<std::string*>(user) = line.substr(start, end - start + 1);
+        }
+    }
+    return size * count;
+}
+
+std::string XmlElement(const std::string& xml, const std::string& name) {
+    size_t start = xml.find("<" + name + ">");
+    size_t end = start == std::string::npos ? start : xml.find("</" + name + ">", start);
+    if (end == std::string::npos) {
+        return "";
+    }
+    start += name.size() + 2;
+    return xml.substr(start, end - start);
+}
+
+// One object of an S3 bucket, with signed requests against it
+class S3Object {
+public:
+    bool Init(const std::string& url, const S3Options& options) {
+        std::string path = url.substr(5);
+        size_t slash = path.find('/');
+        if (slash == std::string::npos || slash == 0 || slash + 1 == path.size()) {
+            std::cerr << "Error: Expected s3://bucket/key, got " << url << std::endl;
+            return false;
+        }
+        std::string endpoint = options.endpoint;
+        while (!endpoint.empty() && endpoint.back() == '/') {
+            endpoint.pop_back();
+        }
+        size_t scheme_end = endpoint.find("://");
+        if (scheme_end == std::string::npos) {
+            std::cerr << "Error: S3 endpoint must be an http(s):// URL (--s3-endpoint or AWS_ENDPOINT_URL)"
+                      << std::endl;
+            return false;
+        }
+        if (options.access_key.empty() || options.secret_key.empty()) {
+            std::cerr << "Error: S3 credentials missing (AWS_ACCESS_KEY_ID, AWS_SECRET_ACCESS_KEY)" << std::endl;
+            return false;
+        }
+        base_url = endpoint + "/" + UriEncode(path.substr(0, slash), false) + "/" +
+                   UriEncode(path.substr(slash + 1), true);
+        signing = "aws:amz:" + options.region + ":s3";
+        credentials = options.access_key + ":" + options.secret_key;
+        session_token = options.session_token;
+        return true;
+    }
+
+    // HTTP status of the request, 0 if it could not be sent
+    long Request(CURL* curl, const std::string& method, const std::map<std::string, std::string>& query,
+                 const u8* body, size_t size, std::string& response, std::string* etag = nullptr) const {
+        std::string query_string;
+        for (const auto& [name, value] : query) {
+            query_string += (query_string.empty() ? "" : "&") + UriEncode(name, false) + "=" + UriEncode(value, false);
+        }
+
+        // libcurl signs the request, including the x-amz-* headers set here.
+        // S3 requires a payload hash header; libcurl signs the value given,
+        // and hashing every part would cost as much as compressing it
+        curl_slist* headers = nullptr;
+        headers = curl_slist_append(headers, "Content-Type: application/octet-stream");
+        headers = curl_slist_append(headers, "x-amz-content-sha256: UNSIGNED-PAYLOAD");
+        if (!session_token.empty()) {
+            headers = curl_slist_append(headers, ("x-amz-security-token: " + session_token).c_str());
+        }
+
+        std::string url = base_url + (query_string.empty() ? "" : "?" + query_string);
+        response.clear();
+        curl_easy_reset(curl);
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method.c_str());
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(curl, CURLOPT_AWS_SIGV4, signing.c_str());
+        curl_easy_setopt(curl, CURLOPT_USERPWD, credentials.c_str());
+        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 30L);
+        if (method != "DELETE") {
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body ? reinterpret_cast<const char*>(body) : "");
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(size));
+        }
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, AppendResponse);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+        if (etag) {
+            curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, FindETag);
+            curl_easy_setopt(curl, CURLOPT_HEADERDATA, etag);
+        }
+        CURLcode code = curl_easy_perform(curl);
+        curl_slist_free_all(headers);
+        if (code != CURLE_OK) {
+            response = curl_easy_strerror(code);
+            return 0;
+        }
+        long status = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+        return status;
+    }
+
+    // Request with retries of transport errors and 5xx responses
+    bool Send(CURL* curl, const std::string& what, const std::string& method,
+              const std::map<std::string, std::string>& query, const u8* body, size_t size, std::string& response,
+              std::string* etag = nullptr) const {
+        long status = 0;
+        for (int attempt = 1; attempt <= MAX_ATTEMPTS; ++attempt) {
+            status = Request(curl, method, query, body, size, response, etag);
+            // CompleteMultipartUpload can fail after sending 200
+            bool error_body = response.find("<Error>") != std::string::npos;
+            if (status >= 200 && status < 300 && !error_body) {
+                return true;
+            }
+            if (status >= 400 && status < 500) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::seconds(attempt));
+        }
+        std::string message = XmlElement(response, "Message");
+        std::cerr << "Error: S3 " << what << " failed";
+        if (status) {
+            std::cerr << " (HTTP " << status << ")";
+        }
+        std::cerr << ": " << (message.empty() ? response.substr(0, 200) : message) << std::endl;
+        return false;
+    }
+
+private:
+    std::string base_url;
+    std::string signing;     // CURLOPT_AWS_SIGV4 provider, region and service
+    std::string credentials; // access:secret
+    std::string session_token;
+};
+
+} // namespace
+
+class S3UploadBuf : public std::streambuf {
+public:
+    ~S3UploadBuf() override {
+        if (!upload_id.empty() && !finished) {
+            Abort();
+        }
+        StopWorkers();
+        if (curl) {
+            curl_easy_cleanup(curl);
+        }
+    }
+
+    bool Open(const std::string& url, S3Options& options) {
+        static std::once_flag curl_init;
+        std::call_once(curl_init, [] { curl_global_init(CURL_GLOBAL_DEFAULT); });
+
+        if (options.endpoint.empty()) {
+            options.endpoint = GetEnv("AWS_ENDPOINT_URL");
+        }
+        if (options.region.empty()) {
+            options.region = GetEnv("AWS_REGION");
+        }
+        if (options.region.empty()) {
+            options.region = GetEnv("AWS_DEFAULT_REGION");
+        }
+        if (options.region.empty()) {
+            options.region = "us-east-1";
+        }
+        if (options.access_key.empty()) {
+            options.access_key = GetEnv("AWS_ACCESS_KEY_ID");
+        }
+        if (options.secret_key.empty()) {
+            options.secret_key = GetEnv("AWS_SECRET_ACCESS_KEY");
+        }
+        if (options.session_token.empty()) {
+            options.session_token = GetEnv("AWS_SESSION_TOKEN");
+        }
+        if (options.part_size < MIN_PART_SIZE) {
+            std::cerr << "Error: S3 part size must be at least " << MIN_PART_SIZE << " bytes" << std::endl;
+            return false;
+        }
+        part_size = options.part_size;
+        if (!object.Init(url, options)) {
+            return false;
+        }
+
+        curl = curl_easy_init();
+        std::string response;
+        if (!curl || !object.Send(curl, "CreateMultipartUpload", "POST", {{"uploads", ""}}, nullptr, 0, response)) {
+            return false;
+        }
+        upload_id = XmlElement(response, "UploadId");
+        if (upload_id.empty()) {
+            std::cerr << "Error: S3 CreateMultipartUpload returned no UploadId" << std::endl;
+            return false;
+        }
+        for (unsigned i = 0; i < std::max(1u, options.threads); ++i) {
+            workers.emplace_back(&S3UploadBuf::Worker, this);
+        }
+        max_queued = workers.size();
+        return true;
+    }
+
+    bool Finish() {
+        if (upload_id.empty() || finished) {
+            return false;
+        }
+        // The seek table is in the last part and the patched header in the first
+        if (!current.empty()) {
+            Submit(next_part++, std::move(current));
+            current.clear();
+        }
+        Submit(1, std::move(first));
+        first.clear();
+        {
+            std::unique_lock lock(mutex);
+            changed.wait(lock, [&] { return failed || (queue.empty() && in_flight == 0); });
+        }
+        StopWorkers();
+        if (failed) {
+            Abort();
+            return false;
+        }
+
+        std::string xml = "<CompleteMultipartUpload>";
+        for (const auto& [number, etag] : etags) {
+            xml += "<Part><PartNumber>" + std::to_string(number) + "</PartNumber><ETag>" + etag + "</ETag></Part>";
+        }
+        xml += "</CompleteMultipartUpload>";
+        std::string response;
+        if (!object.Send(curl, "CompleteMultipartUpload", "POST", {{"uploadId", upload_id}},
+                         reinterpret_cast<const u8*>(xml.data()), xml.size(), response)) {
+            Abort();
+            return false;
+        }
+        finished = true;
+        return true;
+    }
+
+    void Abort() {
+        StopWorkers();
+        if (upload_id.empty() || finished) {
+            return;
+        }
+        std::string response;
+        object.Send(curl, "AbortMultipartUpload", "DELETE", {{"uploadId", upload_id}}, nullptr, 0, response);
+        upload_id.clear();
+    }
+
+    u64 GetSize() const {
+        return size;
+    }
+
+    size_t GetPartCount() const {
+        return etags.size();
+    }
+
+protected:
+    std::streamsize xsputn(const char* data, std::streamsize count) override {
+        if (upload_id.empty() || finished || HasFailed()) {
+            return 0;
+        }
+        if (cursor < size) {
+            // Only the held first part can be rewritten (the header)
+            if (cursor + count > first.size()) {
+                std::cerr << "Error: S3 upload can only rewrite the first " << first.size() << " bytes" << std::endl;
+                return 0;
+            }
+            std::memcpy(first.data() + cursor, data, count);
+            cursor += count;
+            return count;
+        }
+
+        // Parts end on write boundaries, so they hold whole frames
+        std::vector<u8>& part = next_part == 2 && first.size() < part_size ? first : current;
+        part.insert(part.end(), data, data + count);
+        size += count;
+        cursor = size;
+        if (&part == &current && current.size() >= part_size) {
+            if (next_part >= MAX_PARTS) {
+                std::cerr << "Error: S3 upload needs more than " << MAX_PARTS << " parts; use a larger part size"
+                          << std::endl;
+                return 0;
+            }
+            Submit(next_part++, std::move(current));
+            current.clear();
+        }
+        return count;
+    }
+
+    int_type overflow(int_type c) override {
+        if (traits_type::eq_int_type(c, traits_type::eof())) {
+            return traits_type::not_eof(c);
+        }
+        char byte = traits_type::to_char_type(c);
+        return xsputn(&byte, 1) == 1 ? c : traits_type::eof();
+    }
+
+    pos_type seekoff(off_type offset, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+        u64 base = dir == std::ios_base::beg ? 0 : dir == std::ios_base::cur ? cursor : size;
+        return seekpos(static_cast<pos_type>(base + offset), which);
+    }
+
+    pos_type seekpos(pos_type target, std::ios_base::openmode which) override {
+        if (!(which & std::ios_base::out) || target < 0 || static_cast<u64>(target) > size) {
+            return pos_type(off_type(-1));
+        }
+        cursor = static_cast<u64>(target);
+        return target;
+    }
+
+private:
+    bool HasFailed() {
+        std::lock_guard lock(mutex);
+        return failed;
+    }
+
+    void Submit(int number, std::vector<u8> data) {
+        std::unique_lock lock(mutex);
+        // Bound the parts held in memory to the ones being uploaded and as many waiting
+        changed.wait(lock, [&] { return failed || queue.size() < max_queued; });
+        queue.emplace_back(number, std::move(data));
+        changed.notify_all();
+    }
+
+    void Worker() {
+        CURL* worker_curl = curl_easy_init();
+        std::unique_lock lock(mutex);
+        while (true) {
+            changed.wait(lock, [&] { return stopping || !queue.empty(); });
+            if (queue.empty()) {
+                break;
+            }
+            auto [number, data] = std::move(queue.front());
+            queue.pop_front();
+            in_flight++;
+            changed.notify_all();
+            lock.unlock();
+
+            std::string response;
+            std::string etag;
+            bool success = worker_curl &&
+                           object.Send(worker_curl, "UploadPart " + std::to_string(number), "PUT",
+                                       {{"partNumber", std::to_string(number)}, {"uploadId", upload_id}},
+                                       data.data(), data.size(), response, &etag);
+
+            lock.lock();
+            in_flight--;
+            if (success && !etag.empty()) {
+                etags[number] = etag;
+            } else {
+                failed = true;
+                queue.clear();
+            }
+            changed.notify_all();
+        }
+        if (worker_curl) {
+            curl_easy_cleanup(worker_curl);
+        }
+    }
+
+    void StopWorkers() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        workers.clear();
+    }
+
+    S3Object object;
+    CURL* curl = nullptr;
+    std::string upload_id;
+    size_t part_size = 0;
+    bool finished = false;
+
+    std::vector<u8> first;   // Part 1: header, metadata and the first frames
+    std::vector<u8> current; // Part being filled
+    int next_part = 2;
+    u64 size = 0;
+    u64 cursor = 0;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::pair<int, std::vector<u8>>> queue;
+    std::map<int, std::string> etags;
+    size_t in_flight = 0;
+    size_t max_queued = 1;
+    bool failed = false;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+};
+
+S3UploadStream::S3UploadStream() : std::ostream(nullptr), buffer(std::make_unique<S3UploadBuf>()) {
+    rdbuf(buffer.get());
+}
+
+S3UploadStream::~S3UploadStream() = default;
+
+bool S3UploadStream::Open(const std::string& url, S3Options options) {
+    if (!buffer->Open(url, options)) {
+        setstate(std::ios_base::badbit);
+        return false;
+    }
+    return true;
+}
+
+bool S3UploadStream::Finish() {
+    return good() && buffer->Finish();
+}
+
+void S3UploadStream::Abort() {
+    buffer->Abort();
+}
+
+u64 S3UploadStream::GetSize() const {
+    return buffer->GetSize();
+}
+
+size_t S3UploadStream::GetPartCount() const {
+    return buffer->GetPartCount();
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "z3ds_compression.h"
+#include <memory>
+#include <ostream>
+
+// Output sink streaming a Z3DS file straight into an S3 multipart upload
+// (AWS, MinIO or any other S3-compatible store), so compressing to the
+// archive tier needs no local copy.
+//
+// The first part holds the header and metadata and stays in memory: the
+// compressor seeks back to patch the header at the end, so it is uploaded
+// last, together with the final part holding the seek table. Everything in
+// between is cut into parts of whole frames, which are uploaded on worker
+// threads while compression continues. Requests use path-style URLs and are
+// signed with AWS Signature Version 4 by libcurl.
+struct S3Options {
+    std::string endpoint;         // http(s)://host[:port]; AWS_ENDPOINT_URL if empty
+    std::string region;           // AWS_REGION / AWS_DEFAULT_REGION, else us-east-1
+    std::string access_key;       // AWS_ACCESS_KEY_ID if empty
+    std::string secret_key;       // AWS_SECRET_ACCESS_KEY if empty
+    std::string session_token;    // AWS_SESSION_TOKEN if empty; sent as x-amz-security-token when set
+    size_t part_size = 16 * 1024 * 1024; // At least 5 MiB, the S3 minimum for all but the last part
+    unsigned threads = 4;         // Concurrent part uploads
+};
+
+// s3://bucket/key
+inline bool IsS3Url(const std::string& path) {
+    return path.rfind("s3://", 0) == 0;
+}
+
+class S3UploadBuf;
+
+class S3UploadStream : public std::ostream {
+public:
+    S3UploadStream();
+    ~S3UploadStream() override; // Aborts an upload that was not finished
+
+    // Start a multipart upload to url (s3://bucket/key)
+    bool Open(const std::string& url, S3Options options);
+    // Upload the held first and last parts and complete the upload
+    bool Finish();
+    // Discard the upload and every part sent so far
+    void Abort();
+
+    u64 GetSize() const;
+    size_t GetPartCount() const;
+
+private:
+    std::unique_ptr<S3UploadBuf> buffer;
+};
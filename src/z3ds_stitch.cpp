@@ -0,0 +1,294 @@
+#include "z3ds_stitch.h"
+#include "z3ds_reader.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+namespace {
+
+constexpr u32 SKIPPABLE_MAGIC = 0x184D2A5E;
+constexpr u32 SEEKABLE_MAGIC = 0x8F92EAB1;
+
+void WriteLE(std::vector<u8>& out, u64 value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out.push_back(static_cast<u8>(value >> (8 * i)));
+    }
+}
+
+// A byte range of a file as a seekable stream of its own
+class RangeStreamBuf : public std::streambuf {
+public:
+    RangeStreamBuf(std::istream& input, u64 start, u64 size)
+        : input(input), start(start), size(size), buffer(1024 * 1024) {}
+
+protected:
+    int_type underflow() override {
+        if (gptr() < egptr()) {
+            return traits_type::to_int_type(*gptr());
+        }
+        position += egptr() - eback();
+        size_t chunk = static_cast<size_t>(std::min<u64>(buffer.size(), size - position));
+        input.clear();
+        input.seekg(start + position);
+        input.read(buffer.data(), chunk);
+        chunk = input.gcount();
+        setg(buffer.data(), buffer.data(), buffer.data() + chunk);
+        return chunk ? traits_type::to_int_type(*gptr()) : traits_type::eof();
+    }
+
+    pos_type seekoff(off_type offset, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+        u64 base = dir == std::ios_base::beg ? 0 : dir == std::ios_base::cur ? position + (gptr() - eback()) : size;
+        return seekpos(static_cast<pos_type>(base + offset), which);
+    }
+
+    pos_type seekpos(pos_type target, std::ios_base::openmode) override {
+        if (target < 0 || static_cast<u64>(target) > size) {
+            return pos_type(off_type(-1));
+        }
+        position = static_cast<u64>(target);
+        setg(buffer.data(), buffer.data(), buffer.data());
+        return target;
+    }
+
+private:
+    std::istream& input;
+    u64 start;
+    u64 size;
+    std::vector<char> buffer;
+    u64 position = 0; // Offset of eback() in the range
+};
+
+struct Part {
+    std::string file;
+    std::unique_ptr<Z3DSReader> reader;
+    u64 offset = 0;
+    u64 size = 0;
+    u64 total = 0;
+    u64 frame_size = 0;
+};
+
+bool ParsePart(const std::string& file, Part& part) {
+    part.file = file;
+    part.reader = std::make_unique<Z3DSReader>();
+    part.reader->SetRecordAccess(false);
+    if (!part.reader->Open(file)) {
+        return false;
+    }
+    std::string description = part.reader->GetMetadataString("part");
+    if (description.empty()) {
+        std::cerr << "Error: Not a part file: " << file << std::endl;
+        return false;
+    }
+    std::stringstream stream(description);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        size_t equals = item.find('=');
+        if (equals == std::string::npos) {
+            continue;
+        }
+        std::string key = item.substr(0, equals);
+        u64 value = std::strtoull(item.c_str() + equals + 1, nullptr, 10);
+        if (key == "offset") {
+            part.offset = value;
+        } else if (key == "size") {
+            part.size = value;
+        } else if (key == "total") {
+            part.total = value;
+        } else if (key == "framesize") {
+            part.frame_size = value;
+        }
+    }
+    if (part.size != part.reader->GetSize() || part.reader->GetFrames().empty()) {
+        std::cerr << "Error: Part size does not match its frames: " << file << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool CopyBytes(const std::string& src_file, u64 offset, u64 size, std::ostream& output) {
+    std::ifstream input(src_file, std::ios::binary);
+    input.seekg(offset);
+    std::vector<char> buffer(4 * 1024 * 1024);
+    while (size > 0) {
+        size_t chunk = static_cast<size_t>(std::min<u64>(buffer.size(), size));
+        input.read(buffer.data(), chunk);
+        if (input.gcount() != static_cast<std::streamsize>(chunk)) {
+            return false;
+        }
+        output.write(buffer.data(), chunk);
+        size -= chunk;
+    }
+    return output.good();
+}
+
+} // namespace
+
+bool CompressZ3DSPart(const std::string& src_file, const std::string& dst_file,
+                      const std::array<u8, 4>& underlying_magic, size_t frame_size, const PartRange& range,
+                      ProgressCallback update_callback, CompressionStats* stats,
+                      const CompressionProfile& profile, const DeadlineOptions* deadline) {
+    std::ifstream input(src_file, std::ios::binary);
+    if (!input.is_open()) {
+        std::cerr << "Error: Could not open source file: " << src_file << std::endl;
+        return false;
+    }
+    input.seekg(0, std::ios::end);
+    u64 total = input.tellg();
+    u64 end = range.end ? range.end : total;
+    if (frame_size == 0 || range.start % frame_size != 0 || (end % frame_size != 0 && end != total) ||
+        range.start >= end || end > total) {
+        std::cerr << "Error: Part " << range.start << "-" << end << " is not a frame-aligned range of the "
+                  << total << " byte image (frame size " << frame_size << ")" << std::endl;
+        return false;
+    }
+
+    std::ostringstream description;
+    description << "offset=" << range.start << ",size=" << (end - range.start) << ",total=" << total
+                << ",framesize=" << frame_size;
+    std::string part = description.str();
+    RangeStreamBuf buffer(input, range.start, end - range.start);
+    std::istream part_input(&buffer);
+    return CompressZ3DSStream(part_input, dst_file, underlying_magic, frame_size, update_callback,
+                              {{"part", std::vector<u8>(part.begin(), part.end())}}, stats, profile, nullptr,
+                              deadline);
+}
+
+bool StitchZ3DSParts(const std::vector<std::string>& part_files, const std::string& dst_file,
+                     StitchResult& result) {
+    result = {};
+    // Writing the output would truncate a part before it is copied
+    for (const auto& part_file : part_files) {
+        std::error_code ec;
+        if (std::filesystem::equivalent(part_file, dst_file, ec)) {
+            std::cerr << "Error: Output is the same file as part " << part_file << std::endl;
+            return false;
+        }
+    }
+    std::vector<Part> parts(part_files.size());
+    for (size_t i = 0; i < part_files.size(); ++i) {
+        if (!ParsePart(part_files[i], parts[i])) {
+            return false;
+        }
+    }
+    if (parts.empty()) {
+        std::cerr << "Error: No parts to stitch" << std::endl;
+        return false;
+    }
+    std::sort(parts.begin(), parts.end(), [](const Part& a, const Part& b) { return a.offset < b.offset; });
+
+    // The parts must tile one image and decode the same way
+    const Part& first = parts.front();
+    bool has_checksums = true;
+    u64 expected_offset = 0;
+    for (const auto& part : parts) {
+        if (part.offset != expected_offset) {
+            std::cerr << "Error: " << (part.offset < expected_offset ? "Overlapping" : "Missing")
+                      << " data at offset " << std::min(part.offset, expected_offset) << " (" << part.file << ")"
+                      << std::endl;
+            return false;
+        }
+        if (part.total != first.total || part.frame_size != first.frame_size ||
+            part.reader->GetHeader().underlying_magic != first.reader->GetHeader().underlying_magic ||
+            part.reader->GetMetadataString("zdict") != first.reader->GetMetadataString("zdict")) {
+            std::cerr << "Error: " << part.file << " is a part of a different image or compression" << std::endl;
+            return false;
+        }
+        has_checksums = has_checksums && part.reader->HasChecksums();
+        expected_offset += part.size;
+        result.frame_count += part.reader->GetFrames().size();
+    }
+    if (expected_offset != first.total) {
+        std::cerr << "Error: Missing data from offset " << expected_offset << " to " << first.total << std::endl;
+        return false;
+    }
+
+    // Merged seek table as a skippable frame
+    std::vector<u8> seek_table;
+    size_t entry_size = has_checksums ? 12 : 8;
+    u64 frames_size = 0;
+    WriteLE(seek_table, SKIPPABLE_MAGIC, 4);
+    WriteLE(seek_table, result.frame_count * entry_size + 9, 4);
+    for (const auto& part : parts) {
+        for (const auto& frame : part.reader->GetFrames()) {
+            WriteLE(seek_table, frame.compressed_size, 4);
+            WriteLE(seek_table, frame.decompressed_size, 4);
+            if (has_checksums) {
+                WriteLE(seek_table, frame.checksum, 4);
+            }
+            frames_size += frame.compressed_size;
+        }
+    }
+    WriteLE(seek_table, result.frame_count, 4);
+    seek_table.push_back(has_checksums ? 0x80 : 0x00);
+    WriteLE(seek_table, SEEKABLE_MAGIC, 4);
+
+    // Metadata of the first part describes the compression. Parts made with
+    // a front seek index get one for the merged table.
+    bool front_index = !first.reader->GetMetadataString("seekindex").empty();
+    size_t front_index_size = (seek_table.size() + 15) / 16 * 16;
+    Z3DSMetadata meta;
+    for (const auto& [name, data] : first.reader->GetMetadata()) {
+        if (name != "part" && name != "date" && name != "seekindex") {
+            meta.Add(name, data);
+        }
+    }
+    meta.Add("date", GetCurrentTimeISO());
+    meta.Add("stitched", std::to_string(parts.size()) + " parts");
+    if (front_index) {
+        meta.Add("seekindex", "size=" + std::to_string(front_index_size));
+    }
+    auto metadata_binary = meta.AsBinary();
+    metadata_binary.resize((metadata_binary.size() + 15) / 16 * 16, 0);
+    if (front_index) {
+        metadata_binary.insert(metadata_binary.end(), seek_table.begin(), seek_table.end());
+        metadata_binary.resize(metadata_binary.size() + front_index_size - seek_table.size(), 0);
+    }
+
+    Z3DSFileHeader header;
+    header.underlying_magic = first.reader->GetHeader().underlying_magic;
+    header.metadata_size = static_cast<u32>(metadata_binary.size());
+    header.compressed_size = frames_size + seek_table.size();
+    header.uncompressed_size = first.total;
+
+    std::vector<u8> prefix;
+    prefix.insert(prefix.end(), header.magic.begin(), header.magic.end());
+    prefix.insert(prefix.end(), header.underlying_magic.begin(), header.underlying_magic.end());
+    prefix.push_back(header.version);
+    prefix.push_back(header.reserved);
+    WriteLE(prefix, header.header_size, 2);
+    WriteLE(prefix, header.metadata_size, 4);
+    WriteLE(prefix, header.compressed_size, 8);
+    WriteLE(prefix, header.uncompressed_size, 8);
+    prefix.insert(prefix.end(), metadata_binary.begin(), metadata_binary.end());
+
+    std::ofstream output(dst_file, std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) {
+        std::cerr << "Error: Could not create output file: " << dst_file << std::endl;
+        return false;
+    }
+    output.write(reinterpret_cast<const char*>(prefix.data()), prefix.size());
+    for (const auto& part : parts) {
+        // A part's frames are contiguous and end where its seek table starts
+        const auto& frames = part.reader->GetFrames();
+        u64 start = frames.front().compressed_offset;
+        u64 size = frames.back().compressed_offset + frames.back().compressed_size - start;
+        if (!CopyBytes(part.file, start, size, output)) {
+            std::cerr << "Error: Could not copy frames from " << part.file << std::endl;
+            return false;
+        }
+    }
+    output.write(reinterpret_cast<const char*>(seek_table.data()), seek_table.size());
+    if (!output.good()) {
+        std::cerr << "Error: Could not write " << dst_file << std::endl;
+        return false;
+    }
+
+    result.parts = parts.size();
+    result.uncompressed_size = header.uncompressed_size;
+    result.compressed_size = prefix.size() + header.compressed_size;
+    return true;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "z3ds_compression.h"
+
+// Split-and-stitch compression of one large image across processes or hosts.
+// Each process compresses a frame-aligned byte range into a part, a Z3DS
+// file of just that range with a "part" metadata item; StitchZ3DSParts then
+// joins the parts' frames and seek tables into one file without
+// recompressing. Because every part starts on a frame boundary, the stitched
+// file has the same frames as compressing the whole image in one go.
+struct PartRange {
+    u64 start = 0;
+    u64 end = 0; // Exclusive, 0 for the end of the image
+};
+
+// Compress [range.start, range.end) of src_file. start must be a multiple of
+// frame_size and end a multiple of it or the end of the image.
+bool CompressZ3DSPart(const std::string& src_file, const std::string& dst_file,
+                      const std::array<u8, 4>& underlying_magic, size_t frame_size, const PartRange& range,
+                      ProgressCallback update_callback = nullptr, CompressionStats* stats = nullptr,
+                      const CompressionProfile& profile = {}, const DeadlineOptions* deadline = nullptr);
+
+struct StitchResult {
+    size_t parts = 0;
+    size_t frame_count = 0;
+    u64 uncompressed_size = 0;
+    u64 compressed_size = 0;
+};
+
+// Join parts, given in any order, that together cover one whole image.
+// Fails without writing if dst_file is one of the parts under any name.
+bool StitchZ3DSParts(const std::vector<std::string>& part_files, const std::string& dst_file,
+                     StitchResult& result);
@@ -0,0 +1,562 @@
+#include "z3ds_update.h"
+#include "z3ds_pack.h"
+#include "z3ds_precomp.h"
+#include "z3ds_reader.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+constexpr u32 SKIPPABLE_MAGIC = 0x184D2A5E;
+constexpr u32 SEEKABLE_MAGIC = 0x8F92EAB1;
+
+void WriteLE(std::vector<u8>& out, u64 value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out.push_back(static_cast<u8>(value >> (8 * i)));
+    }
+}
+
+u32 ReadLE32(const u8* p) {
+    return static_cast<u32>(p[0]) | (static_cast<u32>(p[1]) << 8) |
+           (static_cast<u32>(p[2]) << 16) | (static_cast<u32>(p[3]) << 24);
+}
+
+u32 Crc32(const u8* data, size_t size, u32 crc = 0) {
+    static const auto table = [] {
+        std::array<u32, 256> t{};
+        for (u32 i = 0; i < 256; ++i) {
+            u32 c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+u32 Crc32OfImage(Z3DSReader& reader) {
+    std::vector<u8> buffer(4 * 1024 * 1024);
+    u32 crc = 0;
+    for (u64 offset = 0; offset < reader.GetSize();) {
+        size_t size = reader.Read(offset, buffer.data(),
+                                  static_cast<size_t>(std::min<u64>(buffer.size(), reader.GetSize() - offset)));
+        if (size == 0) {
+            break;
+        }
+        crc = Crc32(buffer.data(), size, crc);
+        offset += size;
+    }
+    return crc;
+}
+
+// Bytes a patch writes to the target image. Records are applied in order,
+// so later IPS records win where records overlap.
+struct PatchRecord {
+    u64 offset;
+    std::vector<u8> data;
+};
+
+struct Patch {
+    std::vector<PatchRecord> records;
+    u64 target_size = 0;
+    bool has_crc = false;
+    u32 source_crc = 0;
+    u32 target_crc = 0;
+};
+
+bool ParseIPS(const std::vector<u8>& data, u64 source_size, Patch& patch) {
+    patch.target_size = source_size;
+    size_t pos = 5;
+    while (true) {
+        if (pos + 3 > data.size()) {
+            std::cerr << "Error: IPS patch ends without EOF marker" << std::endl;
+            return false;
+        }
+        if (std::memcmp(data.data() + pos, "EOF", 3) == 0) {
+            pos += 3;
+            break;
+        }
+        if (pos + 5 > data.size()) {
+            return false;
+        }
+        PatchRecord record;
+        record.offset = (data[pos] << 16) | (data[pos + 1] << 8) | data[pos + 2];
+        size_t size = (data[pos + 3] << 8) | data[pos + 4];
+        pos += 5;
+        if (size == 0) {
+            // RLE record: count, value
+            if (pos + 3 > data.size()) {
+                return false;
+            }
+            record.data.assign((data[pos] << 8) | data[pos + 1], data[pos + 2]);
+            pos += 3;
+        } else {
+            if (pos + size > data.size()) {
+                return false;
+            }
+            record.data.assign(data.begin() + pos, data.begin() + pos + size);
+            pos += size;
+        }
+        patch.target_size = std::max<u64>(patch.target_size, record.offset + record.data.size());
+        patch.records.push_back(std::move(record));
+    }
+    // Lunar IPS truncation extension
+    if (pos + 3 == data.size()) {
+        patch.target_size = (data[pos] << 16) | (data[pos + 1] << 8) | data[pos + 2];
+    }
+    return true;
+}
+
+bool ReadBPSNumber(const std::vector<u8>& data, size_t& pos, size_t end, u64& value) {
+    value = 0;
+    u64 shift = 1;
+    while (pos < end) {
+        u8 x = data[pos++];
+        value += (x & 0x7F) * shift;
+        if (x & 0x80) {
+            return true;
+        }
+        shift <<= 7;
+        value += shift;
+    }
+    return false;
+}
+
+// BPS actions become records for every target range that is not a
+// SourceRead (or a SourceCopy from the same offset)
+bool ParseBPS(const std::vector<u8>& data, Z3DSReader& source, Patch& patch) {
+    if (data.size() < 4 + 12 || Crc32(data.data(), data.size() - 4) != ReadLE32(data.data() + data.size() - 4)) {
+        std::cerr << "Error: BPS patch is damaged (CRC32 mismatch)" << std::endl;
+        return false;
+    }
+    size_t end = data.size() - 12;
+    size_t pos = 4;
+    u64 source_size;
+    u64 metadata_size;
+    if (!ReadBPSNumber(data, pos, end, source_size) || !ReadBPSNumber(data, pos, end, patch.target_size) ||
+        !ReadBPSNumber(data, pos, end, metadata_size) || metadata_size > end - pos) {
+        return false;
+    }
+    if (source_size != source.GetSize()) {
+        std::cerr << "Error: BPS patch is for a " << source_size << " byte image, not " << source.GetSize()
+                  << " bytes" << std::endl;
+        return false;
+    }
+    pos += metadata_size;
+    patch.has_crc = true;
+    patch.source_crc = ReadLE32(data.data() + end);
+    patch.target_crc = ReadLE32(data.data() + end + 4);
+
+    u64 output_offset = 0;
+    u64 source_relative = 0;
+    u64 target_relative = 0;
+    auto append = [&](const u8* bytes, size_t size) {
+        if (patch.records.empty() || patch.records.back().offset + patch.records.back().data.size() != output_offset) {
+            patch.records.push_back({output_offset, {}});
+        }
+        patch.records.back().data.insert(patch.records.back().data.end(), bytes, bytes + size);
+        output_offset += size;
+    };
+    // Earlier target bytes: patched, or else the same as the source
+    auto target_byte = [&](u64 offset, u8& value) {
+        auto next = std::upper_bound(patch.records.begin(), patch.records.end(), offset,
+                                     [](u64 o, const PatchRecord& record) { return o < record.offset; });
+        if (next != patch.records.begin()) {
+            const PatchRecord& record = *(next - 1);
+            if (offset < record.offset + record.data.size()) {
+                value = record.data[offset - record.offset];
+                return true;
+            }
+        }
+        return source.Read(offset, &value, 1) == 1;
+    };
+
+    std::vector<u8> buffer;
+    while (pos < end) {
+        u64 action;
+        if (!ReadBPSNumber(data, pos, end, action)) {
+            return false;
+        }
+        u64 length = (action >> 2) + 1;
+        if (length > patch.target_size - output_offset) {
+            return false;
+        }
+        switch (action & 3) {
+        case 0: // SourceRead
+            if (output_offset + length > source.GetSize()) {
+                std::cerr << "Error: BPS patch reads past the end of the source" << std::endl;
+                return false;
+            }
+            output_offset += length;
+            break;
+        case 1: // TargetRead
+            if (length > end - pos) {
+                return false;
+            }
+            append(data.data() + pos, static_cast<size_t>(length));
+            pos += static_cast<size_t>(length);
+            break;
+        case 2: { // SourceCopy
+            u64 relative;
+            if (!ReadBPSNumber(data, pos, end, relative)) {
+                return false;
+            }
+            // Offsets wrap around in u64, so check both ends of the range
+            source_relative += (relative & 1) ? 0 - (relative >> 1) : relative >> 1;
+            if (source_relative > source.GetSize() || length > source.GetSize() - source_relative) {
+                std::cerr << "Error: BPS patch copies from outside the source" << std::endl;
+                return false;
+            }
+            if (source_relative == output_offset) {
+                output_offset += length;
+            } else {
+                buffer.resize(static_cast<size_t>(length));
+                if (source.Read(source_relative, buffer.data(), buffer.size()) != buffer.size()) {
+                    return false;
+                }
+                append(buffer.data(), buffer.size());
+            }
+            source_relative += length;
+            break;
+        }
+        case 3: { // TargetCopy, may overlap its own output
+            u64 relative;
+            if (!ReadBPSNumber(data, pos, end, relative)) {
+                return false;
+            }
+            target_relative += (relative & 1) ? 0 - (relative >> 1) : relative >> 1;
+            for (u64 i = 0; i < length; ++i) {
+                u8 value;
+                if (target_relative >= output_offset || !target_byte(target_relative++, value)) {
+                    return false;
+                }
+                append(&value, 1);
+            }
+            break;
+        }
+        }
+    }
+    return output_offset == patch.target_size;
+}
+
+bool ReadPatch(const std::string& file, Z3DSReader& source, Patch& patch) {
+    std::ifstream input(file, std::ios::binary);
+    if (!input.is_open()) {
+        std::cerr << "Error: Could not open patch: " << file << std::endl;
+        return false;
+    }
+    std::vector<u8> data((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    bool ok;
+    if (data.size() >= 5 && std::memcmp(data.data(), "PATCH", 5) == 0) {
+        ok = ParseIPS(data, source.GetSize(), patch);
+    } else if (data.size() >= 4 && std::memcmp(data.data(), "BPS1", 4) == 0) {
+        ok = ParseBPS(data, source, patch);
+    } else {
+        std::cerr << "Error: Not an IPS or BPS patch (xdelta is not supported): " << file << std::endl;
+        return false;
+    }
+    if (!ok) {
+        std::cerr << "Error: Invalid patch: " << file << std::endl;
+    }
+    return ok;
+}
+
+// Parameters the old file was compressed with, from its metadata
+CompressionProfile ProfileFromMetadata(const Z3DSReader& reader) {
+    CompressionProfile profile;
+    std::string name = reader.GetMetadataString("profile");
+    if (!name.empty()) {
+        profile.name = name;
+    }
+    std::string description = reader.GetMetadataString("zstdparams");
+    if (description == "raw") {
+        profile.store_raw = true;
+        return profile;
+    }
+    std::stringstream stream(description);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        size_t equals = item.find('=');
+        std::string error;
+        if (equals != std::string::npos && item.compare(0, equals, "dictID") != 0 &&
+            !SetCompressionParameter(profile, item.substr(0, equals), item.substr(equals + 1), error)) {
+            std::cerr << "Warning: Ignoring recorded parameter " << item << ": " << error << std::endl;
+        }
+    }
+    return profile;
+}
+
+struct OutputFrame {
+    u64 offset;
+    u32 size;
+    size_t old_index; // SIZE_MAX past the old end
+    std::vector<size_t> records; // Patch records writing to this frame, in order
+};
+
+bool WriteUpdate(const std::string& old_file, const std::string& dst_file, const UpdateOptions& options,
+                 ProgressCallback update_callback, UpdateResult& result) {
+    Z3DSReader reader;
+    reader.SetRecordAccess(false);
+    if (!reader.Open(old_file)) {
+        return false;
+    }
+    const auto& magic = reader.GetHeader().underlying_magic;
+    if (magic == PACK_MAGIC || magic == PRECOMP_MAGIC) {
+        std::cerr << "Error: Packs and precomp archives cannot be updated in place" << std::endl;
+        return false;
+    }
+    CompressionProfile profile = options.profile ? *options.profile : ProfileFromMetadata(reader);
+    auto dictionary = reader.GetMetadata().find("zdict");
+    profile.dictionary = dictionary != reader.GetMetadata().end() ? dictionary->second : std::vector<u8>();
+
+    const auto& old_frames = reader.GetFrames();
+    result.old_size = reader.GetSize();
+    Patch patch;
+    std::ifstream source;
+    bool from_patch = !options.patch_file.empty();
+    if (from_patch) {
+        if (!ReadPatch(options.patch_file, reader, patch)) {
+            return false;
+        }
+        if (options.verify && patch.has_crc && Crc32OfImage(reader) != patch.source_crc) {
+            std::cerr << "Error: " << old_file << " is not the image the patch was made for" << std::endl;
+            return false;
+        }
+        result.new_size = patch.target_size;
+    } else {
+        source.open(options.source_file, std::ios::binary);
+        if (!source.is_open()) {
+            std::cerr << "Error: Could not open source file: " << options.source_file << std::endl;
+            return false;
+        }
+        source.seekg(0, std::ios::end);
+        result.new_size = source.tellg();
+    }
+
+    // Old frames up to the new end, then new frames of the old maximum size
+    std::vector<OutputFrame> frames;
+    u32 max_frame_size = 0;
+    for (size_t i = 0; i < old_frames.size() && old_frames[i].decompressed_offset < result.new_size; ++i) {
+        const auto& old = old_frames[i];
+        frames.push_back({old.decompressed_offset,
+                          static_cast<u32>(std::min<u64>(old.decompressed_size, result.new_size - old.decompressed_offset)),
+                          i, {}});
+        max_frame_size = std::max(max_frame_size, old.decompressed_size);
+    }
+    u64 frame_size = std::strtoull(reader.GetMetadataString("maxframesize").c_str(), nullptr, 10);
+    if (frame_size == 0) {
+        frame_size = max_frame_size ? max_frame_size : GetDefaultFrameSize(magic);
+    }
+    for (u64 offset = result.old_size; offset < result.new_size; offset += frame_size) {
+        frames.push_back({offset, static_cast<u32>(std::min<u64>(frame_size, result.new_size - offset)), SIZE_MAX, {}});
+    }
+    for (size_t i = 0; i < patch.records.size(); ++i) {
+        const PatchRecord& record = patch.records[i];
+        result.patched_bytes += record.data.size();
+        auto first = std::upper_bound(frames.begin(), frames.end(), record.offset,
+                                      [](u64 o, const OutputFrame& frame) { return o < frame.offset; });
+        for (auto it = first == frames.begin() ? first : first - 1;
+             it != frames.end() && it->offset < record.offset + record.data.size(); ++it) {
+            if (record.offset < it->offset + it->size) {
+                it->records.push_back(i);
+            }
+        }
+    }
+
+    // Header and metadata, with the compressed size patched in at the end. A
+    // front seek index is kept, its area sized for the new frames.
+    bool front_index = !reader.GetMetadataString("seekindex").empty();
+    u64 front_index_size = front_index ? (8 + frames.size() * 12 + 9 + 15) / 16 * 16 : 0;
+    Z3DSMetadata meta;
+    // Items describing how and when the file was written are replaced below
+    for (const auto& [name, data] : reader.GetMetadata()) {
+        if (name != "date" && name != "seekindex" && name != "updated" && name != "profile" &&
+            name != "zstdparams") {
+            meta.Add(name, data);
+        }
+    }
+    if (front_index) {
+        meta.Add("seekindex", "size=" + std::to_string(front_index_size));
+    }
+    meta.Add("date", GetCurrentTimeISO());
+    meta.Add("updated", std::filesystem::path(from_patch ? options.patch_file : options.source_file)
+                            .filename().string());
+    if (profile.name != "default") {
+        meta.Add("profile", profile.name);
+    }
+    meta.Add("zstdparams", DescribeCompressionProfile(profile));
+    auto metadata_binary = meta.AsBinary();
+    metadata_binary.resize((metadata_binary.size() + 15) / 16 * 16 + front_index_size, 0);
+    Z3DSFileHeader header;
+    header.underlying_magic = magic;
+    header.metadata_size = static_cast<u32>(metadata_binary.size());
+    header.uncompressed_size = result.new_size;
+    std::vector<u8> prefix;
+    prefix.insert(prefix.end(), header.magic.begin(), header.magic.end());
+    prefix.insert(prefix.end(), header.underlying_magic.begin(), header.underlying_magic.end());
+    prefix.push_back(header.version);
+    prefix.push_back(header.reserved);
+    WriteLE(prefix, header.header_size, 2);
+    WriteLE(prefix, header.metadata_size, 4);
+    WriteLE(prefix, 0, 8); // Compressed size
+    WriteLE(prefix, header.uncompressed_size, 8);
+    prefix.insert(prefix.end(), metadata_binary.begin(), metadata_binary.end());
+
+    std::ofstream output(dst_file, std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) {
+        std::cerr << "Error: Could not create output file: " << dst_file << std::endl;
+        return false;
+    }
+    output.write(reinterpret_cast<const char*>(prefix.data()), prefix.size());
+
+    std::vector<u8> seek_table;
+    WriteLE(seek_table, SKIPPABLE_MAGIC, 4);
+    WriteLE(seek_table, frames.size() * 12 + 9, 4);
+    u64 compressed_size = 0;
+    std::vector<u8> data;
+    std::vector<u8> old_data;
+    std::vector<u8> compressed;
+    for (const auto& frame : frames) {
+        const Z3DSReader::FrameInfo* old = frame.old_index != SIZE_MAX ? &old_frames[frame.old_index] : nullptr;
+        bool unchanged = false;
+        u32 checksum = 0;
+        if (from_patch) {
+            unchanged = old && frame.size == old->decompressed_size && frame.records.empty();
+            if (!unchanged) {
+                if (old) {
+                    if (!reader.DecompressFrame(frame.old_index, data, true)) {
+                        return false;
+                    }
+                    data.resize(frame.size);
+                } else {
+                    data.assign(frame.size, 0); // IPS leaves gaps past the old end zeroed
+                }
+                for (size_t index : frame.records) {
+                    const PatchRecord& record = patch.records[index];
+                    u64 begin = std::max(record.offset, frame.offset);
+                    u64 end = std::min<u64>(record.offset + record.data.size(), frame.offset + frame.size);
+                    std::memcpy(data.data() + (begin - frame.offset), record.data.data() + (begin - record.offset),
+                                static_cast<size_t>(end - begin));
+                }
+            }
+        } else {
+            data.resize(frame.size);
+            source.clear();
+            source.seekg(frame.offset);
+            source.read(reinterpret_cast<char*>(data.data()), data.size());
+            if (source.gcount() != static_cast<std::streamsize>(data.size())) {
+                std::cerr << "Error: Could not read " << options.source_file << std::endl;
+                return false;
+            }
+            if (old && frame.size == old->decompressed_size) {
+                if (reader.HasChecksums()) {
+                    unchanged = static_cast<u32>(XXH64(data.data(), data.size()) & 0xFFFFFFFF) == old->checksum;
+                } else {
+                    unchanged = reader.DecompressFrame(frame.old_index, old_data) && old_data == data;
+                }
+            }
+        }
+
+        if (unchanged) {
+            if (!reader.ReadCompressedFrame(frame.old_index, compressed)) {
+                return false;
+            }
+            if (reader.HasChecksums()) {
+                checksum = old->checksum;
+            } else {
+                if (from_patch && !reader.DecompressFrame(frame.old_index, data)) {
+                    return false;
+                }
+                checksum = static_cast<u32>(XXH64(data.data(), data.size()) & 0xFFFFFFFF);
+            }
+            result.copied_frames++;
+        } else {
+            if (!CompressZ3DSFrame(profile, data.data(), data.size(), compressed)) {
+                return false;
+            }
+            checksum = static_cast<u32>(XXH64(data.data(), data.size()) & 0xFFFFFFFF);
+            result.recompressed_frames++;
+        }
+        output.write(reinterpret_cast<const char*>(compressed.data()), compressed.size());
+        WriteLE(seek_table, compressed.size(), 4);
+        WriteLE(seek_table, frame.size, 4);
+        WriteLE(seek_table, checksum, 4);
+        compressed_size += compressed.size();
+        if (update_callback) {
+            update_callback(frame.offset + frame.size, result.new_size);
+        }
+    }
+    WriteLE(seek_table, frames.size(), 4);
+    seek_table.push_back(0x80); // Checksums
+    WriteLE(seek_table, SEEKABLE_MAGIC, 4);
+    output.write(reinterpret_cast<const char*>(seek_table.data()), seek_table.size());
+    compressed_size += seek_table.size();
+
+    if (front_index) {
+        output.seekp(static_cast<std::streamoff>(prefix.size() - front_index_size));
+        output.write(reinterpret_cast<const char*>(seek_table.data()), seek_table.size());
+    }
+    std::vector<u8> size_field;
+    WriteLE(size_field, compressed_size, 8);
+    output.seekp(16);
+    output.write(reinterpret_cast<const char*>(size_field.data()), size_field.size());
+    output.close();
+    if (output.fail()) {
+        std::cerr << "Error: Could not write " << dst_file << std::endl;
+        return false;
+    }
+    result.frames = frames.size();
+
+    if (options.verify && patch.has_crc) {
+        Z3DSReader updated;
+        updated.SetRecordAccess(false);
+        if (!updated.Open(dst_file) || Crc32OfImage(updated) != patch.target_crc) {
+            std::cerr << "Error: Patched image does not match the CRC32 in the patch" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool UpdateZ3DSFile(const std::string& old_file, const std::string& dst_file, const UpdateOptions& options,
+                    ProgressCallback update_callback, UpdateResult& result) {
+    result = {};
+    std::error_code ec;
+    for (const std::string* input : {&old_file, &options.source_file, &options.patch_file}) {
+        if (!input->empty() && std::filesystem::equivalent(*input, dst_file, ec)) {
+            std::cerr << "Error: Output is the same file as the input: " << *input << std::endl;
+            return false;
+        }
+    }
+
+    // Written next to the output and renamed over it once complete, so a
+    // failed update leaves an existing output as it was
+    std::string temp_file = dst_file + ".update.tmp";
+    if (std::filesystem::exists(temp_file, ec)) {
+        std::cerr << "Error: Temporary file already exists: " << temp_file << std::endl;
+        return false;
+    }
+    if (!WriteUpdate(old_file, temp_file, options, update_callback, result)) {
+        std::filesystem::remove(temp_file, ec);
+        return false;
+    }
+    std::filesystem::rename(temp_file, dst_file, ec);
+    if (ec) {
+        std::cerr << "Error: Could not replace " << dst_file << ": " << ec.message() << std::endl;
+        std::filesystem::remove(temp_file, ec);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "z3ds_compression.h"
+
+// Bring a Z3DS file up to date with a new revision of its image without
+// recompressing all of it. The old frame layout is kept: frames whose bytes
+// did not change are copied through compressed, the others are recompressed
+// with the parameters recorded in the old file (or a given profile), and
+// bytes past the old end get new frames.
+//
+// With a new source image every frame is hashed and compared with the seek
+// table checksum. With an IPS or BPS patch only the frames the patch writes
+// to are decoded, patched and recompressed, so the work follows the size of
+// the change. xdelta (VCDIFF) patches are not supported.
+struct UpdateOptions {
+    std::string source_file; // New image, or
+    std::string patch_file;  // .ips or .bps patch against the old image
+    std::optional<CompressionProfile> profile;
+    bool verify = false;     // BPS: check the source and target CRC32 (reads both images)
+};
+
+struct UpdateResult {
+    size_t frames = 0;
+    size_t copied_frames = 0;
+    size_t recompressed_frames = 0;
+    u64 patched_bytes = 0;   // Bytes written by patch records
+    u64 old_size = 0;
+    u64 new_size = 0;
+};
+
+// dst_file must not be the old file, source or patch; it is written through
+// a temporary file beside it and only replaced on success.
+bool UpdateZ3DSFile(const std::string& old_file, const std::string& dst_file, const UpdateOptions& options,
+                    ProgressCallback update_callback, UpdateResult& result);
@@ -0,0 +1,193 @@
+/* The C interface, compiled as C: z3ds_c_api_test <work directory> */
+#include "z3ds.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(condition)                                                            \
+    do {                                                                            \
+        if (!(condition)) {                                                         \
+            fprintf(stderr, "%s:%d: CHECK failed: %s (last error: %s)\n", __FILE__, \
+                    __LINE__, #condition, z3ds_last_error());                       \
+            return 1;                                                               \
+        }                                                                           \
+    } while (0)
+
+#define IMAGE_SIZE (300 * 1024 + 123)
+#define FRAME_SIZE (64 * 1024)
+
+static char source_path[1024];
+static char output_path[1024];
+static char corrupt_path[1024];
+
+static void on_progress(uint64_t processed, uint64_t total, void* user_data) {
+    (void)total;
+    *(uint64_t*)user_data = processed;
+}
+
+static int write_file(const char* path, const unsigned char* data, size_t size) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return 0;
+    }
+    size_t written = fwrite(data, 1, size, file);
+    return fclose(file) == 0 && written == size;
+}
+
+static int test_invalid_arguments(void) {
+    z3ds_reader* reader = (z3ds_reader*)1;
+    z3ds_stat_info info;
+    z3ds_compress_options options;
+    unsigned char byte;
+
+    CHECK(z3ds_open(NULL, &reader) == Z3DS_ERROR_INVALID_ARGUMENT);
+    CHECK(strlen(z3ds_last_error()) > 0);
+    CHECK(z3ds_open(source_path, NULL) == Z3DS_ERROR_INVALID_ARGUMENT);
+    CHECK(z3ds_stat(NULL, &info) == Z3DS_ERROR_INVALID_ARGUMENT);
+    CHECK(z3ds_read(NULL, 0, &byte, 1) == Z3DS_ERROR_INVALID_ARGUMENT);
+    CHECK(z3ds_readv(NULL, NULL, 0) == Z3DS_ERROR_INVALID_ARGUMENT);
+    CHECK(z3ds_get_metadata(NULL, "date", NULL, 0) == Z3DS_ERROR_INVALID_ARGUMENT);
+    CHECK(z3ds_cache_stats(NULL, NULL) == Z3DS_ERROR_INVALID_ARGUMENT);
+    CHECK(z3ds_compress(NULL, output_path, NULL) == Z3DS_ERROR_INVALID_ARGUMENT);
+    CHECK(z3ds_compress(source_path, NULL, NULL) == Z3DS_ERROR_INVALID_ARGUMENT);
+
+    z3ds_compress_options_init(&options);
+    options.struct_size = 0;
+    CHECK(z3ds_compress(source_path, output_path, &options) == Z3DS_ERROR_INVALID_ARGUMENT);
+
+    /* A count without an array */
+    z3ds_compress_options_init(&options);
+    options.zstd_param_count = 2;
+    CHECK(z3ds_compress(source_path, output_path, &options) == Z3DS_ERROR_INVALID_ARGUMENT);
+    CHECK(strstr(z3ds_last_error(), "zstd_params") != NULL);
+
+    {
+        const char* params[] = {"level=abc"};
+        z3ds_compress_options_init(&options);
+        options.zstd_params = params;
+        options.zstd_param_count = 1;
+        CHECK(z3ds_compress(source_path, output_path, &options) == Z3DS_ERROR_INVALID_ARGUMENT);
+        options.zstd_param_count = 0;
+        options.profile = "no-such-profile";
+        CHECK(z3ds_compress(source_path, output_path, &options) == Z3DS_ERROR_INVALID_ARGUMENT);
+    }
+    return 0;
+}
+
+static int test_round_trip(const unsigned char* image) {
+    const char* params[] = {"level=5", "windowLog=20"};
+    z3ds_compress_options options;
+    uint64_t progress = 0;
+    z3ds_reader* reader = NULL;
+    z3ds_stat_info info;
+    z3ds_cache_stats_info cache;
+    unsigned char* read = malloc(IMAGE_SIZE);
+    unsigned char a[100];
+    unsigned char b[5000];
+    z3ds_read_request requests[2];
+    char date[64];
+    int64_t length;
+
+    CHECK(read != NULL);
+    z3ds_compress_options_init(&options);
+    options.frame_size = FRAME_SIZE;
+    options.zstd_params = params;
+    options.zstd_param_count = 2;
+    options.progress = on_progress;
+    options.user_data = &progress;
+    CHECK(z3ds_compress(source_path, output_path, &options) == Z3DS_OK);
+    CHECK(progress == IMAGE_SIZE);
+
+    CHECK(z3ds_open(output_path, &reader) == Z3DS_OK);
+    CHECK(z3ds_stat(reader, &info) == Z3DS_OK);
+    CHECK(info.uncompressed_size == IMAGE_SIZE);
+    CHECK(info.frame_count == (IMAGE_SIZE + FRAME_SIZE - 1) / FRAME_SIZE);
+    CHECK(info.max_frame_size == FRAME_SIZE);
+    CHECK(info.compressed_size < info.file_size);
+
+    CHECK(z3ds_read(reader, 0, read, IMAGE_SIZE) == IMAGE_SIZE);
+    CHECK(memcmp(read, image, IMAGE_SIZE) == 0);
+    /* Short only at the end of the data */
+    CHECK(z3ds_read(reader, IMAGE_SIZE - 10, a, sizeof(a)) == 10);
+    CHECK(z3ds_read(reader, IMAGE_SIZE + 10, a, sizeof(a)) == 0);
+
+    requests[0].offset = FRAME_SIZE - 50;
+    requests[0].buffer = a;
+    requests[0].size = sizeof(a);
+    requests[1].offset = 3 * FRAME_SIZE + 7;
+    requests[1].buffer = b;
+    requests[1].size = sizeof(b);
+    CHECK(z3ds_readv(reader, requests, 2) == sizeof(a) + sizeof(b));
+    CHECK(memcmp(a, image + FRAME_SIZE - 50, sizeof(a)) == 0);
+    CHECK(memcmp(b, image + 3 * FRAME_SIZE + 7, sizeof(b)) == 0);
+    requests[1].buffer = NULL;
+    CHECK(z3ds_readv(reader, requests, 2) == Z3DS_ERROR_INVALID_ARGUMENT);
+
+    length = z3ds_get_metadata(reader, "zstdparams", NULL, 0);
+    CHECK(length > 0);
+    length = z3ds_get_metadata(reader, "date", date, sizeof(date) - 1);
+    CHECK(length > 0 && length < (int64_t)sizeof(date));
+    CHECK(z3ds_get_metadata(reader, "no-such-item", NULL, 0) == Z3DS_ERROR_INVALID_ARGUMENT);
+
+    CHECK(z3ds_cache_stats(reader, &cache) == Z3DS_OK);
+    CHECK(cache.frames > 0 && cache.used_bytes <= cache.budget_bytes);
+    CHECK(cache.file_misses > 0 && cache.file_resident_bytes > 0);
+    z3ds_set_cache_budget(0);
+    CHECK(z3ds_cache_stats(NULL, &cache) == Z3DS_OK);
+    CHECK(cache.budget_bytes == 0 && cache.used_bytes == 0 && cache.file_hits == 0);
+    CHECK(z3ds_read(reader, 5, read, 1000) == 1000);
+    CHECK(memcmp(read, image + 5, 1000) == 0);
+
+    z3ds_close(reader);
+    free(read);
+    return 0;
+}
+
+static int test_errors(void) {
+    z3ds_reader* reader = (z3ds_reader*)1;
+    unsigned char header[32] = {'Z', '3', 'D', 'S', 'N', 'C', 'S', 'D', 1, 0, 0x20, 0, 0xF0, 0xFF, 0xFF, 0xFF};
+
+    CHECK(z3ds_open(corrupt_path, &reader) == Z3DS_ERROR_IO);
+    CHECK(reader == NULL);
+    CHECK(write_file(corrupt_path, header, sizeof(header)));
+    CHECK(z3ds_open(corrupt_path, &reader) == Z3DS_ERROR_FORMAT);
+    CHECK(reader == NULL);
+    /* The reader's own message is the detail, without the "Error: " prefix */
+    CHECK(strstr(z3ds_last_error(), "Not a readable Z3DS file") != NULL);
+    CHECK(strstr(z3ds_last_error(), "(Header sizes run past the end") != NULL);
+    CHECK(strstr(z3ds_last_error(), "Error: ") == NULL);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    unsigned char* image;
+    size_t i;
+    int failed;
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <work directory>\n", argv[0]);
+        return 2;
+    }
+    snprintf(source_path, sizeof(source_path), "%s/c_api_source.bin", argv[1]);
+    snprintf(output_path, sizeof(output_path), "%s/c_api_output.z3ds", argv[1]);
+    snprintf(corrupt_path, sizeof(corrupt_path), "%s/c_api_corrupt.z3ds", argv[1]);
+    remove(corrupt_path);
+
+    CHECK(z3ds_abi_version() == Z3DS_ABI_VERSION);
+    image = malloc(IMAGE_SIZE);
+    CHECK(image != NULL);
+    srand(90);
+    for (i = 0; i < IMAGE_SIZE; ++i) {
+        image[i] = (unsigned char)(i % 251 < 200 ? "z3ds c api "[i % 11] : rand());
+    }
+    CHECK(write_file(source_path, image, IMAGE_SIZE));
+
+    z3ds_set_cache_budget(64 * 1024 * 1024);
+    failed = test_invalid_arguments() || test_round_trip(image) || test_errors();
+    free(image);
+    remove(source_path);
+    remove(output_path);
+    remove(corrupt_path);
+    printf("c_api: %s\n", failed ? "FAILED" : "passed");
+    return failed;
+}
@@ -0,0 +1,124 @@
+// Shared frame and disk caches: hits and misses, eviction and its bounds
+#include "z3ds_disk_cache.h"
+#include "z3ds_frame_cache.h"
+#include "z3ds_reader.h"
+#include "z3ds_test.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+FrameCache::FrameData MakeFrame(size_t size) {
+    std::shared_ptr<u8[]> data(new u8[size]);
+    std::memset(data.get(), 0x11, size);
+    return data;
+}
+
+} // namespace
+
+TEST(frame_cache) {
+    FrameCache& cache = FrameCache::Instance();
+    cache.Clear();
+    cache.SetBudget(64 * 1024 * 1024);
+
+    std::vector<u8> image = MakeData(4 * FRAME_SIZE, 80);
+    std::string file = TempPath("cached.z3ds");
+    CHECK(CompressImage(image, file));
+    Z3DSReader reader;
+    reader.SetRecordAccess(false);
+    CHECK(reader.Open(file));
+    FrameCache::Stats before = cache.GetStats();
+
+    // The first full pass misses every frame, the second hits every one
+    std::vector<u8> read(image.size());
+    for (int pass = 0; pass < 2; ++pass) {
+        for (size_t frame = 0; frame < 4; ++frame) {
+            CHECK(reader.Read(frame * FRAME_SIZE, read.data(), FRAME_SIZE) == FRAME_SIZE);
+        }
+    }
+    FrameCache::FileStats stats = cache.GetFileStats(reader.GetFileId());
+    CHECK(stats.misses == 4);
+    CHECK(stats.hits == 4);
+    CHECK(stats.resident_bytes == image.size());
+    FrameCache::Stats after = cache.GetStats();
+    CHECK(after.hits - before.hits == 4 && after.misses - before.misses == 4);
+    CHECK(after.frames == 4 && after.used_bytes == image.size());
+
+    // Frames that are never read again leave first; the budget is never exceeded
+    const size_t frame_size = 1024;
+    cache.Clear();
+    cache.SetBudget(100 * frame_size);
+    cache.Insert(1, 0, MakeFrame(frame_size), frame_size);
+    CHECK(cache.Lookup(1, 0));
+    CHECK(cache.Lookup(1, 0));
+    for (u32 frame = 0; frame < 500; ++frame) {
+        cache.Insert(2, frame, MakeFrame(frame_size), frame_size);
+        CHECK(cache.GetStats().used_bytes <= 100 * frame_size);
+    }
+    CHECK(cache.Lookup(1, 0));
+    CHECK(!cache.Lookup(2, 0));
+    CHECK(cache.GetStats().evictions >= 400);
+    CHECK(cache.GetFileStats(1).resident_bytes == frame_size);
+    CHECK(cache.GetFileStats(2).resident_bytes <= 99 * frame_size);
+
+    // Counters of files without resident frames are capped
+    for (u64 id = 1000; id < 10000; ++id) {
+        cache.Lookup(id, 0);
+    }
+    CHECK(cache.GetFileStats(9999).misses == 1);
+    CHECK(cache.GetFileStats(1000).misses == 0);
+    CHECK(cache.GetFileStats(1).hits == 3);
+
+    cache.SetBudget(0);
+    CHECK(cache.GetStats().used_bytes == 0);
+    cache.Clear();
+    return true;
+}
+
+TEST(disk_cache) {
+    FrameCache::Instance().Clear();
+    FrameCache::Instance().SetBudget(0);
+    DiskFrameCache& disk = DiskFrameCache::Instance();
+    std::string directory = TempPath("disk");
+    CHECK(disk.Configure(directory, 3 * FRAME_SIZE));
+
+    std::vector<u8> image = MakeData(4 * FRAME_SIZE, 81);
+    std::string file = TempPath("disk.z3ds");
+    CHECK(CompressImage(image, file));
+    std::vector<u8> read(FRAME_SIZE);
+    {
+        Z3DSReader reader;
+        reader.SetRecordAccess(false);
+        CHECK(reader.Open(file));
+        for (size_t frame = 0; frame < 4; ++frame) {
+            CHECK(reader.Read(frame * FRAME_SIZE, read.data(), FRAME_SIZE) == FRAME_SIZE);
+        }
+    }
+    disk.Flush();
+    // Counters are process-wide and survive Configure
+    DiskFrameCache::Stats stats = disk.GetStats();
+    CHECK(stats.writes == 4);
+    CHECK(stats.misses == 4 && stats.hits == 0);
+    CHECK(stats.frames == 3 && stats.used_bytes == 3 * FRAME_SIZE);
+
+    // Reopened, including the cache itself from its index log: the three
+    // most recent frames come from disk, the evicted first one does not
+    CHECK(disk.Configure(directory, 3 * FRAME_SIZE));
+    DiskFrameCache::Stats reopened = disk.GetStats();
+    CHECK(reopened.frames == 3);
+    Z3DSReader reader;
+    reader.SetRecordAccess(false);
+    CHECK(reader.Open(file));
+    for (size_t frame = 3; frame > 0; --frame) {
+        CHECK(reader.Read(frame * FRAME_SIZE, read.data(), FRAME_SIZE) == FRAME_SIZE);
+        CHECK(std::equal(read.begin(), read.end(), image.begin() + frame * FRAME_SIZE));
+    }
+    stats = disk.GetStats();
+    CHECK(stats.hits - reopened.hits == 3 && stats.misses == reopened.misses);
+    CHECK(reader.Read(0, read.data(), FRAME_SIZE) == FRAME_SIZE);
+    CHECK(disk.GetStats().misses - reopened.misses == 1);
+
+    CHECK(disk.Configure("", 0));
+    CHECK(!disk.Enabled());
+    return true;
+}
@@ -0,0 +1,37 @@
+// Extracting to a sparse file: zero and 0xFF fill frames written as holes
+// or fills without decoding
+#include "z3ds_extract.h"
+#include "z3ds_test.h"
+
+TEST(extract_sparse) {
+    // Data, zero padding, 0xFF fill, then data in a partial last frame
+    std::vector<u8> image = MakeData(3 * FRAME_SIZE, 50);
+    image.resize(10 * FRAME_SIZE, 0x00);
+    image.resize(13 * FRAME_SIZE, 0xFF);
+    std::vector<u8> tail = MakeData(FRAME_SIZE / 3, 51);
+    image.insert(image.end(), tail.begin(), tail.end());
+    // Ends in zeros, so the hole at the end needs the size set explicitly
+    std::vector<u8> padded = image;
+    padded.resize(image.size() + 2 * FRAME_SIZE, 0x00);
+
+    CompressionProfile raw;
+    raw.store_raw = true;
+    for (const auto& [input, profile] : {std::pair{&image, CompressionProfile{}}, std::pair{&padded, raw}}) {
+        std::string file = TempPath("sparse.z3ds");
+        std::string output = TempPath("sparse.out");
+        CHECK(CompressImage(*input, file, profile));
+        for (bool known_fill_ff : {false, true}) {
+            ExtractOptions options;
+            options.known_fill_ff = known_fill_ff;
+            options.verify = true;
+            ExtractResult result;
+            CHECK(ExtractZ3DSFile(file, output, options, nullptr, result));
+            CHECK(ReadFile(output) == *input);
+            CHECK(result.size == input->size());
+            CHECK(result.zero_frames == (input == &padded ? 9 : 7));
+            // Frames stored raw are never taken as fill from the checksum alone
+            CHECK(result.ff_frames == (known_fill_ff && !profile.store_raw ? 3 : 0));
+        }
+    }
+    return true;
+}
@@ -0,0 +1,52 @@
+// Wrapping a seekable zstd file into a Z3DS file without recompressing
+#include "z3ds_import.h"
+#include "z3ds_reader.h"
+#include "z3ds_test.h"
+
+namespace {
+
+// The frames and seek table of a Z3DS file are a seekable zstd file as-is
+bool ExtractSeekable(const std::string& z3ds_file, const std::string& zst_file) {
+    Z3DSReader reader;
+    reader.SetRecordAccess(false);
+    CHECK(reader.Open(z3ds_file));
+    const Z3DSFileHeader& header = reader.GetHeader();
+    std::vector<u8> data = ReadFile(z3ds_file);
+    u64 start = static_cast<u64>(header.header_size) + header.metadata_size;
+    CHECK(start + header.compressed_size <= data.size());
+    return WriteFile(zst_file, std::vector<u8>(data.begin() + start, data.begin() + start + header.compressed_size));
+}
+
+} // namespace
+
+TEST(import) {
+    std::vector<u8> image = MakeData(5 * FRAME_SIZE + 321, 88);
+    std::copy(TEST_MAGIC.begin(), TEST_MAGIC.end(), image.begin() + 0x100);
+    std::string source = TempPath("source.z3ds");
+    std::string zst = TempPath("game.cci.zst");
+    std::string imported = TempPath("game.zcci");
+    CHECK(CompressImage(image, source));
+    CHECK(ExtractSeekable(source, zst));
+
+    ImportResult result;
+    CHECK(ImportSeekableZstd(zst, imported, true, result));
+    CHECK(result.frame_count == 6);
+    CHECK(result.verified_frames == 6);
+    CHECK(result.uncompressed_size == image.size());
+    CHECK(result.underlying_magic == TEST_MAGIC);
+    std::vector<u8> read_back;
+    CHECK(ReadImage(imported, read_back));
+    CHECK(read_back == image);
+
+    // The same file under another name is refused before anything is written
+    std::vector<u8> original = ReadFile(zst);
+    std::string same = (std::filesystem::path(zst).parent_path() / "." / "game.cci.zst").string();
+    CHECK(!ImportSeekableZstd(zst, same, false, result));
+    CHECK(ReadFile(zst) == original);
+
+    // Not a seekable zstd file
+    std::string plain = TempPath("plain.zst");
+    CHECK(WriteFile(plain, image));
+    CHECK(!ImportSeekableZstd(plain, TempPath("plain.zcci"), false, result));
+    return true;
+}
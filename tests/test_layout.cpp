@@ -0,0 +1,116 @@
+// ROM layout parsing on a synthetic NoCrypto CXI with a small RomFS
+#include "z3ds_layout.h"
+#include "z3ds_test.h"
+#include <cstring>
+#include <functional>
+
+namespace {
+
+void Put32(std::vector<u8>& data, size_t offset, u32 value) {
+    for (int i = 0; i < 4; ++i) {
+        data[offset + i] = static_cast<u8>(value >> (8 * i));
+    }
+}
+
+void Put64(std::vector<u8>& data, size_t offset, u64 value) {
+    Put32(data, offset, static_cast<u32>(value));
+    Put32(data, offset + 4, static_cast<u32>(value >> 32));
+}
+
+void PutName(std::vector<u8>& data, size_t offset, char name) {
+    data[offset] = static_cast<u8>(name);
+    data[offset + 1] = 0;
+}
+
+constexpr size_t LEVEL3 = 0x600;
+constexpr size_t DIRS = LEVEL3 + 0x100;
+constexpr size_t FILES = LEVEL3 + 0x200;
+constexpr u64 FILE_DATA = LEVEL3 + 0x1000;
+
+// Root directory with file "a" and directory "d" holding file "b"
+std::vector<u8> MakeCXI() {
+    std::vector<u8> image(0x8000);
+    std::memcpy(image.data() + 0x100, "NCCH", 4);
+    Put32(image, 0x104, 0x40);     // NCCH size in media units
+    image[0x188 + 7] = 0x4;        // NoCrypto
+    Put32(image, 0x1B0, 2);        // RomFS at 0x400
+    Put32(image, 0x1B4, 0x3C);
+
+    std::memcpy(image.data() + 0x400, "IVFC", 4);
+    Put32(image, 0x404, 0x10000);
+    Put32(image, 0x408, 0x20);     // Master hash size
+    Put32(image, 0x44C, 9);        // Level 3 block size 0x200
+
+    Put32(image, LEVEL3, 0x28);
+    Put32(image, LEVEL3 + 0xC, 0x100);
+    Put32(image, LEVEL3 + 0x10, 0x32);
+    Put32(image, LEVEL3 + 0x1C, 0x200);
+    Put32(image, LEVEL3 + 0x20, 0x46);
+    Put32(image, LEVEL3 + 0x24, 0x1000);
+
+    // Directories: parent, sibling, first child, first file, hash, name length
+    Put32(image, DIRS + 0x4, 0xFFFFFFFF);
+    Put32(image, DIRS + 0x8, 0x18);
+    Put32(image, DIRS + 0xC, 0);
+    Put32(image, DIRS + 0x18 + 0x4, 0xFFFFFFFF);
+    Put32(image, DIRS + 0x18 + 0x8, 0xFFFFFFFF);
+    Put32(image, DIRS + 0x18 + 0xC, 0x24);
+    Put32(image, DIRS + 0x18 + 0x14, 2);
+    PutName(image, DIRS + 0x18 + 0x18, 'd');
+
+    // Files: parent, sibling, data offset, size, hash, name length
+    Put32(image, FILES + 0x4, 0xFFFFFFFF);
+    Put64(image, FILES + 0x8, 0);
+    Put64(image, FILES + 0x10, 16);
+    Put32(image, FILES + 0x1C, 2);
+    PutName(image, FILES + 0x20, 'a');
+    Put32(image, FILES + 0x24 + 0x4, 0xFFFFFFFF);
+    Put64(image, FILES + 0x24 + 0x8, 0x100);
+    Put64(image, FILES + 0x24 + 0x10, 32);
+    Put32(image, FILES + 0x24 + 0x1C, 2);
+    PutName(image, FILES + 0x24 + 0x20, 'b');
+    return image;
+}
+
+bool Parse(const std::vector<u8>& image, std::vector<NCCHPartition>& partitions) {
+    auto read = [&](u64 offset, void* buffer, size_t size) {
+        if (offset > image.size() || size > image.size() - offset) {
+            return false;
+        }
+        std::memcpy(buffer, image.data() + offset, size);
+        return true;
+    };
+    return ParseRomLayout(read, image.size(), partitions);
+}
+
+} // namespace
+
+TEST(romfs_bounds) {
+    std::vector<u8> image = MakeCXI();
+    std::vector<NCCHPartition> partitions;
+    CHECK(Parse(image, partitions));
+    CHECK(partitions.size() == 1 && !partitions[0].encrypted);
+    const auto& files = partitions[0].romfs_files;
+    CHECK(files.size() == 2);
+    CHECK(files[0].path == "/a" && files[0].offset == FILE_DATA && files[0].size == 16);
+    CHECK(files[1].path == "/d/b" && files[1].offset == FILE_DATA + 0x100 && files[1].size == 32);
+
+    // Offsets and name lengths near 0xFFFFFFFF used to wrap past the bounds
+    // checks in 32 bits; each must now drop the RomFS file list
+    const std::vector<std::pair<size_t, u32>> damage = {
+        {FILES + 0x1C, 0xFFFFFFF0},        // File name length
+        {FILES + 0x4, 0xFFFFFFF0},         // File sibling
+        {DIRS + 0xC, 0xFFFFFFE8},          // First file
+        {DIRS + 0x18 + 0x14, 0xFFFFFFF0},  // Directory name length
+        {DIRS + 0x8, 0xFFFFFFF0},          // First child directory
+        {DIRS + 0x18 + 0xC, 0x46},         // File entry starting at the end of the table
+    };
+    for (const auto& [offset, value] : damage) {
+        std::vector<u8> bad = image;
+        Put32(bad, offset, value);
+        CHECK(Parse(bad, partitions));
+        CHECK(partitions.size() == 1);
+        CHECK(partitions[0].romfs_files.empty());
+    }
+    return true;
+}
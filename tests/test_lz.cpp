@@ -0,0 +1,51 @@
+// LZ10/LZ11 streams: decode, encode, and re-encode against a given stream
+#include "z3ds_precomp.h"
+#include "z3ds_test.h"
+
+namespace {
+
+bool CheckLZ(u8 type) {
+    std::vector<std::vector<u8>> inputs = {
+        MakeData(1, 1), MakeData(17, 2), MakeData(20000, 3), std::vector<u8>(6000, 0x5A),
+    };
+    for (const auto& input : inputs) {
+        for (u8 flags = 0; flags < 16; ++flags) {
+            LZVariant variant = LZVariant::FromFlags(type, flags);
+            if (type == 0x10 && (variant.ext_header || variant.short_max)) {
+                continue;
+            }
+            std::vector<u8> encoded;
+            CHECK(EncodeLZ(input.data(), input.size(), variant, encoded));
+            CHECK(encoded[0] == type);
+
+            std::vector<u8> decoded;
+            size_t length = 0;
+            bool ext_header = false;
+            CHECK(DecodeLZ(encoded.data(), encoded.size(), decoded, length, ext_header));
+            CHECK(decoded == input);
+            CHECK(length == encoded.size());
+            CHECK(ext_header == variant.ext_header);
+
+            // Re-encoding against the stream only succeeds for an exact match
+            std::vector<u8> scratch;
+            CHECK(EncodeLZ(decoded.data(), decoded.size(), variant, scratch, encoded.data(), encoded.size()));
+            std::vector<u8> changed = encoded;
+            changed.back() ^= 1;
+            CHECK(!EncodeLZ(decoded.data(), decoded.size(), variant, scratch, changed.data(), changed.size()));
+
+            // A cut stream does not decode
+            CHECK(!DecodeLZ(encoded.data(), encoded.size() - 1, decoded, length, ext_header));
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+TEST(lz10) {
+    return CheckLZ(0x10);
+}
+
+TEST(lz11) {
+    return CheckLZ(0x11);
+}
@@ -0,0 +1,73 @@
+// Packs of many small files sharing one dictionary
+#include "z3ds_pack.h"
+#include "z3ds_reader.h"
+#include "z3ds_romfs.h"
+#include "z3ds_test.h"
+#include <algorithm>
+
+TEST(pack) {
+    std::filesystem::path dir = TempPath("homebrew");
+    std::filesystem::create_directories(dir / "sub");
+    std::vector<std::pair<std::string, std::vector<u8>>> files = {
+        {"a.3dsx", MakeData(3 * FRAME_SIZE + 10, 95)},
+        {"sub/b.3dsx", MakeData(FRAME_SIZE / 2, 96)},
+        {"sub/c.smdh", MakeData(10, 97)},
+    };
+    for (const auto& [name, data] : files) {
+        CHECK(WriteFile((dir / name).string(), data));
+    }
+    // A file named on its own is packed under its file name after the directory
+    std::string extra = TempPath("extra.bin");
+    files.emplace_back("extra.bin", MakeData(5000, 98));
+    CHECK(WriteFile(extra, files.back().second));
+
+    PackOptions options;
+    options.paths = {dir.string(), extra};
+    options.frame_size = FRAME_SIZE;
+    std::string pack = TempPath("homebrew.z3ds");
+    PackResult result;
+    CHECK(CreatePack(options, pack, {}, nullptr, result));
+    CHECK(result.members == files.size());
+
+    Z3DSReader reader;
+    reader.SetRecordAccess(false);
+    CHECK(reader.Open(pack));
+    CHECK(reader.GetHeader().underlying_magic == PACK_MAGIC);
+    if (result.dictionary_size) {
+        CHECK(reader.GetMetadata().at("zdict").size() == result.dictionary_size);
+    }
+    std::vector<PackMember> members;
+    CHECK(ReadPackIndex(reader, members));
+    CHECK(members.size() == files.size());
+    const auto& frames = reader.GetFrames();
+    u64 input_bytes = 0;
+    for (size_t i = 0; i < members.size(); ++i) {
+        // Back to back, sorted by name within the directory, each starting a frame
+        CHECK(members[i].name == files[i].first);
+        CHECK(members[i].size == files[i].second.size());
+        CHECK(members[i].offset == input_bytes);
+        CHECK(std::any_of(frames.begin(), frames.end(),
+                          [&](const auto& frame) { return frame.decompressed_offset == members[i].offset; }));
+        std::vector<u8> data(members[i].size);
+        CHECK(reader.Read(members[i].offset, data.data(), data.size()) == data.size());
+        CHECK(data == files[i].second);
+        input_bytes += members[i].size;
+    }
+    CHECK(result.input_bytes == input_bytes);
+
+    // Members are files to list and cat
+    RomFileSystem filesystem;
+    CHECK(filesystem.Open(reader));
+    const RomFSFile* file = filesystem.Find("sub/b.3dsx");
+    CHECK(file && file->size == files[1].second.size());
+    std::vector<u8> data(100);
+    CHECK(filesystem.Read(*file, 200, data.data(), data.size()) == data.size());
+    CHECK(std::equal(data.begin(), data.end(), files[1].second.begin() + 200));
+
+    // Two members with one name, and a missing path
+    options.paths = {dir.string(), (dir / "a.3dsx").string()};
+    CHECK(!CreatePack(options, TempPath("duplicate.z3ds"), {}, nullptr, result));
+    options.paths = {TempPath("missing")};
+    CHECK(!CreatePack(options, TempPath("missing.z3ds"), {}, nullptr, result));
+    return true;
+}
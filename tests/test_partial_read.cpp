@@ -0,0 +1,58 @@
+// Z3DSReader::Read decoding frames only up to the end of each request
+#include "z3ds_frame_cache.h"
+#include "z3ds_reader.h"
+#include "z3ds_test.h"
+#include <cstring>
+#include <random>
+
+namespace {
+
+bool CheckRead(Z3DSReader& reader, const std::vector<u8>& image, u64 offset, size_t size) {
+    std::vector<u8> buffer(size, 0xCD);
+    size_t expected = offset < image.size() ? std::min<u64>(size, image.size() - offset) : 0;
+    CHECK(reader.Read(offset, buffer.data(), size) == expected);
+    CHECK(std::memcmp(buffer.data(), image.data() + std::min<u64>(offset, image.size()), expected) == 0);
+    return true;
+}
+
+} // namespace
+
+TEST(partial_read) {
+    std::vector<u8> image = MakeData(6 * FRAME_SIZE + 5000, 70);
+    std::string file = TempPath("partial.z3ds");
+    CHECK(CompressImage(image, file));
+
+    for (u64 budget : {u64{0}, u64{64} * 1024 * 1024}) {
+        FrameCache::Instance().Clear();
+        FrameCache::Instance().SetBudget(budget);
+        Z3DSReader reader;
+        reader.SetRecordAccess(false);
+        CHECK(reader.Open(file));
+
+        // Forward through one frame in small steps, each continuing the last
+        for (u64 offset = FRAME_SIZE; offset < 2 * FRAME_SIZE; offset += 1000) {
+            if (!CheckRead(reader, image, offset, 1000)) {
+                return false;
+            }
+        }
+        // Back to the start of a frame that is only partly decoded
+        CHECK(CheckRead(reader, image, 3 * FRAME_SIZE + 100, 10));
+        CHECK(CheckRead(reader, image, 3 * FRAME_SIZE, 10));
+        // Across frame boundaries, into the short last frame and past the end
+        CHECK(CheckRead(reader, image, 2 * FRAME_SIZE - 7, FRAME_SIZE + 14));
+        CHECK(CheckRead(reader, image, image.size() - 100, 300));
+        CHECK(CheckRead(reader, image, image.size(), 10));
+        CHECK(CheckRead(reader, image, 0, image.size()));
+
+        std::mt19937 random(71);
+        for (int i = 0; i < 200; ++i) {
+            u64 offset = random() % image.size();
+            size_t size = 1 + random() % (FRAME_SIZE / 4);
+            if (!CheckRead(reader, image, offset, size)) {
+                return false;
+            }
+        }
+    }
+    FrameCache::Instance().Clear();
+    return true;
+}
@@ -0,0 +1,190 @@
+// Updating a Z3DS file from an IPS or BPS patch, recompressing only the
+// frames the patch writes to
+#include "z3ds_test.h"
+#include "z3ds_update.h"
+
+namespace {
+
+u32 Crc32(const u8* data, size_t size) {
+    u32 crc = ~0u;
+    for (size_t i = 0; i < size; ++i) {
+        crc ^= data[i];
+        for (int k = 0; k < 8; ++k) {
+            crc = crc & 1 ? 0xEDB88320 ^ (crc >> 1) : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+bool CheckUpdate(const std::vector<u8>& source, const std::vector<u8>& patch, const std::string& extension,
+                 const std::vector<u8>& expected) {
+    std::string old_file = TempPath("old.z3ds");
+    std::string patch_file = TempPath("patch." + extension);
+    std::string new_file = TempPath("new.z3ds");
+    CHECK(CompressImage(source, old_file));
+    CHECK(WriteFile(patch_file, patch));
+    UpdateOptions options;
+    options.patch_file = patch_file;
+    options.verify = extension == "bps";
+    UpdateResult result;
+    CHECK(UpdateZ3DSFile(old_file, new_file, options, nullptr, result));
+    std::vector<u8> image;
+    CHECK(ReadImage(new_file, image));
+    CHECK(image == expected);
+    CHECK(result.copied_frames > 0);
+    return true;
+}
+
+// BPS patch built action by action, applying each one to `target` as well
+class BPSWriter {
+public:
+    explicit BPSWriter(const std::vector<u8>& source) : source(source) {}
+
+    void SourceRead(u64 length) {
+        Action(0, length);
+        target.insert(target.end(), source.begin() + target.size(), source.begin() + target.size() + length);
+    }
+    void TargetRead(const std::vector<u8>& data) {
+        Action(1, data.size());
+        actions.insert(actions.end(), data.begin(), data.end());
+        target.insert(target.end(), data.begin(), data.end());
+    }
+    void SourceCopy(u64 offset, u64 length) {
+        Action(2, length);
+        Offset(static_cast<int64_t>(offset) - static_cast<int64_t>(source_relative));
+        target.insert(target.end(), source.begin() + offset, source.begin() + offset + length);
+        source_relative = offset + length;
+    }
+    void TargetCopy(u64 offset, u64 length) {
+        Action(3, length);
+        Offset(static_cast<int64_t>(offset) - static_cast<int64_t>(target_relative));
+        for (u64 i = 0; i < length; ++i) {
+            target.push_back(target[offset + i]);
+        }
+        target_relative = offset + length;
+    }
+
+    std::vector<u8> Finish(u64 source_size) const {
+        std::vector<u8> patch = {'B', 'P', 'S', '1'};
+        Number(patch, source_size);
+        Number(patch, target.size());
+        Number(patch, 0);
+        patch.insert(patch.end(), actions.begin(), actions.end());
+        for (u32 crc : {Crc32(source.data(), source.size()), Crc32(target.data(), target.size())}) {
+            patch.insert(patch.end(), {static_cast<u8>(crc), static_cast<u8>(crc >> 8), static_cast<u8>(crc >> 16),
+                                       static_cast<u8>(crc >> 24)});
+        }
+        u32 crc = Crc32(patch.data(), patch.size());
+        patch.insert(patch.end(), {static_cast<u8>(crc), static_cast<u8>(crc >> 8), static_cast<u8>(crc >> 16),
+                                   static_cast<u8>(crc >> 24)});
+        return patch;
+    }
+
+    std::vector<u8> target;
+
+private:
+    static void Number(std::vector<u8>& out, u64 value) {
+        while (true) {
+            u8 x = value & 0x7F;
+            value >>= 7;
+            if (value == 0) {
+                out.push_back(0x80 | x);
+                return;
+            }
+            out.push_back(x);
+            value--;
+        }
+    }
+    void Action(u8 command, u64 length) {
+        Number(actions, ((length - 1) << 2) | command);
+    }
+    void Offset(int64_t delta) {
+        Number(actions, (static_cast<u64>(delta < 0 ? -delta : delta) << 1) | (delta < 0 ? 1 : 0));
+    }
+
+    const std::vector<u8>& source;
+    std::vector<u8> actions;
+    u64 source_relative = 0;
+    u64 target_relative = 0;
+};
+
+} // namespace
+
+TEST(ips) {
+    std::vector<u8> source = MakeData(20 * FRAME_SIZE + 1234, 10);
+    std::vector<u8> target = source;
+    std::vector<u8> patch = {'P', 'A', 'T', 'C', 'H'};
+    auto record = [&](u32 offset, const std::vector<u8>& data, bool rle) {
+        patch.push_back(static_cast<u8>(offset >> 16));
+        patch.push_back(static_cast<u8>(offset >> 8));
+        patch.push_back(static_cast<u8>(offset));
+        if (rle) {
+            patch.insert(patch.end(), {0, 0, static_cast<u8>(data.size() >> 8), static_cast<u8>(data.size()),
+                                       data[0]});
+        } else {
+            patch.push_back(static_cast<u8>(data.size() >> 8));
+            patch.push_back(static_cast<u8>(data.size()));
+            patch.insert(patch.end(), data.begin(), data.end());
+        }
+        if (target.size() < offset + data.size()) {
+            target.resize(offset + data.size());
+        }
+        std::copy(data.begin(), data.end(), target.begin() + offset);
+    };
+    record(100, {1, 2, 3, 4, 5}, false);
+    record(3 * FRAME_SIZE - 2, MakeData(300, 11), false); // Across a frame boundary
+    record(7 * FRAME_SIZE, std::vector<u8>(5000, 0xEE), true);
+    record(7 * FRAME_SIZE + 10, {9, 9}, false);           // Later records win
+    record(static_cast<u32>(source.size()) - 10, MakeData(40000, 12), false); // Grows the image
+    patch.insert(patch.end(), {'E', 'O', 'F'});
+    return CheckUpdate(source, patch, "ips", target);
+}
+
+TEST(bps) {
+    std::vector<u8> source = MakeData(20 * FRAME_SIZE + 777, 20);
+    BPSWriter bps(source);
+    bps.SourceRead(2 * FRAME_SIZE + 5);
+    bps.TargetRead(MakeData(1000, 21));
+    bps.SourceCopy(15 * FRAME_SIZE, 3000);               // Forward
+    bps.SourceCopy(FRAME_SIZE, 500);                     // And back
+    bps.TargetCopy(2 * FRAME_SIZE + 5, 4000);            // Earlier target bytes
+    bps.TargetCopy(bps.target.size() - 1, 300);          // Overlapping its own output
+    bps.SourceCopy(bps.target.size(), 6 * FRAME_SIZE);   // In place, nothing to patch
+    bps.SourceRead(source.size() - bps.target.size());
+    bps.TargetRead(MakeData(FRAME_SIZE / 2, 22));        // Grows the image
+    if (!CheckUpdate(source, bps.Finish(source.size()), "bps", bps.target)) {
+        return false;
+    }
+
+    // Reading past the end of the source is rejected: the patch is made
+    // against a longer image but claims this one's size
+    std::vector<u8> longer = source;
+    longer.resize(source.size() + 10, 0x42);
+    BPSWriter past_end(longer);
+    past_end.SourceRead(longer.size());
+    std::vector<u8> bad = past_end.Finish(source.size());
+    std::string old_file = TempPath("old.z3ds");
+    std::string patch_file = TempPath("bad.bps");
+    CHECK(CompressImage(source, old_file));
+    CHECK(WriteFile(patch_file, bad));
+    UpdateOptions options;
+    options.patch_file = patch_file;
+    UpdateResult result;
+    CHECK(!UpdateZ3DSFile(old_file, TempPath("bad.z3ds"), options, nullptr, result));
+    CHECK(!std::filesystem::exists(TempPath("bad.z3ds")));
+
+    // A failed update leaves an existing output as it was
+    std::string existing = TempPath("existing.z3ds");
+    CHECK(WriteFile(existing, {1, 2, 3}));
+    CHECK(!UpdateZ3DSFile(old_file, existing, options, nullptr, result));
+    CHECK(ReadFile(existing) == std::vector<u8>({1, 2, 3}));
+    CHECK(!std::filesystem::exists(existing + ".update.tmp"));
+
+    // Updating a file onto itself, under another name, is refused untouched
+    std::vector<u8> original = ReadFile(old_file);
+    std::string same = (std::filesystem::path(old_file).parent_path() / "." / "old.z3ds").string();
+    options.patch_file = TempPath("patch.bps");
+    CHECK(!UpdateZ3DSFile(old_file, same, options, nullptr, result));
+    CHECK(ReadFile(old_file) == original);
+    return true;
+}
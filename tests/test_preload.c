@@ -0,0 +1,156 @@
+/* The LD_PRELOAD shim, run under it: z3ds_preload_test <work directory> */
+#define _GNU_SOURCE
+#include "z3ds.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define CHECK(condition)                                                                  \
+    do {                                                                                  \
+        if (!(condition)) {                                                               \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            return 1;                                                                     \
+        }                                                                                 \
+    } while (0)
+
+#define IMAGE_SIZE (200 * 1024 + 77)
+#define FRAME_SIZE (64 * 1024)
+
+/* The _FORTIFY_SOURCE entry points, called directly so the test does not
+ * depend on how it was compiled */
+int __open_2(const char* path, int flags);
+ssize_t __read_chk(int fd, void* buffer, size_t size, size_t buffer_size);
+
+static char source_path[1024];
+static char compressed_path[1024];
+static char virtual_path[1024];
+
+static int write_file(const char* path, const unsigned char* data, size_t size) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return 0;
+    }
+    size_t written = fwrite(data, 1, size, file);
+    return fclose(file) == 0 && written == size;
+}
+
+static int test_descriptor(const unsigned char* image) {
+    unsigned char* read_back = malloc(IMAGE_SIZE);
+    unsigned char a[100];
+    unsigned char b[3000];
+    struct iovec iov[2] = {{a, sizeof(a)}, {b, sizeof(b)}};
+    struct stat st;
+    int fd = open(compressed_path, O_RDONLY);
+    int copy;
+
+    CHECK(read_back != NULL);
+    CHECK(fd >= 0);
+    CHECK(fstat(fd, &st) == 0 && st.st_size == IMAGE_SIZE);
+    CHECK(read(fd, read_back, IMAGE_SIZE) == IMAGE_SIZE);
+    CHECK(memcmp(read_back, image, IMAGE_SIZE) == 0);
+    CHECK(read(fd, a, sizeof(a)) == 0);
+    CHECK(lseek(fd, 0, SEEK_END) == IMAGE_SIZE);
+
+    CHECK(pread(fd, a, sizeof(a), FRAME_SIZE - 30) == sizeof(a));
+    CHECK(memcmp(a, image + FRAME_SIZE - 30, sizeof(a)) == 0);
+    CHECK(pread(fd, a, sizeof(a), IMAGE_SIZE - 10) == 10);
+
+    /* Vector reads span frames and advance the shared position */
+    CHECK(lseek(fd, 2 * FRAME_SIZE - 50, SEEK_SET) == 2 * FRAME_SIZE - 50);
+    CHECK(readv(fd, iov, 2) == sizeof(a) + sizeof(b));
+    CHECK(memcmp(a, image + 2 * FRAME_SIZE - 50, sizeof(a)) == 0);
+    CHECK(memcmp(b, image + 2 * FRAME_SIZE + 50, sizeof(b)) == 0);
+    CHECK(preadv(fd, iov, 2, 7) == sizeof(a) + sizeof(b));
+    CHECK(memcmp(a, image + 7, sizeof(a)) == 0);
+    CHECK(memcmp(b, image + 7 + sizeof(a), sizeof(b)) == 0);
+
+    copy = dup(fd);
+    CHECK(copy >= 0);
+    CHECK(lseek(copy, 1000, SEEK_SET) == 1000);
+    CHECK(__read_chk(fd, a, sizeof(a), sizeof(a)) == sizeof(a));
+    CHECK(memcmp(a, image + 1000, sizeof(a)) == 0);
+    CHECK(close(copy) == 0);
+    CHECK(close(fd) == 0);
+    free(read_back);
+    return 0;
+}
+
+static int test_virtual_name(const unsigned char* image) {
+    unsigned char a[100];
+    struct stat st;
+    int fd;
+
+    CHECK(access(virtual_path, F_OK) != 0);
+    CHECK(stat(virtual_path, &st) == 0 && st.st_size == IMAGE_SIZE);
+    fd = __open_2(virtual_path, O_RDONLY);
+    CHECK(fd >= 0);
+    CHECK(read(fd, a, sizeof(a)) == sizeof(a));
+    CHECK(memcmp(a, image, sizeof(a)) == 0);
+    CHECK(close(fd) == 0);
+    return 0;
+}
+
+static int test_stream(const unsigned char* image) {
+    unsigned char a[100];
+    FILE* file = fopen(compressed_path, "rb");
+
+    CHECK(file != NULL);
+    CHECK(fseek(file, 5000, SEEK_SET) == 0);
+    CHECK(fread(a, 1, sizeof(a), file) == sizeof(a));
+    CHECK(memcmp(a, image + 5000, sizeof(a)) == 0);
+    CHECK(fclose(file) == 0);
+    return 0;
+}
+
+/* Opens that could write see the compressed file itself */
+static int test_write_open(void) {
+    unsigned char magic[4];
+    struct stat st;
+    int fd = open(compressed_path, O_RDWR);
+
+    CHECK(fd >= 0);
+    CHECK(fstat(fd, &st) == 0 && st.st_size < IMAGE_SIZE);
+    CHECK(read(fd, magic, sizeof(magic)) == sizeof(magic));
+    CHECK(memcmp(magic, "Z3DS", 4) == 0);
+    CHECK(close(fd) == 0);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    unsigned char* image;
+    z3ds_compress_options options;
+    size_t i;
+    int failed;
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <work directory>\n", argv[0]);
+        return 2;
+    }
+    snprintf(source_path, sizeof(source_path), "%s/preload_source.bin", argv[1]);
+    snprintf(compressed_path, sizeof(compressed_path), "%s/preload_image.zcci", argv[1]);
+    snprintf(virtual_path, sizeof(virtual_path), "%s/preload_image.cci", argv[1]);
+
+    image = malloc(IMAGE_SIZE);
+    CHECK(image != NULL);
+    srand(85);
+    for (i = 0; i < IMAGE_SIZE; ++i) {
+        image[i] = (unsigned char)(i % 239 < 180 ? "z3ds preload "[i % 13] : rand());
+    }
+    CHECK(write_file(source_path, image, IMAGE_SIZE));
+
+    /* Writing the .zcci goes through the hooked open with O_CREAT */
+    z3ds_compress_options_init(&options);
+    options.frame_size = FRAME_SIZE;
+    CHECK(z3ds_compress(source_path, compressed_path, &options) == Z3DS_OK);
+
+    failed = test_descriptor(image) || test_virtual_name(image) || test_stream(image) || test_write_open();
+    free(image);
+    remove(source_path);
+    remove(compressed_path);
+    printf("preload: %s\n", failed ? "FAILED" : "passed");
+    return failed;
+}
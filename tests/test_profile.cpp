@@ -0,0 +1,40 @@
+// Compression profile parameters, from the CLI form and from profile files
+#include "z3ds_test.h"
+#include <fstream>
+
+TEST(profile_bools) {
+    for (const char* name : {"rawLiterals", "mediaUnitMatcher", "frontIndex"}) {
+        for (const auto& [value, expected] : {std::pair{"1", true}, std::pair{"true", true},
+                                              std::pair{"0", false}, std::pair{"false", false}}) {
+            CompressionProfile profile;
+            profile.raw_literals = profile.media_unit_matcher = profile.front_index = !expected;
+            std::string error;
+            CHECK(SetCompressionParameter(profile, name, value, error));
+            bool flag = std::string(name) == "rawLiterals"        ? profile.raw_literals
+                      : std::string(name) == "mediaUnitMatcher" ? profile.media_unit_matcher
+                                                                 : profile.front_index;
+            CHECK(flag == expected);
+        }
+        // A typo is an error rather than a silent "false"
+        for (const char* value : {"yes", "on", "", "2", "True"}) {
+            CompressionProfile profile;
+            profile.front_index = true;
+            std::string error;
+            CHECK(!SetCompressionParameter(profile, name, value, error));
+            CHECK(error.find(name) != std::string::npos);
+            CHECK(profile.front_index);
+        }
+    }
+
+    std::string good_file = TempPath("good.ini");
+    std::string bad_file = TempPath("bad.ini");
+    std::ofstream(good_file) << "[fast]\nlevel = 1\nrawLiterals = true\n[indexed]\nfrontIndex = 1\n";
+    std::ofstream(bad_file) << "[fast]\nlevel = 1\nfrontIndex = yes\n";
+    std::vector<CompressionProfile> profiles;
+    CHECK(ParseCompressionProfiles(good_file, profiles));
+    CHECK(profiles.size() == 2);
+    CHECK(profiles[0].raw_literals && !profiles[0].front_index);
+    CHECK(profiles[1].front_index && !profiles[1].raw_literals);
+    CHECK(!ParseCompressionProfiles(bad_file, profiles));
+    return true;
+}
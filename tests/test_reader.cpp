@@ -0,0 +1,51 @@
+// Z3DSReader against damaged files: every case must fail to open cleanly
+#include "z3ds_reader.h"
+#include "z3ds_test.h"
+
+namespace {
+
+void WriteLE(std::vector<u8>& file, size_t offset, u64 value, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        file[offset + i] = static_cast<u8>(value >> (8 * i));
+    }
+}
+
+bool OpensAfter(const std::vector<u8>& good, const std::string& path,
+                const std::function<void(std::vector<u8>&)>& damage) {
+    std::vector<u8> file = good;
+    damage(file);
+    WriteFile(path, file);
+    Z3DSReader reader;
+    reader.SetRecordAccess(false);
+    return reader.Open(path);
+}
+
+} // namespace
+
+TEST(corrupt_header) {
+    std::vector<u8> image = MakeData(5 * FRAME_SIZE + 100, 60);
+    std::string good_file = TempPath("good.z3ds");
+    std::string bad_file = TempPath("bad.z3ds");
+    CHECK(CompressImage(image, good_file));
+    std::vector<u8> good = ReadFile(good_file);
+    CHECK(OpensAfter(good, bad_file, [](std::vector<u8>&) {}));
+
+    // Metadata larger than the file, and large enough that header_size +
+    // metadata_size wraps in 32 bits
+    CHECK(!OpensAfter(good, bad_file, [](std::vector<u8>& f) { WriteLE(f, 12, 0x7FFFFFF0, 4); }));
+    CHECK(!OpensAfter(good, bad_file, [](std::vector<u8>& f) { WriteLE(f, 12, 0xFFFFFFF0, 4); }));
+    CHECK(!OpensAfter(good, bad_file, [](std::vector<u8>& f) { WriteLE(f, 10, 0xFFFF, 2); }));
+    // Compressed size past the end, and one that wraps when added to the data start
+    CHECK(!OpensAfter(good, bad_file, [](std::vector<u8>& f) { WriteLE(f, 16, f.size(), 8); }));
+    CHECK(!OpensAfter(good, bad_file, [](std::vector<u8>& f) { WriteLE(f, 16, ~0ULL - 8, 8); }));
+    // Seek table frame count and skippable frame size far beyond the file
+    CHECK(!OpensAfter(good, bad_file, [](std::vector<u8>& f) { WriteLE(f, f.size() - 9, 0xFFFFFFFF, 4); }));
+    CHECK(!OpensAfter(good, bad_file, [](std::vector<u8>& f) {
+        u32 frames = ReadLE32(f.data() + f.size() - 9);
+        WriteLE(f, f.size() - 9 - frames * 12 - 4, 0xFFFFFFF0, 4);
+    }));
+    // Truncated inside the seek table and inside the header
+    CHECK(!OpensAfter(good, bad_file, [](std::vector<u8>& f) { f.resize(f.size() - 20); }));
+    CHECK(!OpensAfter(good, bad_file, [](std::vector<u8>& f) { f.resize(16); }));
+    return true;
+}
@@ -0,0 +1,75 @@
+// Trailing seek table and the front index copy of it in the metadata
+#include "z3ds_reader.h"
+#include "z3ds_test.h"
+#include <algorithm>
+
+namespace {
+
+bool CheckSeekTable(const std::vector<u8>& image, const std::string& z3ds_file) {
+    Z3DSReader reader;
+    reader.SetRecordAccess(false);
+    CHECK(reader.Open(z3ds_file));
+    CHECK(reader.HasChecksums());
+    const auto& frames = reader.GetFrames();
+    CHECK(frames.size() == (image.size() + FRAME_SIZE - 1) / FRAME_SIZE);
+    u64 offset = 0;
+    for (const auto& frame : frames) {
+        CHECK(frame.decompressed_offset == offset);
+        CHECK(frame.decompressed_size == std::min<u64>(FRAME_SIZE, image.size() - offset));
+        CHECK(frame.checksum == static_cast<u32>(XXH64(image.data() + offset, frame.decompressed_size)));
+        offset += frame.decompressed_size;
+    }
+    std::vector<u8> read(image.size());
+    CHECK(reader.Read(0, read.data(), read.size()) == read.size());
+    CHECK(read == image);
+
+    // Footer: frame count, checksum flag, seekable magic
+    std::vector<u8> file = ReadFile(z3ds_file);
+    CHECK(file.size() >= 9);
+    const u8* footer = file.data() + file.size() - 9;
+    CHECK(ReadLE32(footer) == frames.size());
+    CHECK(footer[4] == 0x80);
+    CHECK(ReadLE32(footer + 5) == 0x8F92EAB1);
+    return true;
+}
+
+} // namespace
+
+TEST(seek_table) {
+    std::vector<u8> image = MakeData(9 * FRAME_SIZE + 4321, 30);
+    std::string file = TempPath("seek.z3ds");
+    CHECK(CompressImage(image, file));
+    return CheckSeekTable(image, file);
+}
+
+TEST(front_index) {
+    std::vector<u8> image = MakeData(9 * FRAME_SIZE + 4321, 31);
+    std::string plain_file = TempPath("plain.z3ds");
+    std::string indexed_file = TempPath("indexed.z3ds");
+    CompressionProfile profile;
+    profile.front_index = true;
+    CHECK(CompressImage(image, plain_file));
+    CHECK(CompressImage(image, indexed_file, profile));
+    if (!CheckSeekTable(image, indexed_file)) {
+        return false;
+    }
+
+    // The area at the end of the metadata is a copy of the trailing seek table
+    Z3DSReader indexed;
+    indexed.SetRecordAccess(false);
+    CHECK(indexed.Open(indexed_file));
+    std::string item = indexed.GetMetadataString("seekindex");
+    CHECK(item.rfind("size=", 0) == 0);
+    size_t area_size = std::stoul(item.substr(5));
+    size_t table_size = 8 + indexed.GetFrames().size() * 12 + 9;
+    CHECK(area_size >= table_size);
+    std::vector<u8> file = ReadFile(indexed_file);
+    size_t area = indexed.GetHeader().header_size + indexed.GetHeader().metadata_size - area_size;
+    CHECK(std::equal(file.begin() + area, file.begin() + area + table_size, file.end() - table_size));
+
+    Z3DSReader plain;
+    plain.SetRecordAccess(false);
+    CHECK(plain.Open(plain_file));
+    CHECK(plain.GetMetadataString("seekindex").empty());
+    return SameFrames(plain, indexed);
+}
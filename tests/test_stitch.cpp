@@ -0,0 +1,44 @@
+// Compressing an image in parts and stitching them into one file
+#include "z3ds_reader.h"
+#include "z3ds_stitch.h"
+#include "z3ds_test.h"
+
+TEST(stitch) {
+    std::vector<u8> image = MakeData(13 * FRAME_SIZE + 999, 40);
+    std::string source = TempPath("stitch.img");
+    std::string whole_file = TempPath("whole.z3ds");
+    std::string stitched_file = TempPath("stitched.z3ds");
+    std::vector<std::string> parts = {TempPath("part1.z3ds"), TempPath("part0.z3ds")};
+    CHECK(WriteFile(source, image));
+    CHECK(CompressZ3DSFile(source, whole_file, TEST_MAGIC, FRAME_SIZE));
+    CHECK(CompressZ3DSPart(source, parts[1], TEST_MAGIC, FRAME_SIZE, {0, 5 * FRAME_SIZE}));
+    CHECK(CompressZ3DSPart(source, parts[0], TEST_MAGIC, FRAME_SIZE, {5 * FRAME_SIZE, 0}));
+    StitchResult result;
+    CHECK(StitchZ3DSParts(parts, stitched_file, result));
+    CHECK(result.parts == 2);
+    CHECK(result.uncompressed_size == image.size());
+
+    Z3DSReader whole;
+    Z3DSReader stitched;
+    whole.SetRecordAccess(false);
+    stitched.SetRecordAccess(false);
+    CHECK(whole.Open(whole_file) && stitched.Open(stitched_file));
+    CHECK(stitched.GetHeader().underlying_magic == TEST_MAGIC);
+    CHECK(stitched.GetMetadataString("part").empty());
+    if (!SameFrames(whole, stitched)) {
+        return false;
+    }
+    std::vector<u8> read;
+    CHECK(ReadImage(stitched_file, read));
+    CHECK(read == image);
+
+    // An output that is one of the parts, under another name, is refused
+    // before the part is truncated
+    std::vector<u8> part = ReadFile(parts[0]);
+    std::string same = (std::filesystem::path(parts[0]).parent_path() / "." / "part1.z3ds").string();
+    CHECK(!StitchZ3DSParts(parts, same, result));
+    CHECK(ReadFile(parts[0]) == part);
+    // A missing part
+    CHECK(!StitchZ3DSParts({parts[0]}, TempPath("incomplete.z3ds"), result));
+    return true;
+}
@@ -0,0 +1,113 @@
+#include "z3ds_test.h"
+#include "z3ds_reader.h"
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <random>
+
+namespace {
+
+std::filesystem::path work_dir;
+
+std::map<std::string, TestFunction>& Tests() {
+    static std::map<std::string, TestFunction> tests;
+    return tests;
+}
+
+} // namespace
+
+bool RegisterTest(const char* name, TestFunction test) {
+    Tests().emplace(name, test);
+    return true;
+}
+
+std::string TempPath(const std::string& name) {
+    return (work_dir / name).string();
+}
+
+bool WriteFile(const std::string& path, const std::vector<u8>& data) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    return file.good();
+}
+
+std::vector<u8> ReadFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<u8>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+std::vector<u8> MakeData(size_t size, u32 seed) {
+    static const char* words[] = {"romfs", "exefs", "icon", "banner", "level", "texture", "sound", "\x00\x00\x00\x00"};
+    std::mt19937 random(seed);
+    std::vector<u8> data;
+    data.reserve(size);
+    while (data.size() < size) {
+        if (random() % 16 == 0) {
+            data.push_back(static_cast<u8>(random()));
+            continue;
+        }
+        const char* word = words[random() % 8];
+        size_t length = word[0] ? std::strlen(word) : 4;
+        data.insert(data.end(), word, word + length);
+    }
+    data.resize(size);
+    return data;
+}
+
+u32 ReadLE32(const u8* p) {
+    return static_cast<u32>(p[0]) | (static_cast<u32>(p[1]) << 8) |
+           (static_cast<u32>(p[2]) << 16) | (static_cast<u32>(p[3]) << 24);
+}
+
+bool CompressImage(const std::vector<u8>& image, const std::string& z3ds_file, const CompressionProfile& profile) {
+    std::string source = z3ds_file + ".img";
+    return WriteFile(source, image) && CompressZ3DSFile(source, z3ds_file, TEST_MAGIC, FRAME_SIZE, nullptr, {},
+                                                        nullptr, profile);
+}
+
+bool ReadImage(const std::string& z3ds_file, std::vector<u8>& image) {
+    Z3DSReader reader;
+    reader.SetRecordAccess(false);
+    if (!reader.Open(z3ds_file)) {
+        return false;
+    }
+    image.resize(reader.GetSize());
+    return reader.Read(0, image.data(), image.size()) == image.size();
+}
+
+bool SameFrames(Z3DSReader& a, Z3DSReader& b) {
+    CHECK(a.GetSize() == b.GetSize());
+    CHECK(a.GetFrames().size() == b.GetFrames().size());
+    std::vector<u8> frame_a;
+    std::vector<u8> frame_b;
+    for (size_t i = 0; i < a.GetFrames().size(); ++i) {
+        const auto& fa = a.GetFrames()[i];
+        const auto& fb = b.GetFrames()[i];
+        CHECK(fa.decompressed_offset == fb.decompressed_offset);
+        CHECK(fa.decompressed_size == fb.decompressed_size);
+        CHECK(fa.compressed_size == fb.compressed_size);
+        CHECK(fa.checksum == fb.checksum);
+        CHECK(a.ReadCompressedFrame(i, frame_a) && b.ReadCompressedFrame(i, frame_b));
+        CHECK(frame_a == frame_b);
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2 || !Tests().count(argv[1])) {
+        std::cerr << "Usage: " << argv[0] << " <test>\nTests:";
+        for (const auto& [name, test] : Tests()) {
+            std::cerr << " " << name;
+        }
+        std::cerr << std::endl;
+        return 2;
+    }
+    work_dir = std::filesystem::temp_directory_path() /
+               ("z3ds_tests_" + std::string(argv[1]) + "_" + std::to_string(std::random_device{}()));
+    std::filesystem::create_directories(work_dir);
+    bool ok = Tests().at(argv[1])();
+    std::error_code ec;
+    std::filesystem::remove_all(work_dir, ec);
+    std::cout << argv[1] << (ok ? ": passed" : ": FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+// Shared helpers for the round-trip tests. Each test registers itself by
+// name with TEST(name) and is run as its own ctest entry: z3ds_tests <name>
+
+#include "z3ds_compression.h"
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define CHECK(condition)                                                                 \
+    do {                                                                                 \
+        if (!(condition)) {                                                              \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: " #condition     \
+                      << std::endl;                                                      \
+            return false;                                                                \
+        }                                                                                \
+    } while (0)
+
+using TestFunction = bool (*)();
+bool RegisterTest(const char* name, TestFunction test);
+
+#define TEST(name)                                                          \
+    static bool Test_##name();                                              \
+    [[maybe_unused]] static const bool registered_##name = RegisterTest(#name, Test_##name); \
+    static bool Test_##name()
+
+constexpr size_t FRAME_SIZE = 64 * 1024;
+constexpr std::array<u8, 4> TEST_MAGIC = {'N', 'C', 'S', 'D'};
+
+// Path in a directory of its own for the running test, removed afterwards
+std::string TempPath(const std::string& name);
+
+bool WriteFile(const std::string& path, const std::vector<u8>& data);
+std::vector<u8> ReadFile(const std::string& path);
+
+// Text-like data with repeats, so frames and LZ streams have matches to find
+std::vector<u8> MakeData(size_t size, u32 seed);
+
+u32 ReadLE32(const u8* p);
+
+// Write image next to z3ds_file and compress it with FRAME_SIZE frames
+bool CompressImage(const std::vector<u8>& image, const std::string& z3ds_file,
+                   const CompressionProfile& profile = {});
+
+// Whole uncompressed image of a Z3DS file
+bool ReadImage(const std::string& z3ds_file, std::vector<u8>& image);
+
+class Z3DSReader;
+// Same frame map and compressed bytes
+bool SameFrames(Z3DSReader& a, Z3DSReader& b);